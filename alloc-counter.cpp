@@ -0,0 +1,86 @@
+#include <cstdlib>
+#include <new>
+
+#include "alloc-counter.hpp"
+
+
+// Plain counter, without constructor, so it can be used before the thread local storage of
+// the thread has been initialized
+static thread_local uint64_t allocations = 0;
+
+
+uint64_t thread_allocations()
+{
+	return allocations;
+}
+
+
+static void* allocate(std::size_t size)
+{
+	allocations++;
+	// malloc(0) may return NULL
+	return std::malloc(size ? size : 1);
+}
+
+
+void* operator new(std::size_t size)
+{
+	void *ptr = allocate(size);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return allocate(size);
+}
+
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return allocate(size);
+}
+
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+
+void operator delete[](void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept
+{
+	std::free(ptr);
+}
+
+
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept
+{
+	std::free(ptr);
+}
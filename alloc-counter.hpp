@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+
+// The global operators new and delete are replaced by ones that count the
+// allocations of each thread, so the overhead report can show that the
+// sampling path does not allocate memory once the buffers are in place.
+
+// Allocations done by the calling thread since it started
+uint64_t thread_allocations();
@@ -33,7 +33,7 @@ void CATIntel::init()
 }
 
 
-void CATIntel::set_cbm(uint32_t cos, uint64_t mask)
+void CATIntel::set_cbm(uint32_t cos, uint64_t mask, uint32_t domain)
 {
 	if (!initialized)
 		throw_with_trace(std::runtime_error("Could not set mask: init method must be called first"));
@@ -42,10 +42,18 @@ void CATIntel::set_cbm(uint32_t cos, uint64_t mask)
 	l3ca_cos.class_id = cos;
 	l3ca_cos.u.ways_mask = mask;
 
-	uint32_t socket = 0;
-	int ret = pqos_l3ca_set(p_sockets[socket], 1, &l3ca_cos);
-	if  (ret != PQOS_RETVAL_OK)
-		throw_with_trace(std::runtime_error("Could not set COS mask"));
+	bool found = false;
+	for (unsigned i = 0; i < sock_count; i++)
+	{
+		if (domain != all_domains && domain != p_sockets[i])
+			continue;
+		found = true;
+		int ret = pqos_l3ca_set(p_sockets[i], 1, &l3ca_cos);
+		if  (ret != PQOS_RETVAL_OK)
+			throw_with_trace(std::runtime_error("Could not set COS mask in socket " + std::to_string(p_sockets[i])));
+	}
+	if (!found)
+		throw_with_trace(std::runtime_error("Socket " + std::to_string(domain) + " does not exist"));
 }
 
 
@@ -69,11 +77,11 @@ uint32_t CATIntel::get_clos(uint32_t cpu) const
 }
 
 
-uint64_t CATIntel::get_cbm(uint32_t clos) const
+uint64_t CATIntel::get_cbm(uint32_t clos, uint32_t domain) const
 {
 	struct pqos_l3ca l3ca[PQOS_MAX_L3CA_COS];
 	uint32_t num_cos;
-	uint32_t socket = 0;
+	uint32_t socket = domain == all_domains ? p_sockets[0] : domain;
 
 	if (pqos_l3ca_get(socket, PQOS_MAX_L3CA_COS, &num_cos, l3ca) != PQOS_RETVAL_OK)
 		 throw_with_trace(std::runtime_error("Could not get mask for COS" + std::to_string(clos)));
@@ -93,6 +101,28 @@ uint32_t CATIntel::get_max_closids() const
 }
 
 
+std::vector<uint32_t> CATIntel::get_domains() const
+{
+	return std::vector<uint32_t>(p_sockets, p_sockets + sock_count);
+}
+
+
+void CATIntel::set_resource_cbm(const std::string &resource, uint32_t clos, uint64_t cbm, uint32_t domain)
+{
+	if (resource != "L3")
+		throw_with_trace(std::runtime_error("The Intel CAT implementation does not support the " + resource + " resource"));
+	set_cbm(clos, cbm, domain);
+}
+
+
+uint64_t CATIntel::get_resource_cbm(const std::string &resource, uint32_t clos, uint32_t domain) const
+{
+	if (resource != "L3")
+		throw_with_trace(std::runtime_error("The Intel CAT implementation does not support the " + resource + " resource"));
+	return get_cbm(clos, domain);
+}
+
+
 void CATIntel::reset()
 {
 	if (!initialized)
@@ -16,12 +16,22 @@ class CATIntel : public CAT
 	void init() override;
 	void reset() override;
 
-	void set_cbm(uint32_t clos, uint64_t cbm) override;
+	using CAT::set_cbm;
+	using CAT::get_cbm;
+
+	// The domains are the sockets
+	void set_cbm(uint32_t clos, uint64_t cbm, uint32_t domain) override;
 	void add_cpu(uint32_t clos, uint32_t cpu) override;
 
 	uint32_t get_clos(uint32_t cpu) const override;
-	uint64_t get_cbm(uint32_t cos) const override;
+	uint64_t get_cbm(uint32_t cos, uint32_t domain) const override;
 	uint32_t get_max_closids() const override;
+	std::vector<uint32_t> get_domains() const override;
+
+	// Only the L3 without CDP
+	std::vector<std::string> get_resources() const override { return {"L3"}; }
+	void set_resource_cbm(const std::string &resource, uint32_t clos, uint64_t cbm, uint32_t domain) override;
+	uint64_t get_resource_cbm(const std::string &resource, uint32_t clos, uint32_t domain) const override;
 
 	void print() override;
 };
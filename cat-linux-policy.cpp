@@ -30,6 +30,50 @@ using fmt::literals::operator""_format;
 // varaible to assign tasks or cores to CLOS: task / cpu
 const std::string CLOS_ADD = "task";
 
+void LinuxBase::apply_bandwidth(uint64_t current_interval, const std::map<uint32_t, ClosRole> &roles)
+{
+	static const std::map<ClosRole, std::string> names = {
+		{ClosRole::critical, "CR"}, {ClosRole::non_critical, "non-CR"}, {ClosRole::isolated, "isolated"}};
+
+	auto cat_linux = LinuxBase::get_cat();
+	std::string line;
+	for (const auto &item : roles)
+	{
+		const uint32_t clos = item.first;
+		uint32_t percent = bandwidth_of(clos, item.second);
+		if (percent < 100 && !cat_linux->has_mba())
+		{
+			if (!mb_warned)
+				LOGWAR("There is no Memory Bandwidth Allocation in resctrl, the CLOSes cannot be throttled");
+			mb_warned = true;
+			percent = 100;
+		}
+		if (cat_linux->has_mba())
+		{
+			cat_linux->set_mb(clos, percent, domain);
+			percent = cat_linux->get_mb(clos, domain);
+		}
+		const uint64_t mask = cat_linux->get_cbm(clos, domain);
+		line += " CLOS {} ({}): {:#x} {} ways {}%;"_format(clos, names.at(item.second), mask, __builtin_popcountll(mask), percent);
+	}
+	LOGINF("[PARTITION] {}:{}"_format(current_interval, line));
+}
+
+
+uint32_t LinuxBase::bandwidth_of(uint32_t, ClosRole role) const
+{
+	switch (role)
+	{
+		case ClosRole::isolated:
+			return mb_isolated;
+		case ClosRole::non_critical:
+			return mb_non_critical;
+		default:
+			return 100;
+	}
+}
+
+
 // No Part Policy
 void NoPart::apply(uint64_t current_interval, const tasklist_t &tasklist)
 {
@@ -54,15 +98,15 @@ void NoPart::apply(uint64_t current_interval, const tasklist_t &tasklist)
         if (stats == "total")
         {
             // Cycles and IPnC
-            inst = task.stats.sum("instructions");
-			cycl = task.stats.sum("cycles");
+            inst = task.stats.sum(ev_instructions);
+			cycl = task.stats.sum(ev_cycles);
 
         }
         else if (stats == "interval")
         {
             // Cycles and IPnC
-            inst = task.stats.last("instructions");
-			cycl = task.stats.last("cycles");
+            inst = task.stats.last(ev_instructions);
+			cycl = task.stats.last(ev_cycles);
         }
 
 		ipc = inst / cycl;
@@ -94,8 +138,8 @@ void CriticalAware::reset_configuration(const tasklist_t &tasklist)
 	}
 
     //change masks of CLOS to 0xfffff
-    LinuxBase::get_cat()->set_cbm(1,0xfffff);
-    LinuxBase::get_cat()->set_cbm(2,0xfffff);
+    LinuxBase::get_cat()->set_cbm(1,0xfffff, domain);
+    LinuxBase::get_cat()->set_cbm(2,0xfffff, domain);
 
     firstTime = 1;
     state = 0;
@@ -148,11 +192,13 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 
 	auto outlier = std::vector<pair_t>();
 
-    double ipcTotal = 0, mpkiL3Total = 0;
+	// Totals of the tasks sampled in the interval
+	const double ipcTotal = get_domain_rollup().sum(Rollups::ipc);
+	const double l3_occup_mb_total = get_domain_rollup().sum(Rollups::l3_occupancy) / 1024 / 1024;
+    double mpkiL3Total = 0;
     //double missesL3Total = 0, instsTotal = 0;
 	double ipc_CR = 0;
     double ipc_NCR = 0;
-	double l3_occup_mb_total = 0;
 
     uint64_t newMaskNonCr, newMaskCr;
 
@@ -171,14 +217,10 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 		uint32_t cpu = task.cpus.front();
 
 		// stats per interval
-		uint64_t l3_miss = task.stats.last("mem_load_uops_retired.l3_miss");
-		uint64_t inst = task.stats.last("instructions");
-		double ipc = task.stats.last("ipc");
-		double l3_occup_mb = task.stats.last("intel_cqm/llc_occupancy/") / 1024 / 1024;
-
-		l3_occup_mb_total += l3_occup_mb;
+		double ipc = task.stats.last(ev_ipc);
+		double l3_occup_mb = task.stats.last(ev_l3_occup_mb);
 
-		double MPKIL3 = (double)(l3_miss*1000) / (double)inst;
+		double MPKIL3 = task.stats.last(ev_mpki_l3);
 
         //LOGINF("Task {}: MPKI_L3 = {}"_format(taskName,MPKIL3));
         LOGINF("Task {} ({}): IPC = {}, MPKI_L3 = {}, l3_occup_mb {}"_format(taskName,taskPID,ipc,MPKIL3,l3_occup_mb));
@@ -187,7 +229,6 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 		pid_CPU.push_back(std::make_pair(taskPID,cpu));
 		active_tasks.push_back(taskPID);
 
-        ipcTotal += ipc;
 		mpkiL3Total += MPKIL3;
 	}
 
@@ -278,14 +319,14 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 
 		// MEAN AND STD LIMIT OUTLIER CALCULATION
 		//accumulate value
-		macc(meanMPKIL3Total);
+		macc.push(meanMPKIL3Total);
 
 		//calculate rolling mean
-		mpkiL3Mean = acc::rolling_mean(macc);
+		mpkiL3Mean = macc.mean();
      	LOGINF("Rolling mean of MPKI-L3 at interval {} = {}"_format(current_interval, mpkiL3Mean));
 
 		//calculate rolling std and limit of outlier
-		stdmpkiL3Mean = std::sqrt(acc::rolling_variance(macc));
+		stdmpkiL3Mean = macc.stddev();
 		LOGINF("stdMPKILLCmean = {}"_format(stdmpkiL3Mean));
 
 		//calculate limit outlier
@@ -396,8 +437,8 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
             } // close switch
 
             num_shared_ways = 2;
-            LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
-            LinuxBase::get_cat()->set_cbm(2,maskCrCLOS);
+            LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
+            LinuxBase::get_cat()->set_cbm(2,maskCrCLOS, domain);
 
             LOGINF("COS 2 (CR) now has mask {:#x}"_format(maskCrCLOS));
             LOGINF("COS 1 (non-CR) now has mask {:#x}"_format(maskNonCrCLOS));
@@ -595,7 +636,7 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 								LOGINF("NCR-- (Remove one shared way from CLOS with non-critical apps)");
 								newMaskNonCr = (maskNonCrCLOS >> 1) | 0x00010;
 								maskNonCrCLOS = newMaskNonCr;
-								LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
+								LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
 							}
 							break;
 
@@ -607,7 +648,7 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 								LOGINF("CR-- (Remove one shared way from CLOS with critical apps)");
 								newMaskCr = (maskCrCLOS << 1) & 0xfffff;
 								maskCrCLOS = newMaskCr;
-								LinuxBase::get_cat()->set_cbm(2,maskCrCLOS);
+								LinuxBase::get_cat()->set_cbm(2,maskCrCLOS, domain);
 							}
 							break;
 
@@ -619,7 +660,7 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 								LOGINF("NCR++ (Add one shared way to CLOS with non-critical apps)");
 								newMaskNonCr = (maskNonCrCLOS << 1) | 0x00010;
 								maskNonCrCLOS = newMaskNonCr;
-								LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
+								LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
 							}
 							break;
 
@@ -631,7 +672,7 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 								LOGINF("CR++ (Add one shared way to CLOS with critical apps)");
 								newMaskCr = (maskCrCLOS >> 1) | 0x80000;
 								maskCrCLOS = newMaskCr;
-								LinuxBase::get_cat()->set_cbm(2,maskCrCLOS);
+								LinuxBase::get_cat()->set_cbm(2,maskCrCLOS, domain);
 							}
 							break;
 						default:
@@ -639,11 +680,11 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 
 					}
 
-                    num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-                    num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
+                    num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+                    num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
 
-					LOGINF("COS 2 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2),num_ways_CLOS_2));
-                    LOGINF("COS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1),num_ways_CLOS_1));
+					LOGINF("COS 2 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2, domain),num_ways_CLOS_2));
+                    LOGINF("COS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1, domain),num_ways_CLOS_1));
 
 					int64_t aux_ns = (num_ways_CLOS_2 + num_ways_CLOS_1) - 20;
                     num_shared_ways = (aux_ns < 0) ? 0 : aux_ns;
@@ -668,6 +709,93 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 }//apply
 
 
+//////////////// CAC /////////////////////////////
+static
+bool is_contiguous(uint64_t mask)
+{
+	if (!mask)
+		return false;
+	mask >>= __builtin_ctzll(mask);
+	return (mask & (mask + 1)) == 0;
+}
+
+
+// The n highest ways of the mask
+static
+uint64_t highest_ways(uint64_t mask, uint32_t n)
+{
+	uint64_t result = 0;
+	for (int way = 63; way >= 0 && n > 0; way--)
+	{
+		if (mask & (1ULL << way))
+		{
+			result |= 1ULL << way;
+			n--;
+		}
+	}
+	return result;
+}
+
+
+void CriticalAwareCode::apply(uint64_t current_interval, const tasklist_t &tasklist)
+{
+	CriticalAware::apply(current_interval, tasklist);
+	if (current_interval % every != 0 || current_interval < firstInterval)
+		return;
+	split_code_ways(tasklist);
+}
+
+
+// Critical-Aware sets the same code and data masks, the code ones are derived from them every time
+void CriticalAwareCode::split_code_ways(const tasklist_t &tasklist)
+{
+	auto cat_linux = LinuxBase::get_cat();
+	if (!cat_linux->has_resource("L3CODE"))
+	{
+		if (!warned)
+			LOGWAR("CDP is not enabled in resctrl, the code ways cannot be dedicated");
+		warned = true;
+		return;
+	}
+
+	// The critical tasks are in CLOS 2
+	uint32_t heavy = 0;
+	for (const auto &task_ptr : tasklist)
+	{
+		const Task &task = *task_ptr;
+		if (cat_linux->get_clos_of_task(task.pid) != 2)
+			continue;
+		const double inst = task.stats.last(ev_instructions);
+		const double mpki = inst ? task.stats.last(ev_code_miss) * 1000 / inst : 0;
+		if (mpki < code_mpki)
+			continue;
+		LOGINF("Task {} ({}) is critical and code heavy: {:.2f} code MPKI-L2"_format(task.name, task.pid, mpki));
+		heavy++;
+	}
+
+	const uint64_t data_cr = cat_linux->get_resource_cbm("L3DATA", 2, domain);
+	const uint64_t data_ncr = cat_linux->get_resource_cbm("L3DATA", 1, domain);
+	uint64_t code_cr = data_cr;
+	uint64_t code_ncr = data_ncr;
+	if (heavy)
+	{
+		code_cr = highest_ways(data_cr, code_ways);
+		code_ncr = data_ncr & ~code_cr;
+		if (!is_contiguous(code_ncr) || (uint32_t) __builtin_popcountll(code_ncr) < min_num_ways)
+		{
+			LOGWAR("The code ways {:#x} cannot be taken from the non-critical CLOS, they are shared"_format(code_cr));
+			code_ncr = data_ncr;
+		}
+	}
+	cat_linux->set_resource_cbm("L3CODE", 2, code_cr, domain);
+	cat_linux->set_resource_cbm("L3CODE", 1, code_ncr, domain);
+
+	if (code_split != (heavy > 0))
+		LOGINF("{} code ways: CLOS 2 (CR) has code mask {:#x}, CLOS 1 (non-CR) {:#x}"_format(heavy ? "Dedicated" : "Shared", code_cr, code_ncr));
+	code_split = heavy > 0;
+}
+
+
 //////////////// CAV4 /////////////////////////////
 void CriticalAwareV4::isolate_application(uint32_t taskID, pid_t taskPID, std::vector<pair_t>::iterator it)
 {
@@ -682,7 +810,7 @@ void CriticalAwareV4::isolate_application(uint32_t taskID, pid_t taskPID, std::v
 
 	LinuxBase::get_cat()->add_task(CLOS_isolated,taskPID);
 	LOGINF("[TEST] {}: assigned to CLOS {}"_format(taskID,CLOS_isolated));
-	LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated);
+	LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated, domain);
 	LOGINF("[TEST] CLOS {} has now mask {:x}"_format(CLOS_isolated,mask_isolated));
 
 	// Update taskIsInCRCLOS
@@ -727,10 +855,6 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 	auto v_ipc = std::vector<pairD_t>();
 	auto v_l3_occup_mb = std::vector<pairD_t>();
 
-	// Set holding all MPKI-L3 values from a given interval
-	// used to compute the value of limit_outlier
-	auto all_mpkil3 = std::set<double>();
-
 	// Apps that have changed to  critical (1) or to non-critical (0)
 	//to status = std::vector<pair_t>();
 
@@ -738,18 +862,17 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 	auto critical = std::vector<uint32_t>();
 	auto noncritical = std::vector<uint32_t>();
 
-    double ipcTotal = 0, mpkiL3Total = 0;
+	// Totals of the tasks sampled in the interval
+	const double ipcTotal = get_domain_rollup().sum(Rollups::ipc);
+	const double l3_occup_mb_total = get_domain_rollup().sum(Rollups::l3_occupancy) / 1024 / 1024;
+    double mpkiL3Total = 0;
 	double ipc_CR = 0;
     double ipc_NCR = 0;
-	double l3_occup_mb_total = 0;
 	double ipc_ICOV = 0;
 	double NCR_occupancy = 0;
 
 	uint32_t idTask;
 
-	// Accumulator to calculate mean and std of mpkil3
-	ca_accum_t macc;
-
     // Number of critical apps found in the interval
     uint32_t critical_apps = 0;
     bool change_in_outliers = false;
@@ -764,18 +887,11 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 		uint32_t taskID = task.id;
 
 		// stats per interval
-		uint64_t l3_miss = task.stats.last("mem_load_uops_retired.l3_miss");
-		uint64_t l3_hit = task.stats.last("mem_load_uops_retired.l3_hit");
-		uint64_t inst = task.stats.last("instructions");
-		double ipc = task.stats.last("ipc");
-		double l3_occup_mb = task.stats.last("intel_cqm/llc_occupancy/") / 1024 / 1024;
-
-		l3_occup_mb_total += l3_occup_mb;
-
-		double MPKIL3 = (double)(l3_miss*1000) / (double)inst;
-		double HPKIL3 = (double)(l3_hit*1000) / (double)inst;
+		double ipc = task.stats.last(ev_ipc);
+		double l3_occup_mb = task.stats.last(ev_l3_occup_mb);
 
-		double my_sum, prev_sum;
+		double MPKIL3 = task.stats.last(ev_mpki_l3);
+		double HPKIL3 = task.stats.last(ev_hpki_l3);
 
         //LOGINF("Task {}: MPKI_L3 = {}"_format(taskName,MPKIL3));
         LOGINF("Task {} ({}): IPC = {}, HPKIL3 = {}, MPKIL3 = {}, l3_occup_mb {}"_format(taskName,taskID,ipc,HPKIL3,MPKIL3,l3_occup_mb));
@@ -787,18 +903,14 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 		id_pid.push_back(std::make_pair(taskID, taskPID));
 
         // Accumulate total values
-		ipcTotal += ipc;
 		mpkiL3Total += MPKIL3;
 
 		// Update queue of each task with last value of MPKI-L3
 		auto it2 = valid_mpkil3.find(taskID);
         if (it2 != valid_mpkil3.end())
 		{
-			std::deque<double> deque_mpkil3 = it2->second;
-
-			// Remove values until vector size is equal to sliding window size
-			while (deque_mpkil3.size() >= windowSize)
-				deque_mpkil3.pop_back();
+			// The window drops the oldest value when it has windowSize values
+			Window &window_mpkil3 = it2->second;
 
 			// Find current CLOS hosting the task
 			auto itT = std::find_if(taskIsInCRCLOS.begin(), taskIsInCRCLOS.end(),[&taskID](const auto& tuple) {return std::get<0>(tuple) == taskID;});
@@ -808,22 +920,12 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 			auto itS = std::find_if(status.begin(), status.end(),[&taskID](const auto& tuple) {return std::get<0>(tuple) == taskID;});
        		uint64_t state = std::get<1>(*itS);
 
-			ipc_sumXij[taskID] += ipc;
-            ipc_phase_duration[taskID] += 1;
-
 			/**** IPC ICOV ****/
-			my_sum = ipc_sumXij[taskID] / ipc_phase_duration[taskID];
-			prev_sum = (ipc_sumXij[taskID] - ipc) / (ipc_phase_duration[taskID] - 1);
-			ipc_ICOV = fabs(ipc - prev_sum) / my_sum;
+			const auto &phase = ipc_phases.update(taskID, ipc);
+			ipc_ICOV = phase.score;
 			LOGINF("{}: ipc_icov = {} ({})"_format(taskID,ipc_ICOV,ipc));
-			if (ipc_ICOV >= ipc_ICOV_threshold)
-			{
-				LOGINF("{} IPC PHASE CHANGE {}"_format(taskID,ipc_phase_count[taskID]));
-				ipc_phase_count[taskID] += 1;
-				ipc_phase_duration[taskID] = 1;
-				ipc_sumXij[taskID] = ipc;
-				//ipc_icov[taskID] = true;
-			}
+			if (phase.change)
+				LOGINF("{} IPC PHASE CHANGE {}"_format(taskID,phase.phase - 1));
 
 			if (current_interval >= firstInterval)
 			{
@@ -932,22 +1034,18 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 				}
 			}
 
-			// Add to valid_mpkil3 queue
-            deque_mpkil3.push_front(MPKIL3);
-
-			// Store queue modified in the dictionary
-			valid_mpkil3[taskID] = deque_mpkil3;
+			// Add to valid_mpkil3 window
+            window_mpkil3.push(MPKIL3);
 		}
         else
         {
 			// Add a new entry in the dictionary
 			LOGINF("NEW ENTRY IN DICT valid_mpkil3 added");
-			valid_mpkil3[taskID].push_front(MPKIL3);
+			valid_mpkil3.emplace(taskID, Window(windowSize)).first->second.push(MPKIL3);
 			taskIsInCRCLOS.push_back(std::make_pair(taskID,1));
 			status.push_back(std::make_pair(taskID,0));
-			ipc_phase_count[taskID] = 1;
-            ipc_phase_duration[taskID] = 1;
-            ipc_sumXij[taskID] = ipc;
+			ipc_phases.reset(taskID);
+			ipc_phases.update(taskID, ipc);
 			ipc_phase_change[taskID] = false;
 			excluded[taskID]= false;
 			ipc_good[taskID] = false;
@@ -989,26 +1087,27 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
             	idle_count = IDLE_INTERVALS;
         	}
 		}
+		apply_bandwidth(current_interval, clos_roles());
 		return;
 	}
 
 	LOGINF("-MPKIL3-");
     // Add values of MPKI-L3 from each app to the common set
+	mpkil3_values.clear();
 	for (auto const &x : valid_mpkil3)
 	{
-		// Get deque
-		std::deque<double> val = x.second;
+		// Get window
+		const Window &val = x.second;
 		idTask = x.first;
 		std::string res;
 
 		// Add values
 		if (excluded[idTask] == false)
 		{
-			for (auto i = val.cbegin(); i != val.cend(); ++i)
+			for (size_t i = 0; i < val.size(); i++)
 			{
-				res = res + std::to_string(*i) + " ";
-				macc(*i);
-				all_mpkil3.insert(*i);
+				res = res + std::to_string(val[i]) + " ";
+				mpkil3_values.insert(val[i]);
 			}
 			LOGINF(res);
 		}
@@ -1016,16 +1115,10 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 			LOGINF("Task {} is excluded!!!"_format(idTask));
 	}
 
-	uint64_t size;
 	double q3, limit_outlier, limit_houtlier;
 
-	/** Calculate limit outlier using 3std **/
-	//mean = acc::mean(macc);
-	//var = acc::variance(macc);
-	size = all_mpkil3.size();
-	q3 = *std::next(all_mpkil3.begin(), size*0.75);
-	//double limit_outlier = mean + 1.5*std::sqrt(var);
-	//LOGINF("MPKIL3 1.5std: {} -> mean {}, var {}"_format(limit_outlier,mean,var));
+	/** Calculate limit outlier using Q3 **/
+	q3 = mpkil3_values.quartile(3);
 	if (q3 > 1)
 		limit_outlier = q3;
 	else
@@ -1177,10 +1270,10 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 				break;
 		} // close switch
 
-		LinuxBase::get_cat()->set_cbm(1,mask_CLOS1);
-		LinuxBase::get_cat()->set_cbm(2,mask_CLOS2);
-		LinuxBase::get_cat()->set_cbm(3,mask_CLOS3);
-		LinuxBase::get_cat()->set_cbm(4,mask_CLOS4);
+		LinuxBase::get_cat()->set_cbm(1,mask_CLOS1, domain);
+		LinuxBase::get_cat()->set_cbm(2,mask_CLOS2, domain);
+		LinuxBase::get_cat()->set_cbm(3,mask_CLOS3, domain);
+		LinuxBase::get_cat()->set_cbm(4,mask_CLOS4, domain);
 
 		LOGINF("CLOS 1 (non-CR) now has mask {:#x}"_format(mask_CLOS1));
 		LOGINF("CLOS 2 (CR) now has mask {:#x}"_format(mask_CLOS2));
@@ -1306,8 +1399,23 @@ void CriticalAwareV4::apply(uint64_t current_interval, const tasklist_t &tasklis
 	prev_critical_apps = critical_apps;
 	id_pid.clear();
 
+	apply_bandwidth(current_interval, clos_roles());
 }//apply
 
+
+// CLOS 1 has the non-critical tasks, 2 to 4 the critical ones and the isolated CLOSes that are not free the bullies
+std::map<uint32_t, LinuxBase::ClosRole> CriticalAwareV4::clos_roles() const
+{
+	auto roles = std::map<uint32_t, ClosRole>();
+	roles[1] = ClosRole::non_critical;
+	for (uint32_t clos = 2; clos <= 4; clos++)
+		roles[clos] = ClosRole::critical;
+	for (const auto &item : clos_mask)
+		if (std::find(free_closes.begin(), free_closes.end(), item.first) == free_closes.end())
+			roles[item.first] = ClosRole::isolated;
+	return roles;
+}
+
 ///////////////////////////////////////////////////
 
 
@@ -1345,7 +1453,7 @@ void CriticalPhaseAware::update_configuration(std::vector<pair_t> v, std::vector
 	{
 		critical_apps = 0;
 		for (int clos = 1; clos <= 8; clos += 1)
-			LinuxBase::get_cat()->set_cbm(clos,0xfffff);
+			LinuxBase::get_cat()->set_cbm(clos,0xfffff, domain);
 
 		for (const auto &item : v)
 		{
@@ -1381,8 +1489,8 @@ void CriticalPhaseAware::update_configuration(std::vector<pair_t> v, std::vector
 			}
 		}
 
-		num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-      	num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
+		num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+      	num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
       	num_shared_ways = 2;
 
 		LOGINF("[UPDATE] All critical tasks are assigned to CLOS 1. TaskIsInCRCLOS updated");
@@ -1463,18 +1571,18 @@ void CriticalPhaseAware::update_configuration(std::vector<pair_t> v, std::vector
 			break;
 	}
 
-	LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
-	LinuxBase::get_cat()->set_cbm(2,maskCLOS2);
-	LinuxBase::get_cat()->set_cbm(3,maskCLOS3);
-	LinuxBase::get_cat()->set_cbm(4,maskCLOS4);
+	LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
+	LinuxBase::get_cat()->set_cbm(2,maskCLOS2, domain);
+	LinuxBase::get_cat()->set_cbm(3,maskCLOS3, domain);
+	LinuxBase::get_cat()->set_cbm(4,maskCLOS4, domain);
 
-	num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-	num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
-	num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4));
-	num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3));
+	num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+	num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
+	num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4, domain));
+	num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3, domain));
 	num_shared_ways = 2;
-	LOGINF("[UPDATE] CLOS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1),num_ways_CLOS_1));
-	LOGINF("[UPDATE] CLOS 2 (CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2),num_ways_CLOS_2));
+	LOGINF("[UPDATE] CLOS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1, domain),num_ways_CLOS_1));
+	LOGINF("[UPDATE] CLOS 2 (CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2, domain),num_ways_CLOS_2));
 
 	// Leave time for actions to have effect
     //if (!idle & (effectIntervals > 0))
@@ -1501,11 +1609,11 @@ void CriticalPhaseAware::isolate_application(uint32_t taskID, pid_t taskPID, std
 	if (n_isolated_apps == 2)
 	{
 		mask_isolated = 0x0000f;
-		LinuxBase::get_cat()->set_cbm(5,0x0000f);
-		LinuxBase::get_cat()->set_cbm(6,0x0000f);
+		LinuxBase::get_cat()->set_cbm(5,0x0000f, domain);
+		LinuxBase::get_cat()->set_cbm(6,0x0000f, domain);
 	}
 	else
-		LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated);
+		LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated, domain);
 	LOGINF("[TEST] CLOS {} has now mask {:x}"_format(CLOS_isolated,mask_isolated));
 
 	// Update taskIsInCRCLOS
@@ -1523,9 +1631,9 @@ void CriticalPhaseAware::include_application(uint32_t taskID, pid_t taskPID, std
 	if (n_isolated_apps == 1)
 	{
 		if (CLOSvalue == 5)
-			LinuxBase::get_cat()->set_cbm(6,0x00003);
+			LinuxBase::get_cat()->set_cbm(6,0x00003, domain);
 		else
-			LinuxBase::get_cat()->set_cbm(5,0x00003);
+			LinuxBase::get_cat()->set_cbm(5,0x00003, domain);
 	}
 	LOGINF("[TEST] n_isolated_apps = {}"_format(n_isolated_apps));
 	id_isolated.erase(std::remove(id_isolated.begin(), id_isolated.end(), taskID), id_isolated.end());
@@ -1548,22 +1656,22 @@ void CriticalPhaseAware::divide_3_critical(uint64_t clos, bool limitDone)
 		switch (maxWays)
 		{
 			case 20: case 19:
-				LinuxBase::get_cat()->set_cbm(clos,0xfe000);
+				LinuxBase::get_cat()->set_cbm(clos,0xfe000, domain);
 				break;
 			case 18: case 17: case 16:
-				LinuxBase::get_cat()->set_cbm(clos,0xfc000);
+				LinuxBase::get_cat()->set_cbm(clos,0xfc000, domain);
 				break;
 			case 15: case 14: case 13:
-				LinuxBase::get_cat()->set_cbm(clos,0xf8000);
+				LinuxBase::get_cat()->set_cbm(clos,0xf8000, domain);
 				break;
 			case 12: case 11: case 10:
-				LinuxBase::get_cat()->set_cbm(clos,0xf0000);
+				LinuxBase::get_cat()->set_cbm(clos,0xf0000, domain);
 				break;
 			case 9: case 8: case 7:
-				LinuxBase::get_cat()->set_cbm(clos,0xe0000);
+				LinuxBase::get_cat()->set_cbm(clos,0xe0000, domain);
 				break;
 			case 6: case 5: case 4:
-				LinuxBase::get_cat()->set_cbm(clos,0xc0000);
+				LinuxBase::get_cat()->set_cbm(clos,0xc0000, domain);
 				break;
 			default:
 				break;
@@ -1574,22 +1682,22 @@ void CriticalPhaseAware::divide_3_critical(uint64_t clos, bool limitDone)
 		switch (maxWays)
 		{
 			case 20: case 19:
-				LinuxBase::get_cat()->set_cbm(clos,0xfffc0);
+				LinuxBase::get_cat()->set_cbm(clos,0xfffc0, domain);
 				break;
 			case 18: case 17: case 16:
-				LinuxBase::get_cat()->set_cbm(clos,0xfff00);
+				LinuxBase::get_cat()->set_cbm(clos,0xfff00, domain);
 				break;
 			case 15: case 14: case 13:
-				LinuxBase::get_cat()->set_cbm(clos,0xffc00);
+				LinuxBase::get_cat()->set_cbm(clos,0xffc00, domain);
 				break;
 			case 12: case 11: case 10:
-				LinuxBase::get_cat()->set_cbm(clos,0xff000);
+				LinuxBase::get_cat()->set_cbm(clos,0xff000, domain);
 				break;
 			case 9: case 8: case 7:
-				LinuxBase::get_cat()->set_cbm(clos,0xfc000);
+				LinuxBase::get_cat()->set_cbm(clos,0xfc000, domain);
 				break;
 			case 6:
-				LinuxBase::get_cat()->set_cbm(clos,0xf0000);
+				LinuxBase::get_cat()->set_cbm(clos,0xf0000, domain);
 				break;
 			default:
 				break;
@@ -1599,18 +1707,18 @@ void CriticalPhaseAware::divide_3_critical(uint64_t clos, bool limitDone)
 
 	if (clos == 2)
 	{
-		num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
-		maskCLOS2 = LinuxBase::get_cat()->get_cbm(2);
+		num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
+		maskCLOS2 = LinuxBase::get_cat()->get_cbm(2, domain);
 	}
 	else if (clos == 3)
 	{
-		num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3));
-		maskCLOS3 = LinuxBase::get_cat()->get_cbm(3);
+		num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3, domain));
+		maskCLOS3 = LinuxBase::get_cat()->get_cbm(3, domain);
 	}
 	else
 	{
-		num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4));
-		maskCLOS4 = LinuxBase::get_cat()->get_cbm(4);
+		num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4, domain));
+		maskCLOS4 = LinuxBase::get_cat()->get_cbm(4, domain);
 	}
 
 	LOGINF("CLOS 2 now has mask {:#x} ({} ways)"_format(maskCLOS2,num_ways_CLOS_2));
@@ -1630,28 +1738,28 @@ void CriticalPhaseAware::divide_2_critical(uint64_t clos)
 	switch (maxWays)
 	{
 		case 20:
-			LinuxBase::get_cat()->set_cbm(clos,0xffc00);
+			LinuxBase::get_cat()->set_cbm(clos,0xffc00, domain);
 			break;
 		case 19: case 18:
-			LinuxBase::get_cat()->set_cbm(clos,0xff800);
+			LinuxBase::get_cat()->set_cbm(clos,0xff800, domain);
 			break;
 		case 17: case 16:
-			LinuxBase::get_cat()->set_cbm(clos,0xff000);
+			LinuxBase::get_cat()->set_cbm(clos,0xff000, domain);
 			break;
 		case 15: case 14:
-			LinuxBase::get_cat()->set_cbm(clos,0xfe000);
+			LinuxBase::get_cat()->set_cbm(clos,0xfe000, domain);
 			break;
 		case 13: case 12:
-			LinuxBase::get_cat()->set_cbm(clos,0xfc000);
+			LinuxBase::get_cat()->set_cbm(clos,0xfc000, domain);
 			break;
 		case 11: case 10:
-			LinuxBase::get_cat()->set_cbm(clos,0xf8000);
+			LinuxBase::get_cat()->set_cbm(clos,0xf8000, domain);
 			break;
 		case 9: case 8:
-			LinuxBase::get_cat()->set_cbm(clos,0xf0000);
+			LinuxBase::get_cat()->set_cbm(clos,0xf0000, domain);
 			break;
 		case 7: case 6:
-			LinuxBase::get_cat()->set_cbm(clos,0xe0000);
+			LinuxBase::get_cat()->set_cbm(clos,0xe0000, domain);
 			break;
 		default:
 			break;
@@ -1659,18 +1767,18 @@ void CriticalPhaseAware::divide_2_critical(uint64_t clos)
 
 	if (clos == 2)
 	{
-		num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
-		maskCLOS2 = LinuxBase::get_cat()->get_cbm(2);
+		num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
+		maskCLOS2 = LinuxBase::get_cat()->get_cbm(2, domain);
 	}
 	else if (clos == 3)
 	{
-		num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3));
-		maskCLOS3 = LinuxBase::get_cat()->get_cbm(3);
+		num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3, domain));
+		maskCLOS3 = LinuxBase::get_cat()->get_cbm(3, domain);
 	}
 	else
 	{
-		num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4));
-		maskCLOS4 = LinuxBase::get_cat()->get_cbm(4);
+		num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4, domain));
+		maskCLOS4 = LinuxBase::get_cat()->get_cbm(4, domain);
 	}
 
 	LOGINF("CLOS 2 now has mask {:#x} ({} ways)"_format(maskCLOS2,num_ways_CLOS_2));
@@ -1690,7 +1798,7 @@ uint32_t CriticalPhaseAware::get_ways_critical()
         pid_t taskPID = std::get<1>(*it1);
 
 		uint32_t clos = LinuxBase::get_cat()->get_clos_of_task(taskPID);
-		uint32_t ways = __builtin_popcount(LinuxBase::get_cat()->get_cbm(clos));
+		uint32_t ways = __builtin_popcount(LinuxBase::get_cat()->get_cbm(clos, domain));
 		LOGINF("-> CLOS {} has {} ways"_format(clos,ways));
 		if (ways > res)
 			res = ways;
@@ -1701,31 +1809,31 @@ uint32_t CriticalPhaseAware::get_ways_critical()
 
 uint32_t CriticalPhaseAware::get_ways_noncritical()
 {
-	uint32_t ways = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
+	uint32_t ways = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
 	LOGINF("-> CLOS 1 has {} ways"_format(ways));
 	return ways;
 }
 
 void CriticalPhaseAware::update_noncritical_llc_space(uint32_t new_ways_ncr) {
-	uint32_t ways = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
+	uint32_t ways = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
 	LOGINF("CLOS 1 increased from {} to {} ways"_format(ways,new_ways_ncr));
 	uint32_t diff = new_ways_ncr - ways;
 
-	uint64_t schem = LinuxBase::get_cat()->get_cbm(1);
+	uint64_t schem = LinuxBase::get_cat()->get_cbm(1, domain);
 	LOGINF("Old schemata: 0x{:x}"_format(schem));
 	for(uint32_t i=0; i<diff; i++) {
 		schem = (schem << 1) | 0x00001;
 	}
 	LOGINF("New schemata: 0x{:x}"_format(schem));
-	LinuxBase::get_cat()->set_cbm(1,schem);
+	LinuxBase::get_cat()->set_cbm(1,schem, domain);
 
 }
 
 void CriticalPhaseAware::reduce_LLC_to_half(pid_t taskPID)
 {
 	uint32_t clos = LinuxBase::get_cat()->get_clos_of_task(taskPID);
-	uint64_t schem = LinuxBase::get_cat()->get_cbm(clos);
-	uint32_t ways = __builtin_popcount(LinuxBase::get_cat()->get_cbm(clos));
+	uint64_t schem = LinuxBase::get_cat()->get_cbm(clos, domain);
+	uint32_t ways = __builtin_popcount(LinuxBase::get_cat()->get_cbm(clos, domain));
 
 	if (ways == 2)
 	{
@@ -1738,7 +1846,7 @@ void CriticalPhaseAware::reduce_LLC_to_half(pid_t taskPID)
 			schem = (schem << 1) & 0xfffff;
 		}
 		LOGINF("New schemata: 0x{:x}"_format(schem));
-		LinuxBase::get_cat()->set_cbm(clos,schem);
+		LinuxBase::get_cat()->set_cbm(clos,schem, domain);
 	}
 }
 
@@ -1764,36 +1872,36 @@ void CriticalPhaseAware::divide_1_critical(uint64_t clos)
 	switch (maxWays)
 	{
 		case 20:
-			LinuxBase::get_cat()->set_cbm(clos,0xffc00);
-			LinuxBase::get_cat()->set_cbm(1,0x00fff);
+			LinuxBase::get_cat()->set_cbm(clos,0xffc00, domain);
+			LinuxBase::get_cat()->set_cbm(1,0x00fff, domain);
 			break;
 		case 19: case 18:
-			LinuxBase::get_cat()->set_cbm(clos,0xff800);
-			LinuxBase::get_cat()->set_cbm(1,0x01fff);
+			LinuxBase::get_cat()->set_cbm(clos,0xff800, domain);
+			LinuxBase::get_cat()->set_cbm(1,0x01fff, domain);
 			break;
 		case 17: case 16:
-			LinuxBase::get_cat()->set_cbm(clos,0xff000);
-			LinuxBase::get_cat()->set_cbm(1,0x03fff);
+			LinuxBase::get_cat()->set_cbm(clos,0xff000, domain);
+			LinuxBase::get_cat()->set_cbm(1,0x03fff, domain);
 			break;
 		case 15: case 14:
-			LinuxBase::get_cat()->set_cbm(clos,0xfe000);
-			LinuxBase::get_cat()->set_cbm(1,0x07fff);
+			LinuxBase::get_cat()->set_cbm(clos,0xfe000, domain);
+			LinuxBase::get_cat()->set_cbm(1,0x07fff, domain);
 			break;
 		case 13: case 12:
-			LinuxBase::get_cat()->set_cbm(clos,0xfc000);
-			LinuxBase::get_cat()->set_cbm(1,0x0ffff);
+			LinuxBase::get_cat()->set_cbm(clos,0xfc000, domain);
+			LinuxBase::get_cat()->set_cbm(1,0x0ffff, domain);
 			break;
 		case 11: case 10:
-			LinuxBase::get_cat()->set_cbm(clos,0xf8000);
-			LinuxBase::get_cat()->set_cbm(1,0x1ffff);
+			LinuxBase::get_cat()->set_cbm(clos,0xf8000, domain);
+			LinuxBase::get_cat()->set_cbm(1,0x1ffff, domain);
 			break;
 		case 9: case 8:
-			LinuxBase::get_cat()->set_cbm(clos,0xf0000);
-			LinuxBase::get_cat()->set_cbm(1,0x3ffff);
+			LinuxBase::get_cat()->set_cbm(clos,0xf0000, domain);
+			LinuxBase::get_cat()->set_cbm(1,0x3ffff, domain);
 			break;
 		case 7: case 6:
-			LinuxBase::get_cat()->set_cbm(clos,0xe0000);
-			LinuxBase::get_cat()->set_cbm(1,0x7ffff);
+			LinuxBase::get_cat()->set_cbm(clos,0xe0000, domain);
+			LinuxBase::get_cat()->set_cbm(1,0x7ffff, domain);
 			break;
 		default:
 			break;
@@ -1801,22 +1909,22 @@ void CriticalPhaseAware::divide_1_critical(uint64_t clos)
 
 	if (clos == 2)
 	{
-		num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
-		maskCLOS2 = LinuxBase::get_cat()->get_cbm(2);
+		num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
+		maskCLOS2 = LinuxBase::get_cat()->get_cbm(2, domain);
 	}
 	else if (clos == 3)
 	{
-		num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3));
-		maskCLOS3 = LinuxBase::get_cat()->get_cbm(3);
+		num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3, domain));
+		maskCLOS3 = LinuxBase::get_cat()->get_cbm(3, domain);
 	}
 	else
 	{
-		num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4));
-		maskCLOS4 = LinuxBase::get_cat()->get_cbm(4);
+		num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4, domain));
+		maskCLOS4 = LinuxBase::get_cat()->get_cbm(4, domain);
 	}
 
-	num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-    maskNonCrCLOS = LinuxBase::get_cat()->get_cbm(1);
+	num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+    maskNonCrCLOS = LinuxBase::get_cat()->get_cbm(1, domain);
 
 	LOGINF("CLOS 1 now has mask {:#x} ({} ways)"_format(maskNonCrCLOS,num_ways_CLOS_1));
 	LOGINF("CLOS 2 now has mask {:#x} ({} ways)"_format(maskCLOS2,num_ways_CLOS_2));
@@ -1843,28 +1951,23 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 	auto v_l3_occup_mb = std::vector<pairD_t>();
 	auto id_phase_change =  std::vector<uint32_t>();
 
-	// Set holding all MPKI-L3 values from a given interval
-	// used to compute the value of limit_outlier
-	auto all_mpkil3 = std::set<double>();
-
 	// Apps that have changed to  critical (1) or to non-critical (0)
 	auto status = std::vector<pair_t>();
 
 	// Vector with outlier values (1 == outlier, 0 == not outlier)
 	auto outlier = std::vector<pair_t>();
 
-    double ipcTotal = 0, mpkiL3Total = 0;
+	// Totals of the tasks sampled in the interval
+	const double ipcTotal = get_domain_rollup().sum(Rollups::ipc);
+	const double l3_occup_mb_total = get_domain_rollup().sum(Rollups::l3_occupancy) / 1024 / 1024;
+    double mpkiL3Total = 0;
 	double ipc_CR = 0;
     double ipc_NCR = 0;
-	double l3_occup_mb_total = 0;
 	double ipc_ICOV = 0;
 
 	uint32_t taskID;
 	pid_t taskPID;
 
-	// Accumulator to calculate mean and std of mpkil3
-	ca_accum_t macc;
-
     // Number of critical apps found in the interval
     bool change_in_outliers = false;
 
@@ -1877,18 +1980,11 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 		taskID = task.id;
 
 		// stats per interval
-		uint64_t l3_miss = task.stats.last("mem_load_uops_retired.l3_miss");
-		uint64_t l3_hit = task.stats.last("mem_load_uops_retired.l3_hit");
-		uint64_t inst = task.stats.last("instructions");
-		double ipc = task.stats.last("ipc");
-		double l3_occup_mb = task.stats.last("intel_cqm/llc_occupancy/") / 1024 / 1024;
-
-		l3_occup_mb_total += l3_occup_mb;
-
-		double MPKIL3 = (double)(l3_miss*1000) / (double)inst;
-		double HPKIL3 = (double)(l3_hit*1000) / (double)inst;
+		double ipc = task.stats.last(ev_ipc);
+		double l3_occup_mb = task.stats.last(ev_l3_occup_mb);
 
-		double my_sum, prev_sum;
+		double MPKIL3 = task.stats.last(ev_mpki_l3);
+		double HPKIL3 = task.stats.last(ev_hpki_l3);
 
         LOGINF("Task {} ({}): IPC = {}, HPKIL3 = {}, MPKIL3 = {}, l3_occup_mb {}"_format(taskName,taskID,ipc,HPKIL3,MPKIL3,l3_occup_mb));
 
@@ -1900,40 +1996,30 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 		id_pid.push_back(std::make_pair(taskID, taskPID));
 
         // Accumulate total values
-		ipcTotal += ipc;
 		mpkiL3Total += MPKIL3;
 
 		// Update queue of each task with last value of MPKI-L3
 		auto it2 = valid_mpkil3.find(taskID);
         if (it2 != valid_mpkil3.end())
 		{
-			std::deque<double> deque_mpkil3 = it2->second;
-
-			// Remove values until vector size is equal to sliding window size
-			while (deque_mpkil3.size() >= windowSize)
-				deque_mpkil3.pop_back();
+			// The window drops the oldest value when it has windowSize values
+			Window &window_mpkil3 = it2->second;
 
 			auto itT = std::find_if(taskIsInCRCLOS.begin(), taskIsInCRCLOS.end(),[&taskID](const auto& tuple) {return std::get<0>(tuple) == taskID;});
             uint64_t CLOSvalue = std::get<1>(*itT);
 
 			LOGINF("{}: CLOS {}"_format(taskID,CLOSvalue));
 
-			ipc_sumXij[taskID] += ipc;
-			ipc_phase_duration[taskID] += 1;
 			if ((CLOSvalue == 5) | (CLOSvalue == 6))
 				LOGINF("[ISO] Isolated task {} ({}) is in CLOS {} and has IPC {}"_format(taskID,taskName,CLOSvalue,ipc));
 
 			/**** IPC ICOV ****/
-			my_sum = ipc_sumXij[taskID] / ipc_phase_duration[taskID];
-			prev_sum = (ipc_sumXij[taskID] - ipc) / (ipc_phase_duration[taskID] - 1);
-			ipc_ICOV = fabs(ipc - prev_sum) / my_sum;
+			const auto &phase = ipc_phases.update(taskID, ipc);
+			ipc_ICOV = phase.score;
 			LOGINF("{}: ipc_icov = {} ({})"_format(taskID,ipc_ICOV,ipc));
-			if (ipc_ICOV >= icov)
+			if (phase.change)
 			{
-				LOGINF("{} IPC PHASE CHANGE {}"_format(taskID,ipc_phase_count[taskID]));
-				ipc_phase_count[taskID] += 1;
-				ipc_phase_duration[taskID] = 1;
-				ipc_sumXij[taskID] = ipc;
+				LOGINF("{} IPC PHASE CHANGE {}"_format(taskID,phase.phase - 1));
 				id_phase_change.push_back(taskID);
 
 				if ((limit_task[taskID] == true) & (ipc < ipcMedium) & (CLOSvalue >= 2) & (CLOSvalue <= 4))
@@ -1945,28 +2031,28 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 
 					if (critical_apps == 1)
 					{
-						LinuxBase::get_cat()->set_cbm(CLOSvalue,0xfff00);
-						LinuxBase::get_cat()->set_cbm(1,0x003ff);
-						num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-    					maskNonCrCLOS = LinuxBase::get_cat()->get_cbm(1);
+						LinuxBase::get_cat()->set_cbm(CLOSvalue,0xfff00, domain);
+						LinuxBase::get_cat()->set_cbm(1,0x003ff, domain);
+						num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+    					maskNonCrCLOS = LinuxBase::get_cat()->get_cbm(1, domain);
 						if (CLOSvalue == 2)
 						{
-							num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
-							maskCLOS2 = LinuxBase::get_cat()->get_cbm(2);
+							num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
+							maskCLOS2 = LinuxBase::get_cat()->get_cbm(2, domain);
 						}
 						else if (CLOSvalue == 3)
 						{
-							num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3));
-							maskCLOS3 = LinuxBase::get_cat()->get_cbm(3);
+							num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3, domain));
+							maskCLOS3 = LinuxBase::get_cat()->get_cbm(3, domain);
 						}
 						else
 						{
-							num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4));
-							maskCLOS4 = LinuxBase::get_cat()->get_cbm(4);
+							num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4, domain));
+							maskCLOS4 = LinuxBase::get_cat()->get_cbm(4, domain);
 						}
 
-						num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-						maskNonCrCLOS = LinuxBase::get_cat()->get_cbm(1);
+						num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+						maskNonCrCLOS = LinuxBase::get_cat()->get_cbm(1, domain);
 
 						LOGINF("CLOS 1 now has mask {:#x} ({} ways)"_format(maskNonCrCLOS,num_ways_CLOS_1));
 						LOGINF("CLOS 2 now has mask {:#x} ({} ways)"_format(maskCLOS2,num_ways_CLOS_2));
@@ -1979,34 +2065,34 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 					{
 						case 2:
 							if (critical_apps == 2)
-								mask = LinuxBase::get_cat()->get_cbm(3);
+								mask = LinuxBase::get_cat()->get_cbm(3, domain);
 							else if(num_ways_CLOS_3 > 10)
-								mask = LinuxBase::get_cat()->get_cbm(3);
+								mask = LinuxBase::get_cat()->get_cbm(3, domain);
 							else
-								mask = LinuxBase::get_cat()->get_cbm(4);
+								mask = LinuxBase::get_cat()->get_cbm(4, domain);
 							maskCLOS2 = mask;
-							LinuxBase::get_cat()->set_cbm(CLOSvalue,mask);
-							num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
+							LinuxBase::get_cat()->set_cbm(CLOSvalue,mask, domain);
+							num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
 							break;
 						case 3:
 							if (critical_apps == 2)
-								mask = LinuxBase::get_cat()->get_cbm(2);
+								mask = LinuxBase::get_cat()->get_cbm(2, domain);
 							else if(num_ways_CLOS_2 > 10)
-								mask = LinuxBase::get_cat()->get_cbm(2);
+								mask = LinuxBase::get_cat()->get_cbm(2, domain);
 							else
-								mask = LinuxBase::get_cat()->get_cbm(4);
+								mask = LinuxBase::get_cat()->get_cbm(4, domain);
 							maskCLOS3 = mask;
-							LinuxBase::get_cat()->set_cbm(CLOSvalue,mask);
-							num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3));
+							LinuxBase::get_cat()->set_cbm(CLOSvalue,mask, domain);
+							num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3, domain));
 							break;
 						case 4:
 							if (num_ways_CLOS_2 > 10)
-								mask = LinuxBase::get_cat()->get_cbm(2);
+								mask = LinuxBase::get_cat()->get_cbm(2, domain);
 							else
-								mask = LinuxBase::get_cat()->get_cbm(3);
+								mask = LinuxBase::get_cat()->get_cbm(3, domain);
 							maskCLOS4 = mask;
-							LinuxBase::get_cat()->set_cbm(CLOSvalue,mask);
-							num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4));
+							LinuxBase::get_cat()->set_cbm(CLOSvalue,mask, domain);
+							num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4, domain));
 							break;
 					}
 
@@ -2015,23 +2101,19 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 			else if (current_interval == firstInterval)
 				id_phase_change.push_back(taskID);
 
-			// Add to valid_mpkil3 queue
+			// Add to valid_mpkil3 window
 			if (excluded[taskID] == false)
-            	deque_mpkil3.push_front(MPKIL3);
-
-			// Store queue modified in the dictionary
-			valid_mpkil3[taskID] = deque_mpkil3;
+            	window_mpkil3.push(MPKIL3);
 
 		}
         else
         {
 			// Add a new entry in the dictionary
 			LOGINF("NEW ENTRY IN DICT valid_mpkil3 added");
-			valid_mpkil3[taskID].push_front(MPKIL3);
+			valid_mpkil3.emplace(taskID, Window(windowSize)).first->second.push(MPKIL3);
 			taskIsInCRCLOS.push_back(std::make_pair(taskID,1));
-			ipc_phase_count[taskID] = 1;
-            ipc_phase_duration[taskID] = 1;
-            ipc_sumXij[taskID] = ipc;
+			ipc_phases.reset(taskID);
+			ipc_phases.update(taskID, ipc);
 			excluded[taskID]= false;
         }
 
@@ -2049,21 +2131,21 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 	// Calculate limit outlier
 	// Add values of MPKI-L3 from each app to the common set
 	LOGINF("-MPKIL3-");
+	mpkil3_values.clear();
 	for (auto const &x : valid_mpkil3)
 	{
-		// Get deque
-		std::deque<double> val = x.second;
+		// Get window
+		const Window &val = x.second;
 		taskID = x.first;
 		std::string res;
 
 		// Add values
 		if (excluded[taskID] == false)
 		{
-			for (auto i = val.cbegin(); i != val.cend(); ++i)
+			for (size_t i = 0; i < val.size(); i++)
 			{
-				res = res + std::to_string(*i) + " ";
-				macc(*i);
-				all_mpkil3.insert(*i);
+				res = res + std::to_string(val[i]) + " ";
+				mpkil3_values.insert(val[i]);
 			}
 			LOGINF(res);
 		}
@@ -2071,9 +2153,9 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 			LOGINF("Task {} is excluded!!!"_format(taskID));
 	}
 	/** Calculate limit outlier using 3std **/
-	double mean = acc::mean(macc);
-	double var = acc::variance(macc);
-	double limit_outlier = mean + 1.5*std::sqrt(var);
+	double mean = mpkil3_values.mean();
+	double var = mpkil3_values.variance();
+	double limit_outlier = outliers::mean_sigma(mpkil3_values, 1.5);
 	LOGINF("MPKIL3 1.5std: {} -> mean {}, var {}"_format(limit_outlier,mean,var));
 	if (limit_outlier < 1)
 		limit_outlier = 1;
@@ -2156,8 +2238,8 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 					if (excluded[taskID] == true)
 					{
 						excluded[taskID] = false;
-						valid_mpkil3[taskID].clear();
-						valid_mpkil3[taskID].push_front(MPKIL3Task);
+						valid_mpkil3.at(taskID).clear();
+						valid_mpkil3.at(taskID).push(MPKIL3Task);
 					}
 				}
 				break;
@@ -2244,8 +2326,8 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 					if (excluded[taskID] == true)
 					{
 						excluded[taskID] = false;
-						valid_mpkil3[taskID].clear();
-						valid_mpkil3[taskID].push_front(MPKIL3Task);
+						valid_mpkil3.at(taskID).clear();
+						valid_mpkil3.at(taskID).push(MPKIL3Task);
 					}
 				}
 				break;
@@ -2344,20 +2426,20 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 
 		if (state != 4)
 		{
-			LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
-        	LinuxBase::get_cat()->set_cbm(2,maskCLOS2);
+			LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
+        	LinuxBase::get_cat()->set_cbm(2,maskCLOS2, domain);
 			LOGINF("CLOS 1 (non-CR) now has mask {:#x}"_format(maskNonCrCLOS));
 			LOGINF("CLOS 2 (CR) now has mask {:#x}"_format(maskCLOS2));
 
 			if (critical_apps > 1)
 			{
-				LinuxBase::get_cat()->set_cbm(3,maskCLOS3);
+				LinuxBase::get_cat()->set_cbm(3,maskCLOS3, domain);
 				LOGINF("CLOS 3 (CR) now has mask {:#x}"_format(maskCLOS3));
 
 			}
 			if (critical_apps > 2)
 			{
-				LinuxBase::get_cat()->set_cbm(4,maskCLOS4);
+				LinuxBase::get_cat()->set_cbm(4,maskCLOS4, domain);
 				LOGINF("CLOS 4 (CR) now has mask {:#x}"_format(maskCLOS4));
 			}
         	firstTime = 0;
@@ -2627,7 +2709,7 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 							if (num_ways_CLOS_1 > noncritical_apps)
 							{
 								maskNonCrCLOS = (maskNonCrCLOS >> 1) | 0x00001;
-								LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
+								LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
 							}
 							else
 								LOGINF("Non-critical apps. have reached limit space.");
@@ -2639,15 +2721,15 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 							maskCLOS2 = (maskCLOS2 << 1) & 0xfffff;
 							maskCLOS3 = (maskCLOS3 << 1) & 0xfffff;
 							maskCLOS4 = (maskCLOS4 << 1) & 0xfffff;
-							LinuxBase::get_cat()->set_cbm(2,maskCLOS2);
-							LinuxBase::get_cat()->set_cbm(3,maskCLOS3);
-							LinuxBase::get_cat()->set_cbm(4,maskCLOS4);
+							LinuxBase::get_cat()->set_cbm(2,maskCLOS2, domain);
+							LinuxBase::get_cat()->set_cbm(3,maskCLOS3, domain);
+							LinuxBase::get_cat()->set_cbm(4,maskCLOS4, domain);
 							break;
 
 						case 7:
 							LOGINF("NCR++ (Add one shared way to CLOS with non-critical apps)");
 							maskNonCrCLOS = (maskNonCrCLOS << 1) | 0x00001;
-							LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
+							LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
 							break;
 
 						case 8:
@@ -2669,9 +2751,9 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 								maskCLOS2 = (maskCLOS2 >> 1) | 0x80000;
 								maskCLOS3 = (maskCLOS3 >> 1) | 0x80000;
 								maskCLOS4 = (maskCLOS4 >> 1) | 0x80000;
-								LinuxBase::get_cat()->set_cbm(2,maskCLOS2);
-								LinuxBase::get_cat()->set_cbm(3,maskCLOS3);
-								LinuxBase::get_cat()->set_cbm(4,maskCLOS4);
+								LinuxBase::get_cat()->set_cbm(2,maskCLOS2, domain);
+								LinuxBase::get_cat()->set_cbm(3,maskCLOS3, domain);
+								LinuxBase::get_cat()->set_cbm(4,maskCLOS4, domain);
 							}
 							else
 								LOGINF("Critical app(s). have reached limit space.");
@@ -2685,17 +2767,17 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 
 				idle = true;
 
-				num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-				num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
-				num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3));
-				num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4));
+				num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+				num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
+				num_ways_CLOS_3 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(3, domain));
+				num_ways_CLOS_4 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(4, domain));
 
-				LOGINF("CLOS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1),num_ways_CLOS_1));
-				LOGINF("CLOS 2 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2),num_ways_CLOS_2));
+				LOGINF("CLOS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1, domain),num_ways_CLOS_1));
+				LOGINF("CLOS 2 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2, domain),num_ways_CLOS_2));
 				if (critical_apps > 1)
-					LOGINF("CLOS 3 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(3),num_ways_CLOS_3));
+					LOGINF("CLOS 3 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(3, domain),num_ways_CLOS_3));
 				if (critical_apps > 2)
-					LOGINF("CLOS 4 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(4),num_ways_CLOS_4));
+					LOGINF("CLOS 4 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(4, domain),num_ways_CLOS_4));
 
 
 				uint64_t maxways = std::max(num_ways_CLOS_2, num_ways_CLOS_3);
@@ -2730,23 +2812,6 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 
 
 /////////////// CRITICAL-AWARE v2 ///////////////
-double CriticalAwareV2::medianV(std::set<double> vec)
-  {
-      double med;
-      size_t size = vec.size();
-	  size_t s2 = size/2;
-
-	  double med_true = *std::next(vec.begin(), s2);
-	  double med_false = *std::next(vec.begin(), s2 - 1);
-
-      if (size  % 2 == 0)
-          med = (med_true + med_false ) / 2;
-      else
-          med = med_true;
-
-	  return med;
-  }
-
 /*
  * Update configuration method allows to change from one
  * cache configuration to another, i.e. when a different
@@ -2777,7 +2842,7 @@ void CriticalAwareV2::update_configuration(std::vector<pair_t> v, std::vector<pa
 	// >> assign all apps to CLOS 1
 	if ((num_critical_new == 0) | (num_critical_new >= 4)){
 		for (int clos = 1; clos <= 2; clos += 1)
-			LinuxBase::get_cat()->set_cbm(clos,0xfffff);
+			LinuxBase::get_cat()->set_cbm(clos,0xfffff, domain);
 
 		for (const auto &item : v)
 		{
@@ -2874,13 +2939,13 @@ void CriticalAwareV2::update_configuration(std::vector<pair_t> v, std::vector<pa
 
 	}
 
-	LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
-	LinuxBase::get_cat()->set_cbm(2,maskCrCLOS);
-	num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-	num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
+	LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
+	LinuxBase::get_cat()->set_cbm(2,maskCrCLOS, domain);
+	num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+	num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
 	num_shared_ways = 2;
-	LOGINF("[UPDATE] CLOS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1),num_ways_CLOS_1));
-	LOGINF("[UPDATE] CLOS 2 (CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2),num_ways_CLOS_2));
+	LOGINF("[UPDATE] CLOS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1, domain),num_ways_CLOS_1));
+	LOGINF("[UPDATE] CLOS 2 (CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2, domain),num_ways_CLOS_2));
 
 	// Leave time for actions to have effect
     if (!idle & (effectIntervals > 0))
@@ -2917,18 +2982,12 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 	// Apps that have changed to  critical (1) or to non-critical (0)
 	auto status = std::vector<pair_t>();
 
-	/** SETS **/
-	// Set holding all MPKI-L3 values from a given interval
-	// used to compute the value of limit_outlier
-	auto all_mpkil3 = std::set<double>();
-	// Set to order all limit_outlier values computed
-	auto limits = std::set<double>();
-
     /** VARIABLES **/
-    double ipcTotal = 0;
+	// Totals of the tasks sampled in the interval
+	const double ipcTotal = get_domain_rollup().sum(Rollups::ipc);
+	const double l3_occup_mb_total = get_domain_rollup().sum(Rollups::l3_occupancy) / 1024 / 1024;
 	double mpkiL3Total = 0;
 	double hpkiL3Total = 0;
-	double l3_occup_mb_total = 0;
     // Total IPC of critical applications
 	double ipc_CR = 0;
 	// Total IPC of non-critical applications
@@ -2940,9 +2999,6 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 	uint32_t idTask;
 
 
-	// Accumulator to calculate mean and std of mpkil3
-	ca_accum_t macc;
-
 	/********************************/
 
 	// Perform no further action if cache-warmup time has not passed
@@ -2963,25 +3019,20 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
         uint32_t cpu = task.cpus.front();
 
         // Obtain stats per interval
-        uint64_t l3_miss = task.stats.last("mem_load_uops_retired.l3_miss");
-		uint64_t l3_hit = task.stats.last("mem_load_uops_retired.l3_hit");
-        uint64_t inst = task.stats.last("instructions");
 		//uint64_t cycles = task.stats.last("cycles");
-        double ipc = task.stats.last("ipc");
-        double l3_occup_mb = task.stats.last("intel_cqm/llc_occupancy/") / 1024 / 1024;
+        double ipc = task.stats.last(ev_ipc);
+        double l3_occup_mb = task.stats.last(ev_l3_occup_mb);
 
-        double MPKIL3 = (double)(l3_miss*1000) / (double)inst;
-		double HPKIL3 = (double)(l3_hit*1000) / (double)inst;
+        double MPKIL3 = task.stats.last(ev_mpki_l3);
+		double HPKIL3 = task.stats.last(ev_hpki_l3);
 		double APKIL3 = MPKIL3 + HPKIL3;
 
 		//double APKCL3 = (double)((l3_miss + l3_hit)*1000) / cycles;
 		//LOGINF("{}: APKCL3 = {}"_format(taskID,APKCL3));
 
 		// Accumulate total values
-		ipcTotal += ipc;
 		mpkiL3Total += MPKIL3;
 		hpkiL3Total += HPKIL3;
-		l3_occup_mb_total += l3_occup_mb;
 
         LOGINF("Task {} ({}): IPC {}, MPKIL3 {}, HPKIL3 {}, APKIL3 {}, l3_occup_mb {}"_format(taskName,taskID,ipc,MPKIL3,HPKIL3,APKIL3,l3_occup_mb));
 		//LOGINF("APKIL3 {}: {}"_format(taskID,APKIL3));
@@ -2997,11 +3048,9 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 		auto it2 = valid_mpkil3.find(taskID);
         if (it2 != valid_mpkil3.end())
 		{
-			std::deque<double> deque_valid = it2->second;
-
-			// Remove values until vector size is equal to sliding window size
-			while (deque_valid.size() >= windowSizeM[taskID])
-				deque_valid.pop_back();
+			// The window drops the oldest value when it has windowSizeM[taskID] values
+			Window &window_valid = it2->second;
+			window_valid.set_capacity(windowSizeM[taskID]);
 
 			sumXij[taskID] += MPKIL3;
        		phase_duration[taskID] += 1;
@@ -3035,7 +3084,7 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
                 mask_isolated = (mask_isolated >> 2) & mask_isolated;
                 if (mask_isolated == 0x00000)
                     mask_isolated = 0x00003;
-                LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated);
+                LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated, domain);
                 LOGINF("[TEST] CLOS {} has now mask {:x}"_format(CLOS_isolated,mask_isolated));
                 id_isolated.erase(std::remove(id_isolated.begin(), id_isolated.end(), taskID), id_isolated.end());
             }
@@ -3059,7 +3108,7 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 
                       	LinuxBase::get_cat()->add_task(3,taskPID);
                       	LOGINF("[TEST] {}: has l3_occup_mb {} -> assigned to CLOS {}"_format(taskID,l3_occup_mb,CLOS_isolated));
-                      	LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated);
+                      	LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated, domain);
                       	LOGINF("[TEST] CLOS {} has now mask {:x}"_format(CLOS_isolated,mask_isolated));
 
                       	// Update taskIsInCRCLOS
@@ -3096,22 +3145,19 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
                     phase_duration[taskID] = 0;
 
 					// Clear values of previous phase
-                  	deque_valid.clear();
-                  	LOGINF("{}: deque_valid has been cleared as a new phase is starting."_format(taskID));
+                  	window_valid.clear();
+                  	LOGINF("{}: window_valid has been cleared as a new phase is starting."_format(taskID));
 				}
 			}
 
-			// Add to valid_mpkil3 queue
-            deque_valid.push_front(MPKIL3);
-
-			// Store queue modified in the dictionary
-			valid_mpkil3[taskID] = deque_valid;
+			// Add to valid_mpkil3 window
+            window_valid.push(MPKIL3);
 		}
         else
         {
 			// Add a new entry in the dictionary
 			LOGINF("NEW ENTRY IN DICT valid_mpkil3 added");
-			valid_mpkil3[taskID].push_front(MPKIL3);
+			valid_mpkil3.emplace(taskID, Window(windowSizeM[taskID])).first->second.push(MPKIL3);
 			phase_count[taskID] = 1;
 			phase_duration[taskID] = 0;
 			sumXij[taskID] = MPKIL3;
@@ -3190,35 +3236,33 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
     }
 
 	// Add values of MPKI-L3 from each app to the common set
+	mpkil3_values.clear();
+	outlier_limits.clear();
 	double min = 1000000;
 	double maxM = 0;
 	for (auto const &x : valid_mpkil3)
 	{
-		// Get deque
-		std::deque<double> val = x.second;
+		// Get window
+		const Window &val = x.second;
 		idTask = x.first;
 		std::string res;
 
 		if ((reset) & (non_critical[idTask] == 0))
 		{
 			LOGINF("RESET -> Task {} has been CRITICAL THEREFORE ITS VALUES ARE NOT CONSIDERED"_format(idTask));
-			for (auto i = val.cbegin(); i != val.cend(); ++i)
-                  res = res + std::to_string(*i) + " ";
+			for (size_t i = 0; i < val.size(); i++)
+                  res = res + std::to_string(val[i]) + " ";
 		}
 		else
 		{
 			// Add values
-			for (auto i = val.cbegin(); i != val.cend(); ++i)
+			for (size_t i = 0; i < val.size(); i++)
 			{
-				res = res + std::to_string(*i) + " ";
-				all_mpkil3.insert(*i);
-				macc(*i);
-
-				if (*i < min)
-					min = *i;
-				if (*i > maxM)
-					maxM = *i;
+				res = res + std::to_string(val[i]) + " ";
+				mpkil3_values.insert(val[i]);
 			}
+			min = std::min(min, val.min());
+			maxM = std::max(maxM, val.max());
 		}
 		LOGINF(res);
 	}
@@ -3228,91 +3272,75 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 	LOGINF("RANGE: {}"_format(range));
 
 	/** LIMIT OUTLIER CALCULATION **/
-	uint64_t size = all_mpkil3.size();
-	double q1 = *std::next(all_mpkil3.begin(), size/4);
-	double q2 = *std::next(all_mpkil3.begin(), size/2);
-	double q3 = *std::next(all_mpkil3.begin(), size*0.75);
+	uint64_t size = mpkil3_values.size();
+	double q1 = mpkil3_values.quartile(1);
+	double q2 = mpkil3_values.quartile(2);
+	double q3 = mpkil3_values.quartile(3);
 	LOGINF("Size:{}, Q1:{}, Q2:{}, Q3:{}"_format(size,q1,q2,q3));
 	double limit_outlier;
 
 	/** 3std **/
-	double mean = acc::mean(macc);
-	double var = acc::variance(macc);
-	limit_outlier = mean + 3*std::sqrt(var);
+	limit_outlier = outliers::mean_sigma(mpkil3_values, 3);
 	v_limits.push_back(std::make_pair("3std",limit_outlier));
-	limits.insert(limit_outlier);
+	outlier_limits.insert(limit_outlier);
 	LOGINF("3std: {}"_format(limit_outlier));
 
 	/** 2std **/
-    limit_outlier = mean + 2.5*std::sqrt(var);
+    limit_outlier = outliers::mean_sigma(mpkil3_values, 2.5);
     v_limits.push_back(std::make_pair("2.5std",limit_outlier));
-    limits.insert(limit_outlier);
+    outlier_limits.insert(limit_outlier);
     LOGINF("2.5std: {}"_format(limit_outlier));
 
 
 	/** 2std **/
-	limit_outlier = mean + 2*std::sqrt(var);
+	limit_outlier = outliers::mean_sigma(mpkil3_values, 2);
     v_limits.push_back(std::make_pair("2std",limit_outlier));
-    limits.insert(limit_outlier);
+    outlier_limits.insert(limit_outlier);
     LOGINF("2std: {}"_format(limit_outlier));
 
-	/** MAD = Median Absolute Value **/
-	// 1. Find the median
-    double Mj = medianV(all_mpkil3);
-    // 2. Subtract from each value the median
-    auto aux = std::set<double>();
-    for (auto f : all_mpkil3)
-        aux.insert(fabs (f - Mj));
-    // 3. Find the median
-    double Mi = medianV(aux);
-    // 4. Multiply median by b (assume normal distribution)
-    double MAD = Mi * 1.4826;
-    // 5. Calculate limit_outlier
-    limit_outlier = Mj + 3*MAD;
+	/** MAD = Median Absolute Value, scaled assuming a normal distribution **/
+	limit_outlier = outliers::mad(mpkil3_values, 3);
 	v_limits.push_back(std::make_pair("mad",limit_outlier));
-	limits.insert(limit_outlier);
+	outlier_limits.insert(limit_outlier);
 	LOGINF("mad: {}"_format(limit_outlier));
 
 	/** Neil C. Schwetman's method **/
-	double Z = 1.96; //95%
-	double kn = kn_table[size];
-    limit_outlier = q2 + (((2 * (q3 - q2)) / kn) * Z);
+	limit_outlier = outliers::schwetman(mpkil3_values, outliers::z95);
 	v_limits.push_back(std::make_pair("Schwetman",limit_outlier));
-	limits.insert(limit_outlier);
+	outlier_limits.insert(limit_outlier);
 	LOGINF("Schwetman: {}"_format(limit_outlier));
 
 	/** Carling's method **/
-	double k = ((17.63 * size) - 23.64) / ((7.74 * size) - 3.71);
-	limit_outlier = q2 + (k * (q3 - q1));
+	limit_outlier = outliers::carling(mpkil3_values);
 	v_limits.push_back(std::make_pair("Carling",limit_outlier));
-	limits.insert(limit_outlier);
+	outlier_limits.insert(limit_outlier);
 	LOGINF("Carling: {}"_format(limit_outlier));
 
 	/** Turkey **/
-	limit_outlier = q3 + (1.5 * (q3 - q1));
+	limit_outlier = outliers::tukey(mpkil3_values, 1.5);
 	v_limits.push_back(std::make_pair("Turkey",limit_outlier));
-	limits.insert(limit_outlier);
+	outlier_limits.insert(limit_outlier);
 	LOGINF("Turkey: {}"_format(limit_outlier));
 
 	/** Q3 = limit_outlier is equal to Q3 **/
 	limit_outlier = q3;
 	v_limits.push_back(std::make_pair("q3",limit_outlier));
-	limits.insert(limit_outlier);
+	outlier_limits.insert(limit_outlier);
 	LOGINF("q3: {}"_format(limit_outlier));
 
 	// Assign limit_outlier to corresponding outlierMethod
 	// i.e. the one stated in the template
-	size = limits.size();
+	size = outlier_limits.size();
 	if (outlierMethod == "auto1")
 	{
-		auto gt10 = find_if(limits.begin(), limits.end(), [](int x){return x>1;});
-		if (gt10 != limits.end())
+		auto gt10 = find_if(outlier_limits.begin(), outlier_limits.end(), [](int x){return x>1;});
+		if (gt10 != outlier_limits.end())
 			limit_outlier = *gt10;
 		LOGINF("auto1: {}"_format(limit_outlier));
 	}
 	else if (outlierMethod == "auto75")
 	{
-		limit_outlier = *std::next(limits.begin(), size*0.75);
+		limit_outlier = outlier_limits[size*0.75];
 		LOGINF("[!!] Limit_outlier {} from position {}"_format(limit_outlier,size*0.75));
 	}
 	else
@@ -3335,9 +3363,6 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 	}
     LOGINF("limit_outlier = {}"_format(limit_outlier));
 
-	// Clear set
-	all_mpkil3.clear();
-
 	std::string res;
     // Check if MPKI-L3 of each APP is higher than the limit outlier
     for (const auto &item : v_mpkil3)
@@ -3482,11 +3507,11 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 
 
 		// Set masks to each CLOS
-        LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
-        LinuxBase::get_cat()->set_cbm(2,maskCrCLOS);
+        LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
+        LinuxBase::get_cat()->set_cbm(2,maskCrCLOS, domain);
 
-		num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-        num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
+		num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+        num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
 		assert((num_ways_CLOS_1>0) & (num_ways_CLOS_1<=20));
 		assert((num_ways_CLOS_2>0) & (num_ways_CLOS_2<=20));
 		num_shared_ways = (num_ways_CLOS_2 + num_ways_CLOS_1) - 20;
@@ -3650,7 +3675,7 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 						default:
 							break;
 					}
-					LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated);
+					LinuxBase::get_cat()->set_cbm(CLOS_isolated,mask_isolated, domain);
 					LOGINF("[TEST] CLOS {} has now mask {:x}"_format(CLOS_isolated,mask_isolated));
 				}*/
 
@@ -3670,7 +3695,7 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 					if((!false_critical_app) && (ipcTask < 1.3*ipc_prev))
 					{
 						// Assign app to an isolated CLOS with 2 ways
-						LinuxBase::get_cat()->set_cbm(4,0x0000C);
+						LinuxBase::get_cat()->set_cbm(4,0x0000C, domain);
 						LinuxBase::get_cat()->add_task(4,pidTask);
 						uint64_t c = LinuxBase::get_cat()->get_clos_of_task(pidTask);
 						LOGINF("!!!! TASK {} isolated in CLOS {} !!!"_format(pidTask,c));
@@ -3866,7 +3891,7 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 							if((maskNonCrCLOS == 0x00001) | (maskNonCrCLOS == 0x00000))
 								maskNonCrCLOS = 0x00003;
 							assert(maskNonCrCLOS != 0x00000);
-							LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
+							LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
 							break;
 						case 6:
 							LOGINF("CR-- (Remove one shared way from CLOS with critical apps)");
@@ -3874,17 +3899,17 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 							if((maskCrCLOS == 0x10000) | (maskCrCLOS == 0x00000))
                             	maskCrCLOS = 0x30000;
 							assert(maskCrCLOS != 0x00000);
-							LinuxBase::get_cat()->set_cbm(2,maskCrCLOS);
+							LinuxBase::get_cat()->set_cbm(2,maskCrCLOS, domain);
 							break;
 						case 7:
 							LOGINF("NCR++ (Add one shared way to CLOS with non-critical apps)");
 							maskNonCrCLOS = (maskNonCrCLOS << 1) | maskNonCrCLOS;
-							LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
+							LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
 							break;
 						case 8:
 							LOGINF("CR++ (Add one shared way to CLOS with critical apps)");
 							maskCrCLOS = (maskCrCLOS >> 1) | maskCrCLOS;
-							LinuxBase::get_cat()->set_cbm(2,maskCrCLOS);
+							LinuxBase::get_cat()->set_cbm(2,maskCrCLOS, domain);
 							break;
 						default:
 							break;
@@ -3900,13 +3925,13 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
                             if ((maskNonCrCLOS == 0x10000) | (maskNonCrCLOS == 0x00000))
                             	maskNonCrCLOS = 0x30000;
                             assert(maskNonCrCLOS != 0x00000);
-                            LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
+                            LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
                             break;
 						case 6:
 							LOGINF("NCR++ (Add one shared way to CLOS with non-critical apps)");
                             if(maskNonCrCLOS != 0xfffff)
 								maskNonCrCLOS = (maskNonCrCLOS >> 1) | maskNonCrCLOS;
-                            LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS);
+                            LinuxBase::get_cat()->set_cbm(1,maskNonCrCLOS, domain);
                             break;
 						default:
 							break;
@@ -3915,11 +3940,11 @@ void CriticalAwareV2::apply(uint64_t current_interval, const tasklist_t &tasklis
 
 				if (!idle)
 				{
-					num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1));
-					num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2));
+					num_ways_CLOS_1 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(1, domain));
+					num_ways_CLOS_2 = __builtin_popcount(LinuxBase::get_cat()->get_cbm(2, domain));
 
-					LOGINF("CLOS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1),num_ways_CLOS_1));
-					LOGINF("CLOS 2 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2),num_ways_CLOS_2));
+					LOGINF("CLOS 1 (non-CR) has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(1, domain),num_ways_CLOS_1));
+					LOGINF("CLOS 2 (CR)     has mask {:#x} ({} ways)"_format(LinuxBase::get_cat()->get_cbm(2, domain),num_ways_CLOS_2));
 
 					int64_t aux_ns = (num_ways_CLOS_2 + num_ways_CLOS_1) - 20;
 					num_shared_ways = (aux_ns < 0) ? 0 : aux_ns;
@@ -4003,13 +4028,13 @@ clusters_t Cluster_SF::apply(const tasklist_t &tasklist)
 		uint64_t stalls;
 		try
 		{
-			stalls = acc::sum(task->stats.events.at("cycle_activity.stalls_ldm_pending"));
+			stalls = acc::sum(task->stats.get(stalls_id));
 		}
 		catch (const std::exception &e)
 		{
-			std::string msg = "This policy requires the event 'cycle_activity.stalls_ldm_pending'. The events monitorized are:";
-			for (const auto &kv : task->stats.events)
-				msg += "\n" + kv.first;
+			std::string msg = "This policy requires the event '{}'. The events monitorized are:"_format(stalls_id.name());
+			for (const auto &name : task->stats.get_names())
+				msg += "\n" + name;
 			throw_with_trace(std::runtime_error(msg));
 		}
 		v.push_back(std::make_pair(task->id, stalls));
@@ -4060,14 +4085,14 @@ clusters_t Cluster_KMeans::apply(const tasklist_t &tasklist)
 		double metric;
 		try
 		{
-			metric = acc::rolling_mean(task.stats.events.at(event));
+			metric = task.stats.window(event_id).mean();
 			metric = std::floor(metric * 100 + 0.5) / 100; // Round positive numbers to 2 decimals
 		}
 		catch (const std::exception &e)
 		{
 			std::string msg = "This policy requires the event '{}'. The events monitorized are:"_format(event);
-			for (const auto &kv : task.stats.events)
-				msg += "\n" + kv.first;
+			for (const auto &name : task.stats.get_names())
+				msg += "\n" + name;
 			throw_with_trace(std::runtime_error(msg));
 		}
 
@@ -4215,7 +4240,7 @@ void SquareWave::apply(uint64_t current_interval, const tasklist_t &tasklist)
 	// Adjust ways
 	for (uint32_t clos = 0; clos < waves.size(); clos++)
 	{
-		cbm_t cbm = LinuxBase::get_cat()->get_cbm(clos);
+		cbm_t cbm = LinuxBase::get_cat()->get_cbm(clos, domain);
 		if (current_interval % waves[clos].interval == 0)
 		{
 			if (waves[clos].is_down)
@@ -4227,7 +4252,7 @@ void SquareWave::apply(uint64_t current_interval, const tasklist_t &tasklist)
 				cbm = waves[clos].up;
 			}
 			waves[clos].is_down = !waves[clos].is_down;
-			get_cat()->set_cbm(clos, cbm);
+			get_cat()->set_cbm(clos, cbm, domain);
 		}
 		std::string task_str = "";
 		if (clos < clusters.size())
@@ -2,16 +2,16 @@
 
 #include "cat-policy.hpp"
 #include "cat-linux.hpp"
+#include "outliers.hpp"
+#include "phase-detector.hpp"
+#include "window.hpp"
 
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/max.hpp>
 #include <boost/accumulators/statistics/mean.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
-#include <boost/accumulators/statistics/rolling_window.hpp>
-#include <boost/accumulators/statistics/rolling_variance.hpp>
 #include <set>
-#include <deque>
 
 namespace cat
 {
@@ -42,6 +42,39 @@ class LinuxBase : public Base
 
       // Derived classes should perform their operations here. This base class does nothing by default.
       virtual void apply(uint64_t, const tasklist_t &) {}
+
+      // Role of a CLOS in the partition, which decides its memory bandwidth
+      enum class ClosRole { critical, non_critical, isolated };
+
+      // Memory bandwidth, in percentage, of the isolated CLOSes and of the non-critical one
+      void set_bandwidth_limits(uint32_t _mb_isolated, uint32_t _mb_non_critical)
+      {
+          mb_isolated = _mb_isolated;
+          mb_non_critical = _mb_non_critical;
+      }
+
+      protected:
+
+      uint32_t mb_isolated = 100;
+      uint32_t mb_non_critical = 100;
+      bool mb_warned = false;
+
+      // Called once the masks of the interval are decided. Sets the memory bandwidth of the
+      // CLOSes and logs their ways and bandwidth in one line, so both are decided together.
+      void apply_bandwidth(uint64_t current_interval, const std::map<uint32_t, ClosRole> &roles);
+      // Bandwidth of a CLOS, 100 is not throttled
+      virtual uint32_t bandwidth_of(uint32_t clos, ClosRole role) const;
+
+      // Events used by the policies, resolved once instead of on every interval
+      EventId ev_instructions = EventId("instructions");
+      EventId ev_ipc = EventId("ipc");
+      EventId ev_l3_miss = EventId("mem_load_uops_retired.l3_miss");
+      EventId ev_l3_hit = EventId("mem_load_uops_retired.l3_hit");
+      EventId ev_l3_occup = EventId("intel_cqm/llc_occupancy/");
+      // Derived metrics, the builtin ones of DerivedMetrics
+      EventId ev_mpki_l3 = EventId("mpki_l3");
+      EventId ev_hpki_l3 = EventId("hpki_l3");
+      EventId ev_l3_occup_mb = EventId("l3_occup_mb");
 };
 
 
@@ -55,10 +88,14 @@ class NoPart: public Base
 
 	double expected_IPC = 0;
 
+	EventId ev_instructions = EventId("instructions");
+	EventId ev_cycles = EventId("cycles");
+
     public:
     virtual ~NoPart() = default;
     NoPart(uint64_t _every, std::string _stats) : every(_every), stats(_stats){}
     virtual void apply(uint64_t, const tasklist_t &) override;
+    virtual std::vector<std::string> get_required_events() const override { return {ev_instructions.name(), ev_cycles.name()}; }
 };
 typedef NoPart NP;
 
@@ -93,16 +130,8 @@ class CriticalAware: public LinuxBase
     uint64_t idle_count = IDLE_INTERVALS;
     bool idle = false;
 
-	// Define accumulators
-	typedef acc::accumulator_set<
-		double, acc::stats<
-			acc::tag::rolling_mean,
-			acc::tag::rolling_variance
-		>
-	>
-	ca_accum_t;
-
-	ca_accum_t macc;
+	// Rolling window of the mean MPKI-L3
+	Window macc = Window(10);
 
     //vector to store if task is assigned to critical CLOS
 	typedef std::tuple<pid_t, uint64_t> pair_t;
@@ -116,7 +145,7 @@ class CriticalAware: public LinuxBase
 
 	//typedef std::tuple<pid_t, uint64_t> pair_t
 
-    CriticalAware(uint64_t _every, uint64_t _firstInterval) : every(_every), firstInterval(_firstInterval), macc(acc::tag::rolling_window::window_size = 10u) {}
+    CriticalAware(uint64_t _every, uint64_t _firstInterval) : every(_every), firstInterval(_firstInterval) {}
 
     virtual ~CriticalAware() = default;
 
@@ -128,10 +157,46 @@ class CriticalAware: public LinuxBase
 	double medianV(std::vector<pairD_t> &vec);
 
 	virtual void apply(uint64_t current_interval, const tasklist_t &tasklist);
+	virtual std::vector<std::string> get_required_events() const override { return {ev_instructions.name(), "cycles", ev_l3_miss.name(), ev_l3_occup.name()}; }
 
 };
 typedef CriticalAware CA;
 
+
+// Critical-Aware with Code and Data Prioritization. When a critical task has a
+// large code footprint, the highest 'code_ways' ways of the critical CLOS are
+// only for its code, the non-critical CLOS cannot put code there, while the data
+// ways are shared as Critical-Aware decides. Without CDP it is Critical-Aware.
+class CriticalAwareCode: public CriticalAware
+{
+	protected:
+
+	uint32_t code_ways;
+	double code_mpki;        // L2 code misses per kilo instruction of the code heavy tasks
+	bool code_split = false; // The code ways are dedicated
+	bool warned = false;
+
+	EventId ev_code_miss = EventId("l2_rqsts.code_rd_miss");
+
+	void split_code_ways(const tasklist_t &tasklist);
+
+	public:
+
+	CriticalAwareCode(uint64_t _every, uint64_t _firstInterval, uint32_t _code_ways, double _code_mpki) :
+			CriticalAware(_every, _firstInterval), code_ways(_code_ways), code_mpki(_code_mpki) {}
+
+	virtual ~CriticalAwareCode() = default;
+
+	virtual void apply(uint64_t current_interval, const tasklist_t &tasklist) override;
+	virtual std::vector<std::string> get_required_events() const override
+	{
+		auto events = CriticalAware::get_required_events();
+		events.push_back(ev_code_miss.name());
+		return events;
+	}
+};
+typedef CriticalAwareCode CAC;
+
 class CriticalAwareV4: public LinuxBase
 {
     protected:
@@ -180,15 +245,14 @@ class CriticalAwareV4: public LinuxBase
 	};
 
 	// dictionary holding up to windowsize[taskID] last MPKIL3 valid (non-spike) values
-    std::map<uint32_t, std::deque<double>> valid_mpkil3;
+    std::map<uint32_t, Window> valid_mpkil3;
 
-    // dictionaries holdind phase info for each task
-	std::map<uint32_t, uint64_t> ipc_phase_count;
-    std::map<uint32_t, uint64_t> ipc_phase_duration;
-	std::map<uint32_t, uint64_t> bully_counter;
+	// All the valid MPKIL3 values of an interval, to compute the limit of the outliers
+	OrderStats mpkil3_values;
 
-    // dictionary holding sum of MPKIL3 of each application during a given phase
-	std::map<uint32_t, double> ipc_sumXij;
+    // IPC phases of each task
+	PhaseDetector ipc_phases;
+	std::map<uint32_t, uint64_t> bully_counter;
 
 	// Set to true if app has HPKIL3 low and high MPKIL3
 	// In order for next interval to not contaminate
@@ -226,7 +290,7 @@ class CriticalAwareV4: public LinuxBase
 
 	//typedef std::tuple<pid_t, uint64_t> pair_t
 
-    CriticalAwareV4(uint64_t _every, uint64_t _firstInterval, uint64_t _IDLE_INTERVALS, double _ipc_threshold, double _ipc_ICOV_threshold) : every(_every), firstInterval(_firstInterval),IDLE_INTERVALS(_IDLE_INTERVALS), ipc_threshold(_ipc_threshold), ipc_ICOV_threshold(_ipc_ICOV_threshold) {}
+    CriticalAwareV4(uint64_t _every, uint64_t _firstInterval, uint64_t _IDLE_INTERVALS, double _ipc_threshold, double _ipc_ICOV_threshold) : every(_every), firstInterval(_firstInterval),IDLE_INTERVALS(_IDLE_INTERVALS), ipc_threshold(_ipc_threshold), ipc_ICOV_threshold(_ipc_ICOV_threshold), ipc_phases(PhaseDetector::Algorithm::icov, _ipc_ICOV_threshold) {}
 
     virtual ~CriticalAwareV4() = default;
 
@@ -234,7 +298,9 @@ class CriticalAwareV4: public LinuxBase
 	void update_configuration(std::vector<pair_t> v, std::vector<pair_t> status, uint64_t num_critical_old, uint64_t num_critical_new);
 	void include_application(uint32_t taskID, pid_t taskPID, std::vector<pair_t>::iterator it, uint64_t CLOSvalue);
 	void isolate_application(uint32_t taskID, pid_t taskPID, std::vector<pair_t>::iterator it);
+	std::map<uint32_t, ClosRole> clos_roles() const;
 	virtual void apply(uint64_t current_interval, const tasklist_t &tasklist);
+	virtual std::vector<std::string> get_required_events() const override { return {ev_instructions.name(), "cycles", ev_l3_miss.name(), ev_l3_hit.name(), ev_l3_occup.name()}; }
 
 };
 typedef CriticalAwareV4 CAV4;
@@ -296,13 +362,13 @@ class CriticalPhaseAware: public LinuxBase
 	std::set<uint32_t> CLOS_critical = {2, 3, 4};
 
 	// Dictionary holding up to windowsize[taskID] last MPKIL3 valid (non-spike) values
-    std::map<uint32_t, std::deque<double>> valid_mpkil3;
+    std::map<uint32_t, Window> valid_mpkil3;
 
-    // Dictionaries holdind phase info for each task
-	std::map<uint32_t, uint64_t> ipc_phase_count;
-	std::map<uint32_t, uint64_t> ipc_phase_duration;
-	// Dictionary holding sum of MPKIL3 of each application during a given phase
-	std::map<uint32_t, double> ipc_sumXij;
+	// All the valid MPKIL3 values of an interval, to compute the limit of the outliers
+	OrderStats mpkil3_values;
+
+    // IPC phases of each task
+	PhaseDetector ipc_phases;
 
 	// Dictionary and bool variable to indicate in critical app / space has been reduced
 	std::map<uint32_t, uint64_t> limit_task;
@@ -337,7 +403,7 @@ class CriticalPhaseAware: public LinuxBase
 
     public:
 
-    CriticalPhaseAware(uint64_t _every, uint64_t _firstInterval, uint64_t _idleIntervals, double _ipcMedium, double _ipcLow, double _icov, double _hpkil3Limit) : every(_every), firstInterval(_firstInterval), idleIntervals(_idleIntervals), ipcLow(_ipcLow), ipcMedium(_ipcMedium), icov(_icov), hpkil3Limit(_hpkil3Limit) {}
+    CriticalPhaseAware(uint64_t _every, uint64_t _firstInterval, uint64_t _idleIntervals, double _ipcMedium, double _ipcLow, double _icov, double _hpkil3Limit) : every(_every), firstInterval(_firstInterval), idleIntervals(_idleIntervals), ipcLow(_ipcLow), ipcMedium(_ipcMedium), icov(_icov), hpkil3Limit(_hpkil3Limit), ipc_phases(PhaseDetector::Algorithm::icov, _icov) {}
 
     virtual ~CriticalPhaseAware() = default;
 
@@ -353,6 +419,7 @@ class CriticalPhaseAware: public LinuxBase
 	uint32_t get_ways_critical();
 	uint32_t get_ways_noncritical();
 	virtual void apply(uint64_t current_interval, const tasklist_t &tasklist);
+	virtual std::vector<std::string> get_required_events() const override { return {ev_instructions.name(), "cycles", ev_l3_miss.name(), ev_l3_hit.name(), ev_l3_occup.name()}; }
 
 };
 typedef CriticalPhaseAware CPA;
@@ -449,85 +516,6 @@ class CriticalAwareV2: public LinuxBase
 
 
 
-	// Table with values of Kn
-	std::map<uint64_t, double> kn_table = {
-		{ 5, 1.65798 },
-		{ 6, 1.28351 },
-		{ 7, 1.51475 },
-		{ 8, 1.32505 },
-		{ 9, 1.50427 },
-		{ 10, 1.31212 },
-		{ 11, 1.45768 },
-		{ 12, 1.32968 },
-		{ 13, 1.45268 },
-		{ 14, 1.32353 },
-		{ 15, 1.42975 },
-		{ 16, 1.33318 },
-		{ 17, 1.42684 },
-		{ 18, 1.32959 },
-		{ 19, 1.41322 },
-		{ 20, 1.33568 },
-		{ 21, 1.41132 },
-		{ 22, 1.33333 },
-		{ 23, 1.4023 },
-		{ 24, 1.33753 },
-		{ 25, 1.40096 },
-		{ 26, 1.33587 },
-		{ 27, 1.39455 },
-		{ 28, 1.33894 },
-		{ 29, 1.39355 },
-		{ 30, 1.3377 },
-		{ 31, 1.38876 },
-		{ 32, 1.34004 },
-		{ 33, 1.38799 },
-		{ 34, 1.33909 },
-		{ 35, 1.38428 },
-		{ 36, 1.34092 },
-		{ 37, 1.38367 },
-		{ 38, 1.34017 },
-		{ 39, 1.38071 },
-		{ 40, 1.34165 },
-		{ 41, 1.38021 },
-		{ 42, 1.34104 },
-		{ 43, 1.37779 },
-		{ 44, 1.34226 },
-		{ 45, 1.37737 },
-		{ 46, 1.34175 },
-		{ 47, 1.37536 },
-		{ 48, 1.34278 },
-		{ 49, 1.37501 },
-		{ 50, 1.34235 },
-		{ 51, 1.37331 },
-		{ 52, 1.34322 },
-		{ 53, 1.37301 },
-		{ 54, 1.34285 },
-		{ 55, 1.37156 },
-		{ 56, 1.34361 },
-		{ 57, 1.3713 },
-		{ 58, 1.34329 },
-		{ 59, 1.37004 },
-		{ 60, 1.34394 },
-		{ 61, 1.36981 },
-		{ 62, 1.34366 },
-		{ 63, 1.36871 },
-		{ 64, 1.34424 },
-		{ 65, 1.36851 },
-		{ 66, 1.34399 },
-		{ 67, 1.36754 },
-		{ 68, 1.3445 },
-		{ 69, 1.36737 },
-        { 70, 1.34429 },
-		{ 71, 1.3665 },
-		{ 72, 1.34474 },
-		{ 73, 1.36635 },
-		{ 74, 1.34454 },
-		{ 75, 1.36557 },
-		{ 76, 1.34495 },
-		{ 77, 1.36543 },
-		{ 78, 1.34478 },
-		{ 79, 1.36474 },
-		{ 80, 1.34514 }
-    };
 
 
 	// Maximum value of MPKI-L3 in the current interval
@@ -547,7 +535,11 @@ class CriticalAwareV2: public LinuxBase
 	//std::map<uint32_t, std::deque<double>> deque_mpkil3;
 
 	// dictionary holding up to windowsize[taskID] last MPKIL3 valid (non-spike) values
-	std::map<uint32_t, std::deque<double>> valid_mpkil3;
+	std::map<uint32_t, Window> valid_mpkil3;
+
+	// All the valid MPKIL3 values of an interval, and the limits of the outliers computed from them
+	OrderStats mpkil3_values;
+	OrderStats outlier_limits;
 
 	// dictionaries holdind phase info for each task
 	std::map<uint32_t, uint64_t> phase_count;
@@ -579,12 +571,12 @@ class CriticalAwareV2: public LinuxBase
     virtual ~CriticalAwareV2() = default;
 
 
-	double medianV(std::set<double> vec);
 
     //configure CAT
     void update_configuration(std::vector<pair_t> v, std::vector<pair_t> status, uint64_t num_critical_old, uint64_t num_critical_new);
 
     virtual void apply(uint64_t current_interval, const tasklist_t &tasklist);
+    virtual std::vector<std::string> get_required_events() const override { return {ev_instructions.name(), "cycles", ev_l3_miss.name(), ev_l3_hit.name(), ev_l3_occup.name()}; }
 
 };
 typedef CriticalAwareV2 CAV2;
@@ -624,6 +616,7 @@ class Cluster_SF: public ClusteringBase
 
 	int m;
 	std::vector<int> sizes;
+	EventId stalls_id = EventId("cycle_activity.stalls_ldm_pending");
 
 	Cluster_SF(const std::vector<int> &_sizes) : sizes(_sizes) {}
 	virtual ~Cluster_SF() = default;
@@ -640,11 +633,12 @@ class Cluster_KMeans: public ClusteringBase
 	int max_clusters;
 	EvalClusters eval_clusters;
 	std::string event;
+	EventId event_id;
 	bool sort_ascending;
 
 	Cluster_KMeans(int _num_clusters, int _max_clusters, EvalClusters _eval_clusters, std::string _event, bool _sort_ascending) :
 			num_clusters(_num_clusters), max_clusters(_max_clusters),
-			eval_clusters(_eval_clusters), event(_event),
+			eval_clusters(_eval_clusters), event(_event), event_id(_event),
 			sort_ascending(_sort_ascending) {}
 	virtual ~Cluster_KMeans() = default;
 
@@ -1,7 +1,11 @@
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include <fmt/format.h>
+#include <signal.h>
 
 #include "cat-linux.hpp"
 #include "common.hpp"
@@ -9,10 +13,6 @@
 #include "throw-with-trace.hpp"
 
 
-#define ROOT "/sys/fs/resctrl"
-#define INFO_DIR ROOT "/info"
-
-
 namespace fs = boost::filesystem;
 
 using std::string;
@@ -20,15 +20,77 @@ using std::vector;
 using fmt::literals::operator""_format;
 
 
+// Values of the line of a resource in a schemata file, e.g. 'L3:0=fffff;1=fffff', by domain id.
+// The masks are in hexadecimal and the bandwidths of MB in decimal.
+static
+std::map<uint32_t, uint64_t> read_schemata(const fs::path &path, const std::string &resource, int base = 16)
+{
+	std::ifstream f = open_ifstream(path);
+	f.exceptions(std::ifstream::badbit); // Reading until the end sets the failbit
+	string line;
+	while (std::getline(f, line))
+	{
+		// Some kernels align the resources with leading spaces
+		line.erase(0, line.find_first_not_of(' '));
+		if (line.compare(0, resource.size() + 1, resource + ":"))
+			continue;
+
+		auto result = std::map<uint32_t, uint64_t>();
+		std::istringstream domains(line.substr(resource.size() + 1));
+		string domain;
+		while (std::getline(domains, domain, ';'))
+		{
+			const auto eq = domain.find('=');
+			if (eq == string::npos)
+				throw_with_trace(std::runtime_error("Invalid schemata '{}' in '{}'"_format(line, path.string())));
+			result[std::stoul(domain.substr(0, eq))] = std::stoull(domain.substr(eq + 1), nullptr, base);
+		}
+		return result;
+	}
+	throw_with_trace(std::runtime_error("There is no {} schemata in '{}'"_format(resource, path.string())));
+}
+
+
+static
+bool is_l3(const CATInfo &resource)
+{
+	return resource.cache.compare(0, 2, "L3") == 0;
+}
+
+
+// Besides the CLOS, the root has the info directory and, with monitoring, the mon_groups and mon_data ones
+static
+bool is_clos_dir(const fs::path &p)
+{
+	const auto name = p.filename().string();
+	return fs::is_directory(p) && name != "info" && name != "mon_groups" && name != "mon_data";
+}
+
+
+const std::string CATLinux::default_root = "/sys/fs/resctrl";
+
+
 std::map<std::string, CATInfo> cat_read_info()
 {
+	return cat_read_info(CATLinux::default_root);
+}
+
+
+std::map<std::string, CATInfo> cat_read_info(const std::string &root)
+{
+	const auto info_dir = fs::path(root) / "info";
 	std::map<string, CATInfo> info;
-	for(auto &p: fs::directory_iterator(INFO_DIR))
+	for(auto &p: fs::directory_iterator(info_dir))
 	{
+		// Monitoring and memory bandwidth allocation do not have masks
+		if (!fs::exists(p.path() / "cbm_mask"))
+			continue;
+
 		string cache = fs::basename(p);
 		uint64_t cbm_mask;
 		uint32_t min_cbm_bits;
 		uint32_t num_closids;
+		auto domains = vector<uint32_t>();
 
 		try
 		{
@@ -39,22 +101,87 @@ std::map<std::string, CATInfo> cat_read_info()
 			f >> min_cbm_bits;
 			f = open_ifstream(p / "num_closids");
 			f >> num_closids;
+			// The domains are the caches listed in the schemata of the root group
+			for (const auto &d : read_schemata(fs::path(root) / "schemata", cache))
+				domains.push_back(d.first);
 		}
 		catch(const std::system_error &e)
 		{
-			throw_with_trace(std::runtime_error("Cannot read CAT info '{}': {}"_format(INFO_DIR, strerror(errno))));
+			throw_with_trace(std::runtime_error("Cannot read CAT info '{}': {}"_format(info_dir.string(), strerror(errno))));
 		}
 
-		info[cache] = CATInfo(cache, cbm_mask, min_cbm_bits, num_closids);
+		info[cache] = CATInfo(cache, cbm_mask, min_cbm_bits, num_closids, domains);
+	}
+	return info;
+}
+
+
+std::map<std::string, MBAInfo> mba_read_info()
+{
+	return mba_read_info(CATLinux::default_root);
+}
+
+
+std::map<std::string, MBAInfo> mba_read_info(const std::string &root)
+{
+	const auto dir = fs::path(root) / "info" / "MB";
+	std::map<string, MBAInfo> info;
+	if (!fs::exists(dir))
+		return info;
+
+	uint32_t min_bandwidth;
+	uint32_t bandwidth_gran;
+	uint32_t num_closids;
+	auto domains = vector<uint32_t>();
+	try
+	{
+		std::ifstream f;
+		f = open_ifstream(dir / "min_bandwidth");
+		f >> min_bandwidth;
+		f = open_ifstream(dir / "bandwidth_gran");
+		f >> bandwidth_gran;
+		f = open_ifstream(dir / "num_closids");
+		f >> num_closids;
+		for (const auto &d : read_schemata(fs::path(root) / "schemata", "MB", 10))
+			domains.push_back(d.first);
+	}
+	catch(const std::system_error &e)
+	{
+		throw_with_trace(std::runtime_error("Cannot read MBA info '{}': {}"_format(dir.string(), strerror(errno))));
 	}
+
+	info["MB"] = MBAInfo(min_bandwidth, bandwidth_gran, num_closids, domains);
 	return info;
 }
 
 
-void CATLinux::set_schemata(fs::path clos_dir, uint64_t mask)
+// The domains that are not written keep their masks
+void CATLinux::set_schemata(fs::path clos_dir, const CATInfo &resource, uint64_t mask, uint32_t domain)
+{
+	std::string schemata = resource.cache + ":";
+	for (const auto &d : resource.domains)
+		if (domain == all_domains || domain == d)
+			schemata += "{}{}={:x}"_format(schemata.back() == ':' ? "" : ";", d, mask);
+	write_schemata(clos_dir, schemata);
+}
+
+
+void CATLinux::set_mb_schemata(fs::path clos_dir, uint32_t percent, uint32_t domain)
+{
+	std::string schemata = "MB:";
+	for (const auto &d : mba.domains)
+		if (domain == all_domains || domain == d)
+			schemata += "{}{}={}"_format(schemata.back() == ':' ? "" : ";", d, percent);
+	write_schemata(clos_dir, schemata);
+}
+
+
+void CATLinux::write_schemata(fs::path clos_dir, const std::string &schemata)
 {
 	assert_dir_exists(clos_dir);
-	const std::string schemata = "{}:0={:x}"_format(info.cache, mask);
+	if (fake)
+		return fake->write_schemata(clos_dir, schemata);
+
 	std::ofstream f;
 	try
 	{
@@ -71,44 +198,82 @@ void CATLinux::set_schemata(fs::path clos_dir, uint64_t mask)
 	}
 	catch(const std::system_error &e)
 	{
-		throw_with_trace(std::runtime_error("Could not set the cmb '0x{:x}' in clos '{}'"_format(mask, clos_dir.string())));
+		throw_with_trace(std::runtime_error("Could not set the schemata '{}' in clos '{}'"_format(schemata, clos_dir.string())));
 	}
 }
 
 
-uint64_t CATLinux::get_schemata(fs::path clos_dir) const
+std::vector<uint64_t> CATLinux::get_schemata(fs::path clos_dir, const CATInfo &resource) const
 {
-	uint64_t schemata;
+	std::map<uint32_t, uint64_t> masks;
 
 	assert_dir_exists(clos_dir);
 	try
 	{
-		std::ifstream f = open_ifstream(clos_dir / "schemata");
-		f.ignore(std::numeric_limits<std::streamsize>::max(), '=');
-		f >> std::hex >> schemata;
+		masks = read_schemata(clos_dir / "schemata", resource.cache);
 	}
 	catch(const std::system_error &e)
 	{
 		throw_with_trace(std::runtime_error("Cannot get schemata of CLOS '{}': {}"_format(clos_dir.string(), strerror(errno))));
 	}
 
+	auto schemata = vector<uint64_t>();
+	for (const auto &d : resource.domains)
+	{
+		auto it = masks.find(d);
+		if (it == masks.end())
+			throw_with_trace(std::runtime_error("The {} schemata of CLOS '{}' has no mask for the domain {}"_format(resource.cache, clos_dir.string(), d)));
+		schemata.push_back(it->second);
+	}
+	return schemata;
+}
+
+
+std::vector<uint32_t> CATLinux::get_mb_schemata(fs::path clos_dir) const
+{
+	std::map<uint32_t, uint64_t> values;
+
+	assert_dir_exists(clos_dir);
+	try
+	{
+		values = read_schemata(clos_dir / "schemata", "MB", 10);
+	}
+	catch(const std::system_error &e)
+	{
+		throw_with_trace(std::runtime_error("Cannot get the MB schemata of CLOS '{}': {}"_format(clos_dir.string(), strerror(errno))));
+	}
+
+	auto schemata = vector<uint32_t>();
+	for (const auto &d : mba.domains)
+	{
+		auto it = values.find(d);
+		if (it == values.end())
+			throw_with_trace(std::runtime_error("The MB schemata of CLOS '{}' has no bandwidth for the domain {}"_format(clos_dir.string(), d)));
+		schemata.push_back(it->second);
+	}
 	return schemata;
 }
 
 
 void CATLinux::create_clos(std::string clos)
 {
-	auto path = fs::path(ROOT) / clos;
+	auto path = fs::path(root) / clos;
 	if (fs::exists(path))
 		throw_with_trace(std::runtime_error("Cannot create CLOS: directory {} already exists"_format(path.string())));
 
-	fs::create_directory(path);
+	if (fake)
+		fake->mkdir(path);
+	else
+		fs::create_directory(path);
 }
 
 
 void CATLinux::set_cpus(fs::path clos_dir, uint64_t cpu_mask)
 {
 	assert_dir_exists(clos_dir);
+	if (fake)
+		return fake->write_cpus(clos_dir, cpu_mask);
+
 	std::ofstream f = open_ofstream(clos_dir / "cpus");
 	f << std::hex << cpu_mask << std::endl;
 }
@@ -127,11 +292,11 @@ uint64_t CATLinux::get_cpus(fs::path clos_dir) const
 fs::path CATLinux::get_clos_dir(uint32_t cpu) const
 {
 	uint64_t cpu_mask = 1ULL << cpu;
-	if (get_cpus(fs::path(ROOT)) & cpu_mask)
-		return fs::path(ROOT);
+	if (get_cpus(fs::path(root)) & cpu_mask)
+		return fs::path(root);
 
-	for(auto &p: fs::directory_iterator(ROOT))
-		if (fs::is_directory(p) && fs::basename(p) != "info")
+	for(auto &p: fs::directory_iterator(root))
+		if (is_clos_dir(p))
 			if (get_cpus(p) & cpu_mask)
 				return p;
 	throw_with_trace(std::runtime_error("CPU {} is not in any CLOS, does it exist?"));
@@ -141,8 +306,8 @@ fs::path CATLinux::get_clos_dir(uint32_t cpu) const
 std::vector<fs::path> CATLinux::get_clos_dirs() const
 {
 	auto result = std::vector<fs::path>();
-	for(auto &p: fs::directory_iterator(ROOT))
-		if (fs::is_directory(p) && fs::basename(p) != "info")
+	for(auto &p: fs::directory_iterator(root))
+		if (is_clos_dir(p))
 			result.push_back(p);
 	return result;
 }
@@ -163,42 +328,89 @@ std::vector<std::string> CATLinux::get_tasks(fs::path clos_dir) const
 }
 
 
-void CATLinux::add_task(fs::path clos_dir, pid_t pid)
+std::vector<pid_t> CATLinux::add_task(fs::path clos_dir, pid_t pid)
 {
+	auto pids = std::vector<pid_t>(1, pid);
 	assert_dir_exists(clos_dir);
 	try
 	{
-		std::ofstream f = open_ofstream(clos_dir / "tasks");
-		f << pid << std::endl;
-		auto children = std::vector<pid_t>();
-		pid_get_children_rec(pid, children);
-		for (const auto &child_pid : children)
-			f << child_pid << std::endl;
+		if (fake)
+		{
+			pid_get_children_rec(pid, pids);
+			fake->write_tasks(clos_dir, pids);
+		}
+		else
+		{
+			std::ofstream f = open_ofstream(clos_dir / "tasks");
+			f << pid << std::endl;
+			pid_get_children_rec(pid, pids);
+			for (size_t i = 1; i < pids.size(); i++)
+				f << pids[i] << std::endl;
+		}
 	}
 	catch(const std::system_error &e)
 	{
 		throw_with_trace(std::runtime_error("Cannot write pid '{}' into '{}'"_format(pid, (clos_dir / "tasks").string())));
 	}
+	if (monitor)
+		monitor->move(pids, clos_dir.string());
+	return pids;
 }
 
 
 void CATLinux::add_task(uint32_t clos, pid_t pid)
 {
-	add_task(intel_to_linux(clos), pid);
+	{
+		std::lock_guard<std::mutex> lock(model_mtx);
+		if (staging())
+		{
+			if (clos >= get_max_closids())
+				throw_with_trace(std::runtime_error("CLOS {} does not exist"_format(clos)));
+			if (clos == 0)
+				pending->task_clos.erase(pid);
+			else
+				pending->task_clos[pid] = clos;
+			staged.tasks.insert(pid);
+			return;
+		}
+	}
+
+	const auto pids = add_task(intel_to_linux(clos), pid);
+
+	std::lock_guard<std::mutex> lock(model_mtx);
+	for (const auto &p : pids)
+	{
+		if (clos == 0)
+			model.task_clos.erase(p);
+		else
+			model.task_clos[p] = clos;
+	}
 }
 
 
 void CATLinux::add_tasks(uint32_t clos, const std::vector<pid_t> &pids)
 {
 	for (const auto &pid : pids)
-		add_task(intel_to_linux(clos), pid);
+		add_task(clos, pid);
 }
 
 
 void CATLinux::remove_task(std::string task)
 {
-	std::ofstream f = open_ofstream(fs::path(ROOT) / "tasks");
-	f << task << std::endl;
+	if (fake)
+		fake->write_tasks(root, {std::stoi(task)});
+	else
+	{
+		std::ofstream f = open_ofstream(fs::path(root) / "tasks");
+		f << task << std::endl;
+	}
+	if (monitor)
+		monitor->move({std::stoi(task)}, root);
+
+	// The task has exited, a move staged for it can no longer be written
+	std::lock_guard<std::mutex> lock(model_mtx);
+	model.task_clos.erase(std::stoi(task));
+	staged.tasks.erase(std::stoi(task));
 }
 
 
@@ -208,7 +420,10 @@ void CATLinux::delete_clos(fs::path clos_dir)
 {
 	if (!fs::exists(clos_dir))
 		throw_with_trace(std::runtime_error("The COS " + clos_dir.string() + " does not exist"));
-	fs::remove(clos_dir);
+	if (fake)
+		fake->rmdir(clos_dir);
+	else
+		fs::remove(clos_dir);
 }
 
 
@@ -218,8 +433,8 @@ void CATLinux::delete_clos(fs::path clos_dir)
 void CATLinux::delete_all_clos()
 {
 	auto to_remove = vector<fs::path>();
-	for(const auto &p: fs::directory_iterator(ROOT))
-		if (fs::is_directory(p) && fs::basename(p) != "info")
+	for(const auto &p: fs::directory_iterator(root))
+		if (is_clos_dir(p))
 			to_remove.push_back(p);
 	for(const auto &p: to_remove)
 		delete_clos(p);
@@ -236,64 +451,345 @@ void CATLinux::create_all_clos()
 fs::path CATLinux::intel_to_linux(uint32_t clos) const
 {
 	if (clos == 0)
-		return fs::path(ROOT);
+		return fs::path(root);
 	else
-		return fs::path(ROOT) / std::to_string(clos);
+		return fs::path(root) / std::to_string(clos);
+}
+
+
+CATLinux& CATLinux::operator=(const CATLinux &o)
+{
+	if (this == &o)
+		return *this;
+
+	Model m = o.get_model();
+	CAT::operator=(o);
+	root = o.root;
+	fake = o.fake;
+	resources = o.resources;
+	info = o.info;
+	mba = o.mba;
+	monitor = o.monitor;
+	reconcile_every = o.reconcile_every;
+
+	std::lock_guard<std::mutex> lock(model_mtx);
+	model = std::move(m);
+	return *this;
+}
+
+
+CATLinux::Model CATLinux::get_model() const
+{
+	std::lock_guard<std::mutex> lock(model_mtx);
+	return model;
+}
+
+
+// Every mask complete and no cpus
+CATLinux::Model CATLinux::default_model() const
+{
+	Model m;
+	for (const auto &r : resources)
+		m.cbms.push_back(vector<vector<uint64_t>>(get_max_closids(), vector<uint64_t>(r.domains.size(), r.cbm_mask)));
+	m.cpus.assign(get_max_closids(), 0);
+	m.mb.assign(get_max_closids(), vector<uint32_t>(mba.domains.size(), 100));
+	return m;
+}
+
+
+// Only the tasks of the CLOS other than 0 are stored, the root group has every task in the system
+CATLinux::Model CATLinux::read_model() const
+{
+	Model m = default_model();
+	for (uint32_t clos = 0; clos < get_max_closids(); clos++)
+	{
+		const auto dir = intel_to_linux(clos);
+		if (!fs::exists(dir))
+			continue;
+		for (size_t r = 0; r < resources.size(); r++)
+			m.cbms[r][clos] = get_schemata(dir, resources[r]);
+		if (has_mba())
+			m.mb[clos] = get_mb_schemata(dir);
+		m.cpus[clos] = get_cpus(dir);
+		if (clos == 0)
+			continue;
+		for (const auto &task : get_tasks(dir))
+			m.task_clos[std::stoi(task)] = clos;
+	}
+	return m;
 }
 
 
 void CATLinux::init()
 {
 	initialized = true;
-	auto infomap = cat_read_info();
-	info = infomap["L3"];
+	fake.reset();
+	if (FakeResctrl::is_fake(root))
+	{
+		fake = std::make_shared<FakeResctrl>(root);
+		LOGWAR("Using the fake resctrl in '{}', with {} us per write"_format(root, fake->get_latency_us()));
+	}
+	auto infomap = cat_read_info(root);
+
+	// The resources of the L3 first, the kernel has either the unified one or the code and data ones
+	resources.clear();
+	string names;
+	for (const string name : {"L3", "L3DATA", "L3CODE", "L2", "L2DATA", "L2CODE"})
+	{
+		if (!infomap.count(name))
+			continue;
+		resources.push_back(infomap[name]);
+		names += (names.empty() ? "" : ", ") + name;
+	}
+	if (resources.empty() || !is_l3(resources.front()))
+		throw_with_trace(std::runtime_error("There is no L3 cache allocation in resctrl"));
+
+	auto mbamap = mba_read_info(root);
+	mba = mbamap.count("MB") ? mbamap["MB"] : MBAInfo();
+	if (has_mba())
+		names += ", MB";
+
+	// A CLOS needs to exist in every resource
+	info = resources.front();
+	for (const auto &r : resources)
+		info.num_closids = std::min(info.num_closids, r.num_closids);
+	if (has_mba())
+		info.num_closids = std::min(info.num_closids, mba.num_closids);
+	LOGINF("CAT resources: {}, with {} CLOS"_format(names, info.num_closids));
+
+	{
+		std::lock_guard<std::mutex> lock(model_mtx);
+		model = default_model();
+	}
 	reset();
 	create_all_clos();
+
+	auto m = read_model();
+	std::lock_guard<std::mutex> lock(model_mtx);
+	model = std::move(m);
 }
 
 
 void CATLinux::reset()
 {
+	rollback();
 	delete_all_clos();
 
 	create_all_clos();
 
 	// Reset all CBMs (this should be automatic, but it's not)
-	for (uint32_t i = 0; i < get_max_closids(); i++)
-		set_cbm(i, info.cbm_mask);
+	for (size_t r = 0; r < resources.size(); r++)
+		for (uint32_t i = 0; i < get_max_closids(); i++)
+			set_cbm_at(r, i, resources[r].cbm_mask, all_domains);
+	if (has_mba())
+		for (uint32_t i = 0; i < get_max_closids(); i++)
+			set_mb(i, 100, all_domains);
 
 	delete_all_clos();
+
+	// The tasks and cpus of the deleted groups are back in the root group
+	auto m = read_model();
+	std::lock_guard<std::mutex> lock(model_mtx);
+	model = std::move(m);
+}
+
+
+// The kernel checks the masks when they are written, staged masks are checked here
+void CATLinux::check_cbm(size_t r, uint32_t clos, uint64_t cbm) const
+{
+	const auto &resource = resources[r];
+	if (clos >= get_max_closids())
+		throw_with_trace(std::runtime_error("CLOS {} does not exist"_format(clos)));
+	const uint64_t shifted = cbm ? cbm >> __builtin_ctzll(cbm) : 0;
+	if (cbm == 0 || (cbm & ~resource.cbm_mask) || (uint32_t) __builtin_popcountll(cbm) < resource.min_cbm_bits || (shifted & (shifted + 1)))
+		throw_with_trace(std::runtime_error("Invalid {} cbm 0x{:x} for CLOS {}"_format(resource.cache, cbm, clos)));
+}
+
+
+size_t CATLinux::resource_index(const std::string &resource) const
+{
+	for (size_t r = 0; r < resources.size(); r++)
+		if (resources[r].cache == resource)
+			return r;
+	throw_with_trace(std::runtime_error("There is no {} resource in resctrl"_format(resource)));
+}
+
+
+// Position of the domain in the model, 'all_domains' is the first one
+static
+size_t find_domain(const std::vector<uint32_t> &domains, uint32_t domain, const std::string &resource)
+{
+	if (domain == CAT::all_domains && !domains.empty())
+		return 0;
+	auto it = std::find(domains.begin(), domains.end(), domain);
+	if (it == domains.end())
+		throw_with_trace(std::runtime_error("Domain {} of {} does not exist"_format(domain, resource)));
+	return it - domains.begin();
+}
+
+
+size_t CATLinux::domain_index(size_t r, uint32_t domain) const
+{
+	return find_domain(resources[r].domains, domain, resources[r].cache);
+}
+
+
+void CATLinux::set_cbm_at(size_t r, uint32_t clos, uint64_t cbm, uint32_t domain)
+{
+	const size_t first = domain_index(r, domain);
+	const size_t last = domain == all_domains ? resources[r].domains.size() : first + 1;
+	{
+		std::lock_guard<std::mutex> lock(model_mtx);
+		if (staging())
+		{
+			check_cbm(r, clos, cbm);
+			auto &cbms = pending->cbms[r][clos];
+			std::fill(cbms.begin() + first, cbms.begin() + last, cbm);
+			for (size_t d = first; d < last; d++)
+				staged.cbms.emplace(r, clos, d);
+			return;
+		}
+	}
+
+	set_schemata(intel_to_linux(clos), resources[r], cbm, domain);
+
+	std::lock_guard<std::mutex> lock(model_mtx);
+	auto &cbms = model.cbms[r].at(clos);
+	std::fill(cbms.begin() + first, cbms.begin() + last, cbm);
+}
+
+
+uint64_t CATLinux::get_cbm_at(size_t r, uint32_t clos, uint32_t domain) const
+{
+	const size_t d = domain_index(r, domain);
+	std::lock_guard<std::mutex> lock(model_mtx);
+	if (clos >= view().cbms[r].size())
+		throw_with_trace(std::runtime_error("CLOS {} does not exist"_format(clos)));
+	return view().cbms[r][clos][d];
+}
+
+
+void CATLinux::set_cbm(uint32_t clos, uint64_t cbm, uint32_t domain)
+{
+	for (size_t r = 0; r < resources.size() && is_l3(resources[r]); r++)
+		set_cbm_at(r, clos, cbm, domain);
+}
+
+
+uint64_t CATLinux::get_cbm(uint32_t clos, uint32_t domain) const
+{
+	return get_cbm_at(0, clos, domain);
+}
+
+
+uint32_t CATLinux::check_mb(uint32_t clos, uint32_t percent) const
+{
+	if (!has_mba())
+		throw_with_trace(std::runtime_error("There is no Memory Bandwidth Allocation in resctrl"));
+	if (clos >= get_max_closids())
+		throw_with_trace(std::runtime_error("CLOS {} does not exist"_format(clos)));
+	if (percent < mba.min_bandwidth || percent > 100)
+		throw_with_trace(std::runtime_error("Invalid bandwidth {}% for CLOS {}, it must be between {}% and 100%"_format(percent, clos, mba.min_bandwidth)));
+	const uint32_t gran = std::max(mba.bandwidth_gran, 1U);
+	return std::min((percent + gran - 1) / gran * gran, 100U);
+}
+
+
+void CATLinux::set_mb(uint32_t clos, uint32_t percent, uint32_t domain)
+{
+	const uint32_t value = check_mb(clos, percent);
+	const size_t first = find_domain(mba.domains, domain, "MB");
+	const size_t last = domain == all_domains ? mba.domains.size() : first + 1;
+	{
+		std::lock_guard<std::mutex> lock(model_mtx);
+		if (staging())
+		{
+			auto &mb = pending->mb[clos];
+			std::fill(mb.begin() + first, mb.begin() + last, value);
+			for (size_t d = first; d < last; d++)
+				staged.mb.emplace(clos, d);
+			return;
+		}
+	}
+
+	set_mb_schemata(intel_to_linux(clos), value, domain);
+
+	std::lock_guard<std::mutex> lock(model_mtx);
+	auto &mb = model.mb.at(clos);
+	std::fill(mb.begin() + first, mb.begin() + last, value);
+}
+
+
+uint32_t CATLinux::get_mb(uint32_t clos, uint32_t domain) const
+{
+	if (!has_mba())
+		throw_with_trace(std::runtime_error("There is no Memory Bandwidth Allocation in resctrl"));
+	const size_t d = find_domain(mba.domains, domain, "MB");
+	std::lock_guard<std::mutex> lock(model_mtx);
+	if (clos >= view().mb.size())
+		throw_with_trace(std::runtime_error("CLOS {} does not exist"_format(clos)));
+	return view().mb[clos][d];
+}
+
+
+std::vector<std::string> CATLinux::get_resources() const
+{
+	auto result = vector<string>();
+	for (const auto &r : resources)
+		result.push_back(r.cache);
+	return result;
 }
 
 
-void CATLinux::set_cbm(uint32_t clos, uint64_t cbm)
+void CATLinux::set_resource_cbm(const std::string &resource, uint32_t clos, uint64_t cbm, uint32_t domain)
 {
-	set_schemata(intel_to_linux(clos), cbm);
+	set_cbm_at(resource_index(resource), clos, cbm, domain);
 }
 
 
-uint64_t CATLinux::get_cbm(uint32_t clos) const
+uint64_t CATLinux::get_resource_cbm(const std::string &resource, uint32_t clos, uint32_t domain) const
 {
-	return get_schemata(intel_to_linux(clos));
+	return get_cbm_at(resource_index(resource), clos, domain);
 }
 
 
+// A cpu can only be in one group, writing it in a group removes it from the rest
 void CATLinux::add_cpu(uint32_t clos, uint32_t cpu)
 {
-	fs::path clos_dir = intel_to_linux(clos);
-	uint64_t cpu_mask = get_cpus(clos_dir);
-	cpu_mask |= (1ULL << cpu);
-	set_cpus(clos_dir, cpu_mask);
+	const uint64_t bit = 1ULL << cpu;
+	uint64_t cpu_mask;
+	{
+		std::lock_guard<std::mutex> lock(model_mtx);
+		if (staging())
+		{
+			if (clos >= get_max_closids())
+				throw_with_trace(std::runtime_error("CLOS {} does not exist"_format(clos)));
+			for (auto &mask : pending->cpus)
+				mask &= ~bit;
+			pending->cpus[clos] |= bit;
+			staged.cpus |= bit;
+			return;
+		}
+		cpu_mask = model.cpus.at(clos) | bit;
+	}
+	set_cpus(intel_to_linux(clos), cpu_mask);
+
+	std::lock_guard<std::mutex> lock(model_mtx);
+	for (auto &mask : model.cpus)
+		mask &= ~bit;
+	model.cpus[clos] = cpu_mask;
 }
 
 
 uint32_t CATLinux::get_clos(uint32_t cpu) const
 {
-	auto path = get_clos_dir(cpu);
-	if (path == fs::path(ROOT))
-		return 0;
-	string clos = fs::basename(get_clos_dir(cpu));
-	return std::stoi(clos);
+	const uint64_t bit = 1ULL << cpu;
+	std::lock_guard<std::mutex> lock(model_mtx);
+	const auto &m = view();
+	for (uint32_t clos = 0; clos < m.cpus.size(); clos++)
+		if (m.cpus[clos] & bit)
+			return clos;
+	throw_with_trace(std::runtime_error("CPU {} is not in any CLOS, does it exist?"_format(cpu)));
 }
 
 
@@ -305,17 +801,228 @@ uint32_t CATLinux::get_max_closids() const
 
 uint32_t CATLinux::get_clos_of_task(pid_t pid) const
 {
-	auto path = fs::path(ROOT);
-	auto tasks = get_tasks(path);
-	if (std::find(tasks.begin(), tasks.end(), std::to_string(pid)) != tasks.end())
-		return 0;
+	std::lock_guard<std::mutex> lock(model_mtx);
+	const auto &m = view();
+	auto it = m.task_clos.find(pid);
+	return it == m.task_clos.end() ? 0 : it->second;
+}
 
-	for (uint32_t i = 1; i < get_max_closids(); i++)
+
+void CATLinux::reconcile()
+{
+	auto fresh = read_model();
+
+	std::lock_guard<std::mutex> lock(model_mtx);
+	size_t diffs = 0;
+	for (uint32_t clos = 0; clos < fresh.cpus.size(); clos++)
 	{
-		path = fs::path(ROOT) / std::to_string(i);
-		tasks = get_tasks(path);
-		if (std::find(tasks.begin(), tasks.end(), std::to_string(pid)) != tasks.end())
-			return i;
+		for (size_t r = 0; r < fresh.cbms.size(); r++)
+		{
+			for (size_t d = 0; d < fresh.cbms[r][clos].size(); d++)
+			{
+				if (fresh.cbms[r][clos][d] != model.cbms[r][clos][d])
+				{
+					LOGWAR("CLOS {} has {} mask 0x{:x} in the domain {} of resctrl, but 0x{:x} in the model"_format(
+							clos, resources[r].cache, fresh.cbms[r][clos][d], resources[r].domains[d], model.cbms[r][clos][d]));
+					diffs++;
+				}
+			}
+		}
+		for (size_t d = 0; d < fresh.mb[clos].size(); d++)
+		{
+			if (fresh.mb[clos][d] != model.mb[clos][d])
+			{
+				LOGWAR("CLOS {} has bandwidth {}% in the MB domain {} of resctrl, but {}% in the model"_format(
+						clos, fresh.mb[clos][d], mba.domains[d], model.mb[clos][d]));
+				diffs++;
+			}
+		}
+		if (fresh.cpus[clos] != model.cpus[clos])
+		{
+			LOGWAR("CLOS {} has cpus 0x{:x} in resctrl, but 0x{:x} in the model"_format(clos, fresh.cpus[clos], model.cpus[clos]));
+			diffs++;
+		}
+	}
+
+	// Tasks that have exited are not in resctrl anymore, these differences are expected
+	auto clos_of = [](const Model &m, pid_t pid) { auto it = m.task_clos.find(pid); return it == m.task_clos.end() ? 0 : it->second; };
+	for (const auto &t : model.task_clos)
+		if (clos_of(fresh, t.first) != t.second)
+		{
+			LOGDEB("Pid {} is in CLOS {} in resctrl, but in {} in the model"_format(t.first, clos_of(fresh, t.first), t.second));
+			diffs++;
+		}
+	for (const auto &t : fresh.task_clos)
+		if (!model.task_clos.count(t.first))
+		{
+			LOGDEB("Pid {} is in CLOS {} in resctrl, but not in the model"_format(t.first, t.second));
+			diffs++;
+		}
+
+	LOGINF("Reconciled the CAT model with resctrl: {} differences"_format(diffs));
+	model = std::move(fresh);
+}
+
+
+void CATLinux::reconcile_if_due(uint64_t interval)
+{
+	if (reconcile_every && interval && interval % reconcile_every == 0)
+		reconcile();
+}
+
+
+void CATLinux::begin()
+{
+	std::lock_guard<std::mutex> lock(model_mtx);
+	if (pending)
+		throw_with_trace(std::runtime_error("There is already a CAT transaction open"));
+	pending = std::make_unique<Model>(model);
+	staged = Staged();
+	tx_owner = std::this_thread::get_id();
+}
+
+
+void CATLinux::rollback()
+{
+	std::lock_guard<std::mutex> lock(model_mtx);
+	pending.reset();
+	staged = Staged();
+}
+
+
+// Writes only what the transaction changed and differs from the current state,
+// in an order that keeps every intermediate configuration valid:
+//   1. Masks that shrink, so they stop overlapping before others grow into them
+//   2. Masks that grow
+//   3. Memory bandwidths, together with the masks they were decided with
+//   4. Cpus that are gained by a CLOS, which removes them from their old one
+//   5. Cpus that are only lost, they go back to CLOS 0
+//   6. Tasks, once their CLOS has its final configuration
+// The rest is taken from the live model, as other threads may have added or
+// removed tasks while the transaction was open.
+void CATLinux::commit()
+{
+	const auto start = std::chrono::steady_clock::now();
+	Model target;
+	Model current;
+	Staged changes;
+	{
+		std::lock_guard<std::mutex> lock(model_mtx);
+		if (!pending)
+			throw_with_trace(std::runtime_error("There is no CAT transaction open"));
+		target = std::move(*pending);
+		changes = std::move(staged);
+		pending.reset();
+		staged = Staged();
+		current = model;
 	}
-	throw_with_trace(std::runtime_error("The PID {} is not in any CLOS, does it exist?"_format(pid)));
+
+	uint64_t writes = 0;
+	uint64_t unchanged = 0;
+
+	// Masks, each resource and domain is independent from the others
+	for (const auto &c : changes.cbms)
+		if (target.cbms[std::get<0>(c)][std::get<1>(c)][std::get<2>(c)] == current.cbms[std::get<0>(c)][std::get<1>(c)][std::get<2>(c)])
+			unchanged++;
+	for (bool shrink : {true, false})
+	{
+		for (const auto &c : changes.cbms)
+		{
+			const size_t r = std::get<0>(c);
+			const uint32_t clos = std::get<1>(c);
+			const size_t d = std::get<2>(c);
+			const uint64_t cbm = target.cbms[r][clos][d];
+			const uint64_t old = current.cbms[r][clos][d];
+			if (cbm == old || ((cbm & ~old) == 0) != shrink)
+				continue;
+			set_cbm_at(r, clos, cbm, resources[r].domains[d]);
+			writes++;
+		}
+	}
+
+	// Bandwidths, they do not overlap like the masks
+	for (const auto &c : changes.mb)
+	{
+		const uint32_t clos = c.first;
+		const size_t d = c.second;
+		if (target.mb[clos][d] == current.mb[clos][d])
+		{
+			unchanged++;
+			continue;
+		}
+		set_mb(clos, target.mb[clos][d], mba.domains[d]);
+		writes++;
+	}
+
+	// Cpus, the ones not staged stay where they are
+	for (uint32_t clos = 0; clos < target.cpus.size(); clos++)
+		target.cpus[clos] = (target.cpus[clos] & changes.cpus) | (current.cpus[clos] & ~changes.cpus);
+	for (uint32_t clos = 0; clos < target.cpus.size(); clos++)
+	{
+		const uint64_t gained = target.cpus[clos] & ~current.cpus[clos];
+		if (!gained)
+			continue;
+		set_cpus(intel_to_linux(clos), target.cpus[clos] | current.cpus[clos]);
+		for (auto &mask : current.cpus)
+			mask &= ~gained;
+		current.cpus[clos] |= gained;
+		writes++;
+	}
+	for (uint32_t clos = 1; clos < target.cpus.size(); clos++)
+	{
+		if (target.cpus[clos] == current.cpus[clos])
+			continue;
+		set_cpus(intel_to_linux(clos), target.cpus[clos]);
+		current.cpus[0] |= current.cpus[clos] & ~target.cpus[clos];
+		current.cpus[clos] = target.cpus[clos];
+		writes++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(model_mtx);
+		model.cpus = current.cpus;
+	}
+
+	// Tasks, compared with the model now, the sampler may have moved them meanwhile
+	auto clos_of = [](const Model &m, pid_t pid) { auto it = m.task_clos.find(pid); return it == m.task_clos.end() ? 0 : it->second; };
+	for (const auto &pid : changes.tasks)
+	{
+		const uint32_t clos = clos_of(target, pid);
+		{
+			std::lock_guard<std::mutex> lock(model_mtx);
+			if (clos_of(model, pid) == clos)
+			{
+				unchanged++;
+				continue;
+			}
+		}
+		try
+		{
+			add_task(clos, pid);
+		}
+		catch (const std::runtime_error &e)
+		{
+			// It exited after being staged, before the sampler could remove it
+			if (kill(pid, 0) == 0 || errno != ESRCH)
+				throw;
+			LOGDEB("Task {} exited before being moved to CLOS {}"_format(pid, clos));
+			continue;
+		}
+		writes++;
+	}
+
+	const double us = std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(std::chrono::steady_clock::now() - start).count();
+	LOGINF("[CAT COMMIT] {} writes, {} unchanged, {:.1f} us"_format(writes, unchanged, us));
+
+	std::lock_guard<std::mutex> lock(model_mtx);
+	commit_stats.commits++;
+	commit_stats.writes += writes;
+	commit_stats.unchanged += unchanged;
+	commit_stats.us += us;
+}
+
+
+CATLinux::CommitStats CATLinux::get_commit_stats() const
+{
+	std::lock_guard<std::mutex> lock(model_mtx);
+	return commit_stats;
 }
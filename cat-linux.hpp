@@ -19,10 +19,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
 
 #include <boost/filesystem.hpp>
 
 #include "cat.hpp"
+#include "fake-resctrl.hpp"
+#include "resctrl-mon.hpp"
 
 
 class CATInfo
@@ -30,67 +37,214 @@ class CATInfo
 	public:
 
 	CATInfo() = default;
-	CATInfo(const std::string &_cache, uint64_t _cbm_mask, uint32_t _min_cbm_bits, uint32_t _num_closids) :
-			cache(_cache), cbm_mask(_cbm_mask), min_cbm_bits(_min_cbm_bits), num_closids(_num_closids) {}
+	CATInfo(const std::string &_cache, uint64_t _cbm_mask, uint32_t _min_cbm_bits, uint32_t _num_closids, const std::vector<uint32_t> &_domains) :
+			cache(_cache), cbm_mask(_cbm_mask), min_cbm_bits(_min_cbm_bits), num_closids(_num_closids), domains(_domains) {}
 
 	std::string cache;
 	uint64_t cbm_mask;
 	uint32_t min_cbm_bits;
 	uint32_t num_closids;
+	std::vector<uint32_t> domains; // Ids of the caches, in the order of the schemata
+};
+
+
+// Memory Bandwidth Allocation, with the bandwidth as a percentage of the maximum
+class MBAInfo
+{
+	public:
+
+	MBAInfo() = default;
+	MBAInfo(uint32_t _min_bandwidth, uint32_t _bandwidth_gran, uint32_t _num_closids, const std::vector<uint32_t> &_domains) :
+			min_bandwidth(_min_bandwidth), bandwidth_gran(_bandwidth_gran), num_closids(_num_closids), domains(_domains) {}
+
+	uint32_t min_bandwidth = 0;
+	uint32_t bandwidth_gran = 0; // The percentages are rounded up to multiples of it
+	uint32_t num_closids = 0;
+	std::vector<uint32_t> domains; // Ids of the memory controllers, in the order of the schemata
 };
 
 
 class CATLinux : public CAT
 {
+	public:
+
+	// In-memory copy of the resctrl state. Every write goes to sysfs and then
+	// here, so reads do not need to touch sysfs. Tasks not in 'task_clos' are
+	// in CLOS 0, like the tasks that are not in a resctrl group.
+	struct Model
+	{
+		std::map<pid_t, uint32_t> task_clos;
+		std::vector<std::vector<std::vector<uint64_t>>> cbms; // Per resource, CLOS and domain, in the order of 'resources'
+		std::vector<uint64_t> cpus; // Per CLOS
+		std::vector<std::vector<uint32_t>> mb; // Bandwidth per CLOS and MBA domain
+	};
+
+	// Totals of the committed transactions
+	struct CommitStats
+	{
+		uint64_t commits = 0;
+		uint64_t writes = 0;    // Sysfs writes issued
+		uint64_t unchanged = 0; // Staged changes that were already in place
+		double us = 0;          // Time spent committing
+	};
+
+	// Stages the changes done while it exists, commits them on 'commit' and
+	// discards them if it is destroyed before. Does nothing without a CATLinux.
+	class Transaction
+	{
+		std::shared_ptr<CATLinux> cat;
+		bool done = false;
+
+		public:
+
+		Transaction(const std::shared_ptr<CATLinux> &_cat) : cat(_cat) { if (cat) cat->begin(); }
+		~Transaction() { if (cat && !done) cat->rollback(); }
+
+		Transaction(const Transaction &) = delete;
+		Transaction& operator=(const Transaction &) = delete;
+
+		void commit() { if (cat && !done) { done = true; cat->commit(); } }
+	};
+
 	protected:
 
-	CATInfo info;
+	std::string root = default_root;
+	std::shared_ptr<FakeResctrl> fake; // Does the writes if the root is a fake tree
+	std::vector<CATInfo> resources; // Managed, the ones of the L3 first
+	CATInfo info; // Of the first resource, with the CLOS ids that all the resources have
+	MBAInfo mba;  // Without domains if there is no Memory Bandwidth Allocation
+	std::shared_ptr<ResctrlMon> monitor; // Its groups follow the tasks that are moved
+
+	Model model;
+	mutable std::mutex model_mtx; // The policy may run in its own thread
+	uint32_t reconcile_every = 0; // Intervals between reconciliations, 0 for never
+
+	// What the open transaction changed. Other threads keep writing the model
+	// directly while it is open, so only these are taken from 'pending' on commit.
+	struct Staged
+	{
+		std::set<std::tuple<size_t, uint32_t, size_t>> cbms; // Resource, CLOS and domain
+		std::set<std::pair<uint32_t, size_t>> mb;            // CLOS and MBA domain
+		uint64_t cpus = 0;
+		std::set<pid_t> tasks;
+	};
+
+	// State staged by the open transaction. Only the thread that opened it sees it.
+	std::unique_ptr<Model> pending;
+	Staged staged;
+	std::thread::id tx_owner;
+	CommitStats commit_stats;
+
+	bool staging() const { return pending && tx_owner == std::this_thread::get_id(); }
+	const Model& view() const { return staging() ? *pending : model; }
+	void check_cbm(size_t r, uint32_t clos, uint64_t cbm) const;
+	size_t resource_index(const std::string &resource) const;
+	size_t domain_index(size_t r, uint32_t domain) const;
+	void set_cbm_at(size_t r, uint32_t clos, uint64_t cbm, uint32_t domain);
+	uint64_t get_cbm_at(size_t r, uint32_t clos, uint32_t domain) const;
+	uint32_t check_mb(uint32_t clos, uint32_t percent) const; // Returns it rounded like the kernel does
 
 	#define FS boost::filesystem
-	void set_schemata(FS::path clos_dir, uint64_t mask);
+	void write_schemata(FS::path clos_dir, const std::string &schemata);
+	void set_schemata(FS::path clos_dir, const CATInfo &resource, uint64_t mask, uint32_t domain = all_domains);
+	void set_mb_schemata(FS::path clos_dir, uint32_t percent, uint32_t domain = all_domains);
 	void set_cpus(FS::path clos_dir, uint64_t cpu_mask);
-	void add_task(FS::path clos_dir, pid_t pid);
+	std::vector<pid_t> add_task(FS::path clos_dir, pid_t pid); // Returns the pids written
 	void remove_task(std::string task);
 
+	Model default_model() const;
+	Model read_model() const; // From sysfs
+
 	void create_clos(std::string clos);
 	void delete_clos(FS::path clos_dir);
 	void delete_all_clos();
 	void create_all_clos();
 
-	uint64_t get_schemata(FS::path clos_dir) const;
+	std::vector<uint64_t> get_schemata(FS::path clos_dir, const CATInfo &resource) const; // Per domain
+	std::vector<uint64_t> get_schemata(FS::path clos_dir) const { return get_schemata(clos_dir, info); }
+	std::vector<uint32_t> get_mb_schemata(FS::path clos_dir) const; // Per MBA domain
 	uint64_t get_cpus(FS::path clos_dir) const;
 	FS::path get_clos_dir(uint32_t cpu) const;
 	std::vector<std::string> get_tasks(FS::path clos_dir) const;
 	FS::path intel_to_linux(uint32_t clos) const;
 	std::vector<FS::path> get_clos_dirs() const;
 	const CATInfo& get_info() const { return info; };
+	const std::vector<CATInfo>& get_resource_info() const { return resources; };
 	#undef FS
 
 	public:
 
+	static const std::string default_root;
+
 	CATLinux() = default;
+	explicit CATLinux(const std::string &_root) : root(_root) {}
+
+	// The mutex and the open transaction are not copied
+	CATLinux(const CATLinux &o) : CAT(o), root(o.root), fake(o.fake), resources(o.resources), info(o.info), mba(o.mba), monitor(o.monitor), model(o.get_model()), reconcile_every(o.reconcile_every) {}
+	CATLinux& operator=(const CATLinux &o);
 
 	/* CAT API */
 	void init() override;
 	void reset() override;
 
-	void set_cbm(uint32_t clos, uint64_t cbm) override;
+	using CAT::set_cbm;
+	using CAT::get_cbm;
+
+	void set_cbm(uint32_t clos, uint64_t cbm, uint32_t domain) override;
 	void add_cpu(uint32_t clos, uint32_t cpu) override;
 
 	uint32_t get_clos(uint32_t cpu) const override;
-	uint64_t get_cbm(uint32_t clos) const override;
+	uint64_t get_cbm(uint32_t clos, uint32_t domain) const override;
 	uint32_t get_max_closids() const override;
+	std::vector<uint32_t> get_domains() const override { return info.domains; }
+
+	std::vector<std::string> get_resources() const override;
+	void set_resource_cbm(const std::string &resource, uint32_t clos, uint64_t cbm, uint32_t domain) override;
+	uint64_t get_resource_cbm(const std::string &resource, uint32_t clos, uint32_t domain) const override;
 
 	void print() override {};
 
 	/* CAT Linux API */
+
+	const std::string& get_root() const { return root; }
+	bool is_fake() const { return fake != nullptr; }
+
+	// Memory Bandwidth Allocation, in percentage of the bandwidth of each domain
+	bool has_mba() const { return !mba.domains.empty(); }
+	const MBAInfo& get_mba_info() const { return mba; }
+	void set_mb(uint32_t clos, uint32_t percent, uint32_t domain);
+	uint32_t get_mb(uint32_t clos, uint32_t domain) const;
+
 	void add_task(uint32_t clos, pid_t pid);
 	void add_tasks(uint32_t clos, const std::vector<pid_t> &pids);
 
 	uint32_t get_clos_of_task(pid_t pid) const;
+
+	// The monitoring groups of the tasks are moved with them to their new CLOS
+	void set_monitor(std::shared_ptr<ResctrlMon> _monitor) { monitor = _monitor; }
+
+	// Compare the model with sysfs, warn about the differences and keep sysfs
+	void reconcile();
+	void set_reconcile_every(uint32_t intervals) { reconcile_every = intervals; }
+	void reconcile_if_due(uint64_t interval);
+
+	Model get_model() const;
+
+	// Transactions: the changes between 'begin' and 'commit' are only written
+	// to sysfs on commit, and only if they differ from the current state
+	void begin();
+	void commit();
+	void rollback();
+	CommitStats get_commit_stats() const;
 };
 
 typedef std::shared_ptr<CATLinux> catlinux_ptr_t;
 
+// The cache resources in the info directory of resctrl, the others like MB have no masks
 std::map<std::string, CATInfo> cat_read_info();
+std::map<std::string, CATInfo> cat_read_info(const std::string &root);
+
+// The Memory Bandwidth Allocation of resctrl, as 'MB' if the kernel has it
+std::map<std::string, MBAInfo> mba_read_info();
+std::map<std::string, MBAInfo> mba_read_info(const std::string &root);
 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <iterator>
@@ -25,11 +26,66 @@ namespace acc = boost::accumulators;
 using fmt::literals::operator""_format;
 
 
+void PerDomain::set_cat(std::shared_ptr<CAT> _cat)
+{
+	Base::set_cat(_cat);
+	domains = cat->get_domains();
+	if (domains.size() <= 1)
+		domains = {CAT::all_domains};
+	else
+		LOGINF("Running an instance of the CAT policy in each of the {} cache domains"_format(domains.size()));
+
+	instances.resize(1);
+	while (instances.size() < domains.size())
+		instances.push_back(make());
+	domain_tasks.resize(domains.size());
+	for (size_t i = 0; i < domains.size(); i++)
+	{
+		instances[i]->set_domain(domains[i]);
+		instances[i]->set_cat(cat);
+	}
+}
+
+
+void PerDomain::set_rollups(std::shared_ptr<const Rollups> _rollups)
+{
+	Base::set_rollups(_rollups);
+	for (auto &instance : instances)
+		instance->set_rollups(_rollups);
+}
+
+
+void PerDomain::apply(uint64_t current_interval, const tasklist_t &tasklist)
+{
+	if (instances.size() == 1)
+	{
+		instances.front()->apply(current_interval, tasklist);
+		return;
+	}
+
+	for (auto &tasks : domain_tasks)
+		tasks.clear();
+	for (const auto &task : tasklist)
+	{
+		const uint32_t d = task_l3_domain(*task);
+		auto it = std::find(domains.begin(), domains.end(), d);
+		if (it == domains.end())
+		{
+			LOGDEB("Task {}:{} is not pinned to a single cache domain, no policy manages it"_format(task->id, task->name));
+			continue;
+		}
+		domain_tasks[it - domains.begin()].push_back(task);
+	}
+	for (size_t i = 0; i < instances.size(); i++)
+		instances[i]->apply(current_interval, domain_tasks[i]);
+}
+
+
 void Slowfirst::set_masks(const std::vector<uint64_t> &_masks)
 {
 	masks = _masks;
 	for (uint32_t i = 0; i < masks.size(); i++)
-		cat->set_cbm(i, masks[i]);
+		cat->set_cbm(i, masks[i], domain);
 }
 
 
@@ -150,23 +206,21 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 		uint64_t l3_misses;
 		uint64_t stalls;
 		uint64_t accum_stalls;
-		const std::string he = "MEM_LOAD_UOPS_RETIRED.L3_HIT";
-		const std::string me = "MEM_LOAD_UOPS_RETIRED.L3_MISS";
-		const std::string se = "CYCLE_ACTIVITY.STALLS_TOTAL";
 		const Task &task = *task_ptr;
 		const Stats &stats = task.stats;
 		try
 		{
-			l3_hits = acc::rolling_mean(stats.events.at(he));
-			l3_misses = acc::rolling_mean(stats.events.at(me));
-			stalls = acc::rolling_mean(stats.events.at(se));
-			accum_stalls = acc::sum(stats.events.at(se));
+			l3_hits = stats.window(l3_hit_id).mean();
+			l3_misses = stats.window(l3_miss_id).mean();
+			stalls = stats.window(stalls_id).mean();
+			accum_stalls = acc::sum(stats.get(stalls_id));
 		}
 		catch (const std::exception &e)
 		{
-			std::string msg = "This policy requires the events {}, {} and {}. The events monitorized are:"_format(he, me, se);
-			for (const auto &kv : stats.events)
-				msg += "\n" + kv.first;
+			std::string msg = "This policy requires the events {}, {} and {}. The events monitorized are:"_format(
+					l3_hit_id.name(), l3_miss_id.name(), stalls_id.name());
+			for (const auto &name : stats.get_names())
+				msg += "\n" + name;
 			throw_with_trace(std::runtime_error(msg));
 		}
 
@@ -174,7 +228,7 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 		double metric = accum_stalls;
 
 		double completed = task.max_instr ?
-				(double) stats.get_current("instructions") / (double) task.max_instr : task.completed;
+				(double) stats.get_current(instructions_id) / (double) task.max_instr : task.completed;
 
 		accum(stalls);
 
@@ -185,7 +239,7 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 	if (min_stall_ratio > 0)
 	{
 		// Ratio of cycles stalled and cycles the execution has been running for the most stalled application
-		const double stall_ratio = acc::max(accum) / tasklist[0]->stats.get_current("ref_cycles");
+		const double stall_ratio = acc::max(accum) / tasklist[0]->stats.get_current(ref_cycles_id);
 		if (stall_ratio < min_stall_ratio)
 		{
 			LOGDEB("Better to do nothing, since the processor is only stalled {}% of the time"_format(stall_ratio * 100));
@@ -289,7 +343,7 @@ void SlowfirstClusteredOptimallyAdjusted::apply(uint64_t current_interval, const
 	// Get current CAT masks
 	masks.resize(cat->get_max_closids());
 	for (size_t cos = 0; cos < masks.size(); cos++)
-		masks[cos] = cat->get_cbm(cos);
+		masks[cos] = cat->get_cbm(cos, domain);
 
 	// Compute new masks
 	if (model.name != "none")
@@ -7,7 +7,9 @@
 
 #include "cat.hpp"
 #include "kmeans.hpp"
+#include "rollups.hpp"
 #include "task.hpp"
+#include "throw-with-trace.hpp"
 
 namespace cat
 {
@@ -29,19 +31,41 @@ class Base
 
 	std::shared_ptr<CAT> cat;
 
+	// Cache domain whose masks the policy sets, or all of them with the same masks
+	uint32_t domain = CAT::all_domains;
+
+	// Aggregates of the tasks sampled in the interval the policy is applied to
+	std::shared_ptr<const Rollups> rollups;
+
 	public:
 
 	Base() = default;
 
-	void set_cat(std::shared_ptr<CAT> _cat)    { cat = _cat; }
+	virtual void set_cat(std::shared_ptr<CAT> _cat) { cat = _cat; }
 	std::shared_ptr<CAT> get_cat()             { return cat; }
 	const std::shared_ptr<CAT> get_cat() const { return cat; }
 
+	void set_domain(uint32_t _domain) { domain = _domain; }
+	uint32_t get_domain() const       { return domain; }
+
+	virtual void set_rollups(std::shared_ptr<const Rollups> _rollups) { rollups = _rollups; }
+	const Rollups& get_rollups() const
+	{
+		if (!rollups)
+			throw_with_trace(std::runtime_error("The policy needs the rollups of the interval, but they have not been set"));
+		return *rollups;
+	}
+	// Rollup of the domain of the policy, or of the whole system
+	const Rollups::Group& get_domain_rollup() const
+	{
+		return domain == CAT::all_domains ? get_rollups().system() : get_rollups().domain(domain);
+	}
+
 	void set_cbms(const cbms_t &cbms)
 	{
 		assert(cat->get_max_closids() >= cbms.size());
 		for(size_t clos = 0; clos < cbms.size(); clos++)
-			get_cat()->set_cbm(clos, cbms[clos]);
+			get_cat()->set_cbm(clos, cbms[clos], domain);
 	}
 
 	virtual ~Base() = default;
@@ -49,6 +73,44 @@ class Base
 	// Derived classes should perform their operations here.
 	// The base class does nothing by default.
 	virtual void apply(uint64_t, const tasklist_t &) {}
+
+	// Events the policy reads every interval, which can be pinned to the PMU so they are never multiplexed
+	virtual std::vector<std::string> get_required_events() const { return {}; }
+};
+
+
+// Runs an instance of a policy in each cache domain, over the tasks pinned to
+// the cpus of that domain, so every L3 is partitioned on its own. The instances
+// use the same CLOS ids, each one with its masks in its domain. The tasks whose
+// cpus are in more than one domain are left out of all of them. With a single
+// domain there is a single instance for every task.
+class PerDomain: public Base
+{
+	public:
+
+	typedef std::function<std::shared_ptr<Base>()> factory_t;
+
+	protected:
+
+	factory_t make;
+	std::vector<uint32_t> domains;
+	std::vector<std::shared_ptr<Base>> instances; // Per domain
+	std::vector<tasklist_t> domain_tasks;         // Per domain, reused every interval
+
+	public:
+
+	PerDomain(const factory_t &_make) : Base(), make(_make), instances(1, make()), domain_tasks(1) {}
+
+	virtual ~PerDomain() = default;
+
+	// Creates the instances for the domains of the CAT
+	virtual void set_cat(std::shared_ptr<CAT> _cat) override;
+	virtual void set_rollups(std::shared_ptr<const Rollups> _rollups) override;
+
+	const std::vector<std::shared_ptr<Base>>& get_instances() const { return instances; }
+
+	virtual void apply(uint64_t current_interval, const tasklist_t &tasklist) override;
+	virtual std::vector<std::string> get_required_events() const override { return instances.front()->get_required_events(); }
 };
 
 
@@ -151,6 +213,13 @@ class SlowfirstClusteredOptimallyAdjusted: public SlowfirstClustered
 	const std::vector<uint32_t> cluster_sizes; // Fixed cluster sizes
 	const bool min_max;
 
+	// Events this policy requires
+	const EventId l3_hit_id = EventId("MEM_LOAD_UOPS_RETIRED.L3_HIT");
+	const EventId l3_miss_id = EventId("MEM_LOAD_UOPS_RETIRED.L3_MISS");
+	const EventId stalls_id = EventId("CYCLE_ACTIVITY.STALLS_TOTAL");
+	const EventId instructions_id = EventId("instructions");
+	const EventId ref_cycles_id = EventId("ref_cycles");
+
 	// If num_clusters is not 0, then this number of clusters is used, instead of trying to find the optimal one
 	SlowfirstClusteredOptimallyAdjusted(uint64_t _every, uint32_t _num_clusters, const std::string &_model_str, bool _alternate_sides,
 			double _min_stall_ratio, bool _detect_outliers, const std::string &_eval_clusters_str, const std::vector<uint32_t> &_cluster_sizes, bool _min_max)
@@ -169,6 +238,14 @@ class SlowfirstClusteredOptimallyAdjusted: public SlowfirstClustered
 
 	virtual void apply(uint64_t current_interval, const tasklist_t &tasklist);
 
+	virtual std::vector<std::string> get_required_events() const override
+	{
+		auto events = std::vector<std::string>{instructions_id.name(), l3_hit_id.name(), l3_miss_id.name(), stalls_id.name()};
+		if (min_stall_ratio > 0)
+			events.push_back(ref_cycles_id.name());
+		return events;
+	}
+
 	EvalClusters str_to_evalclusters(const std::string &str)
 	{
 		if (str == "dunn")
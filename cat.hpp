@@ -17,8 +17,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
 
@@ -36,15 +38,37 @@ class CAT
 	CAT() = default;
 	virtual ~CAT() = default;
 
+	// Every CLOS has a mask in each cache domain, i.e. each L3 cache, which
+	// are identified by the id of the cache. The masks set for all the domains
+	// are read back from the first one.
+	static constexpr uint32_t all_domains = -1U;
+
 	virtual void init() = 0;
 	virtual void reset() = 0;
 
-	virtual void set_cbm(uint32_t clos, cbm_t cbm) = 0;
+	virtual void set_cbm(uint32_t clos, cbm_t cbm, uint32_t domain) = 0;
+	void set_cbm(uint32_t clos, cbm_t cbm) { set_cbm(clos, cbm, all_domains); }
 	virtual void add_cpu(uint32_t clos, uint32_t cpu) = 0;
 
 	virtual uint32_t get_clos(uint32_t cpu) const = 0;
-	virtual uint64_t get_cbm(uint32_t cos) const = 0;
+	virtual uint64_t get_cbm(uint32_t cos, uint32_t domain) const = 0;
+	uint64_t get_cbm(uint32_t cos) const { return get_cbm(cos, all_domains); }
 	virtual uint32_t get_max_closids() const = 0;
+	virtual std::vector<uint32_t> get_domains() const = 0;
+
+	// Every CLOS has a mask for each cache resource, named like in resctrl: 'L3',
+	// or 'L3CODE' and 'L3DATA' with Code and Data Prioritization (CDP), and the
+	// same for the L2, whose domains are the ids of the L2 caches. 'set_cbm' sets
+	// all the resources of the L3, and 'get_cbm' reads the first one, the data
+	// one with CDP.
+	virtual std::vector<std::string> get_resources() const = 0;
+	bool has_resource(const std::string &resource) const
+	{
+		const auto resources = get_resources();
+		return std::find(resources.begin(), resources.end(), resource) != resources.end();
+	}
+	virtual void set_resource_cbm(const std::string &resource, uint32_t clos, cbm_t cbm, uint32_t domain) = 0;
+	virtual uint64_t get_resource_cbm(const std::string &resource, uint32_t clos, uint32_t domain) const = 0;
 
 	bool is_initialized() const { return initialized; }
 
@@ -55,6 +55,27 @@ void assert_dir_exists(const boost::filesystem::path &dir)
 }
 
 
+// Id of the L3 cache of a cpu, which is the domain of resctrl. Kernels that do not report it have a single one.
+// The topology does not change, so it is read once for all the cpus.
+uint32_t get_l3_domain(uint32_t cpu)
+{
+	static const std::vector<uint32_t> domains = []()
+	{
+		auto result = std::vector<uint32_t>();
+		for (uint32_t c = 0; fs::exists("/sys/devices/system/cpu/cpu{}"_format(c)); c++)
+		{
+			const auto path = fs::path("/sys/devices/system/cpu/cpu{}/cache/index3/id"_format(c));
+			uint32_t id = 0;
+			if (fs::exists(path))
+				open_ifstream(path) >> id;
+			result.push_back(id);
+		}
+		return result;
+	}();
+	return cpu < domains.size() ? domains[cpu] : 0;
+}
+
+
 // Returns the executable basename from a commandline
 std::string extract_executable_name(const std::string &cmd)
 {
@@ -18,6 +18,7 @@ void drop_privileges();
 void set_cpu_affinity(std::vector<uint32_t> cpus, pid_t pid=0);
 int get_self_cpu_id();
 int get_cpu_id(pid_t pid);
+uint32_t get_l3_domain(uint32_t cpu);
 void assert_dir_exists(const boost::filesystem::path &dir);
 
 void pid_get_children_rec(const pid_t pid, std::vector<pid_t> &children);
@@ -81,6 +81,15 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 		uint64_t every = policy["every"].as<uint64_t>();
 		uint64_t firstInterval = policy["firstInterval"].as<uint64_t>();
 
+		// With CDP, the code heavy critical tasks can have their own code ways
+		if (policy["code_ways"])
+		{
+			uint32_t code_ways = policy["code_ways"].as<uint32_t>();
+			double code_mpki = policy["code_mpki"] ? policy["code_mpki"].as<double>() : 1;
+			LOGINF("With {} dedicated code ways for the critical tasks with at least {} code MPKI-L2"_format(code_ways, code_mpki));
+			return std::make_shared<cat::policy::CriticalAwareCode>(every, firstInterval, code_ways, code_mpki);
+		}
+
 		return std::make_shared<cat::policy::CriticalAware>(every, firstInterval);
 	}
 	if (kind == "cav4")
@@ -100,7 +109,13 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 		double ipc_threshold = policy["ipc_threshold"].as<double>();
 		double ipc_ICOV_threshold = policy["ipc_ICOV_threshold"].as<double>();
 
-		return std::make_shared<cat::policy::CriticalAwareV4>(every, firstInterval, IDLE_INTERVALS, ipc_threshold, ipc_ICOV_threshold);
+		// Memory bandwidth, in percentage, of the isolated bullies and of the non-critical tasks
+		uint32_t mb_isolated = policy["mb_isolated"] ? policy["mb_isolated"].as<uint32_t>() : 100;
+		uint32_t mb_non_critical = policy["mb_non_critical"] ? policy["mb_non_critical"].as<uint32_t>() : 100;
+
+		auto result = std::make_shared<cat::policy::CriticalAwareV4>(every, firstInterval, IDLE_INTERVALS, ipc_threshold, ipc_ICOV_threshold);
+		result->set_bandwidth_limits(mb_isolated, mb_non_critical);
+		return result;
 	}
  	else if (kind == "cpa")
 	{
@@ -163,7 +178,7 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 	else if (kind == "sfcoa")
 	{
 		vector<string> required = {"kind", "every", "model"};
-		vector<string> allowed  = {"num_clusters", "alternate_sides", "min_stall_ratio", "detect_outliers", "eval_clusters", "cluster_sizes", "min_max"};
+		vector<string> allowed  = {"num_clusters", "alternate_sides", "min_stall_ratio", "detect_outliers", "eval_clusters", "cluster_sizes", "min_max", "per_domain"};
 		vector<std::pair<string, string>> incompatible = {
 				{"num_clusters", "eval_clusters"},
 				{"num_clusters", "cluster_sizes"},
@@ -201,7 +216,7 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 	else if (kind == "cad")
 	{
 		vector<string> required = {"kind", "clustering", "distribution"};
-		vector<string> allowed  = {"every"};
+		vector<string> allowed  = {"every", "per_domain"};
 
 		config_check_fields(policy, required, allowed);
 
@@ -290,7 +305,7 @@ std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &conf
 	else if (kind == "squarewave")
 	{
 		vector<string> required = {"kind", "waves"};
-		vector<string> allowed  = {};
+		vector<string> allowed  = {"per_domain"};
 
 		config_check_fields(policy, required, allowed);
 
@@ -329,10 +344,12 @@ vector<Cos> config_read_cos(const YAML::Node &config)
 	{
 		const auto &cos = cos_section[i];
 
-		// Schematas are mandatory
+		// Schematas are mandatory, either a mask for all the cache domains or a map of domain ids to masks
 		if (!cos["schemata"])
 			throw_with_trace(std::runtime_error("Each cos must have an schemata"));
-		auto mask = cos["schemata"].as<uint64_t>();
+		const bool per_domain = cos["schemata"].IsMap();
+		auto mask = per_domain ? 0 : cos["schemata"].as<uint64_t>();
+		auto domain_masks = per_domain ? cos["schemata"].as<std::map<uint32_t, uint64_t>>() : std::map<uint32_t, uint64_t>();
 
 		// CPUs are not mandatory, but note that COS 0 will have all the CPUs by defect
 		auto cpus = vector<uint32_t>();
@@ -346,7 +363,7 @@ vector<Cos> config_read_cos(const YAML::Node &config)
 			}
 		}
 
-		result.push_back(Cos(mask, cpus));
+		result.push_back(per_domain ? Cos(domain_masks, cpus) : Cos(mask, cpus));
 	}
 
 	return result;
@@ -484,7 +501,7 @@ sched::ptr_t config_read_sched(const YAML::Node &config)
 	vector<string> allowed;
 
 	required = {"kind"};
-	allowed  = {"allowed_cpus", "every"};
+	allowed  = {"allowed_cpus", "every", "pause"};
 
 	// Check minimum required fields
 	config_check_required_fields(sched, required);
@@ -494,22 +511,22 @@ sched::ptr_t config_read_sched(const YAML::Node &config)
 			sched["allowed_cpus"].as<decltype(allowed_cpus)>() :
 			sched::allowed_cpus(); // All the allowed cpus for this process according to Linux
 	uint32_t every = sched["every"] ? sched["every"].as<decltype(every)>() : 1;
+	string pause   = sched["pause"] ? sched["pause"].as<string>() : "signal";
+	sched::ptr_t result;
 
 	if (kind == "linux")
 	{
 		if (every != 1)
 			LOGDEB("The Linux scheduler ingrores the 'every' option");
 		config_check_fields(sched, required, allowed);
-		return std::make_shared<sched::Base>(every, allowed_cpus);
+		result = std::make_shared<sched::Base>(every, allowed_cpus);
 	}
-
-	if (kind == "random")
+	else if (kind == "random")
 	{
 		config_check_fields(sched, required, allowed);
-		return std::make_shared<sched::Random>(every, allowed_cpus);
+		result = std::make_shared<sched::Random>(every, allowed_cpus);
 	}
-
-	if (kind == "fair")
+	else if (kind == "fair")
 	{
 		required.push_back("event");
 		required.push_back("weights");
@@ -519,10 +536,13 @@ sched::ptr_t config_read_sched(const YAML::Node &config)
 		string event = sched["event"].as<string>();
 		std::vector<uint32_t> weights = sched["weights"].as<decltype(weights)>();
 		bool at_least_one = sched["at_least_one"] ? sched["at_least_one"].as<bool>() : false;
-		return std::make_shared<sched::Fair>(every, allowed_cpus, event, weights, at_least_one);
+		result = std::make_shared<sched::Fair>(every, allowed_cpus, event, weights, at_least_one);
 	}
+	else
+		throw_with_trace(std::runtime_error("Invalid sched kind '{}'"_format(kind)));
 
-	throw_with_trace(std::runtime_error("Invalid sched kind '{}'"_format(kind)));
+	result->set_pause(pause);
+	return result;
 }
 
 
@@ -538,7 +558,7 @@ void config_read_cmd_options(const YAML::Node &config, CmdOptions &cmd_options)
 	vector<string> allowed;
 
 	required = {};
-	allowed  = {"ti", "mi", "event", "cpu-affinity", "cat-impl"};
+	allowed  = {"ti", "mi", "event", "cpu-affinity", "cat-impl", "resctrl-root", "sample-mode", "pipeline", "output-blocks", "output-policy", "task-tracker", "cat-reconcile", "resctrl-mon", "plan-events", "rates", "window", "windows", "quantiles", "percentiles", "phases", "phase-metric", "phase-threshold", "phase-window", "phase-drift"};
 
 	// Check minimum required fields
 	config_check_fields(cmd, required, allowed);
@@ -553,6 +573,44 @@ void config_read_cmd_options(const YAML::Node &config, CmdOptions &cmd_options)
 		cmd_options.cpu_affinity = cmd["cpu-affinity"].as<decltype(cmd_options.cpu_affinity)>();
 	if (cmd["cat-impl"])
 		cmd_options.cat_impl = cmd["cat-impl"].as<decltype(cmd_options.cat_impl)>();
+	if (cmd["resctrl-root"])
+		cmd_options.resctrl_root = cmd["resctrl-root"].as<decltype(cmd_options.resctrl_root)>();
+	if (cmd["sample-mode"])
+		cmd_options.sample_mode = cmd["sample-mode"].as<decltype(cmd_options.sample_mode)>();
+	if (cmd["pipeline"])
+		cmd_options.pipeline = cmd["pipeline"].as<decltype(cmd_options.pipeline)>();
+	if (cmd["output-blocks"])
+		cmd_options.output_blocks = cmd["output-blocks"].as<decltype(cmd_options.output_blocks)>();
+	if (cmd["output-policy"])
+		cmd_options.output_policy = cmd["output-policy"].as<decltype(cmd_options.output_policy)>();
+	if (cmd["task-tracker"])
+		cmd_options.task_tracker = cmd["task-tracker"].as<decltype(cmd_options.task_tracker)>();
+	if (cmd["cat-reconcile"])
+		cmd_options.cat_reconcile = cmd["cat-reconcile"].as<decltype(cmd_options.cat_reconcile)>();
+	if (cmd["resctrl-mon"])
+		cmd_options.resctrl_mon = cmd["resctrl-mon"].as<decltype(cmd_options.resctrl_mon)>();
+	if (cmd["plan-events"])
+		cmd_options.plan_events = cmd["plan-events"].as<decltype(cmd_options.plan_events)>();
+	if (cmd["window"])
+		cmd_options.window = cmd["window"].as<decltype(cmd_options.window)>();
+	if (cmd["windows"])
+		cmd_options.windows = cmd["windows"].as<decltype(cmd_options.windows)>();
+	if (cmd["quantiles"])
+		cmd_options.quantiles = cmd["quantiles"].as<decltype(cmd_options.quantiles)>();
+	if (cmd["percentiles"])
+		cmd_options.percentiles = cmd["percentiles"].as<decltype(cmd_options.percentiles)>();
+	if (cmd["rates"])
+		cmd_options.rates = cmd["rates"].as<decltype(cmd_options.rates)>();
+	if (cmd["phases"])
+		cmd_options.phases = cmd["phases"].as<decltype(cmd_options.phases)>();
+	if (cmd["phase-metric"])
+		cmd_options.phase_metric = cmd["phase-metric"].as<decltype(cmd_options.phase_metric)>();
+	if (cmd["phase-threshold"])
+		cmd_options.phase_threshold = cmd["phase-threshold"].as<decltype(cmd_options.phase_threshold)>();
+	if (cmd["phase-window"])
+		cmd_options.phase_window = cmd["phase-window"].as<decltype(cmd_options.phase_window)>();
+	if (cmd["phase-drift"])
+		cmd_options.phase_drift = cmd["phase-drift"].as<decltype(cmd_options.phase_drift)>();
 }
 
 
@@ -575,9 +633,16 @@ void config_read(const string &path, const string &overlay, CmdOptions &cmd_opti
 	if (config["cos"])
 		coslist = config_read_cos(config);
 
-	// Read CAT policy
+	// Read CAT policy, by default with an instance per cache domain, created once the domains are known
 	if (config["cat_policy"])
-		catpol = config_read_cat_policy(config);
+	{
+		const auto &policy = config["cat_policy"];
+		const bool per_domain = policy["per_domain"] ? policy["per_domain"].as<bool>() : true;
+		if (per_domain && policy["kind"] && policy["kind"].as<string>() != "none")
+			catpol = std::make_shared<cat::policy::PerDomain>([config]() { return config_read_cat_policy(config); });
+		else
+			catpol = config_read_cat_policy(config);
+	}
 
 	// Read tasks into objects
 	if (config["tasks"])
@@ -594,6 +659,15 @@ void config_read(const string &path, const string &overlay, CmdOptions &cmd_opti
 	// Read scheduler
 	sched = config_read_sched(config);
 
+	// Read derived metrics, in order, as they can use the ones defined before
+	if (config["derived_metrics"])
+	{
+		if (!config["derived_metrics"].IsMap())
+			throw_with_trace(std::runtime_error("The 'derived_metrics' field must be a map of names to expressions"));
+		for (const auto &kv : config["derived_metrics"])
+			cmd_options.derived_metrics.push_back(std::make_pair(kv.first.as<string>(), kv.second.as<string>()));
+	}
+
 	// Read general config
 	config_read_cmd_options(config, cmd_options);
 }
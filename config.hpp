@@ -1,20 +1,25 @@
 #pragma once
 
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <vector>
 
 #include "cat-policy.hpp"
+#include "derived-metrics.hpp"
 #include "task.hpp"
 #include "sched.hpp"
 
 
 struct Cos
 {
-	uint64_t mask;              // Ways assigned mask
+	uint64_t mask;              // Ways assigned mask, in every cache domain
+	std::map<uint32_t, uint64_t> domain_masks; // Masks of specific domains, by cache id, instead of 'mask'
 	std::vector<uint32_t> cpus; // Associated CPUs
 
 	Cos(uint64_t _mask, const std::vector<uint32_t> &_cpus = {}) : mask(_mask), cpus(_cpus) {}
+	Cos(const std::map<uint32_t, uint64_t> &_domain_masks, const std::vector<uint32_t> &_cpus = {}) :
+			mask(0), domain_masks(_domain_masks), cpus(_cpus) {}
 };
 
 
@@ -26,6 +31,26 @@ struct CmdOptions
 		std::vector<std::string> event        = {"ref-cycles", "instructions"}; // Events to monitor
 		std::vector<uint32_t>    cpu_affinity = {}; // CPUs to pin the manager to
 		std::string              cat_impl     = "linux"; // Linux or Intel implementation
+		std::string              resctrl_root = "/sys/fs/resctrl"; // Of the Linux implementation and the monitoring groups, it can be a fake tree
+		std::string              sample_mode  = "stop"; // Stop the tasks to sample them (stop) or sample them while running (live)
+		bool                     pipeline     = false; // Run scheduler, CAT policy and output in their own threads
+		uint32_t                 output_blocks = 16; // Blocks for writing the output in the background, 0 for synchronous output
+		std::string              output_policy = "block"; // When all the blocks are busy, wait (block) or drop lines (drop)
+		bool                     task_tracker = false; // Collect stops and exits of the tasks from SIGCHLD instead of waitpid per task
+		uint32_t                 cat_reconcile = 0; // Intervals between checks of the CAT model against resctrl, 0 for never
+		bool                     resctrl_mon  = false; // Occupancy and memory bandwidth from resctrl monitoring groups instead of intel_cqm
+		bool                     plan_events  = false; // Regroup the events to fit in the PMU, pinning the ones the policy needs
+		bool                     rates        = false; // Add the interval length and the rates per second of the counters to the outputs
+		uint32_t                 window       = 7; // Number of intervals in the window of the metrics
+		std::map<std::string, uint32_t> windows = {}; // Window length of specific metrics
+		DerivedMetrics::definitions_t derived_metrics = {}; // Metrics computed from the events, besides the builtin ones
+		std::vector<std::string> quantiles    = {}; // Metrics with the percentiles of their interval values in the totals
+		std::vector<double>      percentiles  = {50, 90, 99}; // Percentiles reported for those metrics
+		std::string              phases       = ""; // Phase detection algorithm (icov, cusum or window) for the interval output, empty for none
+		std::string              phase_metric = "ipc"; // Metric whose phases are detected
+		double                   phase_threshold = 1; // Score that starts a new phase
+		uint32_t                 phase_window = 4; // Values compared by the window algorithm
+		double                   phase_drift  = 0.05; // Relative deviation ignored by the cusum algorithm
 };
 
 
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
+
+#include <fmt/format.h>
+
+#include "derived-metrics.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+constexpr size_t DerivedMetrics::max_stack;
+
+
+namespace
+{
+	struct Token
+	{
+		enum Kind {number, name, op, end} kind;
+		std::string text;
+		double value;
+	};
+
+
+	bool is_name_start(char c)
+	{
+		return std::isalpha((unsigned char) c) || c == '_';
+	}
+
+
+	bool is_name_char(char c)
+	{
+		return std::isalnum((unsigned char) c) || c == '_' || c == '.' || c == '/' || c == ':' || c == '=' || c == ',' || c == '-';
+	}
+
+
+	std::vector<Token> tokenize(const std::string &expr)
+	{
+		auto tokens = std::vector<Token>();
+		size_t i = 0;
+		while (i < expr.size())
+		{
+			char c = expr[i];
+			if (std::isspace((unsigned char) c))
+			{
+				i++;
+			}
+			else if (std::isdigit((unsigned char) c) || c == '.')
+			{
+				const char *begin = expr.c_str() + i;
+				char *end;
+				double value = std::strtod(begin, &end);
+				if (end == begin)
+					throw_with_trace(std::runtime_error("Invalid number at position {} of '{}'"_format(i, expr)));
+				tokens.push_back({Token::number, std::string(begin, (const char *) end), value});
+				i += end - begin;
+			}
+			else if (is_name_start(c))
+			{
+				size_t j = i;
+				while (j < expr.size() && is_name_char(expr[j]))
+					j++;
+				tokens.push_back({Token::name, expr.substr(i, j - i), 0});
+				i = j;
+			}
+			else if (c == '{')
+			{
+				size_t j = expr.find('}', i);
+				if (j == std::string::npos)
+					throw_with_trace(std::runtime_error("Unterminated '{{' at position {} of '{}'"_format(i, expr)));
+				tokens.push_back({Token::name, expr.substr(i + 1, j - i - 1), 0});
+				i = j + 1;
+			}
+			else if (std::string("+-*/()").find(c) != std::string::npos)
+			{
+				tokens.push_back({Token::op, std::string(1, c), 0});
+				i++;
+			}
+			else
+				throw_with_trace(std::runtime_error("Unexpected character '{}' at position {} of '{}'"_format(c, i, expr)));
+		}
+		tokens.push_back({Token::end, "", 0});
+		return tokens;
+	}
+}
+
+
+DerivedMetrics::DerivedMetrics(const definitions_t &definitions)
+{
+	for (const auto &def : definitions)
+		compile(def.first, def.second);
+}
+
+
+DerivedMetrics::definitions_t DerivedMetrics::builtin(const std::vector<std::string> &events)
+{
+	auto has = [&events](const std::string &name)
+	{
+		return std::find(events.begin(), events.end(), name) != events.end();
+	};
+
+	auto result = definitions_t();
+	if (has("instructions") && has("cycles"))
+		result.push_back({"ipc", "instructions / cycles"});
+	if (has("instructions") && has("ref-cycles"))
+		result.push_back({"ref-ipc", "instructions / ref-cycles"});
+	if (has("instructions") && has("mem_load_uops_retired.l3_miss"))
+		result.push_back({"mpki_l3", "1000 * mem_load_uops_retired.l3_miss / instructions"});
+	if (has("instructions") && has("mem_load_uops_retired.l3_hit"))
+		result.push_back({"hpki_l3", "1000 * mem_load_uops_retired.l3_hit / instructions"});
+	if (has("intel_cqm/llc_occupancy/"))
+		result.push_back({"l3_occup_mb", "{intel_cqm/llc_occupancy/} / 1024 / 1024"});
+	return result;
+}
+
+
+// Recursive descent parser, emitting the operations in postfix order:
+//
+//   expr  := term (('+' | '-') term)*
+//   term  := unary (('*' | '/') unary)*
+//   unary := '-' unary | primary
+//   primary := number | name | '(' expr ')'
+void DerivedMetrics::compile(const std::string &name, const std::string &expression)
+{
+	if (std::find(names.begin(), names.end(), name) != names.end())
+		throw_with_trace(std::runtime_error("Derived metric '{}' defined twice"_format(name)));
+
+	const auto tokens = tokenize(expression);
+	auto deps = std::vector<EventId>();
+	auto add_dep = [&deps](EventId id)
+	{
+		if (std::find(deps.begin(), deps.end(), id) == deps.end())
+			deps.push_back(id);
+	};
+	size_t pos = 0;
+	size_t depth = 0;
+
+	auto fail = [&](const std::string &msg)
+	{
+		throw_with_trace(std::runtime_error("Derived metric '{}': {} in '{}'"_format(name, msg, expression)));
+	};
+
+	auto emit = [&](Op op)
+	{
+		if (op.kind == Op::constant || op.kind == Op::event || op.kind == Op::derived)
+			depth++;
+		else if (op.kind != Op::neg)
+			depth--;
+		if (depth > max_stack)
+			fail("too complex");
+		ops.push_back(op);
+	};
+
+	auto is_op = [&](const char *op)
+	{
+		return tokens[pos].kind == Token::op && tokens[pos].text == op;
+	};
+
+	std::function<void()> expr, term, unary, primary;
+
+	expr = [&]()
+	{
+		term();
+		while (is_op("+") || is_op("-"))
+		{
+			auto kind = is_op("+") ? Op::add : Op::sub;
+			pos++;
+			term();
+			emit({kind, 0, 0});
+		}
+	};
+
+	term = [&]()
+	{
+		unary();
+		while (is_op("*") || is_op("/"))
+		{
+			auto kind = is_op("*") ? Op::mul : Op::div;
+			pos++;
+			unary();
+			emit({kind, 0, 0});
+		}
+	};
+
+	unary = [&]()
+	{
+		if (is_op("-"))
+		{
+			pos++;
+			unary();
+			emit({Op::neg, 0, 0});
+		}
+		else
+			primary();
+	};
+
+	primary = [&]()
+	{
+		const Token &t = tokens[pos];
+		if (t.kind == Token::number)
+		{
+			emit({Op::constant, 0, t.value});
+			pos++;
+		}
+		else if (t.kind == Token::name)
+		{
+			auto it = std::find(names.begin(), names.end(), t.text);
+			if (it != names.end())
+			{
+				emit({Op::derived, (uint32_t) (it - names.begin()), 0});
+				for (const auto &id : operands[it - names.begin()])
+					add_dep(id);
+			}
+			else
+			{
+				EventId id(t.text);
+				emit({Op::event, id.get(), 0});
+				add_dep(id);
+				if (std::find(events.begin(), events.end(), id) == events.end())
+					events.push_back(id);
+			}
+			pos++;
+		}
+		else if (is_op("("))
+		{
+			pos++;
+			expr();
+			if (!is_op(")"))
+				fail("expected ')' at token {}"_format(pos));
+			pos++;
+		}
+		else
+			fail(t.kind == Token::end ? "unexpected end" : "unexpected '{}'"_format(t.text));
+	};
+
+	const size_t first_op = ops.size();
+	const size_t first_event = events.size();
+	try
+	{
+		expr();
+		if (tokens[pos].kind != Token::end)
+			fail("unexpected '{}'"_format(tokens[pos].text));
+	}
+	catch (...)
+	{
+		ops.resize(first_op);
+		events.erase(events.begin() + first_event, events.end());
+		throw;
+	}
+	emit({Op::store, 0, 0});
+	assert(depth == 0);
+
+	names.push_back(name);
+	ids.push_back(EventId(name));
+	operands.push_back(deps);
+}
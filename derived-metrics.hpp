@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "event-registry.hpp"
+
+
+// Metrics computed from the events with arithmetic expressions, like
+//
+//   mpki_l3: 1000 * mem_load_uops_retired.l3_miss / instructions
+//
+// Operands are numbers, event names and the names of metrics defined before in
+// the same program. Names may contain '.', '/', ':', '=', ',' and '-', so '-' as
+// an operator has to be separated by spaces from the names. Any other name can
+// be written between braces, e.g. {cpu/event=0x3c, umask=0/}.
+//
+// All the expressions are compiled once into a single flat program in postfix
+// order, which is evaluated with a small stack and no allocations.
+class DerivedMetrics
+{
+	public:
+
+	typedef std::vector<std::pair<std::string, std::string>> definitions_t; // (name, expression)
+
+	DerivedMetrics() = default;
+	DerivedMetrics(const definitions_t &definitions);
+
+	// The metrics the manager computes when their events are monitorized: ipc, ref-ipc,
+	// and the L3 misses and hits per kilo instruction and occupancy in MB of the policies
+	static definitions_t builtin(const std::vector<std::string> &events);
+
+	const std::vector<std::string>& get_names() const { return names; }
+	const std::vector<EventId>& get_ids() const { return ids; }
+	const std::vector<EventId>& get_events() const { return events; } // Events used as operands
+	// Events a metric depends on, directly or through other metrics
+	const std::vector<EventId>& get_operands(size_t metric) const { return operands[metric]; }
+	size_t size() const { return names.size(); }
+
+	// Evaluate all the metrics into 'results'. 'value' returns the value of an event from its id.
+	template <typename F>
+	void eval(const F &value, double *results) const
+	{
+		double stack[max_stack];
+		size_t sp = 0;
+		size_t metric = 0;
+		for (const auto &op : ops)
+		{
+			switch (op.kind)
+			{
+				case Op::constant: stack[sp++] = op.value;                     break;
+				case Op::event:    stack[sp++] = value(op.arg);                break;
+				case Op::derived:  stack[sp++] = results[op.arg];              break;
+				case Op::neg:      stack[sp - 1] = -stack[sp - 1];             break;
+				case Op::add:      sp--; stack[sp - 1] += stack[sp];           break;
+				case Op::sub:      sp--; stack[sp - 1] -= stack[sp];           break;
+				case Op::mul:      sp--; stack[sp - 1] *= stack[sp];           break;
+				case Op::div:      sp--; stack[sp - 1] /= stack[sp];           break;
+				case Op::store:    results[metric++] = stack[--sp];            break;
+			}
+		}
+	}
+
+	private:
+
+	static constexpr size_t max_stack = 32;
+
+	struct Op
+	{
+		enum Kind : uint8_t {constant, event, derived, neg, add, sub, mul, div, store} kind;
+		uint32_t arg;   // Event id or index of a derived metric
+		double value;   // Constants
+	};
+
+	std::vector<Op> ops;
+	std::vector<std::string> names;
+	std::vector<EventId> ids;
+	std::vector<EventId> events;
+	std::vector<std::vector<EventId>> operands;
+
+	void compile(const std::string &name, const std::string &expression);
+};
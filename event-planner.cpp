@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <fstream>
+
+#include <fmt/format.h>
+#include <libcpuid.h>
+
+#include "event-planner.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+PmuCapacity PmuCapacity::detect()
+{
+	struct cpu_raw_data_t raw;
+	if (!cpuid_present() || cpuid_get_raw_data(&raw) < 0)
+		throw_with_trace(std::runtime_error("Could not read cpuid to find the number of counters"));
+
+	auto result = PmuCapacity();
+	const uint32_t max_leaf = raw.basic_cpuid[0][0];
+	const uint32_t eax = max_leaf >= 0xA ? raw.basic_cpuid[0xA][0] : 0;
+	const uint32_t edx = max_leaf >= 0xA ? raw.basic_cpuid[0xA][3] : 0;
+	const uint32_t version = eax & 0xff;
+	if (version == 0)
+	{
+		// Without architectural performance monitoring, assume the minimum of current CPUs
+		result.general = 4;
+		result.fixed = 0;
+		LOGWAR("The CPU does not report its performance counters, assuming {} general purpose counters"_format(result.general));
+	}
+	else
+	{
+		result.general = (eax >> 8) & 0xff;
+		result.fixed = version > 1 ? edx & 0x1f : 0;
+	}
+
+	std::ifstream watchdog("/proc/sys/kernel/nmi_watchdog");
+	int value = 0;
+	if (watchdog >> value)
+		result.watchdog = value != 0;
+
+	LOGINF("PMU with {} general purpose and {} fixed counters{}"_format(
+			result.general, result.fixed, result.watchdog ? ", the NMI watchdog uses the cycles one" : ""));
+	return result;
+}
+
+
+std::vector<std::string> EventPlanner::split(const std::string &group)
+{
+	auto result = std::vector<std::string>();
+	std::string current;
+	bool in_terms = false; // Between the slashes of 'pmu/terms/'
+	for (const char &c : group)
+	{
+		if (c == '/')
+			in_terms = !in_terms;
+		if (c == ',' && !in_terms)
+		{
+			if (!current.empty())
+				result.push_back(current);
+			current.clear();
+			continue;
+		}
+		if (c != ' ' || in_terms)
+			current += c;
+	}
+	if (!current.empty())
+		result.push_back(current);
+	return result;
+}
+
+
+EventPlanner::Kind EventPlanner::classify(const std::string &event) const
+{
+	static const std::vector<std::string> software = {
+		"cpu-clock", "task-clock", "page-faults", "faults", "minor-faults", "major-faults",
+		"context-switches", "cs", "cpu-migrations", "migrations", "alignment-faults", "emulation-faults", "dummy"
+	};
+
+	// Events of other PMUs, 'cpu/.../' is the core PMU
+	auto slash = event.find('/');
+	if (slash != std::string::npos)
+		return event.compare(0, slash, "cpu") == 0 ? Kind::general : Kind::other;
+
+	// Without modifiers
+	const std::string name = event.substr(0, event.find(':'));
+	if (std::find(software.begin(), software.end(), name) != software.end())
+		return Kind::other;
+
+	if (name == "instructions")
+		return pmu.fixed > 0 ? Kind::fixed : Kind::general;
+	if (name == "cycles" || name == "cpu-cycles")
+		return pmu.fixed > 1 && !pmu.watchdog ? Kind::fixed : Kind::general;
+	if (name == "ref-cycles")
+		return pmu.fixed > 2 ? Kind::fixed : Kind::general;
+	return Kind::general;
+}
+
+
+EventPlanner::Plan EventPlanner::plan(const std::vector<std::string> &groups, const std::vector<std::string> &pinned) const
+{
+	auto join = [](const std::vector<std::string> &events)
+	{
+		std::string result;
+		for (const auto &e : events)
+			result += (result.empty() ? "" : ",") + e;
+		return result;
+	};
+	auto contains = [](const std::vector<std::string> &v, const std::string &e)
+	{
+		return std::find(v.begin(), v.end(), e) != v.end();
+	};
+
+	// The pinned group takes its general purpose counters from all the others
+	auto pinned_events = std::vector<std::string>();
+	uint32_t pinned_general = 0;
+	for (const auto &e : pinned)
+	{
+		if (contains(pinned_events, e))
+			continue;
+		pinned_events.push_back(e);
+		pinned_general += classify(e) == Kind::general;
+	}
+	if (pinned_general > pmu.general)
+		throw_with_trace(std::runtime_error("The policy needs {} general purpose counters, but there are only {}"_format(pinned_general, pmu.general)));
+	const uint32_t capacity = pmu.general - pinned_general;
+
+	// Split the groups that do not fit, keeping the events of each one together as far as possible
+	auto seen = pinned_events;
+	auto chunks = std::vector<std::pair<std::vector<std::string>, uint32_t>>(); // (events, general counters)
+	for (const auto &group : groups)
+	{
+		auto chunk = std::make_pair(std::vector<std::string>(), 0U);
+		for (const auto &e : split(group))
+		{
+			if (contains(seen, e))
+			{
+				LOGDEB("Event '{}' requested more than once"_format(e));
+				continue;
+			}
+			seen.push_back(e);
+
+			const bool general = classify(e) == Kind::general;
+			if (general && capacity == 0)
+				throw_with_trace(std::runtime_error("There are no general purpose counters left for the event '{}'"_format(e)));
+			if (general && chunk.second == capacity)
+			{
+				chunks.push_back(chunk);
+				chunk = std::make_pair(std::vector<std::string>(), 0U);
+			}
+			chunk.first.push_back(e);
+			chunk.second += general;
+		}
+		if (!chunk.first.empty())
+			chunks.push_back(chunk);
+	}
+
+	// First fit, in the order requested
+	auto packed = std::vector<std::pair<std::vector<std::string>, uint32_t>>();
+	for (const auto &chunk : chunks)
+	{
+		auto it = std::find_if(packed.begin(), packed.end(), [&](const auto &p) { return p.second + chunk.second <= capacity; });
+		if (it == packed.end())
+			packed.push_back(chunk);
+		else
+		{
+			it->first.insert(it->first.end(), chunk.first.begin(), chunk.first.end());
+			it->second += chunk.second;
+		}
+	}
+
+	auto result = Plan();
+	if (!pinned_events.empty())
+	{
+		result.groups.push_back(join(pinned_events));
+		result.pinned = true;
+	}
+	for (const auto &p : packed)
+		result.groups.push_back(join(p.first));
+
+	for (size_t g = 0; g < result.groups.size(); g++)
+		LOGINF("Event group {}{}: {}"_format(g, result.pinned && g == 0 ? " (pinned)" : "", result.groups[g]));
+	if (packed.size() > 1)
+		LOGINF("The {} unpinned groups will be multiplexed"_format(packed.size()));
+	return result;
+}
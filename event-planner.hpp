@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Counters of the core PMU of this CPU
+struct PmuCapacity
+{
+	uint32_t general = 0;      // General purpose counters
+	uint32_t fixed = 0;        // Fixed counters: instructions, cycles and ref-cycles, in this order
+	bool watchdog = false;     // The NMI watchdog holds the fixed cycles counter
+
+	// From the architectural performance monitoring leaf (0xA) of cpuid, and /proc/sys/kernel/nmi_watchdog
+	static PmuCapacity detect();
+};
+
+
+// Packs the requested events into groups the PMU can count at once, so the
+// events of a group are never multiplexed between them. When there are more
+// groups than fit in the PMU, the kernel rotates them, and the fraction of the
+// time each one was counting is the confidence of its values.
+//
+// The events a policy depends on are put together in the first group, which is
+// pinned to the PMU so they are always counted. The rest of groups share the
+// general purpose counters left.
+class EventPlanner
+{
+	public:
+
+	enum class Kind {fixed, general, other};
+
+	struct Plan
+	{
+		std::vector<std::string> groups;
+		bool pinned = false; // The first group has to be pinned to the PMU
+	};
+
+	EventPlanner(const PmuCapacity &_pmu) : pmu(_pmu) {}
+
+	// 'groups' are comma separated lists of events, as in the 'event' option
+	Plan plan(const std::vector<std::string> &groups, const std::vector<std::string> &pinned) const;
+
+	// Counter used by an event. Software events and the ones of other PMUs (uncore, RDT, RAPL...) are 'other'.
+	Kind classify(const std::string &event) const;
+
+	// Split a group by the commas that are not inside the terms of an event, e.g. 'cpu/event=0x3c,umask=0/'
+	static std::vector<std::string> split(const std::string &group);
+
+	private:
+
+	PmuCapacity pmu;
+};
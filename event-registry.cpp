@@ -0,0 +1,73 @@
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include <fmt/format.h>
+
+#include "event-registry.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+// Function statics, so handles can be created during static initialization
+namespace
+{
+	struct Registry
+	{
+		std::mutex mtx;
+		std::unordered_map<std::string, uint32_t> ids;
+		std::deque<std::string> names; // References stay valid when it grows
+	};
+
+	Registry& registry()
+	{
+		static Registry r;
+		return r;
+	}
+}
+
+
+uint32_t EventRegistry::intern(const std::string &name)
+{
+	auto &r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	auto it = r.ids.find(name);
+	if (it != r.ids.end())
+		return it->second;
+	uint32_t id = r.names.size();
+	r.names.push_back(name);
+	r.ids.emplace(name, id);
+	return id;
+}
+
+
+bool EventRegistry::find(const std::string &name, uint32_t &id)
+{
+	auto &r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	auto it = r.ids.find(name);
+	if (it == r.ids.end())
+		return false;
+	id = it->second;
+	return true;
+}
+
+
+const std::string& EventRegistry::name(uint32_t id)
+{
+	auto &r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	if (id >= r.names.size())
+		throw_with_trace(std::runtime_error("Unknown event id {}"_format(id)));
+	return r.names[id];
+}
+
+
+size_t EventRegistry::size()
+{
+	auto &r = registry();
+	std::lock_guard<std::mutex> lock(r.mtx);
+	return r.names.size();
+}
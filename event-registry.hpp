@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Interns the names of the events and derived metrics, giving each one a dense
+// integer id that is valid during the whole execution
+class EventRegistry
+{
+	public:
+
+	static uint32_t intern(const std::string &name); // Creates the id if needed
+	static bool find(const std::string &name, uint32_t &id);
+	static const std::string& name(uint32_t id);
+	static size_t size();
+};
+
+
+// Typed handle of an event, resolved once from its name. Meant to be built when
+// the policies and stats are constructed, and used in their hot paths.
+class EventId
+{
+	uint32_t id;
+
+	public:
+
+	explicit EventId(const std::string &name) : id(EventRegistry::intern(name)) {}
+
+	uint32_t get() const { return id; }
+	const std::string& name() const { return EventRegistry::name(id); }
+
+	bool operator==(const EventId &o) const { return id == o.id; }
+	bool operator!=(const EventId &o) const { return id != o.id; }
+};
@@ -1,3 +1,12 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
 #include <fmt/format.h>
 
 extern "C"
@@ -6,6 +15,7 @@ extern "C"
 }
 
 #include "common.hpp"
+#include "event-planner.hpp"
 #include "events-perf.hpp"
 #include "log.hpp"
 #include "throw-with-trace.hpp"
@@ -20,8 +30,8 @@ double read_energy_ram();
 
 
 double get_clos_pid(pid_t pid,std::shared_ptr<CAT> cat);
-double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat);
-double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat);
+double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat, uint32_t domain);
+double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat, uint32_t domain);
 
 double get_clos_pid(pid_t pid,std::shared_ptr<CAT> cat)
 {
@@ -29,19 +39,19 @@ double get_clos_pid(pid_t pid,std::shared_ptr<CAT> cat)
 	return (double) ptr->get_clos_of_task(pid);
 }
 
-double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat)
+double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat, uint32_t domain)
 {
 	auto ptr = std::dynamic_pointer_cast<CATLinux>(cat);
 	uint32_t clos = ptr->get_clos_of_task(pid);
 	//LOGINF("get_mask_pid : {:#x}"_format(ptr->get_cbm(clos)));
-	return (double) ptr->get_cbm(clos);
+	return (double) ptr->get_cbm(clos, domain);
 }
 
-double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat)
+double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat, uint32_t domain)
 {
 	auto ptr = std::dynamic_pointer_cast<CATLinux>(cat);
 	uint32_t clos = ptr->get_clos_of_task(pid);
-	uint64_t n = __builtin_popcount(ptr->get_cbm(clos));
+	uint64_t n = __builtin_popcount(ptr->get_cbm(clos, domain));
 	//LOGINF("get_num_ways_pid : {}"_format(n));
     return (double) n;
 }
@@ -54,8 +64,12 @@ void Perf::init()
 void Perf::clean()
 {
 	for (const auto &item : pid_events)
+	{
 		for (const auto &evlist : item.second.groups)
 			::clean(evlist);
+		if (monitor)
+			monitor->remove(item.first);
+	}
 }
 
 
@@ -64,22 +78,57 @@ void Perf::clean(pid_t pid)
 	for (const auto &evlist : pid_events.at(pid).groups)
 		::clean(evlist);
 	pid_events.erase(pid);
+	if (monitor)
+		monitor->remove(pid);
 }
 
 
-void Perf::setup_events(pid_t pid, const std::vector<std::string> &groups)
+void Perf::setup_events(pid_t pid, const std::vector<std::string> &groups, bool pin_first)
 {
 	assert(pid >= 1);
-	for (const auto &events : groups)
+	const char *names[max_num_events];
+	auto seen = std::vector<std::string>();
+	for (const auto &requested : groups)
 	{
-		const auto evlist = ::setup_events(std::to_string(pid).c_str(), events.c_str());
+		const bool pinned = pin_first && &requested == &groups.front();
+
+		// The monitor reads these events, perf may not even have them
+		std::string events;
+		for (const auto &e : EventPlanner::split(requested))
+			if (!monitor || !ResctrlMon::provides(e))
+				events += (events.empty() ? "" : ",") + e;
+		if (events.empty())
+			continue;
+
+		// Try to create a group that can be read at once, if not, the events are read one by one
+		auto evlist = ::setup_events(std::to_string(pid).c_str(), events.c_str(), true, pinned);
+		if (evlist == NULL)
+		{
+			LOGWAR("Could not group events '{}', they will be read one by one"_format(events));
+			evlist = ::setup_events(std::to_string(pid).c_str(), events.c_str(), false, pinned);
+		}
 		if (evlist == NULL)
 			throw_with_trace(std::runtime_error("Could not setup events '{}'"_format(events)));
 		if (::num_entries(evlist) >= max_num_events)
 			throw_with_trace(std::runtime_error("Too many events"));
-		pid_events[pid].append(evlist);
+
+		// Events already in a previous group, the energy and CAT ones go after the first group
+		const int n = ::num_entries(evlist);
+		auto repeated = std::vector<bool>(n);
+		::get_names(evlist, names);
+		for (int i = 0; i < n; i++)
+		{
+			repeated[i] = std::find(seen.begin(), seen.end(), names[i]) != seen.end();
+			seen.push_back(names[i]);
+		}
+		if (pid_events[pid].groups.empty())
+			seen.insert(seen.end(), {"power/energy-pkg/", "power/energy-ram/", "clos_num", "num_ways", "clos_mask"});
+
+		pid_events[pid].append(evlist, ::is_grouped(evlist) ? ::group_read_size(evlist) : 0, repeated);
 		::enable_counters(evlist);
 	}
+	if (monitor)
+		monitor->add(pid);
 }
 
 
@@ -97,58 +146,41 @@ void Perf::disable_counters(pid_t pid)
 }
 
 
-uint64_t read_max_ujoules_ram()
+// The energy is read every interval, so the files are read into a buffer in the stack instead of
+// with a stream, which allocates memory
+static uint64_t read_sysfs_uint(const char *path)
 {
-	// TODO: This needs improvement... i.e. consider more packages etc.
-	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/max_energy_range_uj");
-	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/name");
-	uint64_t data;
-
-	fdata >> data;
-
-	std::string name;
-	fname >> name;
-
-	assert(name == "dram");
-
-	return data;
+	char buffer[32];
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Could not open '{}': {}"_format(path, strerror(errno))));
+	ssize_t n = ::read(fd, buffer, sizeof(buffer) - 1);
+	::close(fd);
+	if (n <= 0)
+		throw_with_trace(std::runtime_error("Could not read '{}'"_format(path)));
+	buffer[n] = '\0';
+	return std::strtoull(buffer, NULL, 10);
 }
 
 
-uint64_t read_max_ujoules_pkg()
+static std::string read_domain_name(const std::string &path)
 {
-	// TODO: This needs improvement... i.e. consider more packages etc.
-	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/max_energy_range_uj");
-	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/name");
-	uint64_t data;
-
-	fdata >> data;
-
+	auto fname = open_ifstream(path);
 	std::string name;
 	fname >> name;
-
-	assert(name == "package-0");
-
-	return data;
+	return name;
 }
 
 
 double read_energy_ram()
 {
 	// TODO: This needs improvement... i.e. consider more packages etc.
-	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/energy_uj");
-	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/name");
-	uint64_t data;
-
-	fdata >> data;
-
-	std::string name;
-	fname >> name;
+	static const bool checked = read_domain_name("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/name") == "dram";
+	assert(checked);
+	(void) checked;
 
+	uint64_t data = read_sysfs_uint("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/energy_uj");
 	LOGDEB("RAM energy: " << data);
-
-	assert(name == "dram");
-
 	return (double) data / 1E6; // Convert it to joules
 }
 
@@ -156,19 +188,12 @@ double read_energy_ram()
 double read_energy_pkg()
 {
 	// TODO: This needs improvement... i.e. consider more packages etc.
-	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/energy_uj");
-	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/name");
-	uint64_t data;
-
-	fdata >> data;
-
-	std::string name;
-	fname >> name;
+	static const bool checked = read_domain_name("/sys/class/powercap/intel-rapl:0/name") == "package-0";
+	assert(checked);
+	(void) checked;
 
+	uint64_t data = read_sysfs_uint("/sys/class/powercap/intel-rapl:0/energy_uj");
 	LOGDEB("PKG energy: " << data);
-
-	assert(name == "package-0");
-
 	return (double) data / 1E6; // Convert it to joules
 }
 
@@ -194,11 +219,17 @@ std::vector<counters_t> Perf::read_counters(pid_t pid,std::shared_ptr<CAT> cat)
 	auto result = std::vector<counters_t>();
 
 	bool first = true;
-	for (const auto &evlist : pid_events[pid].groups)
+	auto &desc = pid_events[pid];
+	for (size_t g = 0; g < desc.groups.size(); g++)
 	{
+		const auto &evlist = desc.groups[g];
+		auto &buffer = desc.buffers[g];
 		int n = ::num_entries(evlist);
 		auto counters = counters_t();
-		::read_counters(evlist, names, results, units, snapshot, enabled, running);
+		if (buffer.empty())
+			::read_counters(evlist, names, results, units, snapshot, enabled, running);
+		else if (int err = ::read_counters_group(evlist, buffer.data(), buffer.size() * sizeof(uint64_t), names, results, units, snapshot, enabled, running))
+			throw_with_trace(std::runtime_error("Could not read the counters of pid {}: {}"_format(pid, strerror(-err))));
 		int i;
 		for (i = 0; i < n; i++)
 		{
@@ -212,8 +243,14 @@ std::vector<counters_t> Perf::read_counters(pid_t pid,std::shared_ptr<CAT> cat)
 			counters.insert({i++, eram, read_energy_ram(), "j", false, 1, 1});
 			// LUCIA put values
 			counters.insert({i++, closnum, get_clos_pid(pid,cat), "", true, 1, 1});
-			counters.insert({i++, maskhex, get_mask_pid(pid,cat), "", true, 1, 1});
 			counters.insert({i++, numways, get_num_ways_pid(pid,cat), "", true, 1, 1});
+			counters.insert({i++, maskhex, get_mask_pid(pid,cat), "", true, 1, 1});
+			if (monitor)
+			{
+				const auto values = monitor->get_values(pid);
+				for (const auto &e : monitor->get_events())
+					counters.insert({i++, ResctrlMon::event_name(e), values[e], ResctrlMon::event_unit(e), ResctrlMon::is_snapshot(e), 1, 1});
+			}
 
 			first = false;
 		}
@@ -253,6 +290,9 @@ std::vector<std::vector<std::string>> Perf::get_names(pid_t pid)
 			v.push_back(closnum);
 			v.push_back(numways);
 			v.push_back(maskhex);
+			if (monitor)
+				for (const auto &e : monitor->get_events())
+					v.push_back(ResctrlMon::event_name(e));
 			first = false;
 		}
 		r.push_back(v);
@@ -261,6 +301,115 @@ std::vector<std::vector<std::string>> Perf::get_names(pid_t pid)
 }
 
 
+counters_t Perf::read_all_counters(pid_t pid, std::shared_ptr<CAT> cat)
+{
+	auto result = counters_t();
+	for (const auto &counters : read_counters(pid, cat))
+	{
+		for (const auto &c : counters.get<by_id>())
+		{
+			Counter copy = c;
+			copy.id = result.size();
+			if (!result.insert(copy).second)
+				LOGDEB("Counter '{}' is in more than one group, using the first one"_format(c.name));
+		}
+	}
+	return result;
+}
+
+
+std::vector<std::string> Perf::get_all_names(pid_t pid)
+{
+	auto result = std::vector<std::string>();
+	for (const auto &names : get_names(pid))
+		for (const auto &name : names)
+			if (std::find(result.begin(), result.end(), name) == result.end())
+				result.push_back(name);
+	return result;
+}
+
+
+void Perf::read_sample(pid_t pid, std::shared_ptr<CAT> cat, Sample &sample, uint32_t domain)
+{
+	const char *names[max_num_events];
+	double results[max_num_events];
+	const char *units[max_num_events];
+	bool snapshot[max_num_events];
+	uint64_t enabled[max_num_events];
+	uint64_t running[max_num_events];
+
+	// The names are only copied the first time, the next reads overwrite the values in place
+	const bool first = sample.names.empty();
+	if (first)
+	{
+		sample.values.clear();
+		sample.enabled.clear();
+		sample.running.clear();
+	}
+	size_t pos = 0;
+	auto add = [&](const char *name, double value, bool snap, uint64_t e, uint64_t r)
+	{
+		if (first)
+		{
+			sample.names.push_back(name);
+			sample.snapshot.push_back(snap);
+			sample.values.push_back(value);
+			sample.enabled.push_back(e);
+			sample.running.push_back(r);
+		}
+		else
+		{
+			assert(pos < sample.size());
+			sample.values[pos] = value;
+			sample.enabled[pos] = e;
+			sample.running[pos] = r;
+		}
+		pos++;
+	};
+
+	// The time is taken before reading, as reading the energy and CAT files takes longer than the counters
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	sample.time_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	// Not 'operator[]', which could insert
+	auto &desc = pid_events.at(pid);
+	for (size_t g = 0; g < desc.groups.size(); g++)
+	{
+		const auto &evlist = desc.groups[g];
+		auto &buffer = desc.buffers[g];
+		const auto &repeated = desc.repeated[g];
+		int n = ::num_entries(evlist);
+		if (buffer.empty())
+			::read_counters(evlist, names, results, units, snapshot, enabled, running);
+		else if (int err = ::read_counters_group(evlist, buffer.data(), buffer.size() * sizeof(uint64_t), names, results, units, snapshot, enabled, running))
+			throw_with_trace(std::runtime_error("Could not read the counters of pid {}: {}"_format(pid, strerror(-err))));
+		for (int i = 0; i < n; i++)
+		{
+			assert(running[i] <= enabled[i]);
+			if (!repeated[i])
+				add(names[i], results[i], snapshot[i], enabled[i], running[i]);
+		}
+		// Put energy measurements only in the first group
+		if (g == 0)
+		{
+			add("power/energy-pkg/", read_energy_pkg(), false, 1, 1);
+			add("power/energy-ram/", read_energy_ram(), false, 1, 1);
+			add("clos_num", get_clos_pid(pid, cat), true, 1, 1);
+			add("num_ways", get_num_ways_pid(pid, cat, domain), true, 1, 1);
+			add("clos_mask", get_mask_pid(pid, cat, domain), true, 1, 1);
+			if (monitor)
+			{
+				const auto values = monitor->get_values(pid);
+				for (const auto &e : monitor->get_events())
+					add(ResctrlMon::event_name(e).c_str(), values[e], ResctrlMon::is_snapshot(e), 1, 1);
+			}
+		}
+	}
+	assert(pos == sample.size());
+}
+
+
 void Perf::print_counters(pid_t pid)
 {
 	for (const auto &evlist : pid_events[pid].groups)
@@ -10,14 +10,15 @@
 #include <boost/multi_index/member.hpp>
 #include "cat-linux.hpp"
 #include "common.hpp"
+#include "resctrl-mon.hpp"
 #include "throw-with-trace.hpp"
 
 
 namespace mi = boost::multi_index;
 
 double get_clos_pid(pid_t pid,std::shared_ptr<CAT> cat);
-double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat);
-double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat);
+double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat, uint32_t domain = CAT::all_domains);
+double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat, uint32_t domain = CAT::all_domains);
 
 struct perf_evlist;
 
@@ -58,6 +59,24 @@ typedef mi::multi_index_container<
 > counters_t;
 
 
+// Values of all the counters of a task in one read, in the order of 'Perf::get_all_names'. The
+// buffers are sized by the first read into them and reused by the following ones.
+struct Sample
+{
+	// Set by the first read
+	std::vector<std::string> names;
+	std::vector<bool> snapshot;
+
+	// Set by every read
+	std::vector<double> values;
+	std::vector<uint64_t> enabled;
+	std::vector<uint64_t> running;
+	uint64_t time_ns = 0; // CLOCK_MONOTONIC when it was read, 0 if unknown
+
+	size_t size() const { return values.size(); }
+};
+
+
 class Perf
 {
 	const int max_num_events = 32;
@@ -66,15 +85,29 @@ class Perf
 	{
 		std::vector<struct perf_evlist*> groups;
 
+		// Preallocated buffers for reading each group with a single read, empty if the group could not be created
+		std::vector<std::vector<uint64_t>> buffers;
+
+		// Events of each group that are also in a previous one, and are not in the samples
+		std::vector<std::vector<bool>> repeated;
+
 		EventDesc() = default;
 		EventDesc(const std::vector<struct perf_evlist*> &_groups) :
-				groups(_groups) {};
-		void append(struct perf_evlist *ev_list) { groups.push_back(ev_list); }
+				groups(_groups), buffers(_groups.size()), repeated(_groups.size()) {};
+		void append(struct perf_evlist *ev_list, size_t buffer_size, const std::vector<bool> &_repeated)
+		{
+			groups.push_back(ev_list);
+			buffers.push_back(std::vector<uint64_t>((buffer_size + sizeof(uint64_t) - 1) / sizeof(uint64_t)));
+			repeated.push_back(_repeated);
+		}
 	};
 
 	std::map<pid_t, EventDesc> pid_events;
 	bool initialized = false;
 
+	// Provides the occupancy and bandwidth events instead of perf, if set
+	std::shared_ptr<ResctrlMon> monitor;
+
 	public:
 
 	Perf() = default;
@@ -93,16 +126,26 @@ class Perf
 	void init();
 	void clean();
 	void clean(pid_t pid);
-	void setup_events(pid_t pid, const std::vector<std::string> &groups);
+	// If 'pin_first' is set, the first group is pinned to the PMU so it is never multiplexed
+	void setup_events(pid_t pid, const std::vector<std::string> &groups, bool pin_first = false);
 	std::vector<counters_t> read_counters(pid_t pid,std::shared_ptr<CAT> cat);
 	std::vector<std::vector<std::string>> get_names(pid_t pid);
-	void enable_counters(pid_t pid);
-	void disable_counters(pid_t pid);
-	void print_counters(pid_t pid);
-};
 
+	// The counters of all the groups together, with consecutive ids
+	counters_t read_all_counters(pid_t pid, std::shared_ptr<CAT> cat);
+	std::vector<std::string> get_all_names(pid_t pid);
 
-uint64_t read_max_ujoules_ram();
-uint64_t read_max_ujoules_pkg();
+	// Same as 'read_all_counters', but into the buffers of 'sample', so once they have the right
+	// size reading does not allocate memory. The mask is the one of the CLOS in 'domain'.
+	void read_sample(pid_t pid, std::shared_ptr<CAT> cat, Sample &sample, uint32_t domain = CAT::all_domains);
 
+	void enable_counters(pid_t pid);
+	void disable_counters(pid_t pid);
+	void print_counters(pid_t pid);
 
+	// The events of the monitor are removed from the groups of the tasks set up after this,
+	// and its values go in the first group, after the CLOS ones
+	void set_monitor(std::shared_ptr<ResctrlMon> _monitor) { monitor = _monitor; }
+	// Read the monitoring groups of all the tasks, once per interval before reading their counters
+	void read_monitor() { if (monitor) monitor->read(); }
+};
@@ -0,0 +1,80 @@
+#include <iostream>
+
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+
+#include "fake-resctrl.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace po = boost::program_options;
+
+using std::string;
+using fmt::literals::operator""_format;
+
+
+int main(int argc, char *argv[])
+{
+	const auto defaults = FakeResctrl::Config();
+
+	po::options_description desc("Create a fake resctrl tree in a regular directory, for running the manager with --resctrl-root without CAT hardware.\nAllowed options");
+	desc.add_options()
+		("help,h", "print usage message")
+		("root,r", po::value<string>()->required(), "directory of the tree, it has to be empty or not exist")
+		("ways", po::value<uint32_t>()->default_value(defaults.ways), "ways of the L3, bits of the masks")
+		("closids", po::value<uint32_t>()->default_value(defaults.num_closids), "number of CLOS")
+		("domains", po::value<uint32_t>()->default_value(defaults.num_domains), "number of L3 domains")
+		("min-cbm-bits", po::value<uint32_t>()->default_value(defaults.min_cbm_bits), "minimum number of ways of a mask")
+		("cpus", po::value<uint32_t>()->default_value(defaults.num_cpus), "number of cpus, 0 for the online ones")
+		("cdp", po::bool_switch(), "code and data prioritization, L3CODE and L3DATA instead of L3")
+		("mba", po::bool_switch(), "memory bandwidth allocation")
+		("latency-us", po::value<uint32_t>()->default_value(defaults.latency_us), "delay of every schemata and tasks write, in microseconds")
+		;
+
+	po::positional_options_description pos;
+	pos.add("root", 1);
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+		if (vm.count("help"))
+		{
+			std::cout << desc << std::endl;
+			return EXIT_SUCCESS;
+		}
+		po::notify(vm);
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << e.what() << std::endl << desc << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		auto config = FakeResctrl::Config();
+		config.ways = vm["ways"].as<uint32_t>();
+		config.num_closids = vm["closids"].as<uint32_t>();
+		config.num_domains = vm["domains"].as<uint32_t>();
+		config.min_cbm_bits = vm["min-cbm-bits"].as<uint32_t>();
+		config.num_cpus = vm["cpus"].as<uint32_t>();
+		config.cdp = vm["cdp"].as<bool>();
+		config.mba = vm["mba"].as<bool>();
+		config.latency_us = vm["latency-us"].as<uint32_t>();
+
+		const string root = vm["root"].as<string>();
+		FakeResctrl::create(root, config);
+		std::cout << "Fake resctrl with {} ways, {} CLOS and {} domains in '{}'"_format(config.ways, config.num_closids, config.num_domains, root) << std::endl;
+	}
+	catch (const std::exception &e)
+	{
+		const auto st = boost::get_error_info<traced>(e);
+		std::cerr << e.what() << std::endl;
+		if (st)
+			std::cerr << *st << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
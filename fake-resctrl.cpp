@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include "fake-resctrl.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using std::vector;
+using fmt::literals::operator""_format;
+
+
+const std::string FakeResctrl::marker = "fake-resctrl";
+
+
+static
+string read_file(const fs::path &path)
+{
+	std::ifstream f(path.string());
+	if (!f)
+		throw_with_trace(std::runtime_error("Could not open '{}'"_format(path.string())));
+	std::stringstream ss;
+	ss << f.rdbuf();
+	return ss.str();
+}
+
+
+static
+void write_file(const fs::path &path, const string &content)
+{
+	std::ofstream f(path.string());
+	if (!(f << content))
+		throw_with_trace(std::runtime_error("Could not write '{}'"_format(path.string())));
+}
+
+
+static
+uint64_t read_cpus(const fs::path &dir)
+{
+	uint64_t cpus = 0;
+	std::istringstream(read_file(dir / "cpus")) >> std::hex >> cpus;
+	return cpus;
+}
+
+
+static
+void write_cpus_file(const fs::path &dir, uint64_t cpus)
+{
+	write_file(dir / "cpus", "{:x}\n"_format(cpus));
+}
+
+
+static
+vector<pid_t> read_tasks(const fs::path &dir)
+{
+	auto pids = vector<pid_t>();
+	std::istringstream ss(read_file(dir / "tasks"));
+	pid_t pid;
+	while (ss >> pid)
+		pids.push_back(pid);
+	return pids;
+}
+
+
+static
+void write_tasks_file(const fs::path &dir, const vector<pid_t> &pids)
+{
+	string content;
+	for (const auto &pid : pids)
+		content += "{}\n"_format(pid);
+	write_file(dir / "tasks", content);
+}
+
+
+void FakeResctrl::create(const std::string &root, const Config &config)
+{
+	if (config.ways == 0 || config.ways > 64 || config.min_cbm_bits == 0 || config.min_cbm_bits > config.ways)
+		throw_with_trace(std::runtime_error("A fake resctrl needs between 1 and 64 ways, and at least 'min_cbm_bits' of them"));
+	if (config.num_closids == 0 || config.num_domains == 0)
+		throw_with_trace(std::runtime_error("A fake resctrl needs at least one CLOS and one domain"));
+	const uint32_t num_cpus = config.num_cpus ? config.num_cpus : std::max(std::thread::hardware_concurrency(), 1U);
+	if (num_cpus > 64)
+		throw_with_trace(std::runtime_error("A fake resctrl can have at most 64 cpus"));
+	if (fs::exists(root) && !fs::is_empty(root))
+		throw_with_trace(std::runtime_error("Cannot create a fake resctrl in '{}', it is not empty"_format(root)));
+
+	const auto dir = fs::path(root);
+	const uint64_t mask = config.ways == 64 ? -1ULL : (1ULL << config.ways) - 1;
+	auto line = [&](const string &resource, const string &value)
+	{
+		string result = resource + ":";
+		for (uint32_t d = 0; d < config.num_domains; d++)
+			result += "{}{}={}"_format(d ? ";" : "", d, value);
+		return result + "\n";
+	};
+
+	string schemata;
+	for (const string &resource : config.cdp ? vector<string>{"L3DATA", "L3CODE"} : vector<string>{"L3"})
+	{
+		const auto info = dir / "info" / resource;
+		fs::create_directories(info);
+		write_file(info / "cbm_mask", "{:x}\n"_format(mask));
+		write_file(info / "min_cbm_bits", "{}\n"_format(config.min_cbm_bits));
+		write_file(info / "num_closids", "{}\n"_format(config.num_closids));
+		write_file(info / "shareable_bits", "0\n");
+		schemata += line(resource, "{:x}"_format(mask));
+	}
+	if (config.mba)
+	{
+		const auto info = dir / "info" / "MB";
+		fs::create_directories(info);
+		write_file(info / "min_bandwidth", "10\n");
+		write_file(info / "bandwidth_gran", "10\n");
+		write_file(info / "num_closids", "{}\n"_format(config.num_closids));
+		schemata += line("MB", "100");
+	}
+
+	write_file(dir / "schemata", schemata);
+	write_file(dir / "tasks", "");
+	write_cpus_file(dir, num_cpus == 64 ? -1ULL : (1ULL << num_cpus) - 1);
+	write_file(dir / marker, "latency_us {}\n"_format(config.latency_us));
+}
+
+
+bool FakeResctrl::is_fake(const std::string &root)
+{
+	return fs::exists(fs::path(root) / marker);
+}
+
+
+FakeResctrl::FakeResctrl(const std::string &_root) : root(_root)
+{
+	std::istringstream ss(read_file(root / marker));
+	string key;
+	while (ss >> key)
+	{
+		if (key != "latency_us" || !(ss >> latency_us))
+			throw_with_trace(std::runtime_error("Invalid '{}' in '{}'"_format(marker, root.string())));
+	}
+}
+
+
+vector<fs::path> FakeResctrl::groups() const
+{
+	auto result = vector<fs::path>(1, root);
+	for (const auto &p : fs::directory_iterator(root))
+		if (fs::is_directory(p) && p.path().filename() != "info")
+			result.push_back(p.path());
+	return result;
+}
+
+
+void FakeResctrl::delay() const
+{
+	if (latency_us)
+		std::this_thread::sleep_for(std::chrono::microseconds(latency_us));
+}
+
+
+void FakeResctrl::mkdir(const fs::path &dir) const
+{
+	// The lines of the root with the default values of every resource
+	string schemata;
+	std::istringstream lines(read_file(root / "schemata"));
+	string line;
+	while (std::getline(lines, line))
+	{
+		line.erase(0, line.find_first_not_of(' '));
+		const auto colon = line.find(':');
+		if (colon == string::npos)
+			continue;
+		const string resource = line.substr(0, colon);
+		string value = "100";
+		if (resource != "MB")
+		{
+			uint64_t mask;
+			std::istringstream(read_file(root / "info" / resource / "cbm_mask")) >> std::hex >> mask;
+			value = "{:x}"_format(mask);
+		}
+		schemata += resource + ":";
+		std::istringstream domains(line.substr(colon + 1));
+		string domain;
+		bool first = true;
+		while (std::getline(domains, domain, ';'))
+		{
+			schemata += "{}{}={}"_format(first ? "" : ";", domain.substr(0, domain.find('=')), value);
+			first = false;
+		}
+		schemata += "\n";
+	}
+
+	if (!fs::create_directory(dir))
+		throw_with_trace(std::runtime_error("Cannot create the group '{}', it already exists"_format(dir.string())));
+	write_file(dir / "schemata", schemata);
+	write_file(dir / "tasks", "");
+	write_cpus_file(dir, 0);
+}
+
+
+void FakeResctrl::rmdir(const fs::path &dir) const
+{
+	if (fs::equivalent(dir, root))
+		throw_with_trace(std::runtime_error("The root group cannot be removed"));
+
+	auto tasks = read_tasks(root);
+	const auto moved = read_tasks(dir);
+	tasks.insert(tasks.end(), moved.begin(), moved.end());
+	write_tasks_file(root, tasks);
+	write_cpus_file(root, read_cpus(root) | read_cpus(dir));
+	fs::remove_all(dir);
+}
+
+
+// The kernel rejects the write with EINVAL
+void FakeResctrl::check(const std::string &resource, const std::string &value) const
+{
+	const uint64_t v = std::stoull(value, nullptr, resource == "MB" ? 10 : 16);
+	if (resource == "MB")
+	{
+		if (v == 0 || v > 100)
+			throw_with_trace(std::runtime_error("Invalid MB bandwidth '{}'"_format(value)));
+		return;
+	}
+
+	uint64_t mask;
+	uint32_t min_cbm_bits;
+	std::istringstream(read_file(root / "info" / resource / "cbm_mask")) >> std::hex >> mask;
+	std::istringstream(read_file(root / "info" / resource / "min_cbm_bits")) >> min_cbm_bits;
+	const uint64_t shifted = v ? v >> __builtin_ctzll(v) : 0;
+	if ((v & ~mask) || (uint32_t) __builtin_popcountll(v) < min_cbm_bits || (shifted & (shifted + 1)))
+		throw_with_trace(std::runtime_error("Invalid {} mask '{}'"_format(resource, value)));
+}
+
+
+// The schemata written has the line of a resource, maybe with only some domains
+void FakeResctrl::write_schemata(const fs::path &dir, const std::string &schemata) const
+{
+	delay();
+
+	const auto colon = schemata.find(':');
+	if (colon == string::npos)
+		throw_with_trace(std::runtime_error("Invalid schemata '{}'"_format(schemata)));
+	const string resource = schemata.substr(0, colon);
+	auto written = std::map<string, string>();
+	std::istringstream domains(schemata.substr(colon + 1));
+	string domain;
+	while (std::getline(domains, domain, ';'))
+	{
+		const auto eq = domain.find('=');
+		if (eq == string::npos)
+			throw_with_trace(std::runtime_error("Invalid schemata '{}'"_format(schemata)));
+		written[domain.substr(0, eq)] = domain.substr(eq + 1);
+		check(resource, domain.substr(eq + 1));
+	}
+
+	string result;
+	bool found = false;
+	std::istringstream lines(read_file(dir / "schemata"));
+	string line;
+	while (std::getline(lines, line))
+	{
+		line.erase(0, line.find_first_not_of(' '));
+		if (line.compare(0, resource.size() + 1, resource + ":"))
+		{
+			result += line + "\n";
+			continue;
+		}
+		found = true;
+		result += resource + ":";
+		std::istringstream current(line.substr(resource.size() + 1));
+		bool first = true;
+		while (std::getline(current, domain, ';'))
+		{
+			const string id = domain.substr(0, domain.find('='));
+			result += (first ? "" : ";") + (written.count(id) ? id + "=" + written[id] : domain);
+			written.erase(id);
+			first = false;
+		}
+		result += "\n";
+	}
+	if (!found || !written.empty())
+		throw_with_trace(std::runtime_error("Invalid schemata '{}' for '{}'"_format(schemata, dir.string())));
+	write_file(dir / "schemata", result);
+}
+
+
+void FakeResctrl::write_tasks(const fs::path &dir, const std::vector<pid_t> &pids) const
+{
+	delay();
+
+	for (const auto &group : groups())
+	{
+		auto tasks = read_tasks(group);
+		auto end = std::remove_if(tasks.begin(), tasks.end(), [&](pid_t p) { return std::find(pids.begin(), pids.end(), p) != pids.end(); });
+		if (fs::equivalent(group, dir))
+		{
+			tasks.erase(end, tasks.end());
+			tasks.insert(tasks.end(), pids.begin(), pids.end());
+			write_tasks_file(group, tasks);
+		}
+		else if (end != tasks.end())
+		{
+			tasks.erase(end, tasks.end());
+			write_tasks_file(group, tasks);
+		}
+	}
+}
+
+
+void FakeResctrl::write_cpus(const fs::path &dir, uint64_t cpus) const
+{
+	const bool is_root = fs::equivalent(dir, root);
+	const uint64_t left = is_root ? 0 : read_cpus(dir) & ~cpus;
+	for (const auto &group : groups())
+	{
+		if (fs::equivalent(group, dir))
+			write_cpus_file(group, cpus);
+		else if (fs::equivalent(group, root))
+			write_cpus_file(group, (read_cpus(group) & ~cpus) | left);
+		else
+			write_cpus_file(group, read_cpus(group) & ~cpus);
+	}
+}
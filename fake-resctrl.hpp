@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <sys/types.h>
+
+
+// A resctrl tree in a regular directory, to run and benchmark the control plane
+// without CAT hardware or root privileges. CATLinux detects it by the marker file
+// in its root and calls this for its writes, which does what the kernel would:
+//
+//   mkdir    the new group gets the complete masks, and no tasks or cpus
+//   rmdir    the tasks and cpus of the group go back to the root
+//   schemata the domains written replace the ones in the file, the rest are kept,
+//            and the masks have to be contiguous, with at least min_cbm_bits
+//   tasks    the pids leave the group they were in
+//   cpus     the cpus leave the other groups, the ones left go to the root
+//
+// The writes of the schemata and tasks can be delayed to emulate the latency of
+// the kernel.
+class FakeResctrl
+{
+	public:
+
+	struct Config
+	{
+		uint32_t ways = 20;
+		uint32_t num_closids = 16;
+		uint32_t num_domains = 1;
+		uint32_t min_cbm_bits = 1;
+		uint32_t num_cpus = 0;   // 0 for the online cpus, at most 64
+		bool cdp = false;        // L3CODE and L3DATA instead of L3
+		bool mba = false;
+		uint32_t latency_us = 0; // Of every schemata and tasks write
+	};
+
+	static const std::string marker; // File in the root of the fake trees
+
+	static void create(const std::string &root, const Config &config); // The root has to be empty or not exist
+	static bool is_fake(const std::string &root);
+
+	explicit FakeResctrl(const std::string &_root);
+
+	#define FS boost::filesystem
+	void mkdir(const FS::path &dir) const;
+	void rmdir(const FS::path &dir) const;
+	void write_schemata(const FS::path &dir, const std::string &schemata) const;
+	void write_tasks(const FS::path &dir, const std::vector<pid_t> &pids) const;
+	void write_cpus(const FS::path &dir, uint64_t cpus) const;
+	#undef FS
+
+	uint32_t get_latency_us() const { return latency_us; }
+
+	private:
+
+	boost::filesystem::path root;
+	uint32_t latency_us = 0;
+
+	std::vector<boost::filesystem::path> groups() const; // With the root first
+	void check(const std::string &resource, const std::string &value) const;
+	void delay() const;
+};
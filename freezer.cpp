@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "freezer.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+std::string Freezer::find_cgroup2_mount()
+{
+	std::ifstream mounts("/proc/self/mounts");
+	std::string line;
+	while (std::getline(mounts, line))
+	{
+		std::istringstream ss(line);
+		std::string dev, dir, type;
+		ss >> dev >> dir >> type;
+		if (type == "cgroup2")
+			return dir;
+	}
+	throw_with_trace(std::runtime_error("There is no cgroup2 filesystem mounted"));
+}
+
+
+Freezer::Freezer()
+{
+	// The cgroup v2 of this process is in the line with hierarchy id 0
+	std::ifstream cgroups("/proc/self/cgroup");
+	std::string line, self;
+	while (std::getline(cgroups, line))
+		if (line.compare(0, 3, "0::") == 0)
+			self = line.substr(3);
+	if (self == "/")
+		self = "";
+
+	root = "{}{}/manager-{}"_format(find_cgroup2_mount(), self, getpid());
+	if (mkdir(root.c_str(), 0755) < 0 && errno != EEXIST)
+		throw_with_trace(std::runtime_error("Could not create cgroup '{}': {}"_format(root, strerror(errno))));
+	if (access((root + "/cgroup.freeze").c_str(), W_OK) < 0)
+		throw_with_trace(std::runtime_error("The cgroup '{}' has no usable cgroup.freeze, the freezer needs Linux 5.2 or newer"_format(root)));
+	LOGINF("Using the cgroup v2 freezer in '{}'"_format(root));
+}
+
+
+Freezer::~Freezer()
+{
+	// The tasks have been killed, but their cgroups may take a moment to become empty
+	auto dirs = stale;
+	for (const auto &l : leaves)
+		dirs.push_back(l.second.path);
+	dirs.push_back(root);
+
+	for (const auto &dir : dirs)
+	{
+		for (int i = 0; rmdir(dir.c_str()) < 0 && errno == EBUSY && i < 100; i++)
+			usleep(1000);
+		if (access(dir.c_str(), F_OK) == 0)
+			LOGWAR("Could not remove cgroup '{}': {}"_format(dir, strerror(errno)));
+	}
+}
+
+
+void Freezer::write_freeze(const std::string &path, bool value) const
+{
+	const std::string file = path + "/cgroup.freeze";
+	int fd = open(file.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Could not open '{}': {}"_format(file, strerror(errno))));
+	ssize_t ret = write(fd, value ? "1" : "0", 1);
+	int err = errno;
+	close(fd);
+	if (ret != 1)
+		throw_with_trace(std::runtime_error("Could not write '{}': {}"_format(file, strerror(err))));
+}
+
+
+// Wait until cgroup.events says the cgroup is frozen. The file is modified, and
+// raises POLLPRI, every time its contents change.
+void Freezer::wait_frozen(const std::string &path, int timeout_ms) const
+{
+	namespace chr = std::chrono;
+	const auto deadline = chr::steady_clock::now() + chr::milliseconds(timeout_ms);
+	const std::string file = path + "/cgroup.events";
+
+	int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Could not open '{}': {}"_format(file, strerror(errno))));
+
+	for (;;)
+	{
+		char buf[256];
+		ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+		if (n < 0)
+		{
+			int err = errno;
+			close(fd);
+			throw_with_trace(std::runtime_error("Could not read '{}': {}"_format(file, strerror(err))));
+		}
+		buf[n] = '\0';
+		if (strstr(buf, "frozen 1"))
+			break;
+
+		int remaining = chr::duration_cast<chr::milliseconds>(deadline - chr::steady_clock::now()).count();
+		if (remaining <= 0)
+		{
+			close(fd);
+			throw_with_trace(std::runtime_error("Timeout waiting for cgroup '{}' to freeze"_format(path)));
+		}
+
+		struct pollfd pfd = {fd, POLLPRI, 0};
+		poll(&pfd, 1, remaining);
+	}
+	close(fd);
+}
+
+
+bool Freezer::covers_all(const std::vector<uint32_t> &ids) const
+{
+	if (ids.size() != leaves.size())
+		return false;
+	for (const auto &id : ids)
+		if (!leaves.count(id))
+			return false;
+	return true;
+}
+
+
+void Freezer::add(uint32_t id)
+{
+	if (leaves.count(id))
+		return;
+
+	Leaf leaf;
+	leaf.path = "{}/task-{}"_format(root, id);
+	if (mkdir(leaf.path.c_str(), 0755) < 0 && errno != EEXIST)
+		throw_with_trace(std::runtime_error("Could not create cgroup '{}': {}"_format(leaf.path, strerror(errno))));
+	leaves[id] = leaf;
+}
+
+
+void Freezer::remove(uint32_t id)
+{
+	auto it = leaves.find(id);
+	if (it == leaves.end())
+		return;
+
+	if (rmdir(it->second.path.c_str()) < 0)
+	{
+		LOGDEB("Cgroup '{}' not removed yet: {}"_format(it->second.path, strerror(errno)));
+		stale.push_back(it->second.path);
+	}
+	leaves.erase(it);
+}
+
+
+void Freezer::enter(uint32_t id) const
+{
+	auto it = leaves.find(id);
+	if (it == leaves.end())
+		throw_with_trace(std::runtime_error("Task {} has no cgroup"_format(id)));
+
+	const std::string file = it->second.path + "/cgroup.procs";
+	int fd = open(file.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Could not open '{}': {}"_format(file, strerror(errno))));
+	ssize_t ret = write(fd, "0", 1); // 0 is the writing process
+	int err = errno;
+	close(fd);
+	if (ret != 1)
+		throw_with_trace(std::runtime_error("Could not move to cgroup '{}': {}"_format(it->second.path, strerror(err))));
+}
+
+
+void Freezer::freeze(const std::vector<uint32_t> &ids, int timeout_ms)
+{
+	// Already frozen by the parent
+	if (root_frozen || ids.empty())
+		return;
+
+	// All the tasks at once
+	if (covers_all(ids))
+	{
+		write_freeze(root, true);
+		root_frozen = true;
+		wait_frozen(root, timeout_ms);
+		return;
+	}
+
+	auto written = std::vector<const Leaf *>();
+	for (const auto &id : ids)
+	{
+		Leaf &leaf = leaves.at(id);
+		if (leaf.frozen)
+			continue;
+		write_freeze(leaf.path, true);
+		leaf.frozen = true;
+		written.push_back(&leaf);
+	}
+	for (const auto &leaf : written)
+		wait_frozen(leaf->path, timeout_ms);
+}
+
+
+// Thawing takes effect immediately, there is no need to wait for cgroup.events
+void Freezer::thaw(const std::vector<uint32_t> &ids)
+{
+	if (root_frozen)
+	{
+		// The tasks not thawed have to remain frozen when the parent is thawed
+		for (auto &l : leaves)
+		{
+			if (l.second.frozen || std::find(ids.begin(), ids.end(), l.first) != ids.end())
+				continue;
+			write_freeze(l.second.path, true);
+			l.second.frozen = true;
+		}
+	}
+
+	for (const auto &id : ids)
+	{
+		Leaf &leaf = leaves.at(id);
+		if (!leaf.frozen)
+			continue;
+		write_freeze(leaf.path, false);
+		leaf.frozen = false;
+	}
+
+	if (root_frozen)
+	{
+		write_freeze(root, false);
+		root_frozen = false;
+	}
+}
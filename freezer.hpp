@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// Pauses and resumes tasks with the cgroup v2 freezer. Every task is placed, with
+// all its descendants, in its own leaf cgroup below a parent cgroup created for
+// this manager:
+//
+//   <cgroup of the manager>/manager-<pid>/task-<id>
+//
+// Freezing every leaf at once is done with a single write to the parent. The
+// leaves are also frozen individually when only some of the tasks are paused.
+class Freezer
+{
+	struct Leaf
+	{
+		std::string path;
+		bool frozen = false; // Value written to its cgroup.freeze
+	};
+
+	std::string root;              // Parent cgroup
+	bool root_frozen = false;      // Value written to cgroup.freeze of the parent
+	std::map<uint32_t, Leaf> leaves;
+	std::vector<std::string> stale; // Leaves of tasks that are done and could not be removed yet
+
+	void write_freeze(const std::string &path, bool value) const;
+	void wait_frozen(const std::string &path, int timeout_ms) const;
+	bool covers_all(const std::vector<uint32_t> &ids) const;
+
+	public:
+
+	// The parent cgroup is created in the cgroup of this process, in the cgroup2 mount
+	Freezer();
+	~Freezer();
+
+	Freezer(const Freezer &) = delete;
+	Freezer& operator=(const Freezer &) = delete;
+
+	// Create the leaf of a task, if it does not exist yet
+	void add(uint32_t id);
+
+	// Remove the leaf of a task that is done
+	void remove(uint32_t id);
+
+	// Move the calling process into the leaf of the task. For the children, before exec.
+	void enter(uint32_t id) const;
+
+	// Freeze the tasks and wait until they are frozen
+	void freeze(const std::vector<uint32_t> &ids, int timeout_ms = 10000);
+
+	// Thaw the tasks, the rest remain frozen if they were
+	void thaw(const std::vector<uint32_t> &ids);
+
+	const std::string& get_root() const { return root; }
+
+	static std::string find_cgroup2_mount();
+};
@@ -0,0 +1,108 @@
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <fmt/format.h>
+
+#include "interval-clock.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace acc = boost::accumulators;
+
+using fmt::literals::operator""_format;
+
+
+static const double probs[] = {0.5, 0.9, 0.99};
+
+
+uint64_t IntervalClock::now_ns()
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		throw_with_trace(std::runtime_error("Could not read the monotonic clock: " + std::string(strerror(errno))));
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+IntervalClock::accum_t IntervalClock::make_accum()
+{
+	return accum_t(acc::extended_p_square_probabilities = probs);
+}
+
+
+IntervalClock::IntervalClock(uint64_t period_us) :
+		period_ns(period_us * 1000),
+		length_acc(make_accum()),
+		wakeup_acc(make_accum())
+{
+	if (period_us == 0)
+		throw_with_trace(std::runtime_error("Interval time must be positive and greater than 0"));
+}
+
+
+void IntervalClock::start()
+{
+	t0 = now_ns();
+	next = 1;
+	int_start = t0;
+	int_end = t0;
+}
+
+
+uint64_t IntervalClock::wait()
+{
+	uint64_t deadline = t0 + next * period_ns;
+	uint64_t now = now_ns();
+
+	if (now >= deadline)
+	{
+		// Skip the deadlines we have missed and align to the grid again
+		uint64_t missed = (now - deadline) / period_ns + 1;
+		overruns++;
+		LOGWAR("Interval overrun by {} us, skipping {} deadline(s)"_format((now - deadline) / 1000, missed));
+		next += missed;
+		deadline = t0 + next * period_ns;
+	}
+
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+	int err;
+	while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR)
+		;
+	if (err)
+		throw_with_trace(std::runtime_error("Could not sleep until the end of the interval: " + std::string(strerror(err))));
+
+	now = now_ns();
+	next++;
+
+	int_start = int_end;
+	int_end = now;
+
+	double length_us = (double) (int_end - int_start) / 1000;
+	length_acc(length_us - (double) period_ns / 1000);
+	wakeup_acc((double) (now - deadline) / 1000);
+
+	return std::llround(length_us);
+}
+
+
+std::string IntervalClock::report() const
+{
+	auto to_str = [](const accum_t &a)
+	{
+		return "min {:.1f} max {:.1f} mean {:.1f} std {:.1f} p50 {:.1f} p90 {:.1f} p99 {:.1f}"_format(
+				acc::min(a), acc::max(a), acc::mean(a), std::sqrt(acc::variance(a)),
+				acc::extended_p_square(a)[0], acc::extended_p_square(a)[1], acc::extended_p_square(a)[2]);
+	};
+
+	if (acc::count(length_acc) == 0)
+		return "no intervals measured";
+
+	return "{} intervals, {} overruns\n"
+			"interval length - period (us): {}\n"
+			"wake-up lateness (us): {}"_format(
+			acc::count(length_acc), overruns, to_str(length_acc), to_str(wakeup_acc));
+}
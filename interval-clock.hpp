@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <time.h>
+
+#include <boost/accumulators/accumulators.hpp>
+#include <boost/accumulators/statistics/extended_p_square.hpp>
+#include <boost/accumulators/statistics/max.hpp>
+#include <boost/accumulators/statistics/mean.hpp>
+#include <boost/accumulators/statistics/min.hpp>
+#include <boost/accumulators/statistics/stats.hpp>
+#include <boost/accumulators/statistics/variance.hpp>
+
+
+// Interval clock based on absolute deadlines over CLOCK_MONOTONIC.
+// Deadline k is always t0 + k * period, so the time spent reading counters
+// and applying policies does not accumulate as drift and wall-clock steps
+// (NTP, settimeofday) do not affect the length of the intervals.
+class IntervalClock
+{
+	// Declare the 'accum_t' typedef
+	#define ACC boost::accumulators
+	typedef ACC::accumulator_set <
+		double,
+		ACC::stats <
+			ACC::tag::min,
+			ACC::tag::max,
+			ACC::tag::mean,
+			ACC::tag::variance,
+			ACC::tag::extended_p_square>> accum_t;
+	#undef ACC
+
+	uint64_t period_ns;
+
+	// Monotonic time in ns when the clock was started
+	uint64_t t0 = 0;
+
+	// Index of the next deadline, i.e. deadline = t0 + next * period
+	uint64_t next = 0;
+
+	// Real start and end of the last completed interval
+	uint64_t int_start = 0;
+	uint64_t int_end = 0;
+
+	// Intervals whose deadline had already passed when we tried to sleep
+	uint64_t overruns = 0;
+
+	// Jitter distributions in us: real interval length minus the nominal
+	// period, and wake-up lateness with respect to the deadline
+	accum_t length_acc;
+	accum_t wakeup_acc;
+
+	static uint64_t now_ns();
+	static accum_t make_accum();
+
+	public:
+
+	IntervalClock(uint64_t period_us);
+
+	// Take the current time as the origin of the deadline grid
+	void start();
+
+	// Sleep until the end of the current interval. Returns the real length of
+	// the interval in us. If the deadline has already been missed, the clock
+	// moves to the next deadline in the future instead of trying to catch up
+	// with shorter intervals.
+	uint64_t wait();
+
+	// Real start and end of the last interval, in us since 'start'
+	uint64_t last_start_us() const { return (int_start - t0) / 1000; }
+	uint64_t last_end_us() const { return (int_end - t0) / 1000; }
+
+	// Time in us since 'start'
+	uint64_t elapsed_us() const { return (now_ns() - t0) / 1000; }
+
+	uint64_t get_overruns() const { return overruns; }
+
+	std::string report() const;
+};
@@ -6,7 +6,7 @@ extern "C"
 
 int main(int argc, char **argv)
 {
-	struct perf_evlist* evlist = setup_events(argv[1], argv[2]);
+	struct perf_evlist* evlist = setup_events(argv[1], argv[2], false, false);
 	enable_counters(evlist);
 
 	while(true)
@@ -1,8 +1,10 @@
 #include <linux/time64.h>
+#include <sys/ioctl.h>
 
 #include "util/drv_configs.h"
 #include "util/stat.h"
 #include "util/thread_map.h"
+#include "util/xyarray.h"
 
 #include "libminiperf.h"
 
@@ -23,13 +25,20 @@ static inline void diff_timespec(struct timespec *r, struct timespec *a,
 }
 
 
-static int create_perf_stat_counter(struct perf_evlist *evsel_list, struct perf_evsel *evsel, struct target *target)
+static int create_perf_stat_counter(struct perf_evlist *evsel_list, struct perf_evsel *evsel, struct target *target, bool group, bool pinned)
 {
 	struct perf_event_attr *attr = &evsel->attr;
 
 	attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
 				    PERF_FORMAT_TOTAL_TIME_RUNNING;
 
+	/*
+	 * The whole group is read at once from the leader, and the values
+	 * are matched with their events using the ids.
+	 */
+	if (group)
+		attr->read_format |= PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+
 	attr->inherit = true;
 
 	/*
@@ -58,6 +67,12 @@ static int create_perf_stat_counter(struct perf_evlist *evsel_list, struct perf_
 	{
 		attr->disabled = 1;
 
+		/*
+		 * A pinned group is always on the PMU, it is never
+		 * multiplexed with the other groups.
+		 */
+		attr->pinned = pinned;
+
 		/*
 		 * In case of initial_delay we enable tracee
 		 * events manually.
@@ -150,6 +165,117 @@ void read_counters(struct perf_evlist *evsel_list, const char **names, double *r
 }
 
 
+bool is_grouped(struct perf_evlist *evsel_list)
+{
+	return perf_evlist__first(evsel_list)->attr.read_format & PERF_FORMAT_GROUP;
+}
+
+
+size_t group_read_size(struct perf_evlist *evsel_list)
+{
+	/* nr, time_enabled, time_running and a value and an id per event */
+	return (3 + 2 * evsel_list->nr_entries) * sizeof(uint64_t);
+}
+
+
+/*
+ * Store the kernel ids of the events, so the values of a group read can be
+ * matched with them
+ */
+static int store_ids(struct perf_evlist *evsel_list)
+{
+	struct perf_evsel *counter;
+	int nthreads = thread_map__nr(evsel_list->threads);
+
+	evlist__for_each_entry(evsel_list, counter)
+	{
+		int ncpus = perf_evsel__nr_cpus(counter);
+
+		if (perf_evsel__alloc_id(counter, ncpus, nthreads))
+			return -ENOMEM;
+
+		for (int thread = 0; thread < nthreads; thread++)
+		{
+			for (int cpu = 0; cpu < ncpus; cpu++)
+			{
+				u64 id;
+				int fd = *(int *) xyarray__entry(counter->fd, cpu, thread);
+				if (ioctl(fd, PERF_EVENT_IOC_ID, &id) < 0)
+					return -errno;
+				perf_evlist__id_add(evsel_list, counter, cpu, thread, id);
+			}
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * Read a grouped evlist with a single read() per cpu/thread pair of the
+ * leader. 'buf' has to hold at least group_read_size() bytes and is reused, so
+ * nothing is allocated.
+ */
+int read_counters_group(struct perf_evlist *evsel_list, uint64_t *buf, size_t size, const char **names, double *results, const char **units, bool *snapshot, uint64_t *enabled, uint64_t *running)
+{
+	struct perf_evsel *leader = perf_evlist__first(evsel_list);
+	struct perf_evsel *counter;
+	int nthreads = thread_map__nr(evsel_list->threads);
+	int ncpus = perf_evsel__nr_cpus(leader);
+	uint64_t nr = evsel_list->nr_entries;
+	uint64_t ena = 0, run = 0;
+
+	if (size < group_read_size(evsel_list))
+		return -ENOSPC;
+
+	for (uint64_t i = 0; i < nr; i++)
+		results[i] = 0;
+
+	for (int thread = 0; thread < nthreads; thread++)
+	{
+		for (int cpu = 0; cpu < ncpus; cpu++)
+		{
+			int fd = *(int *) xyarray__entry(leader->fd, cpu, thread);
+			if (read(fd, buf, size) < 0)
+				return -errno;
+			if (buf[0] != nr)
+				return -EINVAL;
+
+			ena += buf[1];
+			run += buf[2];
+			for (uint64_t i = 0; i < nr; i++)
+			{
+				uint64_t value = buf[3 + 2 * i];
+				uint64_t id = buf[4 + 2 * i];
+
+				/* The kernel returns them in group order, the id is just a check */
+				counter = perf_evlist__id2evsel(evsel_list, id);
+				results[counter ? counter->idx : (int) i] += value;
+			}
+		}
+	}
+
+	size_t i = 0;
+	evlist__for_each_entry(evsel_list, counter)
+	{
+		if (names)
+			names[i] = counter->name;
+		results[i] *= counter->scale;
+		if (units)
+			units[i] = counter->unit;
+		if (snapshot)
+			snapshot[i] = counter->snapshot;
+		if (enabled)
+			enabled[i] = ena;
+		if (running)
+			running[i] = run;
+		i++;
+	}
+	assert(run <= ena);
+
+	return 0;
+}
+
+
 void get_names(struct perf_evlist *evsel_list, const char **names)
 {
 	struct perf_evsel *counter;
@@ -211,10 +337,9 @@ void print_counters2(struct perf_evlist *evsel_list, struct timespec *ts)
 }
 
 
-struct perf_evlist* setup_events(const char *pid, const char *events)
+struct perf_evlist* setup_events(const char *pid, const char *events, bool group, bool pinned)
 {
 	struct perf_evlist	*evsel_list = NULL;
-	bool group = false;
 
 	struct target target = {
 		.uid	= UINT_MAX,
@@ -250,11 +375,19 @@ struct perf_evlist* setup_events(const char *pid, const char *events)
 	struct perf_evsel *counter;
 	evlist__for_each_entry(evsel_list, counter)
 	{
-		if (create_perf_stat_counter(evsel_list, counter, &target) < 0)
+		if (create_perf_stat_counter(evsel_list, counter, &target, group, pinned) < 0)
+		{
+			/* The caller can try again without grouping */
+			if (group)
+				goto out;
 			exit(-1);
+		}
 		counter->supported = true;
 	}
 
+	if (group && store_ids(evsel_list))
+		goto out;
+
 	if (perf_evlist__apply_filters(evsel_list, &counter))
 	{
 		error("failed to set filter \"%s\" on event %s with %d (%s)\n",
@@ -314,7 +447,8 @@ void clean(struct perf_evlist *evlist)
 	 * group leaders.
 	 */
 	disable_counters(evlist);
-	read_counters(evlist, NULL, NULL, NULL, NULL, NULL, NULL);
+	if (!is_grouped(evlist))
+		read_counters(evlist, NULL, NULL, NULL, NULL, NULL, NULL);
 	perf_evlist__close(evlist);
 	perf_evlist__free_stats(evlist);
 	perf_evlist__delete(evlist);
@@ -2,8 +2,13 @@
 #include <clocale>
 #include <iostream>
 #include <csignal>
+#include <functional>
 #include <thread>
 
+#include <boost/accumulators/accumulators.hpp>
+#include <boost/accumulators/statistics/max.hpp>
+#include <boost/accumulators/statistics/mean.hpp>
+#include <boost/accumulators/statistics/stats.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <boost/stacktrace.hpp>
@@ -13,13 +18,20 @@
 #include <signal.h>
 #include <setjmp.h>
 
+#include "alloc-counter.hpp"
 #include "cat-intel.hpp"
 #include "cat-linux.hpp"
 #include "cat-policy.hpp"
 #include "common.hpp"
 #include "config.hpp"
+#include "event-planner.hpp"
 #include "events-perf.hpp"
+#include "interval-clock.hpp"
 #include "log.hpp"
+#include "output.hpp"
+#include "pipeline.hpp"
+#include "resctrl-mon.hpp"
+#include "rollups.hpp"
 #include "stats.hpp"
 #include "task.hpp"
 
@@ -31,22 +43,19 @@ namespace po = boost::program_options;
 using std::string;
 using std::to_string;
 using std::vector;
-using std::this_thread::sleep_for;
 using std::cout;
 using std::cerr;
 using std::endl;
 using fmt::literals::operator""_format;
 
 typedef std::shared_ptr<CAT> CAT_ptr_t;
-typedef std::chrono::system_clock::time_point time_point_t;
 
 
-CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist);
-void loop(tasklist_t &tasklist, std::shared_ptr<cat::policy::Base> catpol, Perf &perf, const vector<string> &events, uint64_t time_int_us, uint32_t max_int, std::ostream &out, std::ostream &ucompl_out, std::ostream &total_out);
+CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist, const string &resctrl_root);
+void loop(tasklist_t &tasklist, std::shared_ptr<cat::policy::Base> catpol, Perf &perf, const vector<string> &events, bool pin_first, PhaseDetector *phases, const string &phase_metric, uint64_t time_int_us, uint32_t max_int, bool live, bool pipelined, std::ostream &out, std::ostream &ucompl_out, std::ostream &total_out, trace::Writer *trace, std::ostream *rollup_out);
 void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf);
 [[noreturn]] void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf);
 std::string program_options_to_string(const std::vector<po::option>& raw);
-void adjust_time(const time_point_t &start_int, const time_point_t &start_glob, const uint64_t interval, const uint64_t time_int_us, int64_t &adj_delay_us);
 void herod_the_great();
 void sigint_handler(int signum);
 void sigabrt_handler(int signum);
@@ -55,7 +64,7 @@ void sigabrt_handler(int signum);
 jmp_buf return_to_top_level;
 
 
-CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist)
+CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist, const string &resctrl_root)
 {
 	LOGINF("Using {} CAT"_format(kind));
 	std::shared_ptr<CAT> cat;
@@ -66,14 +75,18 @@ CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist)
 	else
 	{
 		assert(kind == "linux");
-		cat = std::make_shared<CATLinux>();
+		cat = std::make_shared<CATLinux>(resctrl_root);
 	}
 	cat->init();
+	LOGINF("CAT with {} cache domains"_format(cat->get_domains().size()));
 
 	for (size_t i = 0; i < coslist.size(); i++)
 	{
 		const auto &cos = coslist[i];
-		cat->set_cbm(i, cos.mask);
+		if (cos.domain_masks.empty())
+			cat->set_cbm(i, cos.mask);
+		for (const auto &dm : cos.domain_masks)
+			cat->set_cbm(i, dm.second, dm.first);
 		for (const auto &cpu : cos.cpus)
 			cat->add_cpu(i, cpu);
 	}
@@ -88,74 +101,137 @@ void loop(
 		std::shared_ptr<cat::policy::Base> catpol,
 		Perf &perf,
 		const vector<string> &events,
+		bool pin_first,
+		PhaseDetector *phases,
+		const string &phase_metric,
 		uint64_t time_int_us,
 		uint32_t max_int,
+		bool live,
+		bool pipelined,
 		std::ostream &out,
 		std::ostream &ucompl_out,
-		std::ostream &total_out)
+		std::ostream &total_out,
+		trace::Writer *trace,
+		std::ostream *rollup_out)
 {
 	if (time_int_us <= 0)
 		throw_with_trace(std::runtime_error("Interval time must be positive and greater than 0"));
 	if (max_int <= 0)
 		throw_with_trace(std::runtime_error("Max time must be positive and greater than 0"));
 
-	// Prepare Perf to measure events and initialize stats
-	for (const auto &task : tasklist)
-		task->stats.init(perf.get_names(task->pid)[0]);
-
 	// Print headers
 	task_stats_print_headers(*tasklist[0], out);
-	task_stats_print_headers(*tasklist[0], ucompl_out);
-	task_stats_print_headers(*tasklist[0], total_out);
-
-	// First reading of counters
-	for (const auto &task : tasklist)
-	{
-		perf.enable_counters(task->pid);
-		const counters_t counters = perf.read_counters(task->pid,catpol->get_cat())[0];
-		task->stats.accum(counters);
-	}
+	task_stats_print_headers_total(*tasklist[0], ucompl_out);
+	task_stats_print_headers_total(*tasklist[0], total_out);
+	if (rollup_out)
+		Rollups::print_header(*rollup_out);
 
 	// Loop
 	uint32_t interval;
-	int64_t adj_delay_us = time_int_us;
-	auto start_glob = std::chrono::system_clock::now();
-	auto t1 = std::chrono::system_clock::now(); //measure overhead algorithm
-	auto t2 = std::chrono::system_clock::now();
+	const EventId instructions_id("instructions");
+	auto clock = IntervalClock(time_int_us);
+	auto t1 = std::chrono::steady_clock::now(); //measure overhead algorithm
+	auto t2 = std::chrono::steady_clock::now();
 	uint64_t total_elapsed_us = 0;
+	uint64_t sample_allocs = 0;       // Memory allocations reading and accumulating the counters, should be 0
+	uint64_t total_sample_allocs = 0;
+
+	// Cost of pausing and resuming the tasks with the backend in use, test/freezer_bench compares them.
+	// The calls without tasks, as in live mode when the schedule does not change, are not measured.
+	namespace acc = boost::accumulators;
+	typedef acc::accumulator_set<double, acc::stats<acc::tag::mean, acc::tag::max>> latency_acc_t;
+	latency_acc_t pause_us, resume_us;
+	auto measure_us = [](latency_acc_t &a, tasklist_t &tasks, auto f)
+	{
+		if (tasks.empty())
+			return;
+		auto start = std::chrono::steady_clock::now();
+		f(tasks);
+		a(std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(std::chrono::steady_clock::now() - start).count());
+	};
+	auto latency_str = [](const latency_acc_t &a)
+	{
+		return acc::count(a) ? "mean {:.1f} max {:.1f} us"_format(acc::mean(a), acc::max(a)) : std::string("not measured");
+	};
+
+	const EventId phase_id(phase_metric);
+
+	// Aggregates of the tasks sampled each interval, the policy and the output get a copy
+	Rollups rollups;
 
 	tasklist_t runlist = tasklist_t(tasklist); // Tasks that are not done
 	tasklist_t schedlist = tasklist_t(runlist);
+	tasklist_t running = tasklist_t(); // Tasks not stopped, only used in live mode
+
+	// Scheduling, CAT policies and output in their own threads
+	std::unique_ptr<Pipeline> pipeline;
+	if (pipelined)
+		pipeline.reset(new Pipeline(sched, catpol, out, ucompl_out, total_out, trace, rollup_out));
+
+	clock.start();
 	for (interval = 0; interval < max_int; interval++)
 	{
-		auto start_int = std::chrono::system_clock::now();
 		bool all_completed = true; // Have all the tasks reached their execution limit?
+		std::shared_ptr<PipelineOutput> output;
 
-		LOGINF("Starting interval {} - {} us"_format(interval, chr::duration_cast<chr::microseconds> (start_int - start_glob).count()));
+		if (pipeline)
+		{
+			// Take the newest schedule the policy stage has decided, if any
+			pipeline->check();
+			schedlist = pipeline->schedule(runlist, schedlist);
+			output = std::make_shared<PipelineOutput>();
+			output->interval = interval;
+		}
+
+		LOGINF("Starting interval {} - {} us"_format(interval, clock.elapsed_us()));
 
 		// Sleep
-		t2 = std::chrono::system_clock::now();
+		t2 = std::chrono::steady_clock::now();
 		if (interval > 0)
 		{
 			uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>  (t2 - t1).count();
 			uint32_t prev_interval = interval - 1;
-			LOGINF("[OVERHEAD] Interval {} - {} = {} us"_format(interval,prev_interval,elapsed_us));
+			LOGINF("[OVERHEAD] Interval {} - {} = {} us, {} allocations sampling"_format(interval,prev_interval,elapsed_us,sample_allocs));
 			total_elapsed_us = total_elapsed_us + elapsed_us;
+			total_sample_allocs += sample_allocs;
 		}
-		tasks_resume(schedlist);
-		sleep_for(chr::microseconds(adj_delay_us));
-		tasks_pause(schedlist); // Status can change from runnable -> exited
-		LOGDEB("Slept for {} us"_format(adj_delay_us));
-		t1 = std::chrono::system_clock::now();
+		if (live)
+		{
+			// Only stop the tasks that have been swapped out and only continue the new ones
+			auto contains = [](const tasklist_t &l, const task_ptr_t &t) { return std::find(l.begin(), l.end(), t) != l.end(); };
+			tasklist_t to_pause, to_resume;
+			for (const auto &task_ptr : running)
+				if (!contains(schedlist, task_ptr))
+					to_pause.push_back(task_ptr);
+			for (const auto &task_ptr : schedlist)
+				if (!contains(running, task_ptr))
+					to_resume.push_back(task_ptr);
+			measure_us(pause_us, to_pause, tasks_pause);
+			measure_us(resume_us, to_resume, tasks_resume);
+			running = schedlist;
+		}
+		else
+			measure_us(resume_us, schedlist, tasks_resume);
+		uint64_t length_us = clock.wait();
+		if (live)
+			tasks_poll_exited(schedlist); // Status can change from runnable -> exited
+		else
+			measure_us(pause_us, schedlist, tasks_pause); // Status can change from runnable -> exited
+		LOGDEB("Interval {} lasted {} us ({} - {} us)"_format(interval, length_us, clock.last_start_us(), clock.last_end_us()));
+		t1 = std::chrono::steady_clock::now();
 
-		// Control elapsed time
-		adjust_time(start_int, start_glob, interval, time_int_us, adj_delay_us);
+		// Catch changes to resctrl made behind our back
+		if (auto cat_linux = std::dynamic_pointer_cast<CATLinux>(catpol->get_cat()))
+			cat_linux->reconcile_if_due(interval);
 
 		// Get CPU of manager
 		int cpu_manager =  get_self_cpu_id();
 		LOGDEB("----> Manager is in CPU {}"_format(cpu_manager));
 
 		// Process tasks...
+		sample_allocs = 0;
+		rollups.clear();
+		perf.read_monitor();
 		for (const auto &task_ptr : schedlist)
 		{
 			Task &task = *task_ptr;
@@ -163,11 +239,16 @@ void loop(
 			int cpu_id = get_cpu_id(task.pid);
 			LOGDEB("----> Task {} is in CPU {}"_format(task.pid,cpu_id));
 			// Read stats
-			const counters_t counters = perf.read_counters(task.pid, catpol->get_cat())[0];
-			task.stats.accum(counters);
+			const uint64_t allocs = thread_allocations();
+			perf.read_sample(task.pid, catpol->get_cat(), task.sample, task_l3_domain(task));
+			task.stats.accum(task.sample);
+			if (phases)
+				task.phase = phases->update(task.id, task.stats.last(phase_id));
+			sample_allocs += thread_allocations() - allocs;
+			rollups.add(task);
 
 			// Test if the instruction limit has been reached
-			if (task.max_instr > 0 && task.stats.get_current("instructions") >=  task.max_instr)
+			if (task.max_instr > 0 && task.stats.get_current(instructions_id) >=  task.max_instr)
 			{
 				task.set_status(Task::Status::limit_reached); // Status can change from runnable -> limit_reached
 				task.completed++;
@@ -177,48 +258,97 @@ void loop(
 			if (!task.completed && !task.batch)
 				all_completed = false;
 
-			// Print interval stats
-			task_stats_print_interval(task, interval, out);
-
 			// It's the first time it finishes or reaches the instruction limit print acumulated stats until this point
-			if (task.get_status() == Task::Status::limit_reached || task.get_status() == Task::Status::exited)
+			bool first_completion = (task.get_status() == Task::Status::limit_reached || task.get_status() == Task::Status::exited) &&
+					task.completed == 1;
+
+			// Print interval stats
+			if (output)
 			{
-				if (task.completed == 1)
-					task_stats_print_total(task, interval, ucompl_out);
+				output->tasks.push_back(task_clone(task));
+				output->ucompl.push_back(first_completion);
+				output->total.push_back(false);
+				continue;
 			}
+			task_stats_print_interval(task, interval, out);
+			if (trace)
+				task_stats_trace_interval(task, interval, *trace);
+			if (first_completion)
+				task_stats_print_total(task, interval, ucompl_out);
 		}
 
+		auto rollups_view = std::make_shared<const Rollups>(rollups);
+		if (output)
+			output->rollups = rollups_view;
+		else if (rollup_out)
+			rollups.print(interval, *rollup_out);
+
 		// All the tasks have reached their limit -> finish execution
 		if (all_completed)
 		{
-			LOGINF("[TOTAL OVERHEAD] {} us"_format(total_elapsed_us));
+			LOGINF("[TOTAL OVERHEAD] {} us, {} allocations sampling"_format(total_elapsed_us, total_sample_allocs + sample_allocs));
+			if (output)
+				pipeline->push_output(output);
 			break;
 		}
 
-		for (const auto &task_ptr : schedlist)
+		for (size_t i = 0; i < schedlist.size(); i++)
 		{
+			const auto &task_ptr = schedlist[i];
+
+			// Tasks that are restarted are stopped again and tasks that are done are not running anymore
+			if (live && task_ptr->get_status() != Task::Status::runnable)
+				running.erase(std::remove(running.begin(), running.end(), task_ptr), running.end());
+
 			// Deal with apps that finish or reach the limit
-			task_restart_or_set_done(*task_ptr, catpol->get_cat(), perf, events); // Status can change from (exited | limit_reached) -> done
+			task_restart_or_set_done(*task_ptr, catpol->get_cat(), perf, events, pin_first); // Status can change from (exited | limit_reached) -> done
 
 			// If it's done print total stats
 			if (task_ptr->get_status() == Task::Status::done)
-				task_stats_print_total(*task_ptr, interval, total_out);
+			{
+				if (output)
+					output->total[i] = true;
+				else
+					task_stats_print_total(*task_ptr, interval, total_out);
+			}
 		}
 
 		// Remove tasks that are done from runlist
 		runlist.erase(std::remove_if(runlist.begin(), runlist.end(), [](const auto &task_ptr) { return task_ptr->get_status() == Task::Status::done; }), runlist.end());
 		assert(!runlist.empty());
 
+		if (pipeline)
+		{
+			pipeline->push_output(output);
+			pipeline->push_policy(interval, runlist, rollups_view);
+			continue;
+		}
+
 		// Select tasks for next interval execution
 		schedlist = sched->apply(interval, runlist);
 		assert(!schedlist.empty());
 
 		LOGDEB(iterable_to_string(schedlist.begin(), schedlist.end(), [](const auto &t) {return "{}:{}[{}]({})"_format(t->id, t->name, sched::Status(t->pid)("Cpus_allowed_list"), sched::Stat(t->pid).processor);}, " "));
 
-		// Adjust CAT according to the selected policy
-		catpol->apply(interval, schedlist);
+		// Adjust CAT according to the selected policy, writing only the final configuration
+		{
+			CATLinux::Transaction tx(std::dynamic_pointer_cast<CATLinux>(catpol->get_cat()));
+			catpol->set_rollups(rollups_view);
+			catpol->apply(interval, schedlist);
+			tx.commit();
+		}
 	}
 
+	// Wait for the writer to print all the pending lines
+	if (pipeline)
+		pipeline->finish();
+	if (trace)
+		trace->close();
+
+	// Leave the tasks stopped, as they are in stop mode
+	if (live)
+		tasks_pause(running);
+
 	// Print acumulated stats for non completed tasks and total stats for all the tasks
 	for (const auto &task : tasklist)
 	{
@@ -230,32 +360,14 @@ void loop(
 		if (task->get_status() != Task::Status::done)
 			task_stats_print_total(*task, interval, total_out);
 	}
-}
-
 
-void adjust_time(const time_point_t &start_int, const time_point_t &start_glob, const uint64_t interval, const uint64_t time_int_us, int64_t &adj_delay_us)
-{
-	// Control elapsed time
-	uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>
-			(std::chrono::system_clock::now() - start_int).count();
-	uint64_t total_elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>
-			(std::chrono::system_clock::now() - start_glob).count();
-
-	uint64_t last = adj_delay_us;
-
-	// Adjust time with a PI controller
-	const double kp = 0.5;
-	const double ki = 0.25;
-	int64_t proportional = (int64_t) time_int_us - (int64_t) elapsed_us;
-	int64_t integral     = (int64_t) time_int_us * (interval + 1) - (int64_t) total_elapsed_us;
-	adj_delay_us += kp * proportional;
-	adj_delay_us += ki * integral;
-
-	if (adj_delay_us < 0)
+	LOGINF("[JITTER] {}"_format(clock.report()));
+	LOGINF("[PAUSE] {}: pause {}, resume {}"_format(sched->get_pause(), latency_str(pause_us), latency_str(resume_us)));
+	if (auto cat_linux = std::dynamic_pointer_cast<CATLinux>(catpol->get_cat()))
 	{
-		last *= 0;
-		LOGINF("This interval ({}) was way too long. The next interval should last {} us. It will last {}."_format(interval, adj_delay_us, last));
-		adj_delay_us = last;
+		const auto cs = cat_linux->get_commit_stats();
+		LOGINF("[CAT COMMITS] {} commits, {} writes, {} unchanged, {:.1f} us per commit"_format(
+				cs.commits, cs.writes, cs.unchanged, cs.commits ? cs.us / cs.commits : 0.0));
 	}
 }
 
@@ -317,6 +429,9 @@ void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf)
 	// Kill children
 	herod_the_great();
 
+	// LOGFAT exits without destroying the output streams, write what they have
+	async_outputs_drain();
+
 	LOGFAT("Exit with error");
 }
 
@@ -351,30 +466,56 @@ void open_output_streams(
 		const string &int_str,
 		const string &ucompl_str,
 		const string &total_str,
+		uint32_t blocks,
+		const string &policy_str,
 		std::shared_ptr<std::ostream> &int_out,
 		std::shared_ptr<std::ostream> &ucompl_out,
-		std::shared_ptr<std::ostream> &total_out)
+		std::shared_ptr<std::ostream> &total_out,
+		const string &rollup_str,
+		std::shared_ptr<std::ostream> &rollup_out)
 {
+	const size_t block_size = 64 * 1024;
+	const auto policy = AsyncOutputBuf::str_to_policy(policy_str);
+
 	// Open output file if needed; if not, use cout
 	if (int_str == "")
 	{
-		int_out.reset(new std::ofstream());
-		int_out->rdbuf(cout.rdbuf());
+		if (blocks)
+			int_out.reset(new AsyncOstream(cout.rdbuf(), block_size, blocks, policy));
+		else
+		{
+			int_out.reset(new std::ofstream());
+			int_out->rdbuf(cout.rdbuf());
+		}
 	}
+	else if (blocks)
+		int_out.reset(new AsyncOstream(int_str, block_size, blocks, policy));
 	else
 		int_out.reset(new std::ofstream(int_str));
 
 	// Output file for summary stats until completion
 	if (ucompl_str == "")
 		ucompl_out.reset(new std::stringstream());
+	else if (blocks)
+		ucompl_out.reset(new AsyncOstream(ucompl_str, block_size, blocks, policy));
 	else
 		ucompl_out.reset(new std::ofstream(ucompl_str));
 
 	// Output file for summary stats for all the time the applications have been executed, not only before they are completed
 	if (total_str == "")
 		total_out.reset(new std::stringstream());
+	else if (blocks)
+		total_out.reset(new AsyncOstream(total_str, block_size, blocks, policy));
 	else
 		total_out.reset(new std::ofstream(total_str));
+
+	// Output file for the rollups per CLOS, per L3 domain and of the system, only if requested
+	if (rollup_str == "")
+		rollup_out.reset();
+	else if (blocks)
+		rollup_out.reset(new AsyncOstream(rollup_str, block_size, blocks, policy));
+	else
+		rollup_out.reset(new std::ofstream(rollup_str));
 }
 
 
@@ -437,6 +578,8 @@ int main(int argc, char *argv[])
 		("output,o", po::value<string>()->default_value(""), "pathname for output")
 		("fin-output", po::value<string>()->default_value(""), "pathname for output values when tasks are completed")
 		("total-output", po::value<string>()->default_value(""), "pathname for total output values")
+		("rollup-output", po::value<string>()->default_value(""), "pathname for the interval sums and means of the tasks per CLOS, per L3 domain and of the whole system")
+		("trace", po::value<string>()->default_value(""), "pathname for a binary trace with the interval output values, see trace.hpp")
 		("rundir", po::value<string>()->default_value("run"), "directory for creating the directories where the applications are gonna be executed")
 		("id", po::value<string>()->default_value(random_string(10)), "identifier for the experiment")
 		("ti", po::value<double>(), "time-interval, duration in seconds of the time interval to sample performance counters.")
@@ -447,6 +590,24 @@ int main(int argc, char *argv[])
 		("flog-min", po::value<string>()->default_value(min_flog), "Minimum severity level to log into the log file, defaults to info")
 		("log-file", po::value<string>()->default_value("manager.log"), "file used for the general application log")
 		("cat-impl", po::value<string>(), "Which implementation of CAT to use (linux or intel)")
+		("resctrl-root", po::value<string>(), "where resctrl is mounted, defaults to /sys/fs/resctrl, it can be a tree made by fake-resctrl-gen")
+		("pipeline", po::value<bool>(), "Run the scheduler, the CAT policy and the output writer in their own threads, so they do not delay sampling")
+		("output-blocks", po::value<uint32_t>(), "number of 64 KiB blocks used to write the output in the background, 0 for writing it synchronously")
+		("output-policy", po::value<string>(), "what to do when all the output blocks are waiting to be written: wait (block) or drop lines (drop)")
+		("cat-reconcile", po::value<uint32_t>(), "compare the in-memory CAT state with resctrl every this number of intervals, 0 for never")
+		("resctrl-mon", po::value<bool>(), "read the intel_cqm occupancy and bandwidth events from a resctrl monitoring group per task, for kernels without that perf PMU")
+		("rates", po::value<bool>(), "add the length of each interval (dt) and the rates per second of the counters to the interval and total outputs")
+		("plan-events", po::value<bool>(), "regroup the events so each group fits in the PMU, and pin the ones the CAT policy needs so they are never multiplexed")
+		("quantiles", po::value<vector<string>>()->multitoken(), "metrics with the percentiles of their interval values in the total and until completion outputs")
+		("percentiles", po::value<vector<double>>()->multitoken(), "percentiles (0-100) reported for the metrics in 'quantiles', defaults to 50 90 99")
+		("phases", po::value<string>(), "detect the phases of the tasks with this algorithm (icov, cusum or window) and add them to the interval output")
+		("phase-metric", po::value<string>(), "metric whose phases are detected, defaults to ipc")
+		("phase-threshold", po::value<double>(), "score that starts a new phase, defaults to 1")
+		("phase-window", po::value<uint32_t>(), "number of recent values the window algorithm compares with the ones before them, defaults to 4")
+		("phase-drift", po::value<double>(), "relative deviation from the mean of the phase ignored by the cusum algorithm, defaults to 0.05")
+		("window", po::value<uint32_t>(), "number of intervals in the window used for the rolling statistics of the metrics, the 'windows' config field sets it for specific metrics")
+		("task-tracker", po::value<bool>(), "Learn about stops and exits of the tasks from a signalfd for SIGCHLD in epoll, instead of calling waitpid for every task")
+		("sample-mode", po::value<string>(), "Stop the tasks while sampling counters and applying policies (stop) or sample them while running and only stop the tasks that are swapped out (live)")
 		;
 
 	bool option_error = false;
@@ -488,12 +649,6 @@ int main(int argc, char *argv[])
 	LOGINF("Program cmdline:{}"_format(cmdline));
 	LOGINF("Program options:\n" + option_str);
 
-	// Open output streams
-	auto int_out    = std::shared_ptr<std::ostream>();
-	auto ucompl_out = std::shared_ptr<std::ostream>();
-	auto total_out  = std::shared_ptr<std::ostream>();
-	open_output_streams(vm["output"].as<string>(), vm["fin-output"].as<string>(), vm["total-output"].as<string>(), int_out, ucompl_out, total_out);
-
 	// Read config
 	auto tasklist = tasklist_t();
 	auto coslist = vector<Cos>();
@@ -527,6 +682,8 @@ int main(int argc, char *argv[])
 	// The priority order is: commandline > config file > option defaults
 	if (!vm["cat-impl"].empty())
 		options.cat_impl = vm["cat-impl"].as<string>();
+	if (!vm["resctrl-root"].empty())
+		options.resctrl_root = vm["resctrl-root"].as<string>();
 	if (!vm["ti"].empty())
 		options.ti = vm["ti"].as<double>();
 	if (!vm["mi"].empty())
@@ -535,6 +692,71 @@ int main(int argc, char *argv[])
 		options.event = vm["event"].as<vector<string>>();
 	if (!vm["cpu-affinity"].empty())
 		options.cpu_affinity = vm["cpu-affinity"].as<vector<uint32_t>>();
+	if (!vm["pipeline"].empty())
+		options.pipeline = vm["pipeline"].as<bool>();
+	if (!vm["sample-mode"].empty())
+		options.sample_mode = vm["sample-mode"].as<string>();
+	if (!vm["output-blocks"].empty())
+		options.output_blocks = vm["output-blocks"].as<uint32_t>();
+	if (!vm["output-policy"].empty())
+		options.output_policy = vm["output-policy"].as<string>();
+	if (!vm["task-tracker"].empty())
+		options.task_tracker = vm["task-tracker"].as<bool>();
+	if (!vm["cat-reconcile"].empty())
+		options.cat_reconcile = vm["cat-reconcile"].as<uint32_t>();
+	if (!vm["resctrl-mon"].empty())
+		options.resctrl_mon = vm["resctrl-mon"].as<bool>();
+	if (!vm["plan-events"].empty())
+		options.plan_events = vm["plan-events"].as<bool>();
+	if (!vm["rates"].empty())
+		options.rates = vm["rates"].as<bool>();
+	if (!vm["window"].empty())
+		options.window = vm["window"].as<uint32_t>();
+	if (!vm["quantiles"].empty())
+		options.quantiles = vm["quantiles"].as<vector<string>>();
+	if (!vm["percentiles"].empty())
+		options.percentiles = vm["percentiles"].as<vector<double>>();
+	if (!vm["phases"].empty())
+		options.phases = vm["phases"].as<string>();
+	if (!vm["phase-metric"].empty())
+		options.phase_metric = vm["phase-metric"].as<string>();
+	if (!vm["phase-threshold"].empty())
+		options.phase_threshold = vm["phase-threshold"].as<double>();
+	if (!vm["phase-window"].empty())
+		options.phase_window = vm["phase-window"].as<uint32_t>();
+	if (!vm["phase-drift"].empty())
+		options.phase_drift = vm["phase-drift"].as<double>();
+	if (options.sample_mode != "stop" && options.sample_mode != "live")
+		LOGFAT("Invalid sample mode '{}', it must be 'stop' or 'live'"_format(options.sample_mode));
+
+	// SIGCHLD has to be blocked before creating the output threads
+	if (options.task_tracker)
+	{
+		try
+		{
+			tasks_use_tracker();
+		}
+		catch (const std::exception &e)
+		{
+			LOGFAT(e.what());
+		}
+	}
+
+	// Open output streams
+	auto int_out    = std::shared_ptr<std::ostream>();
+	auto ucompl_out = std::shared_ptr<std::ostream>();
+	auto total_out  = std::shared_ptr<std::ostream>();
+	auto rollup_out = std::shared_ptr<std::ostream>();
+	try
+	{
+		open_output_streams(vm["output"].as<string>(), vm["fin-output"].as<string>(), vm["total-output"].as<string>(),
+				options.output_blocks, options.output_policy, int_out, ucompl_out, total_out,
+				vm["rollup-output"].as<string>(), rollup_out);
+	}
+	catch (const std::exception &e)
+	{
+		LOGFAT(e.what());
+	}
 
 	// Set CPU affinity for not interfering with the executed workloads
 	set_cpu_affinity(options.cpu_affinity);
@@ -542,8 +764,19 @@ int main(int argc, char *argv[])
 	try
 	{
 		// Initial CAT configuration. It may be modified by the CAT policy.
-		cat = cat_setup(options.cat_impl, coslist);
+		cat = cat_setup(options.cat_impl, coslist, options.resctrl_root);
+		if (auto cat_linux = std::dynamic_pointer_cast<CATLinux>(cat))
+			cat_linux->set_reconcile_every(options.cat_reconcile);
 		catpol->set_cat(cat);
+
+		// The groups have to follow the tasks the policy moves
+		if (options.resctrl_mon)
+		{
+			auto monitor = std::make_shared<ResctrlMon>(options.resctrl_root);
+			perf.set_monitor(monitor);
+			if (auto cat_linux = std::dynamic_pointer_cast<CATLinux>(cat))
+				cat_linux->set_monitor(monitor);
+		}
 	}
 	catch (const std::exception &e)
 	{
@@ -556,6 +789,9 @@ int main(int argc, char *argv[])
 
 	try
 	{
+		if (sched->get_pause() == "freezer")
+			tasks_use_freezer();
+
 		// Execute and immediately pause tasks
 		LOGINF("Launching and pausing tasks");
 		for (const auto &task : tasklist)
@@ -563,14 +799,62 @@ int main(int argc, char *argv[])
 		tasks_map_to_initial_clos(tasklist, std::dynamic_pointer_cast<CATLinux>(cat));
 		LOGINF("Tasks ready");
 
-		// Setup events
+		// Group the events by the counters of the PMU, with the ones of the policy pinned
+		auto events = EventPlanner::Plan{options.event, false};
+		if (options.plan_events)
+			events = EventPlanner(PmuCapacity::detect()).plan(options.event, catpol->get_required_events());
+
+		// Setup events and initialize stats. The derived metrics are compiled once for all the tasks.
+		std::shared_ptr<const DerivedMetrics> derived;
+		for (const auto &task : tasklist)
+		{
+			perf.setup_events(task->pid, events.groups, events.pinned);
+			const auto names = perf.get_all_names(task->pid);
+			if (!derived)
+			{
+				auto definitions = DerivedMetrics::builtin(names);
+				// The config can redefine the builtin metrics
+				for (const auto &def : options.derived_metrics)
+					definitions.erase(std::remove_if(definitions.begin(), definitions.end(), [&def](const auto &b) { return b.first == def.first; }), definitions.end());
+				definitions.insert(definitions.end(), options.derived_metrics.begin(), options.derived_metrics.end());
+				derived = std::make_shared<const DerivedMetrics>(definitions);
+			}
+			task->stats.init(names, derived, options.windows, options.window);
+			if (!options.quantiles.empty())
+				task->stats.init_quantiles(options.quantiles, options.percentiles);
+			if (options.rates)
+				task->stats.init_rates();
+			if (!options.phases.empty())
+			{
+				if (!task->stats.has(EventId(options.phase_metric)))
+					throw_with_trace(std::runtime_error("Phases requested for '{}', which is not monitorized"_format(options.phase_metric)));
+				task->track_phases = true;
+			}
+		}
+
+		// First reading of counters, before the headers because the rates depend on which counters are snapshots
+		perf.read_monitor();
 		for (const auto &task : tasklist)
-			perf.setup_events(task->pid, options.event);
+		{
+			perf.enable_counters(task->pid);
+			perf.read_sample(task->pid, catpol->get_cat(), task->sample, task_l3_domain(*task));
+			task->stats.accum(task->sample);
+		}
+
+		// The state of all the tasks is in the same detector
+		std::unique_ptr<PhaseDetector> phases;
+		if (!options.phases.empty())
+			phases.reset(new PhaseDetector(PhaseDetector::str_to_algorithm(options.phases), options.phase_threshold, options.phase_window, options.phase_drift));
+
+		// Binary trace, it uses the names of the stats as columns
+		std::unique_ptr<trace::Writer> trace;
+		if (vm["trace"].as<string>() != "")
+			trace = tasks_trace_open(tasklist, vm["trace"].as<string>());
 
 		// Start doing things
 		LOGINF("Start main loop");
 		if (setjmp(return_to_top_level) == 0)
-			loop(tasklist, sched, catpol, perf, options.event, options.ti * 1000 * 1000, options.mi, *int_out, *ucompl_out, *total_out);
+			loop(tasklist, sched, catpol, perf, events.groups, events.pinned, phases.get(), options.phase_metric, options.ti * 1000 * 1000, options.mi, options.sample_mode == "live", options.pipeline, *int_out, *ucompl_out, *total_out, trace.get(), rollup_out.get());
 		else
 			clean_and_die(tasklist, catpol->get_cat(), perf);
 		// Leaving consistent state after throwing signal
@@ -583,6 +867,12 @@ int main(int argc, char *argv[])
 		// Kill tasks, reset CAT, performance monitors, etc...
 		clean(tasklist, catpol->get_cat(), perf);
 
+		// Write any pending output before printing anything else to stdout
+		int_out->flush();
+		if (rollup_out)
+			rollup_out->flush();
+		async_outputs_drain();
+
 		// If no --fin-output argument, then the final stats are buffered in a stringstream and then outputted to stdout.
 		// If we don't do this and the normal output also goes to stdout, they would mix.
 		if (vm["fin-output"].as<string>() == "")
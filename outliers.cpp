@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "outliers.hpp"
+
+
+void OrderStats::insert(double value)
+{
+	values.insert(std::upper_bound(values.begin(), values.end(), value), value);
+
+	const double delta = value - avg;
+	avg += delta / values.size();
+	m2 += delta * (value - avg);
+}
+
+
+bool OrderStats::erase(double value)
+{
+	auto it = std::lower_bound(values.begin(), values.end(), value);
+	if (it == values.end() || *it != value)
+		return false;
+	values.erase(it);
+
+	if (values.empty())
+	{
+		avg = 0;
+		m2 = 0;
+		return true;
+	}
+	const double delta = value - avg;
+	avg -= delta / values.size();
+	m2 = std::max(0.0, m2 - delta * (value - avg));
+	return true;
+}
+
+
+void OrderStats::clear()
+{
+	values.clear();
+	avg = 0;
+	m2 = 0;
+}
+
+
+double OrderStats::stddev() const
+{
+	return std::sqrt(variance());
+}
+
+
+double OrderStats::quartile(size_t q) const
+{
+	assert(!values.empty() && q < 4);
+	return values[values.size() * q / 4];
+}
+
+
+double OrderStats::median() const
+{
+	assert(!values.empty());
+	const size_t n = values.size();
+	return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+
+// The deviations of the values below the center, walking them downwards, and
+// the ones of the values above it, walking upwards, are two sorted sequences.
+// The k-th smallest deviation is found with a binary search of how many of
+// them come from the first sequence.
+double OrderStats::kth_deviation(double center, size_t k) const
+{
+	const size_t p = std::lower_bound(values.begin(), values.end(), center) - values.begin();
+	const size_t nb = values.size() - p;
+	auto a = [&](size_t i) { return center - values[p - 1 - i]; }; // i < p
+	auto b = [&](size_t j) { return values[p + j] - center; };     // j < nb
+
+	// Take i deviations from 'a' and k + 1 - i from 'b'
+	size_t lo = k + 1 > nb ? k + 1 - nb : 0;
+	size_t hi = std::min(k + 1, p);
+	while (lo < hi)
+	{
+		const size_t i = (lo + hi) / 2;
+		const size_t j = k + 1 - i;
+		if (j > 0 && i < p && b(j - 1) > a(i))
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	const size_t i = lo;
+	const size_t j = k + 1 - i;
+	if (i == 0)
+		return b(j - 1);
+	if (j == 0)
+		return a(i - 1);
+	return std::max(a(i - 1), b(j - 1));
+}
+
+
+double OrderStats::mad() const
+{
+	assert(!values.empty());
+	const double center = median();
+	const size_t n = values.size();
+	return n % 2 ?
+			kth_deviation(center, n / 2) :
+			(kth_deviation(center, n / 2 - 1) + kth_deviation(center, n / 2)) / 2;
+}
+
+
+namespace outliers
+{
+	double mean_sigma(const OrderStats &s, double k)
+	{
+		return s.mean() + k * s.stddev();
+	}
+
+
+	double mad(const OrderStats &s, double k)
+	{
+		return s.median() + k * mad_to_sigma * s.mad();
+	}
+
+
+	double schwetman(const OrderStats &s, double z)
+	{
+		const double q2 = s.quartile(2);
+		return q2 + ((2 * (s.quartile(3) - q2)) / schwetman_kn(s.size())) * z;
+	}
+
+
+	double carling(const OrderStats &s)
+	{
+		const double n = s.size();
+		const double k = ((17.63 * n) - 23.64) / ((7.74 * n) - 3.71);
+		return s.quartile(2) + k * (s.quartile(3) - s.quartile(1));
+	}
+
+
+	double tukey(const OrderStats &s, double k)
+	{
+		return s.quartile(3) + k * (s.quartile(3) - s.quartile(1));
+	}
+}
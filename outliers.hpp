@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// Multiset of values kept sorted as they are inserted and erased, with the
+// order statistics the policies use to find the outliers of a metric. Equal
+// values are all kept, so they do not move the quantiles. The mean and the
+// variance are updated with each value too.
+class OrderStats
+{
+	std::vector<double> values; // Sorted
+	double avg = 0;
+	double m2 = 0;
+
+	// Smallest absolute deviation from 'center' after the k smallest ones
+	double kth_deviation(double center, size_t k) const;
+
+	public:
+
+	OrderStats() = default;
+
+	void insert(double value);
+	bool erase(double value); // Removes one of the values equal to 'value', false if there is none
+	void clear();             // Keeps the memory, so filling it again does not allocate
+
+	size_t size() const { return values.size(); }
+	bool empty() const { return values.empty(); }
+
+	double operator[](size_t i) const { return values[i]; } // i-th smallest value
+	double min() const { return values.front(); }
+	double max() const { return values.back(); }
+
+	// Value at the position n * q / 4, which is how the policies have taken the quartiles
+	double quartile(size_t q) const;
+	// Mean of the two central values for even sizes
+	double median() const;
+	// Median of the absolute deviations from the median, without copying the values
+	double mad() const;
+
+	double mean() const { return avg; }
+	double variance() const { return values.empty() ? 0 : m2 / values.size(); }
+	double stddev() const;
+
+	std::vector<double>::const_iterator begin() const { return values.cbegin(); }
+	std::vector<double>::const_iterator end() const { return values.cend(); }
+};
+
+
+namespace outliers
+{
+	constexpr double mad_to_sigma = 1.4826; // Standard deviation from the MAD, for normal distributions
+	constexpr double z95 = 1.96;            // Two sided 95% of the standard normal distribution
+
+	// Kn of the method of Schwetman and Schwetman for samples of 5 to 80 values
+	constexpr size_t kn_first = 5;
+	constexpr double kn_table[] = {
+		1.65798, 1.28351, 1.51475, 1.32505, 1.50427, 1.31212, 1.45768, 1.32968, 1.45268, 1.32353,
+		1.42975, 1.33318, 1.42684, 1.32959, 1.41322, 1.33568, 1.41132, 1.33333, 1.4023,  1.33753,
+		1.40096, 1.33587, 1.39455, 1.33894, 1.39355, 1.3377,  1.38876, 1.34004, 1.38799, 1.33909,
+		1.38428, 1.34092, 1.38367, 1.34017, 1.38071, 1.34165, 1.38021, 1.34104, 1.37779, 1.34226,
+		1.37737, 1.34175, 1.37536, 1.34278, 1.37501, 1.34235, 1.37331, 1.34322, 1.37301, 1.34285,
+		1.37156, 1.34361, 1.3713,  1.34329, 1.37004, 1.34394, 1.36981, 1.34366, 1.36871, 1.34424,
+		1.36851, 1.34399, 1.36754, 1.3445,  1.36737, 1.34429, 1.3665,  1.34474, 1.36635, 1.34454,
+		1.36557, 1.34495, 1.36543, 1.34478, 1.36474, 1.34514
+	};
+	constexpr size_t kn_last = kn_first + sizeof(kn_table) / sizeof(kn_table[0]) - 1;
+	static_assert(kn_last == 80, "The Kn table goes from 5 to 80 values");
+
+	// Out of the table, the Kn of the nearest size with the same parity, as odd and even sizes converge apart
+	constexpr double schwetman_kn(size_t n)
+	{
+		while (n < kn_first)
+			n += 2;
+		while (n > kn_last)
+			n -= 2;
+		return kn_table[n - kn_first];
+	}
+
+	// Limits above which a value is an outlier
+	double mean_sigma(const OrderStats &s, double k);            // mean + k standard deviations
+	double mad(const OrderStats &s, double k);                   // median + k MADs, scaled to standard deviations
+	double schwetman(const OrderStats &s, double z = z95);       // Q2 + 2 (Q3 - Q2) z / Kn
+	double carling(const OrderStats &s);                         // Q2 + k (Q3 - Q1), with k depending on the size
+	double tukey(const OrderStats &s, double k = 1.5);           // Q3 + k (Q3 - Q1)
+}
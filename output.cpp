@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <set>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "output.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+// Buffers alive, for being able to drain them if we have to die
+static std::mutex alive_mtx;
+static std::set<AsyncOutputBuf *> alive;
+
+
+AsyncOutputBuf::Policy AsyncOutputBuf::str_to_policy(const std::string &str)
+{
+	if (str == "block")
+		return Policy::block;
+	if (str == "drop")
+		return Policy::drop;
+	throw_with_trace(std::runtime_error("Invalid output policy '{}', it must be 'block' or 'drop'"_format(str)));
+}
+
+
+AsyncOutputBuf::AsyncOutputBuf(std::streambuf *_sink, size_t block_size, size_t num_blocks, Policy _policy) :
+		sink(_sink), policy(_policy), blocks(num_blocks)
+{
+	if (!sink)
+		throw_with_trace(std::runtime_error("Invalid sink for the output buffer"));
+	if (block_size == 0 || num_blocks < 2)
+		throw_with_trace(std::runtime_error("The output buffer needs at least 2 blocks of more than 0 bytes"));
+
+	// Preallocate all the memory
+	for (auto &b : blocks)
+	{
+		b.data.resize(block_size);
+		free.push_back(&b);
+	}
+
+	current = free.front();
+	free.pop_front();
+	setp(current->data.data(), current->data.data() + current->data.size());
+
+	flusher = std::thread(&AsyncOutputBuf::flusher_loop, this);
+
+	std::lock_guard<std::mutex> lock(alive_mtx);
+	alive.insert(this);
+}
+
+
+AsyncOutputBuf::~AsyncOutputBuf()
+{
+	{
+		std::lock_guard<std::mutex> lock(alive_mtx);
+		alive.erase(this);
+	}
+
+	submit(true);
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stop = true;
+	}
+	cv_full.notify_one();
+	flusher.join();
+
+	if (dropped_bytes)
+		LOGWAR("The output could not keep up: {} lines ({} bytes) were dropped"_format(dropped_lines, dropped_bytes));
+}
+
+
+void AsyncOutputBuf::flusher_loop()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	for (;;)
+	{
+		cv_full.wait(lock, [this]{ return stop || !full.empty(); });
+		if (full.empty())
+		{
+			assert(stop);
+			break;
+		}
+
+		Block *b = full.front();
+		full.pop_front();
+		bool last = full.empty();
+		writing = true;
+
+		// Write without holding the lock, so the producer can keep submitting blocks
+		lock.unlock();
+		sink->sputn(b->data.data(), b->size);
+		if (last)
+			sink->pubsync();
+		lock.lock();
+
+		writing = false;
+		b->size = 0;
+		free.push_back(b);
+		cv_free.notify_all();
+	}
+	sink->pubsync();
+}
+
+
+void AsyncOutputBuf::skip_dropped_line()
+{
+	char *begin = pbase();
+	char *end = pptr();
+	char *nl = std::find(begin, end, '\n');
+	if (nl != end)
+	{
+		nl++;
+		discarding = false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		dropped_bytes += nl - begin;
+		if (!discarding)
+			dropped_lines++;
+	}
+	size_t rest = end - nl;
+	std::memmove(begin, nl, rest);
+	setp(current->data.data(), current->data.data() + current->data.size());
+	pbump(rest);
+}
+
+
+bool AsyncOutputBuf::submit(bool whole, bool may_drop)
+{
+	if (discarding)
+		skip_dropped_line();
+
+	char *begin = pbase();
+	char *end = pptr();
+	if (begin == end)
+		return true;
+
+	// Only complete lines are submitted, unless forced or the block contains a single incomplete line
+	char *cut = end;
+	if (!whole)
+	{
+		char *nl = end;
+		while (nl != begin && *(nl - 1) != '\n')
+			nl--;
+		if (nl != begin)
+			cut = nl;
+	}
+
+	std::unique_lock<std::mutex> lock(mtx);
+
+	if (may_drop && !partial && free.empty() && policy == Policy::drop)
+	{
+		// Discard the complete lines, keep the rest in the same block. If the
+		// block is full without any, it is the head of a line longer than it,
+		// the whole line is discarded.
+		cut = end;
+		while (cut != begin && *(cut - 1) != '\n')
+			cut--;
+		if (cut == begin && end == epptr())
+		{
+			cut = end;
+			discarding = true;
+		}
+		if (cut == begin)
+			return false;
+		dropped_lines += std::count(begin, cut, '\n');
+		dropped_bytes += cut - begin;
+		if (dropped_bytes == (uint64_t) (cut - begin))
+			LOGWAR("The output cannot keep up, dropping lines");
+		size_t rest = end - cut;
+		std::memmove(begin, cut, rest);
+		setp(current->data.data(), current->data.data() + current->data.size());
+		pbump(rest);
+		return false;
+	}
+
+	cv_free.wait(lock, [this]{ return !free.empty(); });
+	Block *next = free.front();
+	free.pop_front();
+
+	current->size = cut - begin;
+	partial = *(cut - 1) != '\n';
+	full.push_back(current);
+	cv_full.notify_one();
+	lock.unlock();
+
+	// Carry over the incomplete line
+	size_t rest = end - cut;
+	std::memcpy(next->data.data(), cut, rest);
+	current = next;
+	setp(current->data.data(), current->data.data() + current->data.size());
+	pbump(rest);
+	return true;
+}
+
+
+AsyncOutputBuf::int_type AsyncOutputBuf::overflow(int_type ch)
+{
+	submit(false, true);
+
+	// A single line longer than a block
+	if (pptr() == epptr())
+		submit(true, true);
+
+	if (traits_type::eq_int_type(ch, traits_type::eof()))
+		return traits_type::not_eof(ch);
+
+	*pptr() = traits_type::to_char_type(ch);
+	pbump(1);
+	return ch;
+}
+
+
+// Does not wait for the data to reach the sink, use 'drain' for that
+int AsyncOutputBuf::sync()
+{
+	submit(true);
+	return 0;
+}
+
+
+void AsyncOutputBuf::drain()
+{
+	submit(true);
+	std::unique_lock<std::mutex> lock(mtx);
+	cv_free.wait(lock, [this]{ return full.empty() && !writing; });
+}
+
+
+AsyncOstream::AsyncOstream(const std::string &path, size_t block_size, size_t num_blocks, AsyncOutputBuf::Policy policy) :
+		std::ostream(nullptr), file(new std::filebuf())
+{
+	if (!file->open(path, std::ios::out | std::ios::trunc))
+		throw_with_trace(std::runtime_error("Could not open output file '{}': {}"_format(path, strerror(errno))));
+	buf.reset(new AsyncOutputBuf(file.get(), block_size, num_blocks, policy));
+	rdbuf(buf.get());
+}
+
+
+AsyncOstream::AsyncOstream(std::streambuf *sink, size_t block_size, size_t num_blocks, AsyncOutputBuf::Policy policy) :
+		std::ostream(nullptr), buf(new AsyncOutputBuf(sink, block_size, num_blocks, policy))
+{
+	rdbuf(buf.get());
+}
+
+
+AsyncOstream::~AsyncOstream()
+{
+	// The buffer has to be destroyed, and therefore flushed, before the file is closed
+	rdbuf(nullptr);
+	buf.reset();
+}
+
+
+void async_outputs_drain()
+{
+	std::lock_guard<std::mutex> lock(alive_mtx);
+	for (auto b : alive)
+		b->drain();
+}
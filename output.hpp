@@ -0,0 +1,110 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Stream buffer that formats into a pool of preallocated blocks. Full blocks are
+// handed to a background thread that writes them to the sink, so the thread
+// producing the output never waits for the disk while there are free blocks.
+// Memory is bounded by the number of blocks: if all of them are waiting to be
+// written, the producer either waits (block) or discards complete lines (drop).
+// Only the lines that overflow the current block can be dropped: flushing,
+// draining and destroying the buffer always wait for a free block. A line is
+// always dropped or written whole, even if it is longer than a block.
+class AsyncOutputBuf : public std::streambuf
+{
+	public:
+
+	enum class Policy
+	{
+		block,
+		drop,
+	};
+
+	static Policy str_to_policy(const std::string &str);
+
+	AsyncOutputBuf(std::streambuf *_sink, size_t block_size, size_t num_blocks, Policy _policy);
+	~AsyncOutputBuf();
+
+	AsyncOutputBuf(const AsyncOutputBuf &) = delete;
+	AsyncOutputBuf& operator=(const AsyncOutputBuf &) = delete;
+
+	// Hand the current block to the flusher and wait until everything has reached the sink
+	void drain();
+
+	uint64_t get_dropped_bytes() const { return dropped_bytes; }
+
+	protected:
+
+	int_type overflow(int_type ch) override;
+	int sync() override;
+
+	private:
+
+	struct Block
+	{
+		std::vector<char> data;
+		size_t size = 0;
+	};
+
+	std::streambuf *sink;
+	const Policy policy;
+
+	std::vector<Block> blocks;
+	Block *current = nullptr;
+
+	std::mutex mtx;
+	std::condition_variable cv_full;   // Signals the flusher
+	std::condition_variable cv_free;   // Signals the producer
+	std::deque<Block *> full;
+	std::deque<Block *> free;
+	bool writing = false;              // The flusher is writing a block
+	bool stop = false;
+
+	uint64_t dropped_bytes = 0;
+	uint64_t dropped_lines = 0;
+	bool discarding = false;           // The head of the current line has been dropped
+	bool partial = false;              // The head of the current line has been submitted, it cannot be dropped
+
+	std::thread flusher;
+
+	void flusher_loop();
+
+	// Send the complete lines of the current block to the flusher and continue
+	// with a new block, carrying over the last incomplete line. With 'may_drop' and
+	// the drop policy, the lines are discarded if there is no free block.
+	bool submit(bool whole, bool may_drop = false);
+
+	// Drop the rest of a line whose head has been dropped, up to its newline
+	void skip_dropped_line();
+};
+
+
+// Output stream writing to a file, or to another stream buffer, through an AsyncOutputBuf
+class AsyncOstream : public std::ostream
+{
+	std::unique_ptr<std::filebuf> file;
+	std::unique_ptr<AsyncOutputBuf> buf;
+
+	public:
+
+	AsyncOstream(const std::string &path, size_t block_size, size_t num_blocks, AsyncOutputBuf::Policy policy);
+	AsyncOstream(std::streambuf *sink, size_t block_size, size_t num_blocks, AsyncOutputBuf::Policy policy);
+	~AsyncOstream();
+
+	void drain() { buf->drain(); }
+};
+
+
+// Write all the pending output of every AsyncOutputBuf alive. Used before dying.
+void async_outputs_drain();
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include "phase-detector.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+PhaseDetector::PhaseDetector(Algorithm _algorithm, double _threshold, uint32_t _window, double _drift) :
+		algorithm(_algorithm), threshold(_threshold), window(_window), drift(_drift)
+{
+	if (threshold < 0)
+		throw_with_trace(std::runtime_error("The threshold of the phase detector cannot be negative"));
+	if (window == 0)
+		throw_with_trace(std::runtime_error("The window of the phase detector must have at least one value"));
+	if (drift < 0)
+		throw_with_trace(std::runtime_error("The drift of the phase detector cannot be negative"));
+}
+
+
+PhaseDetector::Algorithm PhaseDetector::str_to_algorithm(const std::string &str)
+{
+	if (str == "icov")
+		return Algorithm::icov;
+	if (str == "cusum")
+		return Algorithm::cusum;
+	if (str == "window")
+		return Algorithm::window;
+	throw_with_trace(std::runtime_error("Unknown phase detection algorithm '{}', it must be icov, cusum or window"_format(str)));
+}
+
+
+const PhaseDetector::Event& PhaseDetector::update(uint32_t task, double value)
+{
+	if (task >= states.size())
+		states.resize(task + 1, State(window));
+	State &s = states[task];
+
+	if (!s.event.phase)
+	{
+		start_phase(s, value);
+		s.event.phase = 1;
+		s.event.change = false;
+		return s.event;
+	}
+
+	s.event.score = score(s, value);
+	s.event.change = s.event.score >= threshold;
+	if (s.event.change)
+	{
+		start_phase(s, value);
+		s.event.phase++;
+	}
+	return s.event;
+}
+
+
+void PhaseDetector::reset(uint32_t task)
+{
+	if (task < states.size())
+		states[task] = State(window);
+}
+
+
+const PhaseDetector::Event& PhaseDetector::last(uint32_t task) const
+{
+	if (!has(task))
+		throw_with_trace(std::runtime_error("There are no samples of the task {} in the phase detector"_format(task)));
+	return states[task].event;
+}
+
+
+void PhaseDetector::start_phase(State &s, double value)
+{
+	s.sum = value;
+	s.pos = 0;
+	s.neg = 0;
+	s.recent.clear();
+	s.reference.clear();
+	s.recent.push(value);
+	s.event.score = 0;
+	s.event.duration = 1;
+}
+
+
+// Updates the state of the phase with the value, which is undone by 'start_phase' if there is a change
+double PhaseDetector::score(State &s, double value)
+{
+	double result = 0;
+	switch (algorithm)
+	{
+		case Algorithm::icov:
+		{
+			const double prev_mean = s.sum / s.event.duration;
+			s.sum += value;
+			s.event.duration++;
+			result = std::fabs(value - prev_mean) / (s.sum / s.event.duration);
+			break;
+		}
+
+		case Algorithm::cusum:
+		{
+			const double mean = s.sum / s.event.duration;
+			const double dev = mean ? (value - mean) / std::fabs(mean) : value;
+			s.sum += value;
+			s.event.duration++;
+			s.pos = std::max(0.0, s.pos + dev - drift);
+			s.neg = std::max(0.0, s.neg - dev - drift);
+			result = std::max(s.pos, s.neg);
+			break;
+		}
+
+		case Algorithm::window:
+		{
+			// The oldest recent value moves to the reference window
+			if (s.recent.full())
+				s.reference.push(s.recent[s.recent.size() - 1]);
+			s.recent.push(value);
+			s.event.duration++;
+			if (s.reference.full())
+			{
+				const double ref = s.reference.mean();
+				result = std::fabs(s.recent.mean() - ref) / (ref ? std::fabs(ref) : 1);
+			}
+			break;
+		}
+	}
+	// A phase with a mean of 0 has no relative deviation
+	return std::isfinite(result) ? result : 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "window.hpp"
+
+
+// Online detection of phase changes in the values of a metric of each task.
+// Every sample is processed in constant time, and the state of the tasks is
+// kept in a vector indexed by their id. The algorithms are:
+//
+//   icov:   the value differs from the mean of the phase until the last
+//           interval by more than 'threshold' times the mean of the phase
+//   cusum:  two sided cumulative sum of the deviations from the mean of the
+//           phase, relative to it and minus 'drift', is above 'threshold'
+//   window: the mean of the last 'window' values differs from the mean of the
+//           'window' values before them by more than 'threshold' times the latter
+class PhaseDetector
+{
+	public:
+
+	enum class Algorithm {icov, cusum, window};
+
+	struct Event
+	{
+		bool change = false;    // This sample starts a new phase
+		double score = 0;       // Value compared with the threshold
+		uint64_t phase = 0;     // Number of the phase, starting at 1
+		uint64_t duration = 0;  // Samples in the phase, including this one
+	};
+
+	PhaseDetector(Algorithm _algorithm, double _threshold, uint32_t _window = 4, double _drift = 0);
+
+	static Algorithm str_to_algorithm(const std::string &str);
+
+	// The first sample of a task starts its first phase
+	const Event& update(uint32_t task, double value);
+	void reset(uint32_t task); // The next sample starts a new phase 1
+
+	bool has(uint32_t task) const { return task < states.size() && states[task].event.phase; }
+	const Event& last(uint32_t task) const;
+
+	private:
+
+	struct State
+	{
+		Event event;
+		double sum = 0;         // Of the values of the phase
+		double pos = 0;         // CUSUM of the deviations above and below the mean
+		double neg = 0;
+		Window recent;          // Last values and the ones before them, for 'window'
+		Window reference;
+
+		State(uint32_t window) : recent(window), reference(window) {}
+	};
+
+	Algorithm algorithm;
+	double threshold;
+	uint32_t window;
+	double drift;
+	std::vector<State> states;
+
+	void start_phase(State &s, double value);
+	double score(State &s, double value);
+};
@@ -0,0 +1,256 @@
+#include <chrono>
+
+#include <signal.h>
+
+#include <fmt/format.h>
+
+#include "cat-linux.hpp"
+#include "log.hpp"
+#include "pipeline.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+static void backoff(uint32_t &spins);
+static void block_signals();
+
+
+task_ptr_t task_clone(const Task &task)
+{
+	return std::make_shared<Task>(task);
+}
+
+
+// Spin for a while and then sleep, to not waste a whole cpu when the queue is empty
+static
+void backoff(uint32_t &spins)
+{
+	if (spins++ < 64)
+		std::this_thread::yield();
+	else
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+
+// The SIGINT handler longjmps to the main thread, so the other stages must not receive it
+static
+void block_signals()
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+
+Pipeline::Pipeline(sched::ptr_t _sched, std::shared_ptr<cat::policy::Base> _catpol,
+		std::ostream &_out, std::ostream &_ucompl_out, std::ostream &_total_out,
+		trace::Writer *_trace, std::ostream *_rollup_out, size_t depth) :
+	sched(_sched), catpol(_catpol),
+	out(_out), ucompl_out(_ucompl_out), total_out(_total_out), trace(_trace), rollup_out(_rollup_out),
+	policy_in(depth), policy_res(depth), writer_in(depth * 16),
+	stop_policy(false), stop_writer(false), error_claimed(false), failed(false)
+{
+	policy_thread = std::thread(&Pipeline::policy_stage, this);
+	writer_thread = std::thread(&Pipeline::writer_stage, this);
+}
+
+
+Pipeline::~Pipeline()
+{
+	// Errors, if any, have already been reported with 'check' or 'finish'
+	stop();
+}
+
+
+void Pipeline::stop()
+{
+	stop_policy.store(true, std::memory_order_release);
+	if (policy_thread.joinable())
+		policy_thread.join();
+
+	stop_writer.store(true, std::memory_order_release);
+	if (writer_thread.joinable())
+		writer_thread.join();
+}
+
+
+void Pipeline::fail(std::exception_ptr e)
+{
+	// Only the first error is kept
+	if (error_claimed.exchange(true))
+		return;
+	error = e;
+	failed.store(true, std::memory_order_release);
+}
+
+
+void Pipeline::policy_stage()
+{
+	block_signals();
+
+	uint32_t spins = 0;
+	policy_input_ptr_t input;
+	while (!stop_policy.load(std::memory_order_acquire))
+	{
+		if (!policy_in.try_pop(input))
+		{
+			backoff(spins);
+			continue;
+		}
+		spins = 0;
+
+		try
+		{
+			// Select tasks for next interval execution
+			tasklist_t schedlist = sched->apply(input->interval, input->runlist);
+			assert(!schedlist.empty());
+
+			LOGDEB(iterable_to_string(schedlist.begin(), schedlist.end(), [](const auto &t) {return "{}:{}[{}]({})"_format(t->id, t->name, sched::Status(t->pid)("Cpus_allowed_list"), sched::Stat(t->pid).processor);}, " "));
+
+			// Adjust CAT according to the selected policy, writing only the final configuration
+			{
+				CATLinux::Transaction tx(std::dynamic_pointer_cast<CATLinux>(catpol->get_cat()));
+				catpol->set_rollups(input->rollups);
+				catpol->apply(input->interval, schedlist);
+				tx.commit();
+			}
+
+			auto ids = std::vector<uint32_t>();
+			for (const auto &task : schedlist)
+				ids.push_back(task->id);
+
+			// The sampler consumes all the results every interval, so this should rarely wait
+			while (!policy_res.try_push(std::move(ids)) && !stop_policy.load(std::memory_order_acquire))
+				backoff(spins);
+			spins = 0;
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+			return;
+		}
+	}
+}
+
+
+void Pipeline::writer_stage()
+{
+	block_signals();
+
+	uint32_t spins = 0;
+	output_ptr_t output;
+	for (;;)
+	{
+		// Read the flag before trying to pop, so nothing pushed before stopping is lost
+		bool stopping = stop_writer.load(std::memory_order_acquire);
+		if (!writer_in.try_pop(output))
+		{
+			if (stopping)
+				break;
+			backoff(spins);
+			continue;
+		}
+		spins = 0;
+
+		try
+		{
+			for (size_t i = 0; i < output->tasks.size(); i++)
+			{
+				const Task &task = *output->tasks[i];
+				task_stats_print_interval(task, output->interval, out);
+				if (trace)
+					task_stats_trace_interval(task, output->interval, *trace);
+				if (output->ucompl[i])
+					task_stats_print_total(task, output->interval, ucompl_out);
+				if (output->total[i])
+					task_stats_print_total(task, output->interval, total_out);
+			}
+			if (rollup_out && output->rollups)
+				output->rollups->print(output->interval, *rollup_out);
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+			return;
+		}
+	}
+}
+
+
+void Pipeline::push_policy(uint32_t interval, const tasklist_t &runlist, std::shared_ptr<const Rollups> rollups)
+{
+	auto input = std::make_shared<PolicyInput>();
+	input->interval = interval;
+	input->rollups = rollups;
+	for (const auto &task : runlist)
+		input->runlist.push_back(task_clone(*task));
+
+	if (!policy_in.try_push(std::move(input)))
+		LOGWAR("Policy stage is behind, the snapshot of interval {} has been dropped"_format(interval));
+}
+
+
+void Pipeline::push_output(std::shared_ptr<const PipelineOutput> output)
+{
+	uint32_t spins = 0;
+	while (!writer_in.try_push(output))
+	{
+		check();
+		backoff(spins);
+	}
+}
+
+
+tasklist_t Pipeline::schedule(const tasklist_t &runlist, const tasklist_t &schedlist)
+{
+	auto ids = std::vector<uint32_t>();
+	bool updated = false;
+
+	// Keep only the newest result
+	auto tmp = std::vector<uint32_t>();
+	while (policy_res.try_pop(tmp))
+	{
+		ids = std::move(tmp);
+		updated = true;
+	}
+
+	if (!updated)
+	{
+		for (const auto &task : schedlist)
+			ids.push_back(task->id);
+	}
+
+	tasklist_t result;
+	for (auto id : ids)
+	{
+		auto it = std::find_if(runlist.begin(), runlist.end(), [id](const auto &t){return id == t->id;});
+		if (it != runlist.end())
+			result.push_back(*it);
+	}
+
+	// All the scheduled tasks are done, run the rest until the policy stage decides
+	if (result.empty())
+	{
+		LOGDEB("No scheduled task is runnable, scheduling all the tasks that are not done");
+		result = runlist;
+	}
+
+	return result;
+}
+
+
+void Pipeline::check()
+{
+	if (failed.load(std::memory_order_acquire))
+		std::rethrow_exception(error);
+}
+
+
+void Pipeline::finish()
+{
+	stop();
+	check();
+}
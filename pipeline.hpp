@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "cat-policy.hpp"
+#include "rollups.hpp"
+#include "sched.hpp"
+#include "spsc-queue.hpp"
+#include "task.hpp"
+
+
+// Clone of a task, with a copy of its stats, that can be used from other threads
+task_ptr_t task_clone(const Task &task);
+
+
+// Lines to print after an interval. The tasks are clones taken when they were sampled.
+struct PipelineOutput
+{
+	uint32_t interval;
+	tasklist_t tasks;
+	std::vector<bool> ucompl; // The task has been completed for the first time
+	std::vector<bool> total;  // The task is done
+	std::shared_ptr<const Rollups> rollups;
+};
+
+
+// Three stage pipeline connected by bounded SPSC queues:
+//   - Sampler (caller thread): sleeps until the deadline, reads the counters, accumulates
+//     the stats and restarts tasks. It never waits for the other stages.
+//   - Policy: runs the scheduler and the CAT policy over an immutable snapshot (clones)
+//     of the tasks that are not done, and sends back the ids of the tasks to schedule.
+//   - Writer: formats and writes the interval, ucompl and total lines and the trace.
+class Pipeline
+{
+	struct PolicyInput
+	{
+		uint32_t interval;
+		tasklist_t runlist;
+		std::shared_ptr<const Rollups> rollups;
+	};
+	typedef std::shared_ptr<const PolicyInput> policy_input_ptr_t;
+	typedef std::shared_ptr<const PipelineOutput> output_ptr_t;
+
+	sched::ptr_t sched;
+	std::shared_ptr<cat::policy::Base> catpol;
+
+	std::ostream &out;
+	std::ostream &ucompl_out;
+	std::ostream &total_out;
+	trace::Writer *trace;
+	std::ostream *rollup_out;
+
+	SPSCQueue<policy_input_ptr_t> policy_in;
+	SPSCQueue<std::vector<uint32_t>> policy_res;
+	SPSCQueue<output_ptr_t> writer_in;
+
+	std::atomic<bool> stop_policy;
+	std::atomic<bool> stop_writer;
+
+	// Set by the policy or writer thread when they fail, rethrown in the sampler
+	std::atomic<bool> error_claimed;
+	std::atomic<bool> failed;
+	std::exception_ptr error;
+
+	std::thread policy_thread;
+	std::thread writer_thread;
+
+	void policy_stage();
+	void writer_stage();
+	void fail(std::exception_ptr e);
+	void stop();
+
+	public:
+
+	Pipeline(sched::ptr_t _sched, std::shared_ptr<cat::policy::Base> _catpol,
+			std::ostream &_out, std::ostream &_ucompl_out, std::ostream &_total_out,
+			trace::Writer *_trace = nullptr, std::ostream *_rollup_out = nullptr, size_t depth = 4);
+	~Pipeline();
+
+	Pipeline(const Pipeline &) = delete;
+	Pipeline& operator=(const Pipeline &) = delete;
+
+	// Send a snapshot of the tasks that are not done to the policy stage.
+	// If the policy stage is still busy with older snapshots it is dropped.
+	void push_policy(uint32_t interval, const tasklist_t &runlist, std::shared_ptr<const Rollups> rollups);
+
+	// Send lines to the writer. Output is never dropped, so it waits if the writer is behind.
+	void push_output(std::shared_ptr<const PipelineOutput> output);
+
+	// Newest schedule computed by the policy stage, mapped to the tasks in runlist.
+	// If there is no new schedule, the previous one is returned without the tasks that are done.
+	tasklist_t schedule(const tasklist_t &runlist, const tasklist_t &schedlist);
+
+	// Rethrow in the caller thread any exception raised in the other stages
+	void check();
+
+	// Write all the pending output and stop the threads
+	void finish();
+};
@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "log.hpp"
+#include "resctrl-mon.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+using fmt::literals::operator""_format;
+
+
+const std::string& ResctrlMon::event_name(Event e)
+{
+	static const std::array<std::string, num_events> names = {
+		"intel_cqm/llc_occupancy/", "intel_cqm/total_bytes/", "intel_cqm/local_bytes/"
+	};
+	return names[e];
+}
+
+
+bool ResctrlMon::provides(const std::string &name)
+{
+	for (size_t e = 0; e < num_events; e++)
+		if (name == event_name((Event) e))
+			return true;
+	return false;
+}
+
+
+ResctrlMon::ResctrlMon(const std::string &_root) : root(_root)
+{
+	static const std::array<std::string, num_events> features = {"llc_occupancy", "mbm_total_bytes", "mbm_local_bytes"};
+
+	const auto info = fs::path(root) / "info" / "L3_MON" / "mon_features";
+	if (!fs::exists(info))
+		throw_with_trace(std::runtime_error("There is no L3 monitoring in '{}', is resctrl mounted and does the CPU have CMT?"_format(root)));
+	std::ifstream f(info.string());
+	std::string feature;
+	while (f >> feature)
+	{
+		auto it = std::find(features.begin(), features.end(), feature);
+		if (it != features.end())
+			events.push_back((Event) (it - features.begin()));
+	}
+	std::sort(events.begin(), events.end());
+	if (events.empty())
+		throw_with_trace(std::runtime_error("The L3 monitoring of resctrl has none of the features '{}'"_format(
+				iterable_to_string(features.begin(), features.end(), [](const auto &s) { return s; }, ", "))));
+
+	// The domains are the same for all the groups
+	for (auto &p : fs::directory_iterator(fs::path(root) / "mon_data"))
+		domains.push_back(p.path().filename().string());
+	std::sort(domains.begin(), domains.end());
+
+	LOGINF("Using the resctrl monitoring groups for {} in {} L3 domains"_format(
+			iterable_to_string(events.begin(), events.end(), [](const auto &e) { return features[e]; }, ", "), domains.size()));
+}
+
+
+// The tasks have been killed, so the groups can be removed
+ResctrlMon::~ResctrlMon()
+{
+	for (const auto &g : groups)
+		destroy(g.second);
+}
+
+
+// The CLOS whose tasks file has the pid
+std::string ResctrlMon::find_clos_dir(pid_t pid) const
+{
+	auto dirs = std::vector<fs::path>(1, root);
+	for (auto &p : fs::directory_iterator(root))
+	{
+		const auto name = p.path().filename().string();
+		if (fs::is_directory(p) && name != "info" && name != "mon_groups" && name != "mon_data")
+			dirs.push_back(p.path());
+	}
+	for (const auto &dir : dirs)
+	{
+		std::ifstream f((dir / "tasks").string());
+		pid_t task;
+		while (f >> task)
+			if (task == pid)
+				return dir.string();
+	}
+	throw_with_trace(std::runtime_error("The pid {} is not in the tasks of any CLOS in '{}'"_format(pid, root)));
+}
+
+
+void ResctrlMon::create(pid_t pid, Group &group, const std::vector<pid_t> &pids)
+{
+	group.path = "{}/mon_groups/manager-{}-{}"_format(group.clos_dir, getpid(), pid);
+	if (mkdir(group.path.c_str(), 0755) < 0 && errno != EEXIST)
+	{
+		if (errno == ENOSPC)
+			throw_with_trace(std::runtime_error("Could not create the monitoring group '{}': there are no RMIDs left"_format(group.path)));
+		throw_with_trace(std::runtime_error("Could not create the monitoring group '{}': {}"_format(group.path, strerror(errno))));
+	}
+
+	// Every pid needs its own write
+	const std::string tasks = group.path + "/tasks";
+	std::ofstream f(tasks);
+	for (const auto &p : pids)
+		if (!(f << p << std::endl))
+			throw_with_trace(std::runtime_error("Cannot write pid '{}' into '{}'"_format(p, tasks)));
+
+	group.files.clear();
+	for (const auto &d : domains)
+		for (const auto &e : events)
+			group.files.push_back("{}/mon_data/{}/{}"_format(group.path, d, e == llc_occupancy ? "llc_occupancy" : e == total_bytes ? "mbm_total_bytes" : "mbm_local_bytes"));
+	group.last.assign(group.files.size(), 0);
+	group.values = group.base;
+}
+
+
+// The groups of a CLOS that has been deleted are gone with it
+void ResctrlMon::destroy(const Group &group) const
+{
+	if (rmdir(group.path.c_str()) < 0 && errno != ENOENT)
+		LOGWAR("Could not remove the monitoring group '{}': {}"_format(group.path, strerror(errno)));
+}
+
+
+// The files are read into a buffer in the stack, like the energy ones. Domains
+// without data, i.e. while the kernel has not read them yet, count as 0. The
+// kernel writes "Unavailable" or "Error" instead of a number for a while in new
+// groups, then the last value of the file is kept, as the bandwidth is cumulative.
+void ResctrlMon::read(Group &group) const
+{
+	group.values = group.base;
+	for (size_t i = 0; i < group.files.size(); i++)
+	{
+		const Event e = events[i % events.size()];
+		char buffer[32];
+		int fd = ::open(group.files[i].c_str(), O_RDONLY);
+		if (fd < 0)
+			throw_with_trace(std::runtime_error("Could not open '{}': {}"_format(group.files[i], strerror(errno))));
+		ssize_t n = ::read(fd, buffer, sizeof(buffer) - 1);
+		::close(fd);
+		if (n <= 0)
+			continue;
+		buffer[n] = '\0';
+		char *end;
+		const uint64_t value = std::strtoull(buffer, &end, 10);
+		if (end != buffer)
+			group.last[i] = is_snapshot(e) ? value : value / (1024.0 * 1024);
+		group.values[e] += group.last[i];
+	}
+}
+
+
+void ResctrlMon::add(pid_t pid)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	if (groups.count(pid))
+		return;
+
+	auto pids = std::vector<pid_t>(1, pid);
+	pid_get_children_rec(pid, pids);
+	Group group;
+	group.clos_dir = find_clos_dir(pid);
+	create(pid, group, pids);
+	groups[pid] = group;
+	LOGDEB("Task {} monitored in '{}'"_format(pid, group.path));
+}
+
+
+// Writing the tasks into the control group has taken them out of their
+// monitoring group, which only keeps the traffic until then
+void ResctrlMon::move(const std::vector<pid_t> &pids, const std::string &clos_dir)
+{
+	assert(!pids.empty());
+	std::lock_guard<std::mutex> lock(mtx);
+	auto it = groups.find(pids[0]);
+	if (it == groups.end() || fs::path(it->second.clos_dir) == fs::path(clos_dir))
+		return;
+
+	Group &group = it->second;
+	read(group);
+	for (const auto &e : events)
+		if (!is_snapshot(e))
+			group.base[e] = group.values[e];
+	destroy(group);
+	group.clos_dir = clos_dir;
+	create(pids[0], group, pids);
+	LOGDEB("Task {} monitored in '{}'"_format(pids[0], group.path));
+}
+
+
+void ResctrlMon::remove(pid_t pid)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	auto it = groups.find(pid);
+	if (it == groups.end())
+		return;
+	destroy(it->second);
+	groups.erase(it);
+}
+
+
+void ResctrlMon::read()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	for (auto &g : groups)
+		read(g.second);
+}
+
+
+bool ResctrlMon::has(pid_t pid) const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return groups.count(pid);
+}
+
+
+ResctrlMon::values_t ResctrlMon::get_values(pid_t pid) const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	auto it = groups.find(pid);
+	return it == groups.end() ? values_t() : it->second.values;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+
+// Cache occupancy and memory bandwidth of the tasks from the monitoring groups
+// of resctrl, for the kernels that no longer have the intel_cqm perf PMU. Every
+// task has its own group in the CLOS, the control group, it is in:
+//
+//   <resctrl>/<clos>/mon_groups/manager-<pid of the manager>-<pid>
+//
+// with the root of resctrl being the directory of CLOS 0. A task that is moved to
+// another CLOS leaves its group, so the group has to be moved with it. All the
+// groups are read together once per interval, adding the values of every L3
+// domain in mon_data, and the tasks take their values from the last read.
+class ResctrlMon
+{
+	public:
+
+	// The events, named as the perf ones they replace, and in the units perf gives them
+	enum Event {llc_occupancy, total_bytes, local_bytes, num_events};
+	typedef std::array<double, num_events> values_t;
+
+	private:
+
+	struct Group
+	{
+		std::string clos_dir;   // Control group it is in
+		std::string path;
+		std::vector<std::string> files; // Of the events available in every domain, in the order of 'events'
+		std::vector<double> last;       // Last value read from each file
+		values_t base = {};     // Bandwidth of the groups the task had before being moved
+		values_t values = {};
+	};
+
+	std::string root;
+	std::vector<Event> events;        // Available, in the order of 'Event'
+	std::vector<std::string> domains; // Directories in mon_data, i.e. mon_L3_00
+	std::map<pid_t, Group> groups;
+	mutable std::mutex mtx; // The policy may move tasks from its own thread
+
+	std::string find_clos_dir(pid_t pid) const;
+	void create(pid_t pid, Group &group, const std::vector<pid_t> &pids);
+	void destroy(const Group &group) const;
+	void read(Group &group) const;
+
+	public:
+
+	ResctrlMon(const std::string &_root = "/sys/fs/resctrl");
+	~ResctrlMon();
+
+	ResctrlMon(const ResctrlMon &) = delete;
+	ResctrlMon& operator=(const ResctrlMon &) = delete;
+
+	static const std::string& event_name(Event e);
+	static bool is_snapshot(Event e) { return e == llc_occupancy; }
+	static std::string event_unit(Event e) { return e == llc_occupancy ? "Bytes" : "MB"; }
+
+	// If the name is the one of an event this provides, whether it is available or not
+	static bool provides(const std::string &name);
+
+	const std::vector<Event>& get_events() const { return events; }
+
+	// Create the group of a task, with its children, in the CLOS the task is in
+	void add(pid_t pid);
+
+	// The task and its children have been written into the tasks file of another CLOS.
+	// Only the first pid has to be a task with a group.
+	void move(const std::vector<pid_t> &pids, const std::string &clos_dir);
+
+	// Remove the group of a task that has exited
+	void remove(pid_t pid);
+
+	bool has(pid_t pid) const;
+
+	// Read the groups of all the tasks. It does not allocate memory.
+	void read();
+
+	// Of the last read, zeros for the tasks without group
+	values_t get_values(pid_t pid) const;
+};
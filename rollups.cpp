@@ -0,0 +1,145 @@
+#include <cassert>
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include "rollups.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+double Rollups::Group::mean(Metric m) const
+{
+	if (m == energy_pkg || m == energy_ram)
+		return sums[m];
+	return tasks ? sums[m] / tasks : 0;
+}
+
+
+Rollups::Rollups() :
+		ids({
+			EventId("ipc"),
+			EventId("mem_load_uops_retired.l3_miss"),
+			EventId("intel_cqm/llc_occupancy/"),
+			EventId("intel_cqm/total_bytes/"),
+			EventId("power/energy-pkg/"),
+			EventId("power/energy-ram/")}),
+		clos_id("clos_num")
+{
+	assert(ids.size() == num_metrics);
+}
+
+
+const std::string& Rollups::metric_name(Metric m)
+{
+	static const std::array<std::string, num_metrics> names = {
+		"ipc", "l3_misses", "l3_occupancy", "bandwidth", "energy_pkg", "energy_ram"
+	};
+	return names[m];
+}
+
+
+void Rollups::clear()
+{
+	all = Group();
+	for (auto &g : by_clos)
+		g = Group();
+	for (auto &g : by_domain)
+		g = Group();
+}
+
+
+void Rollups::add(Group &g, const std::array<double, num_metrics> &values)
+{
+	g.tasks++;
+	for (size_t m = 0; m < num_metrics; m++)
+	{
+		if (m == energy_pkg || m == energy_ram)
+			g.sums[m] = values[m];
+		else
+			g.sums[m] += values[m];
+	}
+}
+
+
+void Rollups::add(const Stats &stats, uint32_t domain)
+{
+	std::array<double, num_metrics> values = {};
+	for (size_t m = 0; m < num_metrics; m++)
+	{
+		available[m] = stats.has(ids[m]);
+		if (available[m])
+		{
+			values[m] = stats.last(ids[m]);
+			// A metric undefined in this interval, like the IPC of a task that has not run, does not spoil the sums
+			if (!std::isfinite(values[m]))
+				values[m] = 0;
+		}
+	}
+
+	add(all, values);
+
+	if (stats.has(clos_id))
+	{
+		const uint32_t clos = (uint32_t) stats.last(clos_id);
+		if (clos >= by_clos.size())
+			by_clos.resize(clos + 1);
+		add(by_clos[clos], values);
+	}
+
+	if (domain == CAT::all_domains)
+		return;
+	if (domain >= by_domain.size())
+		by_domain.resize(domain + 1);
+	add(by_domain[domain], values);
+}
+
+
+const Rollups::Group& Rollups::clos(uint32_t clos) const
+{
+	static const Group empty;
+	return clos < by_clos.size() ? by_clos[clos] : empty;
+}
+
+
+const Rollups::Group& Rollups::domain(uint32_t domain) const
+{
+	static const Group empty;
+	return domain < by_domain.size() ? by_domain[domain] : empty;
+}
+
+
+void Rollups::print_header(std::ostream &out, const std::string &sep)
+{
+	out << "interval" << sep << "scope" << sep << "id" << sep << "tasks";
+	for (size_t m = 0; m < num_metrics; m++)
+		out << sep << metric_name((Metric) m) << sep << metric_name((Metric) m) << ":mean";
+	out << '\n';
+}
+
+
+void Rollups::print(uint64_t interval, const std::string &scope, uint32_t id, const Group &g, std::ostream &out, const std::string &sep) const
+{
+	out << interval << sep << scope << sep << id << sep << g.tasks;
+	for (size_t m = 0; m < num_metrics; m++)
+	{
+		if (available[m])
+			out << sep << g.sum((Metric) m) << sep << g.mean((Metric) m);
+		else
+			out << sep << NAN << sep << NAN;
+	}
+	out << '\n';
+}
+
+
+void Rollups::print(uint64_t interval, std::ostream &out, const std::string &sep) const
+{
+	print(interval, "system", 0, all, out, sep);
+	for (size_t i = 0; i < by_clos.size(); i++)
+		if (by_clos[i].tasks)
+			print(interval, "clos", i, by_clos[i], out, sep);
+	for (size_t i = 0; i < by_domain.size(); i++)
+		if (by_domain[i].tasks)
+			print(interval, "domain", i, by_domain[i], out, sep);
+}
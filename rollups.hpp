@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "event-registry.hpp"
+#include "task.hpp"
+
+
+// Sums and means of the interval values of the tasks per CLOS, per L3 domain
+// and for the whole system. The tasks are added one by one as they are
+// sampled, so the policies do not need to walk the tasklist again to compute
+// them. The energy counters are of the whole package, every task reads the
+// same value, so the groups keep that value instead of adding it up. The tasks
+// are in the L3 domain of their cpus, like for the per domain policies, and the
+// ones with cpus in more than one domain only count for the system.
+class Rollups
+{
+	public:
+
+	enum Metric
+	{
+		ipc,
+		l3_misses,
+		l3_occupancy, // Bytes
+		bandwidth,    // Bytes
+		energy_pkg,   // Joules
+		energy_ram,
+		num_metrics,
+	};
+
+	struct Group
+	{
+		uint32_t tasks = 0;
+		std::array<double, num_metrics> sums = {};
+
+		double sum(Metric m) const { return sums[m]; }
+		double mean(Metric m) const;
+	};
+
+	Rollups();
+
+	// Start a new interval, keeping the groups seen so far
+	void clear();
+	void add(const Stats &stats, uint32_t domain); // CAT::all_domains for only the system
+	void add(const Task &task) { add(task.stats, task_l3_domain(task)); }
+
+	const Group& system() const { return all; }
+	const Group& clos(uint32_t clos) const;     // Empty group if no task has been in it
+	const Group& domain(uint32_t domain) const; // By the id of the L3 cache
+	const std::vector<Group>& closes() const  { return by_clos; }
+	const std::vector<Group>& domains() const { return by_domain; }
+
+	// The tasks monitor the event of the metric, otherwise it is 0
+	bool has(Metric m) const { return available[m]; }
+
+	static const std::string& metric_name(Metric m);
+
+	// One line per non empty group, starting with the system one
+	static void print_header(std::ostream &out, const std::string &sep = ",");
+	void print(uint64_t interval, std::ostream &out, const std::string &sep = ",") const;
+
+	private:
+
+	std::vector<EventId> ids; // Of the counters or derived metrics of each metric
+	std::array<bool, num_metrics> available = {};
+	EventId clos_id;
+
+	Group all;
+	std::vector<Group> by_clos;
+	std::vector<Group> by_domain;
+
+	void add(Group &g, const std::array<double, num_metrics> &values);
+	void print(uint64_t interval, const std::string &scope, uint32_t id, const Group &g, std::ostream &out, const std::string &sep) const;
+};
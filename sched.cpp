@@ -240,6 +240,14 @@ tasklist_t Random::apply(uint64_t current_interval, const tasklist_t &tasklist)
 }
 
 
+void Base::set_pause(const std::string &_pause)
+{
+	if (_pause != "signal" && _pause != "freezer")
+		throw_with_trace(std::runtime_error("Invalid pause method '{}', it must be 'signal' or 'freezer'"_format(_pause)));
+	pause = _pause;
+}
+
+
 const std::string Base::show(const tasklist_t &tasklist) const
 {
 	if (tasklist.empty()) return "Tasks scheduled: []";
@@ -27,6 +27,9 @@ class Base
 	// Allowed cpus
 	const std::vector<uint32_t> cpus;
 
+	// How the tasks are paused: signal (SIGSTOP/SIGCONT) or freezer (cgroup v2)
+	std::string pause = "signal";
+
 	// ¬XOR of the cpus allowed for the task and the scheduler
 	void set_cpu_affinity(const tasklist_t &tasklist) const;
 
@@ -37,6 +40,8 @@ class Base
 	~Base() = default;
 
 	const std::string show(const tasklist_t &tasklist) const;
+	void set_pause(const std::string &_pause);
+	const std::string& get_pause() const { return pause; }
 	virtual tasklist_t apply(uint64_t current_interval, const tasklist_t &tasklist);
 };
 typedef std::shared_ptr<Base> ptr_t;
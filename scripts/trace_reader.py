@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# Reader for the binary traces written by the manager with --trace (see trace.hpp).
+# The records are memory mapped as a numpy structured array, nothing is parsed.
+#
+#   import trace_reader
+#   t = trace_reader.Trace("run.trace")
+#   t.records["ipc"]                          # column of all the records
+#   t.select(first=10, last=20, task=3)       # only reads the blocks that match
+#   t.to_dataframe()                          # same columns as the --output CSV
+
+import argparse
+import struct
+import sys
+
+import numpy as np
+
+HEADER_MAGIC = b"MNGTRACE"
+FOOTER_MAGIC = b"MNGTRIDX"
+VERSION = 1
+
+HEADER = struct.Struct("<8s8I")
+FOOTER = struct.Struct("<3Q8s")
+BLOCK = struct.Struct("<Q4I")
+
+
+class Trace:
+
+    def __init__(self, path):
+        self.path = path
+        raw = np.memmap(path, dtype=np.uint8, mode="r")
+        (magic, version, header_size, record_size, num_columns, num_tasks,
+         self.block_records, names_len, bitmap_words) = HEADER.unpack_from(raw, 0)
+        if magic != HEADER_MAGIC:
+            raise ValueError("{} is not a trace".format(path))
+        if version != VERSION:
+            raise ValueError("Unsupported trace version {}".format(version))
+
+        pos = HEADER.size
+        names = bytes(raw[pos:pos + names_len]).decode()
+        self.columns = names.split("\n") if num_columns else []
+        pos += names_len
+
+        self.tasks = {}
+        for _ in range(num_tasks):
+            tid, length = struct.unpack_from("<2I", raw, pos)
+            pos += 8
+            self.tasks[tid] = bytes(raw[pos:pos + length]).decode()
+            pos += length
+
+        fields = [("interval", "<u4"), ("task", "<u4"), ("cpu", "<i4"), ("reserved", "<u4"), ("compl", "<f8")]
+        fields += [(c, "<f8") for c in self.columns]
+        self.dtype = np.dtype(fields)
+        assert self.dtype.itemsize == record_size
+
+        # Index and footer, only if the trace was closed properly
+        self.blocks = None
+        num_records = (len(raw) - header_size) // record_size
+        if len(raw) >= header_size + FOOTER.size:
+            index_offset, num_blocks, n, magic = FOOTER.unpack_from(raw, len(raw) - FOOTER.size)
+            if magic == FOOTER_MAGIC:
+                num_records = n
+                entry = BLOCK.size + 8 * bitmap_words
+                self.blocks = []
+                for b in range(num_blocks):
+                    off = index_offset + b * entry
+                    offset, count, first, last, _ = BLOCK.unpack_from(raw, off)
+                    bitmap = np.frombuffer(raw[off + BLOCK.size:off + entry].tobytes(), dtype="<u8")
+                    self.blocks.append(((offset - header_size) // record_size, count, first, last, bitmap))
+
+        self.records = np.memmap(path, dtype=self.dtype, mode="r", offset=header_size, shape=(num_records,))
+
+    def _has_task(self, bitmap, task):
+        return task // 64 < len(bitmap) and (int(bitmap[task // 64]) >> (task % 64)) & 1
+
+    def select(self, first=0, last=2**32 - 1, task=None):
+        """Records in the interval range [first, last] of the task, using the index to skip blocks."""
+        if self.blocks is None:
+            parts = [self.records]
+        else:
+            parts = [self.records[start:start + count] for start, count, bfirst, blast, bitmap in self.blocks
+                     if blast >= first and bfirst <= last and (task is None or self._has_task(bitmap, task))]
+        if not parts:
+            return self.records[:0]
+        recs = np.concatenate(parts) if len(parts) > 1 else parts[0]
+        mask = (recs["interval"] >= first) & (recs["interval"] <= last)
+        if task is not None:
+            mask &= recs["task"] == task
+        return recs[mask]
+
+    def to_dataframe(self, records=None):
+        import pandas as pd
+        recs = self.records if records is None else records
+        df = pd.DataFrame({c: recs[c] for c in ["interval", "compl"] + self.columns})
+        df.insert(1, "app", ["{:02}_{}".format(t, self.tasks[t]) for t in recs["task"]])
+        df.insert(2, "CPU", recs["cpu"])
+        return df
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Show a summary of a binary trace.")
+    parser.add_argument("trace", help="Trace written with --trace")
+    args = parser.parse_args()
+
+    t = Trace(args.trace)
+    print("Columns: {}".format(", ".join(t.columns)))
+    print("Tasks: {}".format(", ".join("{}:{}".format(k, v) for k, v in sorted(t.tasks.items()))))
+    print("Records: {}".format(len(t.records)))
+    print("Indexed: {}".format(t.blocks is not None))
+    if len(t.records):
+        print("Intervals: {} - {}".format(t.records["interval"].min(), t.records["interval"].max()))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. The producer only writes 'tail' and the consumer only writes 'head',
+// so no CAS loop is needed: acquire/release ordering on the indexes is enough
+// to publish the elements.
+template <typename T>
+class SPSCQueue
+{
+	// Avoid false sharing between the producer and the consumer indexes
+	static constexpr size_t cache_line = 64;
+
+	std::vector<T> buffer;
+	const size_t mask;
+
+	// Padding instead of alignas, over-aligned new is not supported before C++17
+	char pad0[cache_line];
+	std::atomic<size_t> head; // Next element to pop
+	char pad1[cache_line - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> tail; // Next free slot
+	char pad2[cache_line - sizeof(std::atomic<size_t>)];
+
+	static size_t round_up_pow2(size_t n)
+	{
+		size_t p = 1;
+		while (p < n)
+			p <<= 1;
+		return p;
+	}
+
+	public:
+
+	SPSCQueue() = delete;
+	SPSCQueue(size_t capacity) :
+			buffer(round_up_pow2(capacity)), mask(buffer.size() - 1), head(0), tail(0)
+	{
+		assert(capacity > 0);
+	}
+
+	SPSCQueue(const SPSCQueue &) = delete;
+	SPSCQueue& operator=(const SPSCQueue &) = delete;
+
+	// Producer side. Returns false if the queue is full.
+	bool try_push(T &&value)
+	{
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == buffer.size())
+			return false;
+		buffer[t & mask] = std::move(value);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_push(const T &value)
+	{
+		T copy = value;
+		return try_push(std::move(copy));
+	}
+
+	// Consumer side. Returns false if the queue is empty.
+	bool try_pop(T &value)
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		value = std::move(buffer[h & mask]);
+		buffer[h & mask] = T(); // Release resources held by the slot
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const { return buffer.size(); }
+};
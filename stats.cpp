@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cassert>
 #include <functional>
 #include <iomanip>
 #include <sstream>
@@ -7,14 +9,12 @@
 #include <boost/io/ios_state.hpp>
 #include <fmt/format.h>
 
+#include "common.hpp"
 #include "log.hpp"
 #include "stats.hpp"
 #include "throw-with-trace.hpp"
 
 
-#define WIN_SIZE 7
-
-
 namespace acc = boost::accumulators;
 
 using fmt::literals::operator""_format;
@@ -26,193 +26,275 @@ Stats::Stats(const std::vector<std::string> &stats_names)
 }
 
 
-void Stats::init_derived_metrics_total(const std::vector<std::string> &stats_names)
-{
-	bool instructions = std::find(stats_names.begin(), stats_names.end(), "instructions") != stats_names.end();
-	bool cycles = std::find(stats_names.begin(), stats_names.end(), "cycles") != stats_names.end();
-	bool ref_cycles = std::find(stats_names.begin(), stats_names.end(), "ref-cycles") != stats_names.end();
+constexpr uint32_t Stats::default_window;
+constexpr size_t Stats::no_pos;
 
-	if (instructions && cycles)
-	{
-		derived_metrics_total.push_back(std::make_pair("ipc", [this]()
-		{
-			double inst = this->sum("instructions");
-			double cycl = this->sum("cycles");
-			return inst / cycl;
-		}));
-	}
 
-	if (instructions && ref_cycles)
+void Stats::add_event(EventId id, size_t window_length)
+{
+	if (id.get() >= accums.size())
 	{
-		derived_metrics_total.push_back(std::make_pair("ref-ipc", [this]()
-		{
-			double inst = this->sum("instructions");
-			double ref_cycl = this->sum("ref-cycles");
-			return inst / ref_cycl;
-		}));
+		accums.resize(id.get() + 1);
+		windows.resize(id.get() + 1, Window(1));
+		monitored.resize(id.get() + 1, false);
+		snapshot.resize(id.get() + 1, false);
+		confidences.resize(id.get() + 1, 1);
 	}
+	windows[id.get()] = Window(window_length);
+	monitored[id.get()] = true;
 }
 
 
-void Stats::init_derived_metrics_int(const std::vector<std::string> &stats_names)
+void Stats::init(const std::vector<std::string> &stats_names, std::shared_ptr<const DerivedMetrics> derived_metrics,
+		const std::map<std::string, uint32_t> &window_lengths, uint32_t window_length)
 {
-	bool instructions = std::find(stats_names.begin(), stats_names.end(), "instructions") != stats_names.end();
-	bool cycles = std::find(stats_names.begin(), stats_names.end(), "cycles") != stats_names.end();
-	bool ref_cycles = std::find(stats_names.begin(), stats_names.end(), "ref-cycles") != stats_names.end();
-	if (instructions && cycles)
-	{
-		derived_metrics_int.push_back(std::make_pair("ipc", [this]()
-		{
-			double inst = this->last("instructions");
-			double cycl = this->last("cycles");
-			return inst / cycl;
-		}));
-	}
+	assert(!initialized);
 
-	if (instructions && ref_cycles)
+	for (const auto &c : stats_names)
+		name_ids.push_back(EventId(c));
+
+	derived = derived_metrics ?
+			derived_metrics :
+			std::make_shared<const DerivedMetrics>(DerivedMetrics::builtin(stats_names));
+	derived_ids = derived->get_ids();
+	derived_values.resize(derived->size());
+
+	// The operands of the derived metrics have to be counters or the length of the interval
+	for (const auto &id : derived->get_events())
+		if (id != dt_id && std::find(name_ids.begin(), name_ids.end(), id) == name_ids.end())
+			throw_with_trace(std::runtime_error("A derived metric uses the event '{}', which is not monitorized"_format(id.name())));
+	for (const auto &id : derived_ids)
+		if (id == dt_id || std::find(name_ids.begin(), name_ids.end(), id) != name_ids.end())
+			throw_with_trace(std::runtime_error("The derived metric '{}' has the name of an event"_format(id.name())));
+
+	for (const auto &kv : window_lengths)
+		if (kv.second == 0)
+			throw_with_trace(std::runtime_error("The window of '{}' must have at least one value"_format(kv.first)));
+	if (window_length == 0)
+		throw_with_trace(std::runtime_error("The windows must have at least one value"));
+
+	auto length = [&](EventId id)
 	{
-		derived_metrics_int.push_back(std::make_pair("ref-ipc", [this]()
-		{
-			double inst = this->last("instructions");
-			double ref_cycl = this->last("ref-cycles");
-			return inst / ref_cycl;
-		}));
-	}
+		auto it = window_lengths.find(id.name());
+		return it == window_lengths.end() ? window_length : it->second;
+	};
+
+	// Resolve all the ids before creating the accumulators, so there is a single allocation
+	for (const auto &id : name_ids)
+		add_event(id, length(id));
+	for (const auto &id : derived_ids)
+		add_event(id, length(id));
+	add_event(dt_id, length(dt_id));
+
+	// Store the names of the counters
+	names = stats_names;
+
+	initialized = true;
 }
 
 
-void Stats::init(const std::vector<std::string> &stats_names)
+void Stats::init_quantiles(const std::vector<std::string> &metrics, const std::vector<double> &_percentiles, double compression)
 {
-	assert(!initialized);
-
-	for (const auto &c : stats_names)
-		events.insert(std::make_pair(c, accum_t(acc::tag::rolling_window::window_size = WIN_SIZE)));
+	assert(initialized);
 
-	init_derived_metrics_int(stats_names);
-	init_derived_metrics_total(stats_names);
+	for (const auto &p : _percentiles)
+		if (p < 0 || p > 100)
+			throw_with_trace(std::runtime_error("Invalid percentile {}, it must be between 0 and 100"_format(p)));
+	percentiles = _percentiles;
 
-	// Test der metrics
-	if (derived_metrics_int.size() != derived_metrics_total.size())
-		throw_with_trace(std::runtime_error("Different number of derived metrics for int ({}) and total ({})"_format(
-				derived_metrics_int.size(), derived_metrics_total.size())));
-	for(const auto &der : derived_metrics_int)
+	sketches.clear();
+	for (const auto &name : metrics)
 	{
-		auto it = std::find_if(derived_metrics_total.begin(), derived_metrics_total.end(),
-				[&der](const auto& tuple) {return tuple.first == der.first;});
-		if (it == derived_metrics_total.end())
-			throw_with_trace(std::runtime_error("Different derived metrics for int and total results"));
+		EventId id(name);
+		if (!has(id))
+			throw_with_trace(std::runtime_error("Quantiles requested for '{}', which is not monitorized"_format(name)));
+		sketches.push_back(std::make_pair(id, TDigest(compression)));
 	}
+}
 
-	for (const auto &der : derived_metrics_int)
-		events.insert(std::make_pair(der.first, accum_t(acc::tag::rolling_window::window_size = WIN_SIZE)));
 
-	// Store the names of the counters
-	names = stats_names;
+// For correcting the overflows of the energy counters
+static
+uint64_t read_max_ujoules_ram()
+{
+	// TODO: This needs improvement... i.e. consider more packages etc.
+	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/max_energy_range_uj");
+	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/name");
+	uint64_t data;
 
-	initialized = true;
+	fdata >> data;
+
+	std::string name;
+	fname >> name;
+
+	assert(name == "dram");
+
+	return data;
 }
 
 
-Stats& Stats::accum(const counters_t &counters)
+static
+uint64_t read_max_ujoules_pkg()
 {
-	assert(initialized);
+	// TODO: This needs improvement... i.e. consider more packages etc.
+	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/max_energy_range_uj");
+	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/name");
+	uint64_t data;
+
+	fdata >> data;
 
-	clast = ccurr;
-	ccurr = counters;
+	std::string name;
+	fname >> name;
 
-	const auto &last_id_idx = clast.get<by_id>();
-	auto &curr_id_idx = ccurr.get<by_id>();
+	assert(name == "package-0");
+
+	return data;
+}
 
-	assert(!ccurr.empty());
 
-	// App has just started, no last data
-	if (clast.empty())
+Stats& Stats::accum(const counters_t &counters)
+{
+	sspare.names.clear();
+	sspare.snapshot.clear();
+	sspare.values.clear();
+	sspare.enabled.clear();
+	sspare.running.clear();
+	for (const auto &c : counters.get<by_id>())
 	{
-		auto it = curr_id_idx.cbegin();
-		while (it != curr_id_idx.cend())
-		{
-			double value = (it->name == "power/energy-ram/" || it->name == "power/energy-pkg/") ?
-					0 :
-					it->value;
+		sspare.names.push_back(c.name);
+		sspare.snapshot.push_back(c.snapshot);
+		sspare.values.push_back(c.value);
+		sspare.enabled.push_back(c.enabled);
+		sspare.running.push_back(c.running);
+	}
+	return accum(sspare);
+}
+
 
-			assert(it->running >= 0 && it->running <= it->enabled);
+Stats& Stats::accum(Sample &sample)
+{
+	assert(initialized);
+	assert(sample.size() > 0);
 
-			if (it->running)
-				value /= (double) it->running / (double) it->enabled;
+	std::swap(slast, scurr);
+	std::swap(scurr, sample);
+	const Sample &l = slast;
+	Sample &c = scurr;
 
-			assert(std::isfinite(value));
-			events.at(it->name)(value);
-			it++;
+	// App has just started, find the ids of the counters
+	if (counter_ids.empty())
+	{
+		for (size_t i = 0; i < c.size(); i++)
+		{
+			EventId id(c.names[i]);
+			if (!has(id))
+				throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(c.names[i])));
+			counter_ids.push_back(id);
+			snapshot[id.get()] = c.snapshot[i];
+			if (c.names[i] == "power/energy-pkg/")
+				energy_pkg_pos = i;
+			else if (c.names[i] == "power/energy-ram/")
+				energy_ram_pos = i;
 		}
-		cbak = counters; // For being able to iterate them later
 	}
+	assert(c.size() == counter_ids.size());
 
-	// We have data from the last interval
-	else
+	// Length of the interval from the timestamps of the samples. The first sample after a reset has no
+	// previous one, but the counters have been counting for the time they have been enabled.
+	double dt = 0;
+	if (restart)
+		dt = *std::max_element(c.enabled.begin(), c.enabled.end()) / 1E9;
+	else if (c.time_ns && l.time_ns)
+		dt = (c.time_ns - l.time_ns) / 1E9;
+
+	for (size_t i = 0; i < c.size(); i++)
 	{
-		assert(ccurr.size() == clast.size());
-		auto curr_it = curr_id_idx.cbegin();
-		auto last_it = last_id_idx.cbegin();
-		while (curr_it != curr_id_idx.cend() && last_it != last_id_idx.cend())
+		const EventId &id = counter_ids[i];
+		const bool energy = i == energy_pkg_pos || i == energy_ram_pos;
+		assert(c.running[i] <= c.enabled[i]);
+		const double enabled_fraction = (double) c.running[i] / (double) c.enabled[i];
+		const double confidence = c.enabled[i] ? enabled_fraction : 0;
+		double value;
+
+		// No last data
+		if (restart)
+		{
+			value = energy ? 0 : c.values[i];
+			if (c.running[i])
+				value /= enabled_fraction;
+		}
+
+		// We have data from the last interval
+		else
 		{
-			const Counter &c = *curr_it;
-			const Counter &l = *last_it;
-			assert(c.id == l.id);
-			assert(c.name == l.name);
-			double value = c.snapshot ?
-					c.value :
-					c.value - l.value;
+			assert(l.size() == c.size());
+			value = c.snapshot[i] ?
+					c.values[i] :
+					c.values[i] - l.values[i];
 
 			if (value < 0)
 			{
 				// There has been an overflow with the energy, and we have to correct it
 				double newvalue = 0;
-				if (c.name == "power/energy-pkg/")
-					newvalue = c.value * 1E6 + (read_max_ujoules_pkg() - l.value * 1E6);
-				else if (c.name == "power/energy-ram/")
-					newvalue = c.value * 1E6 + (read_max_ujoules_ram() - l.value * 1E6);
+				if (i == energy_pkg_pos)
+					newvalue = c.values[i] * 1E6 + (read_max_ujoules_pkg() - l.values[i] * 1E6);
+				else if (i == energy_ram_pos)
+					newvalue = c.values[i] * 1E6 + (read_max_ujoules_ram() - l.values[i] * 1E6);
 				else
-					throw_with_trace(std::runtime_error("Negative interval value ({}) for the counter '{}'"_format(value, c.name)));
+					throw_with_trace(std::runtime_error("Negative interval value ({}) for the counter '{}'"_format(value, id.name())));
 
 				newvalue /= 1E6;
-				LOGDEB("Energy counter '{}' overflow. Last interval value was {}. Current will be {}"_format(c.name, last(c.name), newvalue));
+				LOGDEB("Energy counter '{}' overflow. Last interval value was {}. Current will be {}"_format(id.name(), last(id), newvalue));
 				value = newvalue;
 			}
 
-			assert(c.enabled >= 0 && c.running <= c.enabled);
-
-			double enabled_fraction = (double) c.running / (double) c.enabled;
-			if (c.enabled == 0)
-				LOGINF("Counter '{}' was not enabled during this interval"_format(c.name));
+			if (c.enabled[i] == 0)
+				LOGINF("Counter '{}' was not enabled during this interval"_format(id.name()));
 			else if (enabled_fraction < 1)
 			{
 				value /= enabled_fraction;
-				LOGDEB("Counter {} has been scaled ({})"_format(c.name, enabled_fraction));
+				LOGDEB("Counter {} has been scaled ({})"_format(id.name(), enabled_fraction));
 			}
 			else
 			{
 				assert(enabled_fraction == 1);
-				LOGDEB("Counter {} has been read without scaling"_format(c.name));
+				LOGDEB("Counter {} has been read without scaling"_format(id.name()));
 			}
 
-			assert(std::isfinite(value));
-			events.at(c.name)(value);
-
 			// Perf reports events since the begining of the execution, but enabled and running times are for the interval.
 			// Therefore, in order to know the running and enabled times since the start we need to accumulate them.
-			curr_id_idx.modify(curr_it, [&l](auto &c_){c_.enabled += l.enabled; c_.running += l.running;});
+			c.enabled[i] += l.enabled[i];
+			c.running[i] += l.running[i];
 
 			// Check values of each counter
-			LOGDEB("Counter {} has value {}"_format(c.name,c.value));
-
-			curr_it++;
-			last_it++;
+			LOGDEB("Counter {} has value {}"_format(id.name(), c.values[i]));
 		}
+
+		assert(std::isfinite(value));
+		confidences[id.get()] = confidence;
+		accums[id.get()](value);
+		windows[id.get()].push(value);
 	}
+	restart = false;
+
+	accums[dt_id.get()](dt);
+	windows[dt_id.get()].push(dt);
 
 	// Compute and add derived metrics
-	for (const auto &der : derived_metrics_int)
-		events.at(der.first)(der.second());
+	derived->eval([this](uint32_t id) { return acc::last(accums[id]); }, derived_values.data());
+	for (size_t i = 0; i < derived_ids.size(); i++)
+	{
+		accums[derived_ids[i].get()](derived_values[i]);
+		windows[derived_ids[i].get()].push(derived_values[i]);
+
+		double confidence = 1;
+		for (const auto &id : derived->get_operands(i))
+			confidence = std::min(confidence, confidences[id.get()]);
+		confidences[derived_ids[i].get()] = confidence;
+	}
+
+	for (auto &sketch : sketches)
+		sketch.second.add(acc::last(accums[sketch.first.get()]));
 
 	counter++;
 
@@ -230,8 +312,27 @@ std::string Stats::header_to_string(const std::string &sep) const
 	it++;
 	for (; it != names.end(); it++)
 		ss << sep << *it;
-	for (const auto &der : derived_metrics_int) // Int, snapshot and total have the same derived metrics
-		ss << sep << der.first;
+	for (const auto &name : derived->get_names()) // Int, snapshot and total have the same derived metrics
+		ss << sep << name;
+	if (rates)
+	{
+		assert(!counter_ids.empty());
+		ss << sep << dt_id.name();
+		for (size_t i = 0; i < names.size(); i++)
+			if (!snapshot[name_ids[i].get()])
+				ss << sep << names[i] << "/s";
+	}
+	return ss.str();
+}
+
+
+std::string Stats::header_to_string_total(const std::string &sep) const
+{
+	std::stringstream ss;
+	ss << header_to_string(sep);
+	for (const auto &sketch : sketches)
+		for (const auto &p : percentiles)
+			ss << sep << "{}:p{}"_format(sketch.first.name(), p);
 	return ss.str();
 }
 
@@ -243,32 +344,49 @@ std::string Stats::header_to_string(const std::string &sep) const
 std::string Stats::data_to_string_total(const std::string &sep) const
 {
 	std::stringstream ss;
+	data_to_stream_total(ss, sep);
+	return ss.str();
+}
 
-	assert(cbak.size() > 0);
 
-	const auto &cbak_id_idx = cbak.get<by_id>();
-	auto it = cbak_id_idx.cbegin();
-	while (it != cbak_id_idx.cend())
+void Stats::data_to_stream_total(std::ostream &ss, const std::string &sep) const
+{
+	assert(counter_ids.size() > 0);
+
+	auto it = counter_ids.cbegin();
+	while (it != counter_ids.cend())
 	{
-		const auto &name = it->name;
-		const accum_t &event = events.at(name);
-		double value = it->snapshot ?
+		const accum_t &event = accums[it->get()];
+		double value = snapshot[it->get()] ?
 				acc::mean(event) :
 				acc::sum(event);
 		ss << value;
 		it++;
-		if (it != cbak_id_idx.cend())
+		if (it != counter_ids.cend())
 			ss << sep;
 	}
 
-	// Derived metrics
-	for (auto it1 = derived_metrics_total.cbegin(); it1 != derived_metrics_total.cend(); it1++)
-	{
-		double value = it1->second();
+	// Derived metrics, from the same values of the counters
+	static thread_local auto values = std::vector<double>();
+	values.resize(derived->size());
+	derived->eval([this](uint32_t id) { return snapshot[id] ? acc::mean(accums[id]) : acc::sum(accums[id]); }, values.data());
+	for (const auto &value : values)
 		ss << sep << value;
+
+	// Rates over the whole execution
+	if (rates)
+	{
+		const double dt = acc::sum(accums[dt_id.get()]);
+		ss << sep << dt;
+		for (const auto &id : name_ids)
+			if (!snapshot[id.get()])
+				ss << sep << acc::sum(accums[id.get()]) / dt;
 	}
 
-	return ss.str();
+	// Percentiles
+	for (const auto &sketch : sketches)
+		for (const auto &p : percentiles)
+			ss << sep << sketch.second.quantile(p / 100);
 }
 
 std::string Stats::double2hexstr(double x) const
@@ -284,63 +402,153 @@ std::string Stats::double2hexstr(double x) const
 std::string Stats::data_to_string_int(const std::string &sep) const
 {
 	std::stringstream ss;
+	data_to_stream_int(ss, sep);
+	return ss.str();
+}
+
 
+void Stats::data_to_stream_int(std::ostream &ss, const std::string &sep) const
+{
 	assert(names.size() > 0);
 
-	auto it1 = names.cbegin();
-	while (it1 != names.cend())
+	static const EventId clos_mask("clos_mask");
+
+	auto it1 = name_ids.cbegin();
+	while (it1 != name_ids.cend())
 	{
-		if (*it1 == "clos_mask")
+		if (*it1 == clos_mask)
 		{
-			double val_clos = (double) acc::last(events.at(*it1));
+			double val_clos = (double) acc::last(accums[it1->get()]);
 			std::string s_clos = double2hexstr(val_clos);
 			ss << s_clos;
 		}
 		else
-			ss << acc::last(events.at(*it1));
+			ss << acc::last(accums[it1->get()]);
 
 		it1++;
 
-		if (it1 != names.cend())
+		if (it1 != name_ids.cend())
 			ss << sep;
 	}
 
 	// Derived metrics
-	for (auto it = derived_metrics_int.cbegin(); it != derived_metrics_int.cend(); it++)
+	for (const auto &id : derived_ids)
+		ss << sep << acc::last(accums[id.get()]);
+
+	if (rates)
 	{
-		double value = it->second();
-		ss << sep << value;
+		const double dt = acc::last(accums[dt_id.get()]);
+		ss << sep << dt;
+		for (const auto &id : name_ids)
+			if (!snapshot[id.get()])
+				ss << sep << acc::last(accums[id.get()]) / dt;
 	}
+}
 
-	return ss.str();
+
+void Stats::data_to_vector_int(std::vector<double> &values) const
+{
+	assert(names.size() > 0);
+
+	values.clear();
+	for (const auto &id : name_ids)
+		values.push_back(acc::last(accums[id.get()]));
+
+	// Derived metrics
+	for (const auto &id : derived_ids)
+		values.push_back(acc::last(accums[id.get()]));
+
+	if (rates)
+	{
+		const double dt = acc::last(accums[dt_id.get()]);
+		values.push_back(dt);
+		for (const auto &id : name_ids)
+			if (!snapshot[id.get()])
+				values.push_back(acc::last(accums[id.get()]) / dt);
+	}
 }
 
 
 double Stats::get_current(const std::string &name) const
 {
-	const auto &curr_index = ccurr.get<by_name>();
-	auto it = curr_index.find(name);
-	if (it == curr_index.end())
-		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(name)));
-	if (it->value == 0) return 0; // This way we don't have to worry about enabled being 0
-	return it->value / ((double) it->running / (double) it->enabled);
+	return get_current(EventId(name));
+}
+
+
+// The counters are in the samples in the same order as in 'counter_ids'
+double Stats::get_current(EventId id) const
+{
+	auto pos = std::find(counter_ids.cbegin(), counter_ids.cend(), id);
+	if (pos == counter_ids.cend())
+		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(id.name())));
+	const size_t i = pos - counter_ids.cbegin();
+	assert(i < scurr.size());
+	if (scurr.values[i] == 0) return 0; // This way we don't have to worry about enabled being 0
+	return scurr.values[i] / ((double) scurr.running[i] / (double) scurr.enabled[i]);
+}
+
+
+double Stats::rate(EventId id) const
+{
+	return last(id) / last(dt_id);
+}
+
+
+const Stats::accum_t& Stats::get(EventId id) const
+{
+	if (!has(id))
+		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(id.name())));
+	return accums[id.get()];
+}
+
+
+double Stats::quantile(EventId id, double q) const
+{
+	for (const auto &sketch : sketches)
+		if (sketch.first == id)
+			return sketch.second.quantile(q);
+	throw_with_trace(std::runtime_error("There is no quantile sketch for '{}'"_format(id.name())));
+}
+
+
+double Stats::confidence(EventId id) const
+{
+	if (!has(id))
+		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(id.name())));
+	return confidences[id.get()];
+}
+
+
+const Window& Stats::window(EventId id) const
+{
+	if (!has(id))
+		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(id.name())));
+	return windows[id.get()];
+}
+
+
+std::vector<std::string> Stats::get_names() const
+{
+	auto result = names;
+	result.insert(result.end(), derived->get_names().begin(), derived->get_names().end());
+	return result;
 }
 
 
-double Stats::sum(const std::string &name) const
+double Stats::sum(EventId id) const
 {
-	return acc::sum(events.at(name));
+	return acc::sum(get(id));
 }
 
 
-double Stats::last(const std::string &name) const
+double Stats::last(EventId id) const
 {
-	return acc::last(events.at(name));
+	return acc::last(get(id));
 }
 
 
+// The counters keep their ids, the next sample is taken as the first one
 void Stats::reset_counters()
 {
-	clast = counters_t();
-	ccurr = counters_t();
+	restart = true;
 }
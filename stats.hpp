@@ -2,21 +2,26 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <ostream>
 
 #include <boost/accumulators/accumulators.hpp>
-#include <boost/accumulators/statistics/rolling_mean.hpp>
-#include <boost/accumulators/statistics/rolling_window.hpp>
 #include <boost/accumulators/statistics/mean.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
 #include <boost/accumulators/statistics/variance.hpp>
 
 #include "accum-last.hpp"
+#include "derived-metrics.hpp"
+#include "event-registry.hpp"
 #include "events-perf.hpp"
+#include "tdigest.hpp"
+#include "window.hpp"
 
 
 class Stats
 {
+	public:
+
 	// Declare the 'accum_t' typedef
 	#define ACC boost::accumulators
 	typedef ACC::accumulator_set <
@@ -25,57 +30,129 @@ class Stats
 			ACC::tag::last,
 			ACC::tag::sum,
 			ACC::tag::mean,
-			ACC::tag::variance,
-			ACC::tag::rolling_mean>> accum_t;
+			ACC::tag::variance>> accum_t;
 	#undef ACC
 
+	private:
+
 	// Set to true when the 'init' method is called
 	bool initialized = false;
 
 	// Times that the 'accum' method has been called
 	uint64_t counter = 0;
 
-	// Last and current counter values that have been passed to the 'accum' method
-	counters_t cbak; // Only for the names and properties of the counters after a reset
-	counters_t clast;
-	counters_t ccurr;
+	// Last and current samples that have been passed to the 'accum' method, which swaps them with
+	// the one passed instead of copying it
+	Sample slast;
+	Sample scurr;
+	Sample sspare; // For the counters passed as a 'counters_t'
+
+	// The next sample has no previous one, after the first call to 'init' or 'reset_counters'
+	bool restart = true;
+
+	// Positions of the energy counters in the samples, which can overflow
+	static constexpr size_t no_pos = -1;
+	size_t energy_pkg_pos = no_pos;
+	size_t energy_ram_pos = no_pos;
 
-	// Vectors with lambdas that compute derived stats
-	std::vector<
-		std::pair<
-			std::string,
-			std::function<double()>
-		>
-	> derived_metrics_int, derived_metrics_total;
+	// Program that computes the derived metrics, shared by the tasks
+	std::shared_ptr<const DerivedMetrics> derived;
+	std::vector<double> derived_values; // Results of the last evaluation
 
-	// Vector with the names of the counters that will be accumulated
+	// Vector with the names of the counters that will be accumulated, and their ids
 	std::vector<std::string> names;
+	std::vector<EventId> name_ids;
+
+	// Ids of the counters in the order of the samples, set by the first call to 'accum'
+	std::vector<EventId> counter_ids;
+
+	// Ids of the derived metrics, in the same order as in 'derived'
+	std::vector<EventId> derived_ids;
+
+	// Accumulators and windows of the counters and the derived metrics, indexed by event id
+	std::vector<accum_t> accums;
+	std::vector<Window> windows;
+	std::vector<bool> monitored;
+	std::vector<bool> snapshot; // The total of snapshot counters is their mean, instead of their sum
+	std::vector<double> confidences; // Fraction of the last interval the counters were counting
+
+	// Length in seconds of the intervals between samples, which derived metrics can use as 'dt'
+	EventId dt_id = EventId("dt");
+
+	// Add the length of the interval and the rates per second of the counters to the output
+	bool rates = false;
+
+	// Quantile sketches of the interval values of some metrics, and the percentiles of the totals
+	std::vector<std::pair<EventId, TDigest>> sketches;
+	std::vector<double> percentiles;
+
+	void add_event(EventId id, size_t window_length);
 
 	std::string data_to_string(const std::string &sep, bool force_snapshot) const;
 
 	public:
 
-	std::map<std::string, accum_t> events;
+	static constexpr uint32_t default_window = 7;
 
 	Stats() = default;
 	Stats(const std::vector<std::string> &counters);
 
-	void init(const std::vector<std::string> &counters);
-	void init_derived_metrics_total(const std::vector<std::string> &counters);
-	void init_derived_metrics_int(const std::vector<std::string> &counters);
+	// Without a program for the derived metrics, the builtin ones are computed. The window of each
+	// metric has the length in 'window_lengths', or 'window_length' if it is not there.
+	void init(const std::vector<std::string> &counters, std::shared_ptr<const DerivedMetrics> derived = nullptr,
+			const std::map<std::string, uint32_t> &window_lengths = {}, uint32_t window_length = default_window);
+	// Keep a sketch of the interval values of 'metrics', and report 'percentiles' (0-100) of them in
+	// the totals. Call it after 'init'.
+	void init_quantiles(const std::vector<std::string> &metrics, const std::vector<double> &percentiles, double compression = 100);
+	// Add 'dt' and the rates of the counters that are not snapshots ('name/s') after the derived
+	// metrics in the int and total outputs. The headers need a sample to know the snapshots.
+	void init_rates() { rates = true; }
+
+	// The buffers of 'sample' are swapped with the ones of the last sample, which are returned in it
+	// for the next read, so in steady state accumulating does not allocate memory
+	Stats& accum(Sample &sample);
 	Stats& accum(const counters_t &c);
 
 	void reset_counters();
 
 	double get_current(const std::string &name) const;
+	double get_current(EventId id) const;
+
+	// Accumulator of a counter or derived metric, throws if it is not monitorized
+	bool has(EventId id) const { return id.get() < monitored.size() && monitored[id.get()]; }
+	const accum_t& get(EventId id) const;
+	const Window& window(EventId id) const;
+
+	// Fraction (0-1) of the last interval a counter was in the PMU, the rest of the value is
+	// extrapolated. For a derived metric, the lowest one of the counters it depends on.
+	double confidence(EventId id) const;
+
+	// Quantile (0-1) of the interval values of a metric with a sketch
+	double quantile(EventId id, double q) const;
+
+	// Names of the counters and derived metrics monitorized
+	std::vector<std::string> get_names() const;
 
 	// sum of accumulated values
-	double sum(const std::string &name) const;
+	double sum(EventId id) const;
+	double sum(const std::string &name) const { return sum(EventId(name)); }
 	// Last accumulated value into the counter
-	double last(const std::string &name) const;
+	double last(EventId id) const;
+	double last(const std::string &name) const { return last(EventId(name)); }
+	// Last accumulated value divided by the length of its interval
+	double rate(EventId id) const;
+	double rate(const std::string &name) const { return rate(EventId(name)); }
 
 	std::string header_to_string(const std::string &sep) const;
+	std::string header_to_string_total(const std::string &sep) const;
 	std::string data_to_string_int(const std::string &sep) const;
 	std::string data_to_string_total(const std::string &sep) const;
+
+	// Same as the 'data_to_string' methods, but writing directly into the stream
+	void data_to_stream_int(std::ostream &out, const std::string &sep) const;
+	void data_to_stream_total(std::ostream &out, const std::string &sep) const;
+
+	// Interval values, in the same order as the header, for the binary trace
+	void data_to_vector_int(std::vector<double> &values) const;
 	std::string double2hexstr(double x) const;
 };
@@ -0,0 +1,180 @@
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "task-tracker.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+void TaskTracker::block_sigchld()
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+	if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0)
+		throw_with_trace(std::runtime_error("Could not block SIGCHLD"));
+}
+
+
+void TaskTracker::unblock_sigchld()
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+	pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+}
+
+
+TaskTracker::TaskTracker()
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGCHLD);
+
+	sfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sfd < 0)
+		throw_with_trace(std::runtime_error("Could not create signalfd for SIGCHLD: {}"_format(strerror(errno))));
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+	{
+		close(sfd);
+		throw_with_trace(std::runtime_error("Could not create epoll instance: {}"_format(strerror(errno))));
+	}
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = sfd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) < 0)
+	{
+		close(sfd);
+		close(epfd);
+		throw_with_trace(std::runtime_error("Could not add signalfd to epoll: {}"_format(strerror(errno))));
+	}
+}
+
+
+TaskTracker::~TaskTracker()
+{
+	close(epfd);
+	close(sfd);
+}
+
+
+void TaskTracker::track(pid_t pid)
+{
+	states.emplace(pid, State());
+}
+
+
+void TaskTracker::untrack(pid_t pid)
+{
+	states.erase(pid);
+}
+
+
+const TaskTracker::State& TaskTracker::get(pid_t pid) const
+{
+	auto it = states.find(pid);
+	if (it == states.end())
+		throw_with_trace(std::runtime_error("Pid {} is not being tracked"_format(pid)));
+	return it->second;
+}
+
+
+// Collect every state change of every child
+void TaskTracker::reap()
+{
+	for (;;)
+	{
+		siginfo_t info;
+		memset(&info, 0, sizeof(info));
+		if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WCONTINUED | WNOHANG) < 0)
+		{
+			if (errno == ECHILD)
+				return;
+			if (errno == EINTR)
+				continue;
+			throw_with_trace(std::runtime_error("Error in waitid: {}"_format(strerror(errno))));
+		}
+
+		// No more changes
+		if (info.si_pid == 0)
+			return;
+
+		auto it = states.find(info.si_pid);
+		if (it == states.end())
+		{
+			LOGDEB("Ignoring state change of untracked pid {}"_format(info.si_pid));
+			continue;
+		}
+
+		State &s = it->second;
+		switch (info.si_code)
+		{
+			case CLD_EXITED:
+				s.exited = true;
+				s.status = (info.si_status & 0xff) << 8;
+				break;
+			case CLD_KILLED:
+			case CLD_DUMPED:
+				s.exited = true;
+				s.status = info.si_status & 0x7f;
+				break;
+			case CLD_STOPPED:
+			case CLD_TRAPPED:
+				s.stops++;
+				break;
+			case CLD_CONTINUED:
+				s.conts++;
+				break;
+			default:
+				LOGWAR("Unknown child state change {} for pid {}"_format(info.si_code, info.si_pid));
+				break;
+		}
+	}
+}
+
+
+void TaskTracker::update()
+{
+	// Empty the signalfd. Signals are coalesced, so the number read does not matter.
+	struct signalfd_siginfo si[16];
+	while (read(sfd, si, sizeof(si)) > 0)
+		;
+	reap();
+}
+
+
+void TaskTracker::wait_until(const std::function<bool()> &done, int timeout_ms)
+{
+	namespace chr = std::chrono;
+	const auto deadline = chr::steady_clock::now() + chr::milliseconds(timeout_ms);
+
+	update();
+	while (!done())
+	{
+		int remaining = chr::duration_cast<chr::milliseconds>(deadline - chr::steady_clock::now()).count();
+		if (remaining <= 0)
+			throw_with_trace(std::runtime_error("Timeout waiting for the tasks to change their state"));
+
+		struct epoll_event ev;
+		int n = epoll_wait(epfd, &ev, 1, remaining);
+		if (n < 0 && errno != EINTR)
+			throw_with_trace(std::runtime_error("Error in epoll_wait: {}"_format(strerror(errno))));
+		update();
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include <sys/types.h>
+
+
+// Tracks state changes (stop, continue, exit) of the children of the manager.
+// SIGCHLD is received through a signalfd registered in an epoll instance, and
+// every time it is readable all the pending changes are collected with a single
+// waitid(P_ALL) loop, so there is no waitpid per task and interval.
+//
+// SIGCHLD has to be blocked in every thread for the signalfd to receive it, so
+// 'block_sigchld' must be called before creating any thread, and the children
+// have to unblock it ('unblock_sigchld') before exec.
+class TaskTracker
+{
+	public:
+
+	struct State
+	{
+		uint64_t stops = 0;     // Number of stops reported
+		uint64_t conts = 0;     // Number of continues reported
+		bool exited = false;    // Exited or killed by a signal
+		int status = 0;         // Exit status, encoded as in waitpid
+	};
+
+	static void block_sigchld();
+	static void unblock_sigchld();
+
+	TaskTracker();
+	~TaskTracker();
+
+	TaskTracker(const TaskTracker &) = delete;
+	TaskTracker& operator=(const TaskTracker &) = delete;
+
+	// Start or stop tracking a pid. Changes of pids not tracked are reaped and ignored.
+	void track(pid_t pid);
+	void untrack(pid_t pid);
+
+	const State& get(pid_t pid) const;
+
+	// Collect pending state changes without blocking
+	void update();
+
+	// Wait for state changes until 'done' returns true. Throws on timeout.
+	void wait_until(const std::function<bool()> &done, int timeout_ms = 10000);
+
+	// The epoll fd, readable when there are state changes to collect
+	int get_fd() const { return epfd; }
+
+	private:
+
+	int sfd = -1;
+	int epfd = -1;
+	std::unordered_map<pid_t, State> states;
+
+	void reap();
+};
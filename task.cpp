@@ -10,13 +10,16 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <cxx-prettyprint/prettyprint.hpp>
 #include <fmt/format.h>
 #include <glib.h>
 
+#include "freezer.hpp"
 #include "log.hpp"
 #include "task.hpp"
+#include "task-tracker.hpp"
 #include "throw-with-trace.hpp"
 
 
@@ -33,6 +36,64 @@ using fmt::literals::operator""_format;
 // Init static atribute
 std::atomic<uint32_t> Task::ID(0);
 
+// Used to compute the completed fraction on every interval
+static const EventId instructions_id("instructions");
+
+// When set, state changes of the tasks are collected by the tracker instead of waitpid
+static std::unique_ptr<TaskTracker> tracker;
+
+
+void tasks_use_tracker()
+{
+	TaskTracker::block_sigchld();
+	tracker = std::make_unique<TaskTracker>();
+}
+
+
+// When set, tasks are paused and resumed with the cgroup v2 freezer instead of signals
+static std::unique_ptr<Freezer> freezer;
+
+
+void tasks_use_freezer()
+{
+	freezer = std::make_unique<Freezer>();
+}
+
+
+static
+std::vector<uint32_t> tasks_ids(const tasklist_t &tasklist)
+{
+	auto ids = std::vector<uint32_t>();
+	for (const auto &task : tasklist)
+		ids.push_back(task->id);
+	return ids;
+}
+
+
+// Same checks as after the waitpid calls, for a task that has been reaped while
+// running, by waitpid with WNOHANG or by the tracker
+static
+void task_reaped(Task &task, int status)
+{
+	if (WIFEXITED(status))
+	{
+		if (status == 0)
+		{
+			LOGWAR("Task {}:{} with pid {} exited with status '{}'"_format(task.id, task.name, task.pid, status));
+			task.completed++;
+			task.set_status(Task::Status::exited);
+		}
+		else
+		{
+			throw_with_trace(std::runtime_error("Task {}:{} with pid {} exited unexpectedly with status '{}'"_format(task.id, task.name, task.pid, WEXITSTATUS(status))));
+		}
+	}
+	else if (WIFSIGNALED(status))
+	{
+		throw_with_trace(std::runtime_error("Task {}:{} with pid {} was killed by signal {}"_format(task.id, task.name, task.pid, WTERMSIG(status))));
+	}
+}
+
 
 void tasks_set_rundirs(tasklist_t &tasklist, const std::string &rundir_base)
 {
@@ -83,6 +144,23 @@ void task_pause(const Task &task)
 	if (pid <= 1)
 		throw_with_trace(std::runtime_error("Tried to send SIGSTOP to pid " + to_string(pid) + ", check for bugs"));
 
+	if (freezer)
+	{
+		freezer->freeze({task.id});
+		return;
+	}
+
+	if (tracker)
+	{
+		const auto &state = tracker->get(pid);
+		const uint64_t stops = state.stops;
+		kill(pid, SIGSTOP); // Stop child process
+		tracker->wait_until([&] { return state.stops > stops || state.exited; });
+		if (state.exited && WIFEXITED(state.status))
+			throw_with_trace(std::runtime_error("Command '" + task.cmd + "' with pid " + to_string(pid) + " exited unexpectedly with status " + to_string(WEXITSTATUS(state.status))));
+		return;
+	}
+
 	kill(pid, SIGSTOP); // Stop child process
 	if (waitpid(pid, &status, WUNTRACED) != pid) // Wait until it stops
 		throw_with_trace(std::runtime_error("Error in waitpid for command '{}' with pid {}"_format(task.name, task.pid)));
@@ -92,9 +170,56 @@ void task_pause(const Task &task)
 }
 
 
+// Pause multiple tasks, waiting for the stops reported by the tracker
+static
+void tasks_pause_tracked(tasklist_t &tasklist)
+{
+	std::vector<uint64_t> stops;
+	for (const auto &task : tasklist)
+	{
+		if (task->pid <= 1)
+			throw_with_trace(std::runtime_error("Tried to send SIGSTOP to pid " + to_string(task->pid) + ", check for bugs"));
+		stops.push_back(tracker->get(task->pid).stops);
+		kill(task->pid, SIGSTOP); // Stop process
+	}
+
+	tracker->wait_until([&]
+	{
+		for (size_t i = 0; i < tasklist.size(); i++)
+		{
+			const auto &state = tracker->get(tasklist[i]->pid);
+			if (state.stops == stops[i] && !state.exited)
+				return false;
+		}
+		return true;
+	});
+
+	for (const auto &task : tasklist)
+	{
+		const auto &state = tracker->get(task->pid);
+		if (state.exited && task->get_status() != Task::Status::exited)
+			task_reaped(*task, state.status);
+	}
+}
+
+
 // Pause multiple tasks
 void tasks_pause(tasklist_t &tasklist)
 {
+	// The freezer does not report exits, check them after freezing
+	if (freezer)
+	{
+		freezer->freeze(tasks_ids(tasklist));
+		tasks_poll_exited(tasklist);
+		return;
+	}
+
+	if (tracker)
+	{
+		tasks_pause_tracked(tasklist);
+		return;
+	}
+
 	for (const auto &task : tasklist)
 		kill(task->pid, SIGSTOP); // Stop process
 
@@ -126,6 +251,45 @@ void tasks_pause(tasklist_t &tasklist)
 }
 
 
+// Check, without blocking, if any of the tasks has exited while running
+void tasks_poll_exited(tasklist_t &tasklist)
+{
+	if (tracker)
+	{
+		tracker->update();
+		for (const auto &task : tasklist)
+		{
+			const auto &state = tracker->get(task->pid);
+			if (state.exited && task->get_status() != Task::Status::exited)
+				task_reaped(*task, state.status);
+		}
+		return;
+	}
+
+	for (const auto &task : tasklist)
+	{
+		// Already reaped
+		if (task->get_status() == Task::Status::exited)
+			continue;
+
+		pid_t pid = task->pid;
+		int status = 0;
+
+		if (pid <= 1)
+			throw_with_trace(std::runtime_error("Tried to waitpid pid " + to_string(pid) + ", check for bugs"));
+
+		int ret = waitpid(pid, &status, WNOHANG);
+		if (ret == 0)
+			continue;
+		if (ret != pid)
+			throw_with_trace(std::runtime_error("Error in waitpid for command '{}' with pid {}"_format(task->name, task->pid)));
+
+		// The pid is gone once reaped, a task killed by a signal cannot stay runnable
+		task_reaped(*task, status);
+	}
+}
+
+
 void task_resume(const Task &task)
 {
 	pid_t pid = task.pid;
@@ -134,6 +298,23 @@ void task_resume(const Task &task)
 	if (pid <= 1)
 		throw_with_trace(std::runtime_error("Task {}:{}: tried to send SIGCONT to pid {}, check for bugs"_format(task.id, task.name, task.pid)));
 
+	if (freezer)
+	{
+		freezer->thaw({task.id});
+		return;
+	}
+
+	if (tracker)
+	{
+		const auto &state = tracker->get(pid);
+		const uint64_t conts = state.conts;
+		kill(pid, SIGCONT); // Resume process
+		tracker->wait_until([&] { return state.conts > conts || state.exited; });
+		if (state.exited && WIFEXITED(state.status))
+			throw_with_trace(std::runtime_error("Command '" + task.cmd + "' with pid " + to_string(pid) + " exited unexpectedly with status " + to_string(WEXITSTATUS(state.status))));
+		return;
+	}
+
 	kill(pid, SIGCONT); // Resume process
 
 	if (waitpid(pid, &status, WCONTINUED) != pid) // Ensure it resumed
@@ -144,9 +325,57 @@ void task_resume(const Task &task)
 }
 
 
+// Resume multiple tasks, waiting for the continues reported by the tracker
+static
+void tasks_resume_tracked(const tasklist_t &tasklist)
+{
+	std::vector<uint64_t> conts;
+	for (const auto &task : tasklist)
+	{
+		if (task->pid <= 1)
+			throw_with_trace(std::runtime_error("Task {}:{}: tried to send SIGCONT to pid {}, check for bugs"_format(task->id, task->name, task->pid)));
+		conts.push_back(tracker->get(task->pid).conts);
+		kill(task->pid, SIGCONT); // Resume process
+	}
+
+	tracker->wait_until([&]
+	{
+		for (size_t i = 0; i < tasklist.size(); i++)
+		{
+			// The task has finished, is not running
+			if (tasklist[i]->get_status() == Task::Status::exited)
+				continue;
+			const auto &state = tracker->get(tasklist[i]->pid);
+			if (state.conts == conts[i] && !state.exited)
+				return false;
+		}
+		return true;
+	});
+
+	for (const auto &task : tasklist)
+	{
+		const auto &state = tracker->get(task->pid);
+		if (task->get_status() != Task::Status::exited && state.exited && WIFEXITED(state.status))
+			throw_with_trace(std::runtime_error("Task {}:{} with pid {} exited unexpectedly with status {}"_format(task->id, task->name, task->pid, WEXITSTATUS(state.status))));
+	}
+}
+
+
 // Resume multiple tasks
 void tasks_resume(const tasklist_t &tasklist)
 {
+	if (freezer)
+	{
+		freezer->thaw(tasks_ids(tasklist));
+		return;
+	}
+
+	if (tracker)
+	{
+		tasks_resume_tracked(tasklist);
+		return;
+	}
+
 	for (const auto &task : tasklist)
 		kill(task->pid, SIGCONT); // Resume process
 
@@ -184,6 +413,9 @@ void task_execute(Task &task)
 
 	LOGDEB("Task cpu affinity: " << task.cpus);
 
+	if (freezer)
+		freezer->add(task.id);
+
 	pid_t pid = fork();
 	switch (pid) {
 		// Child
@@ -191,6 +423,23 @@ void task_execute(Task &task)
 		{
 			setsid();
 
+			// The mask is inherited, and the tracker may have blocked it
+			TaskTracker::unblock_sigchld();
+
+			// Enter the cgroup of the task, so its descendants are frozen with it
+			if (freezer)
+			{
+				try
+				{
+					freezer->enter(task.id);
+				}
+				catch (const std::exception &e)
+				{
+					cerr << "Could not move task {}:{} to its cgroup: {}"_format(task.id, task.name, e.what()) << endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+
 			// Set CPU affinity
 			try
 			{
@@ -269,6 +518,8 @@ void task_execute(Task &task)
 		default:
 			usleep(100); // Wait a bit, just in case
 			task.pid = pid;
+			if (tracker)
+				tracker->track(pid);
 			LOGINF("Task {}:{} with pid {} has started"_format(task.id, task.name, task.pid));
 			task_pause(task);
 			g_strfreev(argv); // Free the memory allocated for argv
@@ -294,6 +545,9 @@ void task_kill(Task &task)
 			if (kill(-pid, SIGKILL) < 0)
 				throw_with_trace(std::runtime_error("Could not SIGKILL command '" + task.cmd + "' with pid " + to_string(pid) + ": " + strerror(errno)));
 		}
+		// The tracker reaps it later and ignores it
+		if (tracker)
+			tracker->untrack(pid);
 		task.pid = 0;
 	}
 	else
@@ -333,7 +587,19 @@ std::vector<uint32_t> tasks_cores_used(const tasklist_t &tasklist)
 }
 
 
-void task_restart_or_set_done(Task &task, cat_ptr_t cat, Perf &perf, const std::vector<std::string> &events)
+uint32_t task_l3_domain(const Task &task)
+{
+	if (task.cpus.empty())
+		return CAT::all_domains;
+	const uint32_t domain = get_l3_domain(task.cpus.front());
+	for (const auto &cpu : task.cpus)
+		if (get_l3_domain(cpu) != domain)
+			return CAT::all_domains;
+	return domain;
+}
+
+
+void task_restart_or_set_done(Task &task, cat_ptr_t cat, Perf &perf, const std::vector<std::string> &events, bool pin_first)
 {
 	auto cat_linux = std::dynamic_pointer_cast<CATLinux>(cat);
 	const auto status = task.get_status();
@@ -369,11 +635,13 @@ void task_restart_or_set_done(Task &task, cat_ptr_t cat, Perf &perf, const std::
 			{
 				task_restart(task);
 			}
-			perf.setup_events(task.pid, events);
+			perf.setup_events(task.pid, events, pin_first);
 		}
 		else
 		{
 			task.set_status(Task::Status::done);
+			if (freezer)
+				freezer->remove(task.id);
 		}
 	}
 }
@@ -387,11 +655,13 @@ void task_stats_print_interval(const Task &t, uint64_t interval, std::ostream &o
 
 	// out << (t.max_instr ? (double) t.stats.get_current("instructions") / (double) t.max_instr : 0) << sep;
 	double completed = t.max_instr ?
-			(double) t.stats.sum("instructions") / (double) t.max_instr :
+			(double) t.stats.sum(instructions_id) / (double) t.max_instr :
 			NAN;
 	out << completed << sep;
-	out << t.stats.data_to_string_int(sep);
-	out << std::endl;
+	if (t.track_phases)
+		out << t.phase.phase << sep << t.phase.change << sep;
+	t.stats.data_to_stream_int(out, sep);
+	out << '\n';
 }
 
 
@@ -401,11 +671,38 @@ void task_stats_print_total(const Task &t, uint64_t interval, std::ostream &out,
 	out << interval << sep << std::setfill('0') << std::setw(2);
 	out << t.id << "_" << t.name << sep << cpu_id << sep;
 	double completed = t.max_instr ?
-			(double) t.stats.sum("instructions") / (double) t.max_instr :
+			(double) t.stats.sum(instructions_id) / (double) t.max_instr :
 			NAN;
 	out << completed << sep;
-	out << t.stats.data_to_string_total(sep);
-	out << std::endl;
+	t.stats.data_to_stream_total(out, sep);
+	out << '\n';
+}
+
+
+std::unique_ptr<trace::Writer> tasks_trace_open(const tasklist_t &tasklist, const std::string &path)
+{
+	assert(!tasklist.empty());
+
+	auto columns = std::vector<std::string>();
+	auto header = tasklist[0]->stats.header_to_string("\n");
+	boost::split(columns, header, boost::is_any_of("\n"));
+
+	auto tasks = std::vector<std::pair<uint32_t, std::string>>();
+	for (const auto &task : tasklist)
+		tasks.push_back(std::make_pair(task->id, task->name));
+
+	return std::unique_ptr<trace::Writer>(new trace::Writer(path, columns, tasks));
+}
+
+
+void task_stats_trace_interval(const Task &t, uint64_t interval, trace::Writer &trace)
+{
+	static thread_local auto values = std::vector<double>();
+	double completed = t.max_instr ?
+			(double) t.stats.sum(instructions_id) / (double) t.max_instr :
+			NAN;
+	t.stats.data_to_vector_int(values);
+	trace.write_record(interval, t.id, get_cpu_id(t.pid), completed, values);
 }
 
 
@@ -415,8 +712,22 @@ void task_stats_print_headers(const Task &t, std::ostream &out, const std::strin
 	out << "app" << sep;
 	out << "CPU" << sep;
 	out << "compl" << sep;
+	if (t.track_phases)
+		out << "phase" << sep << "phase_change" << sep;
 	out << t.stats.header_to_string(sep);
-	out << std::endl;
+	out << '\n';
+}
+
+
+// The totals also have the percentiles of the metrics with quantile sketches
+void task_stats_print_headers_total(const Task &t, std::ostream &out, const std::string &sep)
+{
+	out << "interval" << sep;
+	out << "app" << sep;
+	out << "CPU" << sep;
+	out << "compl" << sep;
+	out << t.stats.header_to_string_total(sep);
+	out << '\n';
 }
 
 
@@ -450,6 +761,19 @@ void tasks_map_to_initial_clos(tasklist_t &tasklist, const std::shared_ptr<CATLi
 
 bool task_exited(const Task &task)
 {
+	if (tracker)
+	{
+		tracker->update();
+		const auto &state = tracker->get(task.pid);
+		if (state.exited && WIFEXITED(state.status))
+		{
+			if (WEXITSTATUS(state.status) != 0)
+				throw_with_trace(std::runtime_error("Task {} ({}) with pid {} exited unexpectedly with status {}"_format(task.id, task.name, task.pid, WEXITSTATUS(state.status))));
+			return true;
+		}
+		return false;
+	}
+
 	int status = 0;
 	int ret = waitpid(task.pid, &status, WNOHANG);
 	switch (ret)
@@ -5,7 +5,9 @@
 
 #include "cat-linux.hpp"
 #include "common.hpp"
+#include "phase-detector.hpp"
 #include "stats.hpp"
+#include "trace.hpp"
 
 
 class Task
@@ -41,6 +43,11 @@ class Task
 	pid_t pid = 0;           // Set after executing the task
 
 	Stats stats = Stats();
+	Sample sample; // Buffers for reading the counters, swapped with the ones in 'stats'
+
+	// Phase of the metric followed by the phase detector of the manager, if there is one
+	bool track_phases = false;
+	PhaseDetector::Event phase;
 
 	uint32_t num_restarts = 0;  // Number of times it has reached the instruction limit
 	uint32_t completed = 0;     // Number of times it has reached the instruction limit
@@ -73,11 +80,15 @@ typedef std::vector<task_ptr_t> tasklist_t;
 
 
 void tasks_set_rundirs(tasklist_t &tasklist, const std::string &rundir_base);
+void tasks_use_tracker(); // Collect state changes from SIGCHLD, call before creating threads
+void tasks_use_freezer(); // Pause and resume with the cgroup v2 freezer, call before executing the tasks
 void tasks_pause(tasklist_t &tasklist);
 void tasks_resume(const tasklist_t &tasklist);
+void tasks_poll_exited(tasklist_t &tasklist); // Non-blocking, for tasks that are not stopped
 void tasks_map_to_initial_clos(tasklist_t &tasklist, const std::shared_ptr<CATLinux> &cat);
 std::vector<uint32_t> tasks_cores_used(const tasklist_t &tasklist);
 const task_ptr_t& tasks_find(const tasklist_t &tasklist, uint32_t id);
+uint32_t task_l3_domain(const Task &task); // CAT::all_domains if its cpus are in more than one L3
 
 void task_create_rundir(const Task &task);
 void task_remove_rundir(const Task &task);
@@ -92,8 +103,13 @@ bool task_exited(const Task &task); // Test if the task has exited
 
 // If the limit has been reached, kill the application.
 // If the limit of restarts has not been reached, restart the application. If the limit of restarts was reached, mark the application as done.
-void task_restart_or_set_done(Task &task, cat_ptr_t cat, Perf &perf, const std::vector<std::string> &events);
+void task_restart_or_set_done(Task &task, cat_ptr_t cat, Perf &perf, const std::vector<std::string> &events, bool pin_first = false);
 
 void task_stats_print_headers(const Task &t, std::ostream &out, const std::string &sep = ",");
+void task_stats_print_headers_total(const Task &t, std::ostream &out, const std::string &sep = ",");
 void task_stats_print_interval(const Task &t, uint64_t interval, std::ostream &out, const std::string &sep = ",");
 void task_stats_print_total(const Task &t, uint64_t interval, std::ostream &out, const std::string &sep = ",");
+
+// Binary trace with the same data as the interval output
+std::unique_ptr<trace::Writer> tasks_trace_open(const tasklist_t &tasklist, const std::string &path);
+void task_stats_trace_interval(const Task &t, uint64_t interval, trace::Writer &trace);
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "tdigest.hpp"
+
+
+TDigest::TDigest(double _compression) :
+		compression(_compression), min_value(NAN), max_value(NAN)
+{
+	assert(compression >= 10);
+
+	// With k1 the centroids cannot be more than 'compression', plus one per merge because of rounding
+	const size_t max_centroids = std::ceil(compression) + 1;
+	const size_t buffer_size = 5 * max_centroids;
+	centroids.reserve(max_centroids);
+	buffer.reserve(buffer_size);
+	scratch.reserve(max_centroids + buffer_size);
+}
+
+
+double TDigest::k(double q) const
+{
+	return compression / (2 * M_PI) * std::asin(2 * q - 1);
+}
+
+
+double TDigest::k_inv(double k_) const
+{
+	return (std::sin(std::min(k_ * 2 * M_PI / compression, M_PI / 2)) + 1) / 2;
+}
+
+
+void TDigest::add(double value)
+{
+	if (!std::isfinite(value))
+		return;
+
+	if (count() == 0)
+		min_value = max_value = value;
+	else
+	{
+		min_value = std::min(min_value, value);
+		max_value = std::max(max_value, value);
+	}
+
+	buffer.push_back({value, 1});
+	if (buffer.size() == buffer.capacity())
+		merge();
+}
+
+
+void TDigest::flush() const
+{
+	merge();
+}
+
+
+// Merge the buffer and the centroids in order, joining neighbours while the
+// resulting centroid spans less than one unit of k. The direction alternates,
+// otherwise the error accumulates at the high tail.
+void TDigest::merge() const
+{
+	if (buffer.empty())
+		return;
+
+	scratch.clear();
+	scratch.insert(scratch.end(), centroids.begin(), centroids.end());
+	scratch.insert(scratch.end(), buffer.begin(), buffer.end());
+	std::sort(scratch.begin(), scratch.end());
+	if (merges++ % 2)
+		std::reverse(scratch.begin(), scratch.end());
+
+	const double new_total = total + buffer.size();
+	buffer.clear();
+	centroids.clear();
+
+	Centroid cur = scratch[0];
+	double w_so_far = 0;
+	double w_limit = new_total * k_inv(k(0) + 1);
+	for (size_t i = 1; i < scratch.size(); i++)
+	{
+		const Centroid &next = scratch[i];
+		if (w_so_far + cur.weight + next.weight <= w_limit)
+		{
+			cur.weight += next.weight;
+			cur.mean += (next.mean - cur.mean) * next.weight / cur.weight;
+		}
+		else
+		{
+			w_so_far += cur.weight;
+			w_limit = new_total * k_inv(k(w_so_far / new_total) + 1);
+			centroids.push_back(cur);
+			cur = next;
+		}
+	}
+	centroids.push_back(cur);
+	if (scratch.front().mean > scratch.back().mean)
+		std::reverse(centroids.begin(), centroids.end());
+	total = new_total;
+	assert(centroids.size() <= centroids.capacity());
+}
+
+
+// Interpolate between the centers of the centroids, where half of their weight is
+double TDigest::quantile(double q) const
+{
+	assert(q >= 0 && q <= 1);
+	merge();
+
+	if (centroids.empty())
+		return NAN;
+	if (centroids.size() == 1)
+		return centroids[0].mean;
+
+	const double index = q * total;
+	if (index < 1)
+		return min_value;
+	if (index > total - 1)
+		return max_value;
+
+	// Between the minimum and the center of the first centroid
+	const Centroid &first = centroids.front();
+	if (first.weight > 1 && index < first.weight / 2)
+		return min_value + (index - 1) / (first.weight / 2 - 1) * (first.mean - min_value);
+
+	// Between the center of the last centroid and the maximum
+	const Centroid &last = centroids.back();
+	if (last.weight > 1 && total - index <= last.weight / 2)
+		return max_value - (total - index - 1) / (last.weight / 2 - 1) * (max_value - last.mean);
+
+	double w_so_far = first.weight / 2;
+	for (size_t i = 0; i + 1 < centroids.size(); i++)
+	{
+		const Centroid &a = centroids[i];
+		const Centroid &b = centroids[i + 1];
+		const double dw = (a.weight + b.weight) / 2;
+		if (w_so_far + dw > index)
+		{
+			const double left = index - w_so_far;
+			const double right = w_so_far + dw - index;
+			return (a.mean * right + b.mean * left) / (left + right);
+		}
+		w_so_far += dw;
+	}
+	return last.mean;
+}
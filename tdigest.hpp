@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// Streaming quantile sketch (merging t-digest, Dunning and Ertl). Values are
+// buffered and merged into a bounded set of centroids, small near the tails and
+// large near the median, so extreme quantiles stay accurate. The memory used
+// depends only on the compression, not on the number of values.
+class TDigest
+{
+	struct Centroid
+	{
+		double mean;
+		double weight;
+		bool operator<(const Centroid &o) const { return mean < o.mean; }
+	};
+
+	double compression;
+
+	// Merging the buffer does not change the distribution, so it is done in const methods too
+	mutable std::vector<Centroid> centroids;
+	mutable std::vector<Centroid> buffer;   // Values not merged yet
+	mutable std::vector<Centroid> scratch;  // Merge space, so merging does not allocate
+	mutable double total = 0;               // Weight of the centroids
+	mutable size_t merges = 0;
+	double min_value;
+	double max_value;
+
+	// Scale function k1, which limits the size of the centroids depending on their quantile
+	double k(double q) const;
+	double k_inv(double k) const;
+
+	void merge() const;
+
+	public:
+
+	TDigest(double compression = 100);
+
+	void add(double value); // NaN and infinite values are ignored
+	void flush() const;     // Merge the buffered values, 'quantile' does it when needed
+
+	// q in [0, 1]. NaN if there are no values.
+	double quantile(double q) const;
+
+	double count() const { return total + buffer.size(); }
+	size_t size() const { return centroids.size(); }
+	double min() const { return min_value; }
+	double max() const { return max_value; }
+};
@@ -1,10 +1,15 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <cmath>
+#include <thread>
 #include <vector>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include <libcpuid.h>
+#include <unistd.h>
 
 #include "cat-linux.hpp"
 #include "cat-intel.hpp"
@@ -17,9 +22,15 @@ using testing::AllOf;
 using testing::AnyOf;
 
 
+// A fake tree with the CAT of the machines of the tests
 TEST(CATInfo, Read)
 {
-	auto cat_info = cat_read_info();
+	namespace fs = boost::filesystem;
+	const auto root = fs::temp_directory_path() / fs::unique_path();
+	FakeResctrl::create(root.string(), FakeResctrl::Config());
+	auto cat_info = cat_read_info(root.string());
+	fs::remove_all(root);
+
 	ASSERT_EQ(cat_info.size(), 1U);
 	ASSERT_EQ(cat_info["L3"].cache, "L3");
 	ASSERT_EQ(cat_info["L3"].cbm_mask, 0xfffffULL);
@@ -27,6 +38,47 @@ TEST(CATInfo, Read)
 	ASSERT_THAT(cat_info["L3"].num_closids, AnyOf(Eq(4U),Eq(16U)));
 }
 
+// A resctrl tree with CDP, L2 allocation and the resources without masks
+TEST(CATInfo, ReadFakeTree)
+{
+	namespace fs = boost::filesystem;
+	const auto root = fs::temp_directory_path() / fs::unique_path();
+	auto write = [](const fs::path &path, const std::string &content)
+	{
+		fs::create_directories(path.parent_path());
+		std::ofstream(path.string()) << content << std::endl;
+	};
+	for (const auto &r : std::vector<std::pair<std::string, std::string>>{{"L3CODE", "7ff"}, {"L3DATA", "7ff"}, {"L2", "ff"}})
+	{
+		write(root / "info" / r.first / "cbm_mask", r.second);
+		write(root / "info" / r.first / "min_cbm_bits", "1");
+		write(root / "info" / r.first / "num_closids", r.first == "L2" ? "8" : "16");
+	}
+	write(root / "info" / "MB" / "min_bandwidth", "10");
+	write(root / "info" / "MB" / "bandwidth_gran", "10");
+	write(root / "info" / "MB" / "num_closids", "8");
+	write(root / "info" / "L3_MON" / "num_rmids", "224");
+	write(root / "schemata", "L3DATA:0=7ff;1=7ff\nL3CODE:0=7ff;1=7ff\n    L2:0=ff;1=ff;2=ff;3=ff\nMB:0=100;1=100");
+
+	auto cat_info = cat_read_info(root.string());
+	auto mba_info = mba_read_info(root.string());
+	fs::remove_all(root);
+
+	ASSERT_EQ(cat_info.size(), 3U);
+	ASSERT_EQ(cat_info["L3CODE"].cbm_mask, 0x7ffULL);
+	ASSERT_EQ(cat_info["L3DATA"].num_closids, 16U);
+	ASSERT_EQ(cat_info["L3DATA"].domains, std::vector<uint32_t>({0, 1}));
+	ASSERT_EQ(cat_info["L2"].cbm_mask, 0xffULL);
+	ASSERT_EQ(cat_info["L2"].num_closids, 8U);
+	ASSERT_EQ(cat_info["L2"].domains, std::vector<uint32_t>({0, 1, 2, 3}));
+
+	ASSERT_EQ(mba_info.size(), 1U);
+	ASSERT_EQ(mba_info["MB"].min_bandwidth, 10U);
+	ASSERT_EQ(mba_info["MB"].bandwidth_gran, 10U);
+	ASSERT_EQ(mba_info["MB"].num_closids, 8U);
+	ASSERT_EQ(mba_info["MB"].domains, std::vector<uint32_t>({0, 1}));
+}
+
 TEST(CPUID, Present)
 {
 	ASSERT_TRUE(cpuid_present());
@@ -34,20 +86,33 @@ TEST(CPUID, Present)
 
 class CATLinuxTest : public CATLinux
 {
+	public:
+
+	using CATLinux::CATLinux;
+
+	private:
+
 	FRIEND_TEST(CATLinuxAPI, SetGetCBM);
+	FRIEND_TEST(CATLinuxAPI, SetGetCBMPerDomain);
 	FRIEND_TEST(CATLinuxAPI, Reset);
 	FRIEND_TEST(CATLinuxAPI, Init);
+	FRIEND_TEST(CATLinuxAPI, TransactionCommit);
+	FRIEND_TEST(CATLinuxAPI, TransactionRollback);
+	FRIEND_TEST(CATLinuxAPI, TransactionConcurrentTask);
 	FRIEND_TEST(CATLinuxConsistency, SetCBM);
 	FRIEND_TEST(CATLinuxConsistency, AddCPU);
 	FRIEND_TEST(CATLinuxConsistency, Reset);
 	FRIEND_TEST(CATLinuxConsistency, Init);
 	FRIEND_TEST(CATLinuxConsistency, NonContiguousMask);
+	FRIEND_TEST(FakeResctrlTest, Latency);
 };
 
+// The API on a fake tree with two domains, so it runs without CAT hardware or root
 class CATLinuxAPI : public testing::Test
 {
 	protected:
 
+	const boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
 	CATLinuxTest cat;
 	struct cpu_id_t data;
 
@@ -55,16 +120,23 @@ class CATLinuxAPI : public testing::Test
 	{
 		struct cpu_raw_data_t raw;
 
-		cat = CATLinuxTest();
-		cat.init();
-
 		ASSERT_GE(cpuid_get_raw_data(&raw), 0);
 		ASSERT_GE(cpu_identify(&raw, &data), 0);
+
+		auto config = FakeResctrl::Config();
+		config.num_domains = 2;
+		config.num_cpus = data.total_logical_cpus;
+		FakeResctrl::create(root.string(), config);
+
+		cat = CATLinuxTest(root.string());
+		cat.init();
+		ASSERT_TRUE(cat.is_fake());
 	}
 
 	virtual void TearDown() override
 	{
 		cat.reset();
+		boost::filesystem::remove_all(root);
 	}
 };
 
@@ -91,6 +163,31 @@ TEST_F(CATLinuxAPI, SetGetCBM)
 	ASSERT_THROW(cat.set_cbm(0, cbm), std::runtime_error);
 }
 
+TEST_F(CATLinuxAPI, SetGetCBMPerDomain)
+{
+	const auto mask = cat.get_info().cbm_mask;
+	const auto domains = cat.get_domains();
+	ASSERT_GE(domains.size(), 1U);
+
+	// Each domain keeps its own mask, the last one is written in a different way than the rest
+	for (size_t d = 0; d < domains.size(); d++)
+		cat.set_cbm(1, d + 1 == domains.size() ? mask : mask >> 1, domains[d]);
+	auto schemata = cat.get_schemata(cat.intel_to_linux(1));
+	for (size_t d = 0; d < domains.size(); d++)
+	{
+		const uint64_t expected = d + 1 == domains.size() ? mask : mask >> 1;
+		ASSERT_EQ(cat.get_cbm(1, domains[d]), expected);
+		ASSERT_EQ(schemata[d], expected);
+	}
+
+	cat.set_cbm(1, mask >> 2);
+	for (const auto &domain : domains)
+		ASSERT_EQ(cat.get_cbm(1, domain), mask >> 2);
+
+	ASSERT_THROW(cat.set_cbm(1, mask, domains.back() + 1), std::runtime_error);
+	ASSERT_THROW(cat.get_cbm(1, domains.back() + 1), std::runtime_error);
+}
+
 TEST_F(CATLinuxAPI, AddCPU)
 {
 	uint32_t clos;
@@ -131,6 +228,86 @@ TEST_F(CATLinuxAPI, Reset)
 	ASSERT_THROW(cat.set_cbm(1, cat.get_info().cbm_mask), std::runtime_error);
 }
 
+TEST_F(CATLinuxAPI, TransactionCommit)
+{
+	const auto mask = cat.get_info().cbm_mask;
+	cat.begin();
+	cat.set_cbm(1, mask >> 2);
+	cat.set_cbm(1, mask >> 1);
+	cat.set_cbm(2, mask);
+	cat.add_cpu(1, 0);
+
+	// Staged, but not written
+	const auto num_domains = cat.get_domains().size();
+	ASSERT_EQ(cat.get_cbm(1), mask >> 1);
+	ASSERT_EQ(cat.get_clos(0), 1U);
+	ASSERT_EQ(cat.get_schemata(cat.intel_to_linux(1)), std::vector<uint64_t>(cat.get_domains().size(), mask));
+
+	cat.commit();
+	ASSERT_EQ(cat.get_schemata(cat.intel_to_linux(1)), std::vector<uint64_t>(num_domains, mask >> 1));
+	ASSERT_EQ(cat.get_cpus(cat.intel_to_linux(1)), 1U);
+
+	// Only the mask, in every domain, and the cpu changed, CLOS 2 already had the full mask
+	auto stats = cat.get_commit_stats();
+	ASSERT_EQ(stats.commits, 1U);
+	ASSERT_EQ(stats.writes, num_domains + 1);
+}
+
+TEST_F(CATLinuxAPI, TransactionRollback)
+{
+	const auto mask = cat.get_info().cbm_mask;
+	{
+		CATLinux::Transaction tx(std::shared_ptr<CATLinux>(&cat, [](CATLinux *) {}));
+		cat.set_cbm(1, mask >> 1);
+		ASSERT_THROW(cat.set_cbm(1, 0), std::runtime_error);
+		ASSERT_THROW(cat.set_cbm(1, 0x5), std::runtime_error); // Not contiguous
+	}
+	ASSERT_EQ(cat.get_cbm(1), mask);
+	ASSERT_EQ(cat.get_schemata(cat.intel_to_linux(1)), std::vector<uint64_t>(cat.get_domains().size(), mask));
+}
+
+// A task moved by another thread while the transaction is open is not moved back on commit
+TEST_F(CATLinuxAPI, TransactionConcurrentTask)
+{
+	const pid_t pid = getpid();
+	cat.begin();
+	cat.set_cbm(1, cat.get_info().cbm_mask >> 1);
+	std::thread([&]{ cat.add_task(1, pid); }).join();
+	cat.commit();
+
+	ASSERT_EQ(cat.get_clos_of_task(pid), 1U);
+	const auto tasks = cat.get_tasks(cat.intel_to_linux(1));
+	ASSERT_NE(std::find(tasks.begin(), tasks.end(), std::to_string(pid)), tasks.end());
+	ASSERT_EQ(cat.get_commit_stats().writes, cat.get_domains().size());
+}
+
+
+// The writes of the schemata and the tasks are delayed
+TEST(FakeResctrlTest, Latency)
+{
+	const auto root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	auto config = FakeResctrl::Config();
+	config.latency_us = 2000;
+	FakeResctrl::create(root.string(), config);
+
+	CATLinuxTest cat(root.string());
+	cat.init();
+	ASSERT_EQ(cat.fake->get_latency_us(), 2000U);
+
+	const auto start = std::chrono::steady_clock::now();
+	cat.set_cbm(1, 0xff);
+	cat.add_task(1, getpid());
+	const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	ASSERT_GE(us, 2 * 2000);
+	ASSERT_EQ(cat.get_tasks(cat.intel_to_linux(1)), std::vector<std::string>({std::to_string(getpid())}));
+	ASSERT_EQ(cat.get_clos_of_task(getpid()), 1U);
+
+	// The task goes back to the root with the CLOS
+	cat.reset();
+	ASSERT_EQ(cat.get_tasks(cat.intel_to_linux(0)), std::vector<std::string>({std::to_string(getpid())}));
+	boost::filesystem::remove_all(root);
+}
+
 
 class CATLinuxConsistency : public testing::Test
 {
@@ -0,0 +1,131 @@
+#include <map>
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "derived-metrics.hpp"
+#include "stats.hpp"
+
+
+class DerivedMetricsTest : public testing::Test
+{
+	protected:
+
+	std::map<uint32_t, double> values;
+
+	void set(const std::string &name, double value)
+	{
+		values[EventId(name).get()] = value;
+	}
+
+	std::vector<double> eval(const DerivedMetrics &dm)
+	{
+		auto results = std::vector<double>(dm.size());
+		dm.eval([this](uint32_t id) { return values.at(id); }, results.data());
+		return results;
+	}
+};
+
+
+TEST_F(DerivedMetricsTest, Precedence)
+{
+	set("instructions", 2000);
+	set("mem_load_uops_retired.l3_miss", 10);
+	DerivedMetrics dm({
+		{"mpki_l3", "1000 * mem_load_uops_retired.l3_miss / instructions"},
+		{"a", "1 + 2 * 3"},
+		{"b", "(1 + 2) * 3"},
+		{"c", "-2 - -3 - 1"},
+		{"d", "8 / 4 / 2"},
+	});
+	EXPECT_EQ(eval(dm), std::vector<double>({5, 7, 9, 0, 1}));
+	EXPECT_EQ(dm.get_events().size(), 2U);
+}
+
+
+TEST_F(DerivedMetricsTest, Names)
+{
+	set("ref-cycles", 4);
+	set("intel_cqm/llc_occupancy/", 3 * 1024 * 1024);
+	set("cpu/event=0x3c, umask=0/", 2);
+	DerivedMetrics dm({
+		{"occup_mb", "intel_cqm/llc_occupancy/ / 1024 / 1024"},
+		{"x", "ref-cycles - {cpu/event=0x3c, umask=0/}"},
+		{"y", "occup_mb * x"}, // Previous metrics
+	});
+	EXPECT_EQ(eval(dm), std::vector<double>({3, 2, 6}));
+	EXPECT_EQ(dm.get_names(), std::vector<std::string>({"occup_mb", "x", "y"}));
+	EXPECT_EQ(dm.get_ids()[2], EventId("y"));
+}
+
+
+TEST_F(DerivedMetricsTest, Errors)
+{
+	typedef DerivedMetrics::definitions_t defs_t;
+	EXPECT_THROW(DerivedMetrics(defs_t{{"a", "1 +"}}), std::runtime_error);
+	EXPECT_THROW(DerivedMetrics(defs_t{{"a", "(1 + 2"}}), std::runtime_error);
+	EXPECT_THROW(DerivedMetrics(defs_t{{"a", "1 2"}}), std::runtime_error);
+	EXPECT_THROW(DerivedMetrics(defs_t{{"a", "1 % 2"}}), std::runtime_error);
+	EXPECT_THROW(DerivedMetrics(defs_t{{"a", "1"}, {"a", "2"}}), std::runtime_error);
+}
+
+
+TEST(DerivedMetricsStatsTest, IntervalAndTotal)
+{
+	auto defs = DerivedMetrics::builtin({"instructions", "cycles"});
+	defs.push_back({"cpki", "1000 * cycles / instructions"});
+	auto dm = std::make_shared<const DerivedMetrics>(defs);
+
+	Stats s;
+	s.init({"instructions", "cycles"}, dm);
+	EXPECT_EQ(s.header_to_string(","), "instructions,cycles,ipc,cpki");
+
+	counters_t c;
+	c.insert(Counter(0, "instructions", 1000, "", false, 1, 1));
+	c.insert(Counter(1, "cycles", 500, "", false, 1, 1));
+	s.accum(c);
+	counters_t d;
+	d.insert(Counter(0, "instructions", 2000, "", false, 1, 1));
+	d.insert(Counter(1, "cycles", 2500, "", false, 1, 1));
+	s.accum(d);
+
+	EXPECT_EQ(s.last(EventId("cpki")), 2000);
+	EXPECT_EQ(s.data_to_string_int(","), "1000,2000,0.5,2000");
+	EXPECT_EQ(s.data_to_string_total(","), "2000,2500,0.8,1250");
+}
+
+
+TEST(DerivedMetricsStatsTest, NotMonitorized)
+{
+	auto dm = std::make_shared<const DerivedMetrics>(DerivedMetrics::definitions_t({{"x", "2 * stalls"}}));
+	Stats s;
+	EXPECT_THROW(s.init({"instructions", "cycles"}, dm), std::runtime_error);
+}
+
+
+// The metrics of the critical aware policies
+TEST(DerivedMetricsStatsTest, BuiltinL3)
+{
+	const std::vector<std::string> names = {"instructions", "mem_load_uops_retired.l3_miss", "mem_load_uops_retired.l3_hit", "intel_cqm/llc_occupancy/"};
+	Stats s;
+	s.init(names);
+	EXPECT_EQ(s.header_to_string(","), "instructions,mem_load_uops_retired.l3_miss,mem_load_uops_retired.l3_hit,intel_cqm/llc_occupancy/,mpki_l3,hpki_l3,l3_occup_mb");
+
+	counters_t c;
+	c.insert(Counter(0, names[0], 0, "", false, 1, 1));
+	c.insert(Counter(1, names[1], 0, "", false, 1, 1));
+	c.insert(Counter(2, names[2], 0, "", false, 1, 1));
+	c.insert(Counter(3, names[3], 0, "", true, 1, 1));
+	s.accum(c);
+	counters_t d;
+	d.insert(Counter(0, names[0], 4000, "", false, 1, 1));
+	d.insert(Counter(1, names[1], 20, "", false, 1, 1));
+	d.insert(Counter(2, names[2], 8, "", false, 1, 1));
+	d.insert(Counter(3, names[3], 3 * 1024 * 1024, "", true, 1, 1));
+	s.accum(d);
+
+	EXPECT_EQ(s.last(EventId("mpki_l3")), 5);
+	EXPECT_EQ(s.last(EventId("hpki_l3")), 2);
+	EXPECT_EQ(s.last(EventId("l3_occup_mb")), 3);
+}
@@ -0,0 +1,74 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "event-planner.hpp"
+
+
+typedef std::vector<std::string> strings_t;
+
+
+// A Skylake-like PMU: 4 general purpose and 3 fixed counters
+static PmuCapacity pmu(uint32_t general = 4, uint32_t fixed = 3, bool watchdog = false)
+{
+	auto result = PmuCapacity();
+	result.general = general;
+	result.fixed = fixed;
+	result.watchdog = watchdog;
+	return result;
+}
+
+
+TEST(EventPlannerTest, Split)
+{
+	EXPECT_EQ(EventPlanner::split("instructions,cycles"), strings_t({"instructions", "cycles"}));
+	EXPECT_EQ(EventPlanner::split("instructions, cycles,"), strings_t({"instructions", "cycles"}));
+	EXPECT_EQ(EventPlanner::split("cpu/event=0x3c,umask=0/,intel_cqm/llc_occupancy/"),
+			strings_t({"cpu/event=0x3c,umask=0/", "intel_cqm/llc_occupancy/"}));
+}
+
+
+TEST(EventPlannerTest, Classify)
+{
+	EventPlanner planner(pmu());
+	EXPECT_EQ(planner.classify("instructions"), EventPlanner::Kind::fixed);
+	EXPECT_EQ(planner.classify("cycles:u"), EventPlanner::Kind::fixed);
+	EXPECT_EQ(planner.classify("ref-cycles"), EventPlanner::Kind::fixed);
+	EXPECT_EQ(planner.classify("mem_load_uops_retired.l3_miss"), EventPlanner::Kind::general);
+	EXPECT_EQ(planner.classify("cpu/event=0x3c,umask=0/"), EventPlanner::Kind::general);
+	EXPECT_EQ(planner.classify("intel_cqm/llc_occupancy/"), EventPlanner::Kind::other);
+	EXPECT_EQ(planner.classify("task-clock"), EventPlanner::Kind::other);
+
+	// The NMI watchdog takes the fixed cycles counter
+	EXPECT_EQ(EventPlanner(pmu(4, 3, true)).classify("cycles"), EventPlanner::Kind::general);
+	EXPECT_EQ(EventPlanner(pmu(4, 0)).classify("instructions"), EventPlanner::Kind::general);
+}
+
+
+TEST(EventPlannerTest, FitsInOneGroup)
+{
+	auto plan = EventPlanner(pmu()).plan({"instructions,cycles,l3_miss,l3_hit"}, {});
+	EXPECT_FALSE(plan.pinned);
+	EXPECT_EQ(plan.groups, strings_t({"instructions,cycles,l3_miss,l3_hit"}));
+}
+
+
+TEST(EventPlannerTest, SplitsLargeGroups)
+{
+	auto plan = EventPlanner(pmu(2)).plan({"a,b,c,instructions,d,e"}, {});
+	EXPECT_EQ(plan.groups, strings_t({"a,b", "c,instructions,d", "e"}));
+}
+
+
+TEST(EventPlannerTest, PackAndPin)
+{
+	auto plan = EventPlanner(pmu()).plan({"a,b", "c", "instructions,d", "e,f"}, {"instructions", "cycles", "l3_miss"});
+	EXPECT_TRUE(plan.pinned);
+
+	// The pinned group leaves 3 general purpose counters, and repeated events are dropped
+	EXPECT_EQ(plan.groups, strings_t({"instructions,cycles,l3_miss", "a,b,c", "d,e,f"}));
+
+	EXPECT_THROW(EventPlanner(pmu(2)).plan({}, {"a", "b", "c"}), std::runtime_error);
+	EXPECT_THROW(EventPlanner(pmu(2)).plan({"c"}, {"a", "b"}), std::runtime_error);
+}
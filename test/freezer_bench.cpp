@@ -0,0 +1,133 @@
+// Cost of pausing and resuming the tasks with signals, as tasks_pause and
+// tasks_resume do, and with the cgroup v2 freezer, as the number of tasks
+// grows. The tasks are children spinning on a cpu. Both all the tasks and
+// half of them are paused, as in live mode only the tasks leaving the
+// schedule are.
+//
+//   freezer_bench [iterations]
+//
+// The freezer needs a writable cgroup v2 hierarchy, without it only the
+// signals are measured.
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "freezer.hpp"
+
+
+static double measure_us(const std::function<void()> &f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static void wait_all(const std::vector<pid_t> &pids, int options)
+{
+	for (const auto &pid : pids)
+	{
+		int status;
+		if (waitpid(pid, &status, options) != pid)
+		{
+			std::perror("waitpid");
+			std::exit(EXIT_FAILURE);
+		}
+	}
+}
+
+
+static void signal_pause(const std::vector<pid_t> &pids)
+{
+	for (const auto &pid : pids)
+		kill(pid, SIGSTOP);
+	wait_all(pids, WUNTRACED);
+}
+
+
+static void signal_resume(const std::vector<pid_t> &pids)
+{
+	for (const auto &pid : pids)
+		kill(pid, SIGCONT);
+	wait_all(pids, WCONTINUED);
+}
+
+
+int main(int argc, char **argv)
+{
+	const size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100;
+
+	std::unique_ptr<Freezer> freezer;
+	try
+	{
+		freezer = std::make_unique<Freezer>();
+	}
+	catch (const std::exception &e)
+	{
+		std::printf("Freezer not available, only the signals are measured: %s\n", e.what());
+	}
+
+	std::printf("%6s %6s %14s %14s %14s %14s\n", "tasks", "paused", "sig stop (us)", "sig cont (us)", "freeze (us)", "thaw (us)");
+	for (uint32_t tasks : {1, 2, 4, 8, 16, 32})
+	{
+		auto pids = std::vector<pid_t>();
+		auto ids = std::vector<uint32_t>();
+		for (uint32_t id = 0; id < tasks; id++)
+		{
+			if (freezer)
+				freezer->add(id);
+			pid_t pid = fork();
+			if (pid < 0)
+			{
+				std::perror("fork");
+				return EXIT_FAILURE;
+			}
+			if (pid == 0)
+			{
+				if (freezer)
+					freezer->enter(id);
+				for (volatile uint64_t i = 0; ; i++);
+			}
+			pids.push_back(pid);
+			ids.push_back(id);
+		}
+
+		for (uint32_t paused : {tasks, tasks / 2})
+		{
+			if (paused == 0)
+				continue;
+			const auto sub_pids = std::vector<pid_t>(pids.begin(), pids.begin() + paused);
+			const auto sub_ids = std::vector<uint32_t>(ids.begin(), ids.begin() + paused);
+			double t_stop = 0, t_cont = 0, t_freeze = 0, t_thaw = 0;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				t_stop += measure_us([&] { signal_pause(sub_pids); });
+				t_cont += measure_us([&] { signal_resume(sub_pids); });
+				if (freezer)
+				{
+					t_freeze += measure_us([&] { freezer->freeze(sub_ids); });
+					t_thaw += measure_us([&] { freezer->thaw(sub_ids); });
+				}
+			}
+			if (freezer)
+				std::printf("%6u %6u %14.2f %14.2f %14.2f %14.2f\n", tasks, paused, t_stop / iterations, t_cont / iterations, t_freeze / iterations, t_thaw / iterations);
+			else
+				std::printf("%6u %6u %14.2f %14.2f %14s %14s\n", tasks, paused, t_stop / iterations, t_cont / iterations, "-", "-");
+		}
+
+		for (const auto &pid : pids)
+			kill(pid, SIGKILL);
+		wait_all(pids, 0);
+		if (freezer)
+			for (const auto &id : ids)
+				freezer->remove(id);
+	}
+}
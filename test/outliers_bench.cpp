@@ -0,0 +1,89 @@
+// Cost per interval of the outlier limits of the critical aware policies, as
+// the number of tasks grows: the sets filled on every interval against the
+// order statistics of outliers.hpp.
+//
+//   outliers_bench [intervals]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "outliers.hpp"
+#include "window.hpp"
+
+
+static const size_t window_size = 10;
+static volatile double sink; // So the limits are not optimized away
+
+
+// The limits as computed before, with std::set
+static double limits_set(const std::vector<Window> &windows)
+{
+	auto all = std::set<double>();
+	double sum = 0, sum2 = 0;
+	for (const auto &w : windows)
+		for (size_t i = 0; i < w.size(); i++)
+		{
+			all.insert(w[i]);
+			sum += w[i];
+			sum2 += w[i] * w[i];
+		}
+	const size_t n = all.size();
+	const double q1 = *std::next(all.begin(), n / 4);
+	const double q2 = *std::next(all.begin(), n / 2);
+	const double q3 = *std::next(all.begin(), n * 0.75);
+	auto dev = std::set<double>();
+	for (double x : all)
+		dev.insert(std::fabs(x - q2));
+	const double mad = *std::next(dev.begin(), dev.size() / 2);
+	const double mean = sum / (windows.size() * window_size);
+	const double sd = std::sqrt(sum2 / (windows.size() * window_size) - mean * mean);
+	return q1 + q3 + mad + mean + 3 * sd;
+}
+
+
+static double limits_order_stats(const std::vector<Window> &windows, OrderStats &values)
+{
+	values.clear();
+	for (const auto &w : windows)
+		for (size_t i = 0; i < w.size(); i++)
+			values.insert(w[i]);
+	return values.quartile(1) + values.quartile(3) + values.mad() + outliers::mean_sigma(values, 3) +
+			outliers::tukey(values) + outliers::schwetman(values) + outliers::carling(values);
+}
+
+
+int main(int argc, char **argv)
+{
+	const size_t intervals = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+	std::mt19937 gen(42);
+	std::lognormal_distribution<double> mpki(0, 1);
+
+	std::printf("%6s %14s %14s\n", "tasks", "set (us)", "order (us)");
+	for (size_t tasks : {2, 4, 8, 16, 32, 64, 128})
+	{
+		auto windows = std::vector<Window>(tasks, Window(window_size));
+		OrderStats values;
+		double t_set = 0, t_order = 0;
+		for (size_t interval = 0; interval < intervals; interval++)
+		{
+			for (auto &w : windows)
+				w.push(mpki(gen));
+
+			auto start = std::chrono::steady_clock::now();
+			sink = limits_set(windows);
+			auto mid = std::chrono::steady_clock::now();
+			sink = limits_order_stats(windows, values);
+			auto end = std::chrono::steady_clock::now();
+
+			t_set += std::chrono::duration<double, std::micro>(mid - start).count();
+			t_order += std::chrono::duration<double, std::micro>(end - mid).count();
+		}
+		std::printf("%6zu %14.2f %14.2f\n", tasks, t_set / intervals, t_order / intervals);
+	}
+}
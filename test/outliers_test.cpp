@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "outliers.hpp"
+
+
+static double brute_median(std::vector<double> v)
+{
+	std::sort(v.begin(), v.end());
+	const size_t n = v.size();
+	return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+
+static double brute_mad(const std::vector<double> &v)
+{
+	const double m = brute_median(v);
+	auto dev = std::vector<double>();
+	for (double x : v)
+		dev.push_back(std::fabs(x - m));
+	return brute_median(dev);
+}
+
+
+TEST(OrderStatsTest, KeepsDuplicates)
+{
+	OrderStats s;
+	for (double x : {3.0, 1.0, 2.0, 2.0, 2.0, 5.0, 2.0, 2.0})
+		s.insert(x);
+	EXPECT_EQ(s.size(), 8u);
+	EXPECT_EQ(s.min(), 1);
+	EXPECT_EQ(s.max(), 5);
+
+	// A set would have {1, 2, 3, 5} and a third quartile of 5
+	EXPECT_EQ(s.quartile(1), 2);
+	EXPECT_EQ(s.quartile(2), 2);
+	EXPECT_EQ(s.quartile(3), 3);
+	EXPECT_EQ(s.median(), 2);
+	EXPECT_DOUBLE_EQ(s.mean(), 19.0 / 8);
+
+	EXPECT_TRUE(s.erase(2));
+	EXPECT_FALSE(s.erase(2.5));
+	EXPECT_EQ(s.size(), 7u);
+	EXPECT_DOUBLE_EQ(s.mean(), 17.0 / 7);
+}
+
+
+TEST(OrderStatsTest, SlidingWindow)
+{
+	std::mt19937 gen(7);
+	std::lognormal_distribution<double> dist(0, 1);
+	auto window = std::vector<double>();
+	OrderStats s;
+	for (int i = 0; i < 500; i++)
+	{
+		const double x = std::round(dist(gen) * 10) / 10; // With repeated values
+		if (window.size() == 40)
+		{
+			ASSERT_TRUE(s.erase(window.front()));
+			window.erase(window.begin());
+		}
+		window.push_back(x);
+		s.insert(x);
+
+		ASSERT_DOUBLE_EQ(s.median(), brute_median(window));
+		ASSERT_DOUBLE_EQ(s.mad(), brute_mad(window));
+
+		double mean = 0;
+		for (double v : window)
+			mean += v;
+		mean /= window.size();
+		double var = 0;
+		for (double v : window)
+			var += (v - mean) * (v - mean);
+		ASSERT_NEAR(s.mean(), mean, 1e-9);
+		ASSERT_NEAR(s.variance(), var / window.size(), 1e-9);
+	}
+}
+
+
+TEST(OutliersTest, Limits)
+{
+	static_assert(outliers::schwetman_kn(5) == 1.65798, "");
+	static_assert(outliers::schwetman_kn(80) == 1.34514, "");
+	static_assert(outliers::schwetman_kn(81) == outliers::schwetman_kn(79), "");
+	static_assert(outliers::schwetman_kn(2) == outliers::schwetman_kn(6), "");
+
+	OrderStats s;
+	for (double x : {1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0})
+		s.insert(x);
+	EXPECT_DOUBLE_EQ(outliers::tukey(s), 7 + 1.5 * (7 - 3));
+	EXPECT_DOUBLE_EQ(outliers::mad(s, 3), 4.5 + 3 * outliers::mad_to_sigma * 2);
+	EXPECT_DOUBLE_EQ(outliers::mean_sigma(s, 2), 4.5 + 2 * std::sqrt(5.25));
+	EXPECT_DOUBLE_EQ(outliers::schwetman(s), 5 + 2 * (7 - 5) / outliers::schwetman_kn(8) * outliers::z95);
+}
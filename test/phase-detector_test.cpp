@@ -0,0 +1,63 @@
+#include <cmath>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "phase-detector.hpp"
+
+
+// Feed the values to a task and return the samples that started a new phase
+static std::vector<size_t> changes(PhaseDetector &detector, uint32_t task, const std::vector<double> &values)
+{
+	auto result = std::vector<size_t>();
+	for (size_t i = 0; i < values.size(); i++)
+		if (detector.update(task, values[i]).change)
+			result.push_back(i);
+	return result;
+}
+
+
+TEST(PhaseDetectorTest, Icov)
+{
+	PhaseDetector detector(PhaseDetector::Algorithm::icov, 0.5);
+	EXPECT_FALSE(detector.has(0));
+	EXPECT_EQ(changes(detector, 0, {1, 1.1, 0.9, 1, 3, 3.1, 2.9, 3}), std::vector<size_t>({4}));
+
+	const auto &e = detector.last(0);
+	EXPECT_EQ(e.phase, 2u);
+	EXPECT_EQ(e.duration, 4u);
+
+	// Same score as the rule of the critical aware policies: |x - mean before| / mean with x
+	PhaseDetector icov(PhaseDetector::Algorithm::icov, 1);
+	icov.update(0, 1);
+	icov.update(0, 2);
+	EXPECT_DOUBLE_EQ(icov.update(0, 3).score, std::fabs(3 - 1.5) / 2);
+}
+
+
+TEST(PhaseDetectorTest, Cusum)
+{
+	PhaseDetector detector(PhaseDetector::Algorithm::cusum, 0.5, 4, 0.05);
+
+	// Small deviations are absorbed by the drift, a sustained shift accumulates
+	EXPECT_EQ(changes(detector, 3, {1, 1.02, 0.98, 1, 1.3, 1.3, 1.3, 1.3}), std::vector<size_t>({6}));
+	EXPECT_EQ(detector.last(3).phase, 2u);
+	EXPECT_FALSE(detector.has(0));
+}
+
+
+TEST(PhaseDetectorTest, Window)
+{
+	PhaseDetector detector(PhaseDetector::Algorithm::window, 0.3, 2);
+
+	// Two reference and two recent values are needed
+	EXPECT_EQ(changes(detector, 0, {1, 1, 1, 1, 1, 2, 2, 2}), std::vector<size_t>({5}));
+
+	detector.reset(0);
+	EXPECT_FALSE(detector.has(0));
+	EXPECT_FALSE(detector.update(0, 10).change);
+	EXPECT_EQ(detector.last(0).phase, 1u);
+
+	EXPECT_THROW(PhaseDetector::str_to_algorithm("fft"), std::runtime_error);
+	EXPECT_THROW(PhaseDetector(PhaseDetector::Algorithm::window, 1, 0), std::runtime_error);
+}
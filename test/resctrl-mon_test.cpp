@@ -0,0 +1,141 @@
+#include <fstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "resctrl-mon.hpp"
+
+
+namespace fs = boost::filesystem;
+using fmt::literals::operator""_format;
+
+
+// A resctrl tree with CLOS 0 and 1, and two L3 domains that monitor the occupancy and the total bandwidth
+class ResctrlMonTest : public testing::Test
+{
+	protected:
+
+	fs::path root = fs::temp_directory_path() / fs::unique_path();
+	pid_t pid = getpid();
+
+	static void write(const fs::path &path, const std::string &content)
+	{
+		fs::create_directories(path.parent_path());
+		std::ofstream(path.string()) << content << std::endl;
+	}
+
+	// The kernel creates the files of the groups
+	void write_group(const fs::path &clos_dir, uint64_t occupancy_0, uint64_t occupancy_1, uint64_t bytes_0, uint64_t bytes_1)
+	{
+		const auto group = clos_dir / "mon_groups" / "manager-{}-{}"_format(getpid(), pid);
+		write(group / "mon_data" / "mon_L3_00" / "llc_occupancy", std::to_string(occupancy_0));
+		write(group / "mon_data" / "mon_L3_01" / "llc_occupancy", std::to_string(occupancy_1));
+		write(group / "mon_data" / "mon_L3_00" / "mbm_total_bytes", std::to_string(bytes_0));
+		write(group / "mon_data" / "mon_L3_01" / "mbm_total_bytes", std::to_string(bytes_1));
+	}
+
+	void SetUp() override
+	{
+		write(root / "info" / "L3_MON" / "mon_features", "llc_occupancy\nmbm_total_bytes");
+		write(root / "info" / "L3_MON" / "num_rmids", "224");
+		fs::create_directories(root / "mon_data" / "mon_L3_00");
+		fs::create_directories(root / "mon_data" / "mon_L3_01");
+		fs::create_directories(root / "mon_groups");
+		fs::create_directories(root / "1" / "mon_groups");
+		write(root / "tasks", std::to_string(pid));
+		write(root / "1" / "tasks", "");
+	}
+
+	void TearDown() override
+	{
+		fs::remove_all(root);
+	}
+
+	static std::string read_tasks(const fs::path &group)
+	{
+		std::ifstream f((group / "tasks").string());
+		std::string tasks;
+		f >> tasks;
+		return tasks;
+	}
+};
+
+
+TEST_F(ResctrlMonTest, Events)
+{
+	ResctrlMon mon(root.string());
+	EXPECT_EQ(mon.get_events(), std::vector<ResctrlMon::Event>({ResctrlMon::llc_occupancy, ResctrlMon::total_bytes}));
+	EXPECT_TRUE(ResctrlMon::provides("intel_cqm/llc_occupancy/"));
+	EXPECT_TRUE(ResctrlMon::provides("intel_cqm/local_bytes/"));
+	EXPECT_FALSE(ResctrlMon::provides("instructions"));
+	EXPECT_TRUE(ResctrlMon::is_snapshot(ResctrlMon::llc_occupancy));
+	EXPECT_FALSE(ResctrlMon::is_snapshot(ResctrlMon::total_bytes));
+}
+
+
+TEST_F(ResctrlMonTest, AddAndRead)
+{
+	ResctrlMon mon(root.string());
+	mon.add(pid);
+	ASSERT_TRUE(mon.has(pid));
+	EXPECT_EQ(read_tasks(root / "mon_groups" / "manager-{}-{}"_format(getpid(), pid)), std::to_string(pid));
+
+	// The domains are added, the bandwidth is in MB like perf gives it
+	write_group(root, 1000, 24, 1024 * 1024, 3 * 1024 * 1024);
+	mon.read();
+	const auto values = mon.get_values(pid);
+	EXPECT_EQ(values[ResctrlMon::llc_occupancy], 1024);
+	EXPECT_EQ(values[ResctrlMon::total_bytes], 4);
+	EXPECT_EQ(values[ResctrlMon::local_bytes], 0);
+
+	mon.remove(pid);
+	EXPECT_FALSE(mon.has(pid));
+	EXPECT_EQ(mon.get_values(pid)[ResctrlMon::llc_occupancy], 0);
+}
+
+
+// The new group starts from 0, the bandwidth of the old one is kept
+TEST_F(ResctrlMonTest, Move)
+{
+	ResctrlMon mon(root.string());
+	mon.add(pid);
+	write_group(root, 1000, 0, 2 * 1024 * 1024, 0);
+
+	write(root / "1" / "tasks", std::to_string(pid));
+	mon.move({pid}, (root / "1").string());
+	EXPECT_EQ(read_tasks(root / "1" / "mon_groups" / "manager-{}-{}"_format(getpid(), pid)), std::to_string(pid));
+
+	write_group(root / "1", 10, 0, 1024 * 1024, 0);
+	mon.read();
+	const auto values = mon.get_values(pid);
+	EXPECT_EQ(values[ResctrlMon::llc_occupancy], 10);
+	EXPECT_EQ(values[ResctrlMon::total_bytes], 3);
+
+	// Moving it to the CLOS it is in does nothing
+	mon.move({pid}, (root / "1").string());
+	mon.read();
+	EXPECT_EQ(mon.get_values(pid)[ResctrlMon::total_bytes], 3);
+}
+
+
+// A file without a number keeps its last value, the total must not go down
+TEST_F(ResctrlMonTest, Unavailable)
+{
+	ResctrlMon mon(root.string());
+	mon.add(pid);
+	write_group(root, 1000, 24, 1024 * 1024, 3 * 1024 * 1024);
+	mon.read();
+	EXPECT_EQ(mon.get_values(pid)[ResctrlMon::total_bytes], 4);
+
+	const auto group = root / "mon_groups" / "manager-{}-{}"_format(getpid(), pid);
+	write(group / "mon_data" / "mon_L3_01" / "mbm_total_bytes", "Unavailable");
+	mon.read();
+	EXPECT_EQ(mon.get_values(pid)[ResctrlMon::total_bytes], 4);
+
+	write_group(root, 1000, 24, 2 * 1024 * 1024, 4 * 1024 * 1024);
+	mon.read();
+	EXPECT_EQ(mon.get_values(pid)[ResctrlMon::total_bytes], 6);
+}
@@ -0,0 +1,111 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "rollups.hpp"
+
+
+static counters_t make_counters(double instructions, double cycles, double occupancy, double energy, double clos)
+{
+	counters_t c;
+	c.insert(Counter(0, "instructions", instructions, "", false, 1, 1));
+	c.insert(Counter(1, "cycles", cycles, "", false, 1, 1));
+	c.insert(Counter(2, "intel_cqm/llc_occupancy/", occupancy, "", true, 1, 1));
+	c.insert(Counter(3, "power/energy-pkg/", energy, "j", false, 1, 1));
+	c.insert(Counter(4, "clos_num", clos, "", true, 1, 1));
+	return c;
+}
+
+
+static const std::vector<std::string> names = {"instructions", "cycles", "intel_cqm/llc_occupancy/", "power/energy-pkg/", "clos_num"};
+
+
+TEST(RollupsTest, Groups)
+{
+	Stats a(names), b(names);
+	a.accum(make_counters(0, 0, 0, 10, 1));
+	a.accum(make_counters(200, 100, 1000, 15, 1));
+	b.accum(make_counters(0, 0, 0, 10, 2));
+	b.accum(make_counters(100, 100, 3000, 15, 2));
+
+	Rollups r;
+	r.add(a, 0);
+	r.add(b, 0);
+
+	EXPECT_TRUE(r.has(Rollups::ipc));
+	EXPECT_FALSE(r.has(Rollups::l3_misses));
+	EXPECT_EQ(r.system().tasks, 2U);
+	EXPECT_EQ(r.system().sum(Rollups::ipc), 3);
+	EXPECT_EQ(r.system().mean(Rollups::ipc), 1.5);
+	EXPECT_EQ(r.system().sum(Rollups::l3_occupancy), 4000);
+
+	// Every task reads the energy of the whole package
+	EXPECT_EQ(r.system().sum(Rollups::energy_pkg), 5);
+	EXPECT_EQ(r.system().mean(Rollups::energy_pkg), 5);
+
+	EXPECT_EQ(r.clos(0).tasks, 0U);
+	EXPECT_EQ(r.clos(1).tasks, 1U);
+	EXPECT_EQ(r.clos(1).sum(Rollups::ipc), 2);
+	EXPECT_EQ(r.clos(2).sum(Rollups::l3_occupancy), 3000);
+	EXPECT_EQ(r.clos(7).tasks, 0U);
+
+	EXPECT_EQ(r.domains().size(), 1U);
+	EXPECT_EQ(r.domain(0).tasks, 2U);
+
+	// A new interval starts from 0
+	r.clear();
+	EXPECT_EQ(r.system().tasks, 0U);
+	EXPECT_EQ(r.clos(1).tasks, 0U);
+	EXPECT_EQ(r.system().mean(Rollups::ipc), 0);
+}
+
+
+// A task with cpus in two L3 domains is not seen by the policy of either, so it only counts for the system
+TEST(RollupsTest, SpanningTask)
+{
+	Stats a(names), b(names);
+	a.accum(make_counters(0, 0, 0, 10, 1));
+	a.accum(make_counters(200, 100, 1000, 15, 1));
+	b.accum(make_counters(0, 0, 0, 10, 1));
+	b.accum(make_counters(100, 100, 3000, 15, 1));
+
+	Rollups r;
+	r.add(a, 1);
+	r.add(b, CAT::all_domains);
+
+	EXPECT_EQ(r.system().tasks, 2U);
+	EXPECT_EQ(r.system().sum(Rollups::ipc), 3);
+	EXPECT_EQ(r.clos(1).tasks, 2U);
+	EXPECT_EQ(r.domain(0).tasks, 0U);
+	EXPECT_EQ(r.domain(1).tasks, 1U);
+	EXPECT_EQ(r.domain(1).sum(Rollups::ipc), 2);
+	EXPECT_EQ(r.domain(1).sum(Rollups::l3_occupancy), 1000);
+}
+
+
+TEST(RollupsTest, Print)
+{
+	Stats a(names);
+	a.accum(make_counters(0, 0, 0, 10, 1));
+	a.accum(make_counters(200, 100, 1000, 15, 1));
+
+	Rollups r;
+	r.add(a, 0);
+
+	std::stringstream ss;
+	Rollups::print_header(ss);
+	r.print(3, ss);
+
+	std::string line;
+	std::getline(ss, line);
+	EXPECT_EQ(line.substr(0, 30), "interval,scope,id,tasks,ipc,ip");
+	std::getline(ss, line);
+	EXPECT_EQ(line, "3,system,0,1,2,2,nan,nan,1000,1000,nan,nan,5,5,nan,nan");
+	std::getline(ss, line);
+	EXPECT_EQ(line.substr(0, 11), "3,clos,1,1,");
+	std::getline(ss, line);
+	EXPECT_EQ(line.substr(0, 9), "3,domain,");
+	EXPECT_FALSE(std::getline(ss, line));
+}
@@ -0,0 +1,192 @@
+#include <string>
+#include <vector>
+
+#include <boost/log/core.hpp>
+#include <gtest/gtest.h>
+
+#include "alloc-counter.hpp"
+#include "event-registry.hpp"
+#include "stats.hpp"
+
+
+counters_t make_counters(double instructions, double cycles)
+{
+	counters_t c;
+	c.insert(Counter(0, "instructions", instructions, "", false, 1, 1));
+	c.insert(Counter(1, "cycles", cycles, "", false, 1, 1));
+	return c;
+}
+
+
+TEST(EventRegistryTest, Intern)
+{
+	uint32_t id;
+	EXPECT_FALSE(EventRegistry::find("stats_test.unknown", id));
+	EventId a("stats_test.a");
+	EventId b("stats_test.b");
+	EXPECT_NE(a, b);
+	EXPECT_EQ(a, EventId("stats_test.a"));
+	EXPECT_TRUE(EventRegistry::find("stats_test.b", id));
+	EXPECT_EQ(id, b.get());
+	EXPECT_EQ(a.name(), "stats_test.a");
+}
+
+
+TEST(StatsTest, AccumById)
+{
+	Stats s({"instructions", "cycles"});
+	s.accum(make_counters(100, 50));
+	s.accum(make_counters(400, 150));
+
+	const EventId inst("instructions");
+	const EventId ipc("ipc");
+	EXPECT_TRUE(s.has(inst));
+	EXPECT_TRUE(s.has(ipc));
+	EXPECT_EQ(s.last(inst), 300);
+	EXPECT_EQ(s.sum(inst), 400);
+	EXPECT_EQ(s.last(ipc), 3);
+	EXPECT_EQ(s.last("cycles"), 100);
+	EXPECT_EQ(s.get_current(EventId("cycles")), 150);
+	EXPECT_EQ(s.data_to_string_int(","), "300,100,3");
+	EXPECT_EQ(s.get_names(), std::vector<std::string>({"instructions", "cycles", "ipc"}));
+}
+
+
+TEST(StatsTest, NotMonitorized)
+{
+	Stats s({"instructions", "cycles"});
+	s.accum(make_counters(100, 50));
+	const EventId other("mem_load_uops_retired.l3_miss");
+	EXPECT_FALSE(s.has(other));
+	EXPECT_THROW(s.get(other), std::runtime_error);
+	EXPECT_THROW(s.get_current(other), std::runtime_error);
+}
+
+
+TEST(StatsTest, Quantiles)
+{
+	Stats s({"instructions", "cycles"});
+	s.init_quantiles({"ipc"}, {50, 99});
+	EXPECT_THROW(s.init_quantiles({"stalls"}, {50}), std::runtime_error);
+	s.init_quantiles({"ipc"}, {50, 99});
+	EXPECT_EQ(s.header_to_string_total(","), "instructions,cycles,ipc,ipc:p50,ipc:p99");
+
+	double inst = 0, cycl = 0;
+	for (int i = 1; i <= 100; i++)
+	{
+		inst += i;
+		cycl += 1;
+		s.accum(make_counters(inst, cycl));
+	}
+	EXPECT_NEAR(s.quantile(EventId("ipc"), 0.5), 50, 1);
+	EXPECT_NEAR(s.quantile(EventId("ipc"), 0.99), 99, 1);
+	EXPECT_THROW(s.quantile(EventId("cycles"), 0.5), std::runtime_error);
+}
+
+
+TEST(StatsTest, Confidence)
+{
+	Stats s({"instructions", "cycles"});
+	s.accum(make_counters(100, 50));
+	EXPECT_EQ(s.confidence(EventId("ipc")), 1);
+
+	// Cycles only counted during a quarter of the interval, its value is extrapolated
+	counters_t c;
+	c.insert(Counter(0, "instructions", 400, "", false, 4, 4));
+	c.insert(Counter(1, "cycles", 75, "", false, 4, 1));
+	s.accum(c);
+	EXPECT_EQ(s.confidence(EventId("instructions")), 1);
+	EXPECT_EQ(s.confidence(EventId("cycles")), 0.25);
+	EXPECT_EQ(s.confidence(EventId("ipc")), 0.25);
+	EXPECT_EQ(s.last("cycles"), 100);
+}
+
+
+TEST(StatsTest, SampleSwap)
+{
+	Stats s({"instructions", "cycles"});
+	Sample sample;
+	sample.names = {"instructions", "cycles"};
+	sample.snapshot = {false, false};
+	sample.values = {100, 50};
+	sample.enabled = {1, 1};
+	sample.running = {1, 1};
+	s.accum(sample);
+	EXPECT_TRUE(sample.names.empty()); // The buffers of the last sample, empty the first time
+
+	sample = Sample{{"instructions", "cycles"}, {false, false}, {400, 150}, {1, 1}, {1, 1}};
+	s.accum(sample);
+	EXPECT_EQ(s.last("instructions"), 300);
+	EXPECT_EQ(s.last("ipc"), 3);
+	EXPECT_EQ(s.get_current(EventId("cycles")), 150);
+
+	// After a reset the next sample is the first one again, with the same counters
+	s.reset_counters();
+	sample = Sample{{"instructions", "cycles"}, {false, false}, {40, 20}, {1, 1}, {1, 1}};
+	s.accum(sample);
+	EXPECT_EQ(s.last("instructions"), 40);
+	EXPECT_EQ(s.data_to_string_total(","), "440,170,2.58824");
+}
+
+
+TEST(StatsTest, NoAllocationsInSteadyState)
+{
+	boost::log::core::get()->set_logging_enabled(false); // Formatting the debug messages allocates
+	Stats s({"instructions", "cycles"});
+	s.init_quantiles({"ipc"}, {50});
+
+	// What 'Perf::read_sample' does, the names are only set in the first read into each buffer
+	Sample sample;
+	double inst = 0, cycl = 0;
+	auto read = [&]()
+	{
+		inst += 200;
+		cycl += 100;
+		if (sample.names.empty())
+			sample = Sample{{"instructions", "cycles"}, {false, false}, {0, 0}, {1, 1}, {1, 1}};
+		sample.values[0] = inst;
+		sample.values[1] = cycl;
+		s.accum(sample);
+	};
+
+	// The three buffers that rotate are filled
+	for (int i = 0; i < 3; i++)
+		read();
+
+	const uint64_t allocs = thread_allocations();
+	for (int i = 0; i < 1000; i++)
+		read();
+	EXPECT_EQ(thread_allocations() - allocs, 0U);
+	EXPECT_EQ(s.last("ipc"), 2);
+	boost::log::core::get()->set_logging_enabled(true);
+}
+
+
+TEST(StatsTest, Rates)
+{
+	auto derived = std::make_shared<const DerivedMetrics>(DerivedMetrics::definitions_t{{"ips", "instructions / dt"}});
+	Stats s;
+	s.init({"instructions", "occupancy"}, derived);
+	s.init_rates();
+
+	// The first sample takes the length of the interval from the time the counters were enabled
+	Sample sample{{"instructions", "occupancy"}, {false, true}, {1000, 5}, {500000000, 500000000}, {500000000, 500000000}, 3000000000};
+	s.accum(sample);
+	EXPECT_EQ(s.last("dt"), 0.5);
+	EXPECT_EQ(s.rate("instructions"), 2000);
+
+	sample = Sample{{"instructions", "occupancy"}, {false, true}, {5000, 7}, {2000000000, 2000000000}, {2000000000, 2000000000}, 5000000000};
+	s.accum(sample);
+	EXPECT_EQ(s.last("dt"), 2);
+	EXPECT_EQ(s.rate("instructions"), 2000);
+	EXPECT_EQ(s.last("ips"), 2000);
+
+	EXPECT_EQ(s.header_to_string(","), "instructions,occupancy,ips,dt,instructions/s");
+	EXPECT_EQ(s.data_to_string_int(","), "4000,7,2000,2,2000");
+	EXPECT_EQ(s.data_to_string_total(","), "5000,6,2000,2.5,2000");
+
+	// 'dt' is not a name for a metric
+	Stats t;
+	auto bad = std::make_shared<const DerivedMetrics>(DerivedMetrics::definitions_t{{"dt", "instructions"}});
+	EXPECT_THROW(t.init({"instructions"}, bad), std::runtime_error);
+}
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tdigest.hpp"
+
+
+// Fraction of the sorted values below 'x'
+static double rank(const std::vector<double> &sorted, double x)
+{
+	return (std::lower_bound(sorted.begin(), sorted.end(), x) - sorted.begin()) / (double) sorted.size();
+}
+
+
+TEST(TDigestTest, Empty)
+{
+	TDigest t;
+	EXPECT_TRUE(std::isnan(t.quantile(0.5)));
+	t.add(NAN);
+	EXPECT_EQ(t.count(), 0);
+	t.add(3);
+	EXPECT_EQ(t.quantile(0), 3);
+	EXPECT_EQ(t.quantile(0.99), 3);
+}
+
+
+TEST(TDigestTest, Small)
+{
+	TDigest t;
+	for (int i = 1; i <= 5; i++)
+		t.add(i);
+	EXPECT_EQ(t.quantile(0), 1);
+	EXPECT_EQ(t.quantile(1), 5);
+	EXPECT_NEAR(t.quantile(0.5), 3, 0.5);
+}
+
+
+TEST(TDigestTest, Accuracy)
+{
+	std::mt19937 gen(1);
+	std::lognormal_distribution<double> dist(0, 1);
+	TDigest t(100);
+	auto values = std::vector<double>();
+	for (int i = 0; i < 200000; i++)
+	{
+		double v = dist(gen);
+		t.add(v);
+		values.push_back(v);
+	}
+	std::sort(values.begin(), values.end());
+
+	EXPECT_EQ(t.count(), values.size());
+	EXPECT_EQ(t.min(), values.front());
+	EXPECT_EQ(t.max(), values.back());
+
+	// Rank error, smaller at the tails
+	EXPECT_NEAR(rank(values, t.quantile(0.5)), 0.5, 0.005);
+	EXPECT_NEAR(rank(values, t.quantile(0.9)), 0.9, 0.003);
+	EXPECT_NEAR(rank(values, t.quantile(0.99)), 0.99, 0.001);
+	EXPECT_NEAR(rank(values, t.quantile(0.999)), 0.999, 0.0005);
+	EXPECT_NEAR(rank(values, t.quantile(0.01)), 0.01, 0.001);
+
+	// The memory does not grow with the number of values
+	EXPECT_LE(t.size(), 101U);
+}
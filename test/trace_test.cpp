@@ -0,0 +1,149 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "trace.hpp"
+
+
+class TraceTest : public testing::Test
+{
+	protected:
+
+	std::string path;
+	const std::vector<std::string> columns = {"instructions", "cycles", "cpu/event=0x3c,umask=0/", "ipc"};
+	const std::vector<std::pair<uint32_t, std::string>> tasks = {{0, "mcf"}, {1, "lbm"}, {70, "xz"}};
+
+	virtual void SetUp()
+	{
+		path = "/tmp/trace_test_" + std::to_string(getpid()) + ".bin";
+	}
+
+	virtual void TearDown()
+	{
+		std::remove(path.c_str());
+	}
+
+	// Write 'intervals' intervals with a record for each task
+	void write(uint32_t intervals, uint32_t block_records)
+	{
+		trace::Writer writer(path, columns, tasks, block_records);
+		for (uint32_t i = 0; i < intervals; i++)
+			for (const auto &t : tasks)
+				writer.write_record(i, t.first, t.first % 8, i / 100.0, {(double) i, (double) t.first, 0.5, NAN});
+		writer.close();
+	}
+
+	// Overwrite 'value' at 'offset', from the end of the file if negative
+	void patch(int64_t offset, uint64_t value, size_t len)
+	{
+		std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+		f.seekp(offset, offset < 0 ? std::ios::end : std::ios::beg);
+		f.write((const char *) &value, len);
+	}
+};
+
+
+TEST_F(TraceTest, Header)
+{
+	write(10, 4);
+	trace::Reader reader(path);
+	EXPECT_EQ(reader.get_columns(), columns);
+	EXPECT_EQ(reader.get_tasks(), tasks);
+	EXPECT_EQ(reader.task_name(70), "xz");
+	EXPECT_EQ(reader.get_header().header_size % 8, 0U);
+	EXPECT_EQ(reader.get_header().record_size, sizeof(trace::TraceRecord) + columns.size() * sizeof(double));
+}
+
+
+TEST_F(TraceTest, Records)
+{
+	write(10, 4);
+	trace::Reader reader(path);
+	ASSERT_TRUE(reader.is_indexed());
+	ASSERT_EQ(reader.get_num_records(), 10 * tasks.size());
+	for (uint64_t i = 0; i < reader.get_num_records(); i++)
+	{
+		const auto &r = reader.record(i);
+		const double *v = reader.values(i);
+		EXPECT_EQ(r.interval, i / tasks.size());
+		EXPECT_EQ(r.task_id, tasks[i % tasks.size()].first);
+		EXPECT_EQ(r.cpu, (int32_t) r.task_id % 8);
+		EXPECT_DOUBLE_EQ(r.compl_, r.interval / 100.0);
+		EXPECT_EQ(v[0], r.interval);
+		EXPECT_EQ(v[1], r.task_id);
+		EXPECT_EQ(v[2], 0.5);
+		EXPECT_TRUE(std::isnan(v[3]));
+	}
+}
+
+
+TEST_F(TraceTest, FindByInterval)
+{
+	write(100, 6); // Two intervals per block
+	trace::Reader reader(path);
+	auto ranges = reader.find(10, 13);
+	ASSERT_EQ(ranges.size(), 1U);
+	EXPECT_EQ(ranges[0].first, 10 * tasks.size());
+	EXPECT_EQ(ranges[0].second, 14 * tasks.size());
+}
+
+
+TEST_F(TraceTest, FindByTask)
+{
+	write(4, 1); // One record per block
+	trace::Reader reader(path);
+	auto ranges = reader.find(0, -1U, 70);
+	ASSERT_EQ(ranges.size(), 4U);
+	for (const auto &range : ranges)
+	{
+		EXPECT_EQ(range.second - range.first, 1U);
+		EXPECT_EQ(reader.record(range.first).task_id, 70U);
+	}
+}
+
+
+// The manager died, there is no index and the last record is incomplete
+TEST_F(TraceTest, Unfinished)
+{
+	write(10, 4);
+	size_t size;
+	{
+		trace::Reader reader(path);
+		size = reader.get_header().header_size + 5 * tasks.size() * reader.get_header().record_size + 10;
+	}
+	ASSERT_EQ(truncate(path.c_str(), size), 0);
+
+	trace::Reader reader(path);
+	EXPECT_FALSE(reader.is_indexed());
+	EXPECT_EQ(reader.get_num_records(), 5 * tasks.size());
+}
+
+
+// A corrupted header or index is rejected instead of read out of bounds
+TEST_F(TraceTest, Corrupted)
+{
+	write(10, 4);
+	patch(offsetof(trace::TraceHeader, record_size), 0, sizeof(uint32_t));
+	EXPECT_THROW(trace::Reader reader(path), std::runtime_error);
+
+	write(10, 4);
+	patch(offsetof(trace::TraceFooter, index_offset) - sizeof(trace::TraceFooter), 1 << 30, sizeof(uint64_t));
+	EXPECT_THROW(trace::Reader reader(path), std::runtime_error);
+
+	write(10, 4);
+	patch(offsetof(trace::TraceFooter, num_blocks) - sizeof(trace::TraceFooter), 1000, sizeof(uint64_t));
+	EXPECT_THROW(trace::Reader reader(path), std::runtime_error);
+
+	// Without the footer the records are still readable
+	write(10, 4);
+	patch(offsetof(trace::TraceFooter, magic) - sizeof(trace::TraceFooter), 0, sizeof(uint64_t));
+	trace::Reader reader(path);
+	EXPECT_FALSE(reader.is_indexed());
+}
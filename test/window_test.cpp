@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+
+#include <gtest/gtest.h>
+
+#include "window.hpp"
+
+
+// Compare with the values kept in a deque, newest first
+static void expect_same(const Window &w, const std::deque<double> &d)
+{
+	ASSERT_EQ(w.size(), d.size());
+	double mean = 0;
+	for (size_t i = 0; i < d.size(); i++)
+	{
+		EXPECT_EQ(w[i], d[i]);
+		mean += d[i];
+	}
+	mean /= d.size();
+	double var = 0;
+	for (const auto &v : d)
+		var += (v - mean) * (v - mean);
+	var /= d.size();
+
+	EXPECT_NEAR(w.mean(), mean, 1e-9);
+	EXPECT_NEAR(w.variance(), var, 1e-6);
+	EXPECT_EQ(w.min(), *std::min_element(d.begin(), d.end()));
+	EXPECT_EQ(w.max(), *std::max_element(d.begin(), d.end()));
+	EXPECT_EQ(w.last(), d.front());
+}
+
+
+TEST(WindowTest, Empty)
+{
+	Window w(3);
+	EXPECT_TRUE(w.empty());
+	EXPECT_TRUE(std::isnan(w.mean()));
+	EXPECT_TRUE(std::isnan(w.max()));
+	EXPECT_EQ(w.sum(), 0);
+}
+
+
+TEST(WindowTest, Sliding)
+{
+	Window w(7);
+	std::deque<double> d;
+	srand(1);
+	for (int i = 0; i < 1000; i++)
+	{
+		double v = rand() % 1000 / 10.0;
+		w.push(v);
+		d.push_front(v);
+		if (d.size() > 7)
+			d.pop_back();
+		expect_same(w, d);
+	}
+	EXPECT_TRUE(w.full());
+}
+
+
+// Every value stays in one of the monotonic queues until it leaves the window
+TEST(WindowTest, Monotonic)
+{
+	Window w(4);
+	std::deque<double> up, down;
+	for (int i = 0; i < 20; i++)
+	{
+		w.push(i);
+		up.push_front(i);
+		if (up.size() > 4)
+			up.pop_back();
+		expect_same(w, up);
+	}
+	w.clear();
+	for (int i = 20; i > 0; i--)
+	{
+		w.push(i);
+		down.push_front(i);
+		if (down.size() > 4)
+			down.pop_back();
+		expect_same(w, down);
+	}
+}
+
+
+TEST(WindowTest, SetCapacity)
+{
+	Window w(4);
+	for (double v : {1, 2, 3, 4})
+		w.push(v);
+	w.set_capacity(2);
+	expect_same(w, {4, 3});
+	w.set_capacity(5);
+	w.push(5);
+	expect_same(w, {5, 4, 3});
+	w.clear();
+	EXPECT_TRUE(w.empty());
+	w.push(6);
+	expect_same(w, {6});
+}
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "throw-with-trace.hpp"
+#include "trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+namespace trace
+{
+
+static size_t align8(size_t n)
+{
+	return (n + 7) & ~(size_t) 7;
+}
+
+
+Writer::Writer(const std::string &path, const std::vector<std::string> &columns,
+		const std::vector<std::pair<uint32_t, std::string>> &tasks, uint32_t _block_records) :
+	filebuf(1 << 20), num_columns(columns.size()), block_records(_block_records)
+{
+	if (block_records == 0)
+		throw_with_trace(std::runtime_error("The trace needs at least one record per block"));
+
+	uint32_t max_id = 0;
+	for (const auto &t : tasks)
+		max_id = std::max(max_id, t.first);
+	bitmap_words = max_id / 64 + 1;
+	record_size = sizeof(TraceRecord) + num_columns * sizeof(double);
+
+	out.rdbuf()->pubsetbuf(filebuf.data(), filebuf.size());
+	out.open(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+		throw_with_trace(std::runtime_error("Could not open trace file '{}': {}"_format(path, strerror(errno))));
+
+	std::string names;
+	for (size_t i = 0; i < columns.size(); i++)
+	{
+		if (columns[i].find('\n') != std::string::npos)
+			throw_with_trace(std::runtime_error("Invalid column name '{}' for the trace"_format(columns[i])));
+		names += (i ? "\n" : "") + columns[i];
+	}
+
+	std::string task_table;
+	for (const auto &t : tasks)
+	{
+		uint32_t len = t.second.size();
+		task_table.append((const char *) &t.first, sizeof(t.first));
+		task_table.append((const char *) &len, sizeof(len));
+		task_table.append(t.second);
+	}
+
+	TraceHeader h;
+	std::memcpy(h.magic, header_magic, sizeof(h.magic));
+	h.version = version;
+	h.header_size = align8(sizeof(h) + names.size() + task_table.size());
+	h.record_size = record_size;
+	h.num_columns = num_columns;
+	h.num_tasks = tasks.size();
+	h.block_records = block_records;
+	h.names_len = names.size();
+	h.bitmap_words = bitmap_words;
+
+	write(&h, sizeof(h));
+	write(names.data(), names.size());
+	write(task_table.data(), task_table.size());
+	const char zeros[8] = {};
+	write(zeros, h.header_size - offset);
+
+	record.resize(num_columns + sizeof(TraceRecord) / sizeof(double));
+	bitmap.assign(bitmap_words, 0);
+	std::memset(&block, 0, sizeof(block));
+}
+
+
+Writer::~Writer()
+{
+	// Errors cannot be reported from the destructor, call 'close' to get them
+	try
+	{
+		close();
+	}
+	catch (...) {}
+}
+
+
+void Writer::write(const void *data, size_t size)
+{
+	out.write((const char *) data, size);
+	if (!out)
+		throw_with_trace(std::runtime_error("Could not write the trace: {}"_format(strerror(errno))));
+	offset += size;
+}
+
+
+void Writer::write_record(uint32_t interval, uint32_t task_id, int32_t cpu, double compl_, const std::vector<double> &values)
+{
+	assert(!closed);
+	if (values.size() != num_columns)
+		throw_with_trace(std::runtime_error("Trace record with {} values, expected {}"_format(values.size(), num_columns)));
+	if (task_id / 64 >= bitmap_words)
+		throw_with_trace(std::runtime_error("Task id {} is not in the trace task table"_format(task_id)));
+
+	if (block.num_records == 0)
+	{
+		block.offset = offset;
+		block.first_interval = interval;
+	}
+	block.last_interval = std::max(block.last_interval, interval);
+	block.first_interval = std::min(block.first_interval, interval);
+	bitmap[task_id / 64] |= (uint64_t) 1 << (task_id % 64);
+
+	// Build the record in a reused buffer and write it at once
+	TraceRecord *r = (TraceRecord *) record.data();
+	r->interval = interval;
+	r->task_id = task_id;
+	r->cpu = cpu;
+	r->reserved = 0;
+	r->compl_ = compl_;
+	std::copy(values.begin(), values.end(), record.begin() + sizeof(TraceRecord) / sizeof(double));
+	write(record.data(), record_size);
+
+	num_records++;
+	if (++block.num_records == block_records)
+		close_block();
+}
+
+
+void Writer::close_block()
+{
+	if (block.num_records == 0)
+		return;
+	index.insert(index.end(), (const char *) &block, (const char *) &block + sizeof(block));
+	index.insert(index.end(), (const char *) bitmap.data(), (const char *) (bitmap.data() + bitmap.size()));
+	num_blocks++;
+	std::memset(&block, 0, sizeof(block));
+	std::fill(bitmap.begin(), bitmap.end(), 0);
+}
+
+
+void Writer::close()
+{
+	if (closed)
+		return;
+	closed = true;
+
+	close_block();
+
+	TraceFooter f;
+	f.index_offset = offset;
+	f.num_blocks = num_blocks;
+	f.num_records = num_records;
+	std::memcpy(f.magic, footer_magic, sizeof(f.magic));
+
+	write(index.data(), index.size());
+	write(&f, sizeof(f));
+	out.close();
+}
+
+
+Reader::Reader(const std::string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Could not open trace file '{}': {}"_format(path, strerror(errno))));
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		throw_with_trace(std::runtime_error("Could not stat trace file '{}': {}"_format(path, strerror(errno))));
+	}
+	size = st.st_size;
+
+	if (size < sizeof(TraceHeader))
+	{
+		close(fd);
+		throw_with_trace(std::runtime_error("The file '{}' is too small to be a trace"_format(path)));
+	}
+
+	void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		throw_with_trace(std::runtime_error("Could not map trace file '{}': {}"_format(path, strerror(errno))));
+	base = (const char *) p;
+
+	// The destructor does not run if the constructor throws, unmap here then
+	auto unmap = [this](const char *) { munmap((void *) base, size); base = nullptr; };
+	std::unique_ptr<const char, decltype(unmap)> mapping(base, unmap);
+
+	std::memcpy(&header, base, sizeof(header));
+	if (std::memcmp(header.magic, header_magic, sizeof(header.magic)) != 0)
+		throw_with_trace(std::runtime_error("The file '{}' is not a trace"_format(path)));
+	if (header.version != version)
+		throw_with_trace(std::runtime_error("Unsupported trace version {}"_format(header.version)));
+	if (header.header_size > size || sizeof(header) + header.names_len > header.header_size)
+		throw_with_trace(std::runtime_error("Corrupted trace header in '{}'"_format(path)));
+	if (header.record_size < sizeof(TraceRecord) + header.num_columns * sizeof(double))
+		throw_with_trace(std::runtime_error("Corrupted trace header in '{}': {} bytes per record for {} columns"_format(path, header.record_size, header.num_columns)));
+
+	// Column names
+	const char *names = base + sizeof(header);
+	std::string name;
+	for (size_t i = 0; i < header.names_len; i++)
+	{
+		if (names[i] == '\n')
+		{
+			columns.push_back(name);
+			name.clear();
+		}
+		else
+			name += names[i];
+	}
+	if (header.num_columns)
+		columns.push_back(name);
+	if (columns.size() != header.num_columns)
+		throw_with_trace(std::runtime_error("Corrupted trace header in '{}': {} column names for {} columns"_format(path, columns.size(), header.num_columns)));
+
+	// Task table
+	const char *t = names + header.names_len;
+	for (size_t i = 0; i < header.num_tasks; i++)
+	{
+		uint32_t id, len;
+		if (t + 2 * sizeof(uint32_t) > base + header.header_size)
+			throw_with_trace(std::runtime_error("Corrupted trace task table in '{}'"_format(path)));
+		std::memcpy(&id, t, sizeof(id));
+		std::memcpy(&len, t + sizeof(id), sizeof(len));
+		t += 2 * sizeof(uint32_t);
+		if (t + len > base + header.header_size)
+			throw_with_trace(std::runtime_error("Corrupted trace task table in '{}'"_format(path)));
+		tasks.push_back(std::make_pair(id, std::string(t, len)));
+		t += len;
+	}
+
+	// Footer and index, if the trace was closed properly
+	if (size >= header.header_size + sizeof(TraceFooter))
+	{
+		const TraceFooter *f = (const TraceFooter *) (base + size - sizeof(TraceFooter));
+		if (std::memcmp(f->magic, footer_magic, sizeof(f->magic)) == 0)
+		{
+			// The index has to fill the space between the records and the footer
+			const uint64_t entry_size = index_entry_size();
+			if (f->index_offset < header.header_size || f->index_offset > size - sizeof(TraceFooter) ||
+					f->num_blocks != (size - sizeof(TraceFooter) - f->index_offset) / entry_size ||
+					f->index_offset + f->num_blocks * entry_size + sizeof(TraceFooter) != size ||
+					f->num_records > (f->index_offset - header.header_size) / header.record_size)
+				throw_with_trace(std::runtime_error("Corrupted trace index in '{}'"_format(path)));
+			footer = f;
+			indexed = true;
+			num_records = f->num_records;
+		}
+	}
+	if (!indexed)
+		num_records = (size - header.header_size) / header.record_size;
+
+	mapping.release();
+}
+
+
+size_t Reader::index_entry_size() const
+{
+	return sizeof(TraceBlock) + header.bitmap_words * sizeof(uint64_t);
+}
+
+
+Reader::~Reader()
+{
+	if (base)
+		munmap((void *) base, size);
+}
+
+
+std::string Reader::task_name(uint32_t id) const
+{
+	auto it = std::find_if(tasks.begin(), tasks.end(), [id](const auto &t) { return t.first == id; });
+	if (it == tasks.end())
+		throw_with_trace(std::runtime_error("Task {} not found in the trace"_format(id)));
+	return it->second;
+}
+
+
+const TraceRecord& Reader::record(uint64_t i) const
+{
+	assert(i < num_records);
+	return *(const TraceRecord *) (base + header.header_size + i * header.record_size);
+}
+
+
+const double* Reader::values(uint64_t i) const
+{
+	return (const double *) (&record(i) + 1);
+}
+
+
+std::vector<std::pair<uint64_t, uint64_t>> Reader::find(uint32_t first_interval, uint32_t last_interval, int64_t task_id) const
+{
+	auto result = std::vector<std::pair<uint64_t, uint64_t>>();
+
+	if (!indexed)
+	{
+		result.push_back(std::make_pair(0, num_records));
+		return result;
+	}
+
+	const size_t entry_size = index_entry_size();
+	const char *entry = base + footer->index_offset;
+	for (uint64_t b = 0; b < footer->num_blocks; b++, entry += entry_size)
+	{
+		const TraceBlock *block = (const TraceBlock *) entry;
+		const uint64_t *bitmap = (const uint64_t *) (block + 1);
+
+		if (block->last_interval < first_interval || block->first_interval > last_interval)
+			continue;
+		if (task_id >= 0 && ((uint64_t) task_id / 64 >= header.bitmap_words ||
+				!(bitmap[task_id / 64] & ((uint64_t) 1 << (task_id % 64)))))
+			continue;
+
+		if (block->offset < header.header_size)
+			throw_with_trace(std::runtime_error("Corrupted trace index: block {} starts before the records"_format(b)));
+		uint64_t first = (block->offset - header.header_size) / header.record_size;
+		uint64_t last = first + block->num_records;
+		if (last > num_records)
+			throw_with_trace(std::runtime_error("Corrupted trace index: block {} ends after the records"_format(b)));
+
+		// Merge contiguous blocks
+		if (!result.empty() && result.back().second == first)
+			result.back().second = last;
+		else
+			result.push_back(std::make_pair(first, last));
+	}
+	return result;
+}
+
+} // namespace trace
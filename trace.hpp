@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Binary trace with the per-interval stats of the tasks (the same data as --output).
+// All the integers and doubles are stored little-endian, and every part of the file
+// is 8-byte aligned, so the records can be mapped directly as an array of structs.
+//
+//   Header      TraceHeader, column names separated by '\n', task table
+//               (u32 id, u32 name length, name) and padding up to 'header_size'
+//   Records     'record_size' bytes each: TraceRecord followed by one f64 per column
+//   Index       One TraceBlock per 'block_records' records, each one followed by
+//               'bitmap_words' u64 with a bit set for every task id in the block
+//   Footer      TraceFooter
+//
+// If the writer does not finish (i.e. the manager dies) there is no index nor footer,
+// but the complete records can still be read: (file size - header_size) / record_size.
+namespace trace
+{
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The trace format is little-endian");
+
+const char header_magic[8] = {'M', 'N', 'G', 'T', 'R', 'A', 'C', 'E'};
+const char footer_magic[8] = {'M', 'N', 'G', 'T', 'R', 'I', 'D', 'X'};
+const uint32_t version = 1;
+
+struct TraceHeader
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t header_size;   // Offset of the first record
+	uint32_t record_size;   // Bytes per record, including the columns
+	uint32_t num_columns;
+	uint32_t num_tasks;
+	uint32_t block_records; // Records per index block
+	uint32_t names_len;     // Bytes of the column names
+	uint32_t bitmap_words;  // u64 words of the task bitmap of each index block
+};
+static_assert(sizeof(TraceHeader) == 40, "Unexpected padding in TraceHeader");
+
+struct TraceRecord
+{
+	uint32_t interval;
+	uint32_t task_id;
+	int32_t  cpu;
+	uint32_t reserved;
+	double   compl_;        // Fraction of the instruction limit completed, NaN without limit
+	// double values[num_columns] follow
+};
+static_assert(sizeof(TraceRecord) == 24, "Unexpected padding in TraceRecord");
+
+struct TraceBlock
+{
+	uint64_t offset;        // Offset of the first record of the block
+	uint32_t num_records;
+	uint32_t first_interval;
+	uint32_t last_interval;
+	uint32_t reserved;
+	// uint64_t task_bitmap[bitmap_words] follow
+};
+static_assert(sizeof(TraceBlock) == 24, "Unexpected padding in TraceBlock");
+
+struct TraceFooter
+{
+	uint64_t index_offset;
+	uint64_t num_blocks;
+	uint64_t num_records;
+	char     magic[8];
+};
+static_assert(sizeof(TraceFooter) == 32, "Unexpected padding in TraceFooter");
+
+
+class Writer
+{
+	std::ofstream out;
+	std::vector<char> filebuf;
+
+	uint32_t num_columns;
+	uint32_t block_records;
+	uint32_t bitmap_words;
+	uint32_t record_size;
+
+	uint64_t offset = 0;      // Bytes written
+	uint64_t num_records = 0;
+
+	// Index of the finished blocks and state of the current one
+	std::vector<char> index;
+	uint64_t num_blocks = 0;
+	TraceBlock block;
+	std::vector<uint64_t> bitmap;
+
+	std::vector<double> record; // Reused buffer for a full record
+
+	bool closed = false;
+
+	void write(const void *data, size_t size);
+	void close_block();
+
+	public:
+
+	// 'columns' are the names of the values of each record and 'tasks' (id, name) the task table
+	Writer(const std::string &path, const std::vector<std::string> &columns,
+			const std::vector<std::pair<uint32_t, std::string>> &tasks, uint32_t _block_records = 4096);
+	~Writer();
+
+	Writer(const Writer &) = delete;
+	Writer& operator=(const Writer &) = delete;
+
+	void write_record(uint32_t interval, uint32_t task_id, int32_t cpu, double compl_, const std::vector<double> &values);
+
+	// Write the index and the footer
+	void close();
+};
+
+
+class Reader
+{
+	const char *base = nullptr;
+	size_t size = 0;
+
+	TraceHeader header;
+	std::vector<std::string> columns;
+	std::vector<std::pair<uint32_t, std::string>> tasks;
+
+	uint64_t num_records = 0;
+	bool indexed = false;
+	const TraceFooter *footer = nullptr;
+
+	size_t index_entry_size() const;
+
+	public:
+
+	Reader(const std::string &path);
+	~Reader();
+
+	Reader(const Reader &) = delete;
+	Reader& operator=(const Reader &) = delete;
+
+	const TraceHeader& get_header() const { return header; }
+	const std::vector<std::string>& get_columns() const { return columns; }
+	const std::vector<std::pair<uint32_t, std::string>>& get_tasks() const { return tasks; }
+	std::string task_name(uint32_t id) const;
+
+	uint64_t get_num_records() const { return num_records; }
+	bool is_indexed() const { return indexed; }
+
+	const TraceRecord& record(uint64_t i) const;
+	const double* values(uint64_t i) const;
+
+	// Ranges [first, last) of records that may contain the interval range and the task.
+	// Uses the index if available, else returns the whole trace.
+	std::vector<std::pair<uint64_t, uint64_t>> find(uint32_t first_interval, uint32_t last_interval, int64_t task_id = -1) const;
+};
+
+} // namespace trace
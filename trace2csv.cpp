@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <iostream>
+#include <limits>
+
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+
+#include "throw-with-trace.hpp"
+#include "trace.hpp"
+
+
+namespace po = boost::program_options;
+
+using std::string;
+using fmt::literals::operator""_format;
+
+
+// Same format as the interval output of the manager
+static
+void print_record(const trace::Reader &reader, uint64_t i, const std::vector<bool> &is_hex, FILE *out)
+{
+	const auto &r = reader.record(i);
+	const double *values = reader.values(i);
+
+	// Doubles are printed as an ostream with the default precision would do
+	fmt::print(out, "{},{:02}_{},{},{:g}", r.interval, r.task_id, reader.task_name(r.task_id), r.cpu, r.compl_);
+	for (size_t c = 0; c < is_hex.size(); c++)
+	{
+		if (is_hex[c])
+			fmt::print(out, ",0x{:02x}", (int) values[c]);
+		else
+			fmt::print(out, ",{:g}", values[c]);
+	}
+	fmt::print(out, "\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+	po::options_description desc("Convert a binary trace to the CSV format of the interval output.\nAllowed options");
+	desc.add_options()
+		("help,h", "print usage message")
+		("input,i", po::value<string>()->required(), "pathname of the trace")
+		("output,o", po::value<string>()->default_value(""), "pathname for the CSV, stdout by default")
+		("first", po::value<uint32_t>()->default_value(0), "first interval to convert")
+		("last", po::value<uint32_t>()->default_value(std::numeric_limits<uint32_t>::max()), "last interval to convert")
+		("task", po::value<int64_t>()->default_value(-1), "id of the only task to convert")
+		;
+
+	po::positional_options_description pos;
+	pos.add("input", 1);
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+		if (vm.count("help"))
+		{
+			std::cout << desc << std::endl;
+			return EXIT_SUCCESS;
+		}
+		po::notify(vm);
+	}
+	catch (const std::exception &e)
+	{
+		std::cerr << e.what() << std::endl << desc << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		const trace::Reader reader(vm["input"].as<string>());
+		const uint32_t first = vm["first"].as<uint32_t>();
+		const uint32_t last = vm["last"].as<uint32_t>();
+		const int64_t task = vm["task"].as<int64_t>();
+
+		if (!reader.is_indexed())
+			std::cerr << "Warning: the trace has no index, it may be incomplete" << std::endl;
+
+		FILE *out = stdout;
+		const string out_path = vm["output"].as<string>();
+		if (out_path != "")
+		{
+			out = fopen(out_path.c_str(), "w");
+			if (!out)
+				throw_with_trace(std::runtime_error("Could not open '{}'"_format(out_path)));
+		}
+
+		const auto &columns = reader.get_columns();
+		auto is_hex = std::vector<bool>();
+		fmt::print(out, "interval,app,CPU,compl");
+		for (const auto &c : columns)
+		{
+			fmt::print(out, ",{}", c);
+			is_hex.push_back(c == "clos_mask");
+		}
+		fmt::print(out, "\n");
+
+		for (const auto &range : reader.find(first, last, task))
+		{
+			for (uint64_t i = range.first; i < range.second; i++)
+			{
+				const auto &r = reader.record(i);
+				if (r.interval < first || r.interval > last)
+					continue;
+				if (task >= 0 && r.task_id != task)
+					continue;
+				print_record(reader, i, is_hex, out);
+			}
+		}
+
+		if (out != stdout)
+			fclose(out);
+	}
+	catch (const std::exception &e)
+	{
+		const auto st = boost::get_error_info<traced>(e);
+		std::cerr << e.what() << std::endl;
+		if (st)
+			std::cerr << *st << std::endl;
+		return EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+
+// Fixed capacity ring buffer with the last values of a metric. When a value
+// enters or leaves the window the mean and the variance are updated
+// incrementally, and the minimum and maximum are kept in monotonic queues, so
+// none of them needs a pass over the values. Element 0 is the newest value.
+class Window
+{
+	// Monotonic queue of (sequence number, value), in a ring with the capacity of the window
+	template <typename Compare>
+	class Extreme
+	{
+		std::vector<std::pair<uint64_t, double>> q;
+		size_t first = 0;
+		size_t n = 0;
+
+		const std::pair<uint64_t, double>& back() const { return q[(first + n - 1) % q.size()]; }
+
+		public:
+
+		Extreme(size_t capacity) : q(capacity) {}
+
+		void push(uint64_t seq, double value)
+		{
+			// Values that can no longer be the extreme
+			while (n > 0 && !Compare()(back().second, value))
+				n--;
+			assert(n < q.size());
+			q[(first + n) % q.size()] = std::make_pair(seq, value);
+			n++;
+		}
+
+		// Drop the values older than 'seq'
+		void expire(uint64_t seq)
+		{
+			while (n > 0 && q[first].first < seq)
+			{
+				first = (first + 1) % q.size();
+				n--;
+			}
+		}
+
+		double get() const { return n ? q[first].second : NAN; }
+		void clear() { first = n = 0; }
+	};
+
+	std::vector<double> buffer;
+	uint64_t seq = 0;   // Values pushed since the last clear, the newest is at (seq - 1) % capacity
+	size_t count = 0;   // Values in the window
+	double avg = 0;     // Mean of the values in the window
+	double m2 = 0;      // Sum of squared differences to the mean
+	Extreme<std::greater<double>> max_q;
+	Extreme<std::less<double>> min_q;
+
+	// Recompute mean and m2 from the values, so rounding errors do not build up
+	void resync()
+	{
+		avg = 0;
+		for (size_t i = 0; i < count; i++)
+			avg += buffer[i];
+		avg /= count;
+		m2 = 0;
+		for (size_t i = 0; i < count; i++)
+			m2 += (buffer[i] - avg) * (buffer[i] - avg);
+	}
+
+	public:
+
+	Window(size_t capacity) : buffer(capacity), max_q(capacity), min_q(capacity)
+	{
+		assert(capacity > 0);
+	}
+
+	void push(double value)
+	{
+		const size_t pos = seq % buffer.size();
+		if (count < buffer.size())
+		{
+			// Welford
+			count++;
+			double delta = value - avg;
+			avg += delta / count;
+			m2 += delta * (value - avg);
+		}
+		else
+		{
+			// Replace the oldest value, the number of values does not change
+			double old = buffer[pos];
+			double old_avg = avg;
+			avg += (value - old) / count;
+			m2 += (value - old) * (value - avg + old - old_avg);
+			m2 = std::max(m2, 0.0);
+		}
+		buffer[pos] = value;
+		seq++;
+
+		max_q.expire(seq - count);
+		min_q.expire(seq - count);
+		max_q.push(seq - 1, value);
+		min_q.push(seq - 1, value);
+
+		if (count == buffer.size() && seq % (buffer.size() * 16) == 0)
+			resync();
+	}
+
+	void clear()
+	{
+		seq = count = 0;
+		avg = m2 = 0;
+		max_q.clear();
+		min_q.clear();
+	}
+
+	// Change the capacity keeping the newest values that fit
+	void set_capacity(size_t capacity)
+	{
+		assert(capacity > 0);
+		if (capacity == buffer.size())
+			return;
+
+		auto values = std::vector<double>();
+		for (size_t i = std::min(count, capacity); i > 0; i--)
+			values.push_back((*this)[i - 1]);
+
+		*this = Window(capacity);
+		for (const auto &v : values)
+			push(v);
+	}
+
+	// Element 0 is the newest value
+	double operator[](size_t i) const
+	{
+		assert(i < count);
+		return buffer[(seq - 1 - i) % buffer.size()];
+	}
+
+	size_t size()     const { return count; }
+	size_t capacity() const { return buffer.size(); }
+	bool   empty()    const { return count == 0; }
+	bool   full()     const { return count == buffer.size(); }
+
+	double last()     const { return count ? (*this)[0] : NAN; }
+	double mean()     const { return count ? avg : NAN; }
+	double sum()      const { return avg * count; }
+	double variance() const { return count ? m2 / count : NAN; }
+	double stddev()   const { return std::sqrt(variance()); }
+	double min()      const { return min_q.get(); }
+	double max()      const { return max_q.get(); }
+};